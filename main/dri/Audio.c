@@ -1,56 +1,148 @@
 #include "Audio.h"
-#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
 #include "utils.h"
+#include "trace.h"
 
-#define AUDIO_SDA_PIN GPIO_NUM_9
-#define AUDIO_BUSY_PIN GPIO_NUM_7
+static const char *TAG = "audio";
 
-#define AUDIO_SDA_H gpio_set_level(AUDIO_SDA_PIN, 1)
-#define AUDIO_SDA_L gpio_set_level(AUDIO_SDA_PIN, 0)
+// 音频任务
+#define AUDIO_TASK_NAME       "audio_task"
+#define AUDIO_TASK_STACK_SIZE 2048
+#define AUDIO_TASK_PRIORITY   4
 
-#define AUDIO_READ_BUSY gpio_get_level(AUDIO_BUSY_PIN)
+// 待播放队列长度
+#define AUDIO_QUEUE_LEN 4
+
+// 发完一帧后芯片拉起 BUSY 需要的时间
+#define AUDIO_BUSY_SETTLE_MS 4
+// 等待上一段语音播完的最长时间，超时后直接发送（新命令会打断旧语音）
+#define AUDIO_BUSY_TIMEOUT_MS 1000
+#define AUDIO_BUSY_POLL_MS    10
+
+static const audio_backend_t *audio_backend = NULL;
+static TaskHandle_t audio_task_handle        = NULL;
+
+// 环形队列：入队/出队都是 O(1)，用自旋锁保护，ISR 以外的任何任务都可以调用 Audio_Play
+static uint8_t audio_queue[AUDIO_QUEUE_LEN];
+static uint8_t audio_queue_head  = 0; // 下一个出队位置
+static uint8_t audio_queue_count = 0;
+static portMUX_TYPE audio_lock   = portMUX_INITIALIZER_UNLOCKED;
+
+static audio_stats_t audio_stats = {0};
+
+static void audio_task(void *arg);
+
+size_t Audio_BuildFrame(uint8_t data, audio_pulse_t *pulses)
+{
+    size_t n = 0;
+    // 先拉高2ms
+    pulses[n++] = (audio_pulse_t){1, 2000};
+    // 拉低10ms
+    pulses[n++] = (audio_pulse_t){0, 10000};
+    // 低位在前：1 = 高600us + 低200us，0 = 高200us + 低600us
+    for (int i = 0; i < 8; i++) {
+        if (data & 0x01) {
+            pulses[n++] = (audio_pulse_t){1, 600};
+            pulses[n++] = (audio_pulse_t){0, 200};
+        } else {
+            pulses[n++] = (audio_pulse_t){1, 200};
+            pulses[n++] = (audio_pulse_t){0, 600};
+        }
+        data >>= 1;
+    }
+    // 拉高2ms
+    pulses[n++] = (audio_pulse_t){1, 2000};
+    return n;
+}
 
 void Audio_Init(void)
 {
-    gpio_config_t io_conf = {};
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = (1ULL << AUDIO_SDA_PIN);
-    gpio_config(&io_conf);
-
-    io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_INPUT;
-    io_conf.pin_bit_mask = (1ULL << AUDIO_BUSY_PIN);
-    gpio_config(&io_conf);
+#if CONFIG_IDF_TARGET_LINUX
+    audio_backend = &audio_backend_sim;
+#else
+    audio_backend = &audio_backend_rmt;
+#endif
+    audio_backend->init();
+
+    xTaskCreate(audio_task, AUDIO_TASK_NAME, AUDIO_TASK_STACK_SIZE, NULL, AUDIO_TASK_PRIORITY, &audio_task_handle);
 }
 
 void Audio_Play(uint8_t data)
 {
-    /// 先拉高2ms
-    AUDIO_SDA_H;
-    DelayMs(2);
-    // 拉低10ms
-    AUDIO_SDA_L;
-    DelayMs(10);
-    for (int i = 0; i < 8; i++)
-    {
-        if (data & 0x01)
-        {
-            AUDIO_SDA_H;
-            DelayUs(600);
-            AUDIO_SDA_L;
-            DelayUs(200);
+    uint8_t queued = 1;
+
+    TRACE(TRACE_AUDIO_PLAY, data);
+    taskENTER_CRITICAL(&audio_lock);
+    uint8_t tail = (audio_queue_head + audio_queue_count) % AUDIO_QUEUE_LEN;
+    if (audio_queue_count > 0 && audio_queue[(tail + AUDIO_QUEUE_LEN - 1) % AUDIO_QUEUE_LEN] == data) {
+        // 与队尾相同的提示音（例如连续按键音）合并为一次
+        audio_stats.coalesced++;
+        queued = 0;
+    } else {
+        if (audio_queue_count == AUDIO_QUEUE_LEN) {
+            // 队列满：丢弃最旧的提示音，保证最新的反馈能播出
+            audio_queue_head = (audio_queue_head + 1) % AUDIO_QUEUE_LEN;
+            audio_queue_count--;
+            audio_stats.dropped++;
+            tail = (audio_queue_head + audio_queue_count) % AUDIO_QUEUE_LEN;
         }
-        else
-        {
-            AUDIO_SDA_H;
-            DelayUs(200);
-            AUDIO_SDA_L;
-            DelayUs(600);
+        audio_queue[tail] = data;
+        audio_queue_count++;
+    }
+    taskEXIT_CRITICAL(&audio_lock);
+
+    if (queued && audio_task_handle) {
+        xTaskNotifyGive(audio_task_handle);
+    }
+}
+
+void Audio_GetStats(audio_stats_t *stats)
+{
+    taskENTER_CRITICAL(&audio_lock);
+    *stats = audio_stats;
+    taskEXIT_CRITICAL(&audio_lock);
+}
+
+// 取出下一条提示音，队列为空返回 0
+static uint8_t Audio_Dequeue(uint8_t *data)
+{
+    uint8_t ok = 0;
+    taskENTER_CRITICAL(&audio_lock);
+    if (audio_queue_count > 0) {
+        *data            = audio_queue[audio_queue_head];
+        audio_queue_head = (audio_queue_head + 1) % AUDIO_QUEUE_LEN;
+        audio_queue_count--;
+        ok = 1;
+    }
+    taskEXIT_CRITICAL(&audio_lock);
+    return ok;
+}
+
+static void audio_task(void *arg)
+{
+    audio_pulse_t frame[AUDIO_FRAME_PULSES];
+    uint8_t data = 0;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (Audio_Dequeue(&data)) {
+            // 等待上一段语音播完，期间新到的请求在队列里合并
+            for (int waited = 0; audio_backend->busy() && waited < AUDIO_BUSY_TIMEOUT_MS; waited += AUDIO_BUSY_POLL_MS) {
+                DelayMs(AUDIO_BUSY_POLL_MS);
+            }
+
+            size_t count = Audio_BuildFrame(data, frame);
+            audio_backend->send(frame, count);
+
+            taskENTER_CRITICAL(&audio_lock);
+            audio_stats.played++;
+            taskEXIT_CRITICAL(&audio_lock);
+            ESP_LOGD(TAG, "prompt %d sent", data);
+
+            DelayMs(AUDIO_BUSY_SETTLE_MS);
         }
-        data >>= 1;
     }
-    // 拉高2ms
-    AUDIO_SDA_H;
-    DelayMs(2);
-}
\ No newline at end of file
+}
@@ -1,5 +1,50 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
+
+// WTN6170 一线协议的一帧：同步高2ms + 同步低10ms + 8个数据位(每位两段) + 结束高2ms
+#define AUDIO_FRAME_PULSES (2 + 8 * 2 + 1)
+
+// 一线协议中的一段电平：level 持续 duration_us 微秒
+typedef struct {
+    uint8_t level;
+    uint16_t duration_us;
+} audio_pulse_t;
+
+/**
+ * @brief 音频后端：负责把一帧电平序列送到 WTN6170 的 SDA 引脚
+ *
+ * init  初始化 SDA / BUSY 引脚
+ * send  发送一帧，阻塞到帧发送完成（只在音频任务中调用）
+ * busy  芯片是否正在播放（BUSY 引脚有效）
+ */
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void (*send)(const audio_pulse_t *pulses, size_t count);
+    uint8_t (*busy)(void);
+} audio_backend_t;
+
+// RMT 外设硬件定时
+extern const audio_backend_t audio_backend_rmt;
+
+#if CONFIG_IDF_TARGET_LINUX
+// 主机仿真：记录生成的波形时序
+extern const audio_backend_t audio_backend_sim;
+// 打印记录下来的波形，并把每一帧还原为语音编号
+void Audio_SimDump(void);
+#endif
+
+// 播放统计
+typedef struct {
+    uint32_t played;    // 已发送的帧数
+    uint32_t coalesced; // 与队尾相同而被合并的请求数
+    uint32_t dropped;   // 队列满时被丢弃的最旧请求数
+} audio_stats_t;
 
 void Audio_Init(void);
+// 非阻塞：把语音编号放入队列后立即返回，由音频任务负责发送
 void Audio_Play(uint8_t data);
+// 生成 data 对应的一帧电平序列，返回段数
+size_t Audio_BuildFrame(uint8_t data, audio_pulse_t *pulses);
+void Audio_GetStats(audio_stats_t *stats);
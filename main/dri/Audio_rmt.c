@@ -0,0 +1,90 @@
+#include "Audio.h"
+#include "driver/gpio.h"
+#include "driver/rmt_tx.h"
+#include "driver/rmt_encoder.h"
+#include "esp_log.h"
+#include "utils.h"
+
+#define AUDIO_SDA_PIN  GPIO_NUM_9
+#define AUDIO_BUSY_PIN GPIO_NUM_7
+
+// 芯片播放时 BUSY 输出低电平
+#define AUDIO_BUSY_LEVEL 0
+
+#define AUDIO_READ_BUSY gpio_get_level(AUDIO_BUSY_PIN)
+
+// 1MHz 分辨率，1 tick = 1us，最长一段 10ms = 10000 tick，在 15 位计数范围内
+#define AUDIO_RMT_RESOLUTION_HZ 1000000
+// 一帧 19 段电平，每个 RMT 符号装两段
+#define AUDIO_RMT_SYMBOLS ((AUDIO_FRAME_PULSES + 1) / 2)
+// 单帧约 20ms，留足余量
+#define AUDIO_RMT_TIMEOUT_MS 50
+
+static const char *TAG = "audio rmt";
+
+static rmt_channel_handle_t audio_chan    = NULL;
+static rmt_encoder_handle_t audio_encoder = NULL;
+static rmt_symbol_word_t audio_symbols[AUDIO_RMT_SYMBOLS];
+
+// 发送结束后保持高电平，与原来的空闲电平一致
+static const rmt_transmit_config_t audio_tx_config = {
+    .loop_count      = 0,
+    .flags.eot_level = 1,
+};
+
+static void Audio_RmtInit(void)
+{
+    rmt_tx_channel_config_t tx_chan_config = {
+        .clk_src           = RMT_CLK_SRC_DEFAULT,
+        .gpio_num          = AUDIO_SDA_PIN,
+        .mem_block_symbols = 48, // 一帧只有 10 个符号，一块内存就够
+        .resolution_hz     = AUDIO_RMT_RESOLUTION_HZ,
+        .trans_queue_depth = 1,
+    };
+    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &audio_chan));
+
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_ERROR_CHECK(rmt_new_copy_encoder(&copy_encoder_config, &audio_encoder));
+    ESP_ERROR_CHECK(rmt_enable(audio_chan));
+
+    gpio_config_t io_conf = {};
+    io_conf.intr_type     = GPIO_INTR_DISABLE;
+    io_conf.mode          = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask  = (1ULL << AUDIO_BUSY_PIN);
+    gpio_config(&io_conf);
+}
+
+static void Audio_RmtSend(const audio_pulse_t *pulses, size_t count)
+{
+    // 相邻两段电平合成一个 RMT 符号，奇数段时最后一个符号的第二段时长为 0（结束标记）
+    size_t n = 0;
+    for (size_t i = 0; i < count; i += 2) {
+        audio_symbols[n].level0    = pulses[i].level;
+        audio_symbols[n].duration0 = pulses[i].duration_us;
+        if (i + 1 < count) {
+            audio_symbols[n].level1    = pulses[i + 1].level;
+            audio_symbols[n].duration1 = pulses[i + 1].duration_us;
+        } else {
+            audio_symbols[n].level1    = pulses[i].level;
+            audio_symbols[n].duration1 = 0;
+        }
+        n++;
+    }
+
+    ESP_ERROR_CHECK(rmt_transmit(audio_chan, audio_encoder, audio_symbols, n * sizeof(rmt_symbol_word_t), &audio_tx_config));
+    if (rmt_tx_wait_all_done(audio_chan, AUDIO_RMT_TIMEOUT_MS) != ESP_OK) {
+        ESP_LOGW(TAG, "frame transmit timeout");
+    }
+}
+
+static uint8_t Audio_RmtBusy(void)
+{
+    return AUDIO_READ_BUSY == AUDIO_BUSY_LEVEL;
+}
+
+const audio_backend_t audio_backend_rmt = {
+    .name = "rmt",
+    .init = Audio_RmtInit,
+    .send = Audio_RmtSend,
+    .busy = Audio_RmtBusy,
+};
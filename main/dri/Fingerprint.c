@@ -1,45 +1,173 @@
-#include "fingerprint.h"
-#include "driver/uart.h"
+#include "Fingerprint.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include "trace.h"
+#include "timer_service.h"
 
-#define FINGER_UART_TX_PIN GPIO_NUM_21
-#define FINGER_UART_RX_PIN GPIO_NUM_20
+static const char *TAG = "fingerprint";
 
-#define RX_BUF_SIZE        2048
+// 应答包的包标识
+#define FINGER_PID_REPLY 0x07
 
 // 有效指纹数量
 static uint8_t finger_num = 0;
 
+static const finger_port_t *finger_port = NULL;
+
+/**
+ * @brief 增量解析器：按包头和长度字段逐字节组包
+ *
+ * 不依赖读超时来判断包结束：收到长度字段声明的全部字节后立即完成。
+ * 包头不对时逐字节重新同步，声明长度超过 FINGER_PACKET_MAX 的包直接丢弃。
+ */
+typedef struct {
+    uint8_t buf[FINGER_PACKET_MAX];
+    uint16_t len;  // 已收集的字节数
+    uint16_t need; // 整个包的长度（解析出长度字段之前为 FINGER_HEADER_LEN）
+} finger_parser_t;
+
+// 解析统计
+static uint32_t finger_checksum_errors = 0;
+static uint32_t finger_dropped_bytes   = 0;
+
+static void Finger_ParserReset(finger_parser_t *parser)
+{
+    parser->len  = 0;
+    parser->need = FINGER_HEADER_LEN;
+}
+
+// 喂一个字节，返回 1 表示收到一个完整且校验正确的包
+static uint8_t Finger_ParserFeed(finger_parser_t *parser, uint8_t byte)
+{
+    if ((parser->len == 0 && byte != 0xEF) || (parser->len == 1 && byte != 0x01)) {
+        finger_dropped_bytes += parser->len + 1;
+        Finger_ParserReset(parser);
+        if (byte == 0xEF) {
+            parser->buf[parser->len++] = byte;
+            finger_dropped_bytes--;
+        }
+        return 0;
+    }
+
+    parser->buf[parser->len++] = byte;
+    if (parser->len == FINGER_HEADER_LEN) {
+        uint16_t pkt_len = (parser->buf[7] << 8) | parser->buf[8];
+        // 内容至少包含确认码/指令码和两字节校验和
+        if (pkt_len < 3 || FINGER_HEADER_LEN + pkt_len > FINGER_PACKET_MAX) {
+            finger_dropped_bytes += parser->len;
+            Finger_ParserReset(parser);
+            return 0;
+        }
+        parser->need = FINGER_HEADER_LEN + pkt_len;
+    }
+    if (parser->len < parser->need) return 0;
+
+    // 校验和 = 包标识 + 包长度 + 包内容 各字节之和
+    uint16_t checksum = 0;
+    for (uint16_t i = 6; i < parser->len - 2; i++) {
+        checksum += parser->buf[i];
+    }
+    if (checksum != ((parser->buf[parser->len - 2] << 8) | parser->buf[parser->len - 1])) {
+        finger_checksum_errors++;
+        finger_dropped_bytes += parser->len;
+        Finger_ParserReset(parser);
+        return 0;
+    }
+    return 1;
+}
+
+// 丢弃残留数据后发送一个指令包
+static void Finger_Send(const uint8_t *cmd, size_t cmd_len)
+{
+    finger_port->flush();
+    TRACE(TRACE_FINGER_TX, cmd[9]);
+    finger_port->write(cmd, cmd_len);
+}
+
+/**
+ * @brief 等待一个应答包
+ *
+ * 收到完整、校验正确的应答包后立即返回，不会等满超时时间。
+ * 每次只读取当前包还缺的字节，所以连续到达的多个应答包可以逐个取出。
+ *
+ * @param reply      应答包缓冲，至少 FINGER_PACKET_MAX 字节
+ * @param timeout_ms 等待应答的最长时间
+ * @return int 应答包长度，超时返回 -1
+ */
+static int Finger_Receive(uint8_t *reply, uint32_t timeout_ms)
+{
+    finger_parser_t parser;
+    uint8_t chunk[16];
+
+    Finger_ParserReset(&parser);
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (1) {
+        int64_t remain_us = deadline - esp_timer_get_time();
+        if (remain_us <= 0) break;
+
+        // 只读取当前包还缺的字节，多余的数据留在驱动缓冲里
+        size_t want = parser.need - parser.len;
+        if (want > sizeof(chunk)) want = sizeof(chunk);
+        int n = finger_port->read(chunk, want, (remain_us + 999) / 1000);
+        if (n < 0) {
+            ESP_LOGW(TAG, "port read error");
+            Finger_ParserReset(&parser);
+            continue;
+        }
+        for (int i = 0; i < n; i++) {
+            if (Finger_ParserFeed(&parser, chunk[i])) {
+                if (parser.buf[6] == FINGER_PID_REPLY) {
+                    TRACE(TRACE_FINGER_RX, parser.buf[9]);
+                    memcpy(reply, parser.buf, parser.len);
+                    return parser.len;
+                }
+                // 不是应答包，继续等待
+                Finger_ParserReset(&parser);
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 发送一个指令包并等待应答包
+ *
+ * @param cmd        指令包
+ * @param cmd_len    指令包长度
+ * @param reply      应答包缓冲，至少 FINGER_PACKET_MAX 字节
+ * @param timeout_ms 等待应答的最长时间
+ * @return int 应答包长度，超时返回 -1
+ */
+static int Finger_Transact(const uint8_t *cmd, size_t cmd_len, uint8_t *reply, uint32_t timeout_ms)
+{
+    Finger_Send(cmd, cmd_len);
+    int length = Finger_Receive(reply, timeout_ms);
+    if (length < 0) {
+        ESP_LOGD(TAG, "cmd 0x%02x no reply, checksum errors %" PRIu32 ", dropped bytes %" PRIu32,
+                 cmd[9], finger_checksum_errors, finger_dropped_bytes);
+    }
+    return length;
+}
+
 static int8_t Finger_GetSN(void);
-static int8_t Finger_GetImage(void);
-static int8_t Finger_GenChar(uint8_t BufferID);
-static int8_t Finger_RegModel(void);
-static int8_t Finger_StoreChar(uint8_t PageID);
 static int8_t Finger_SetSecurityLevel(uint8_t security_level);
 static int8_t Finger_ValidTemplateNum(uint8_t *valid_template_num);
 
+// 初始化时等待模块进入休眠的最多次数，间隔 10ms，超过即认为没有接模块
+#define FINGER_INIT_SLEEP_RETRIES 50
+
 /// 初始化指纹模块
-void Fingerprint_Init(void)
+int8_t Fingerprint_Init(void)
 {
-    // UART 配置
-    // 定义一个UART配置结构体变量uart_config，用于设置UART的通信参数
-    uart_config_t uart_config = {
-        // 设置波特率为57600，这是UART通信的数据传输速率
-        .baud_rate = 57600,
-        // 设置数据位为8位，这是UART通信中数据帧的数据部分的位数
-        .data_bits = UART_DATA_8_BITS,
-        // 禁用奇偶校验，UART通信中不使用奇偶校验位来检测传输错误
-        .parity = UART_PARITY_DISABLE,
-        // 设置停止位为1位，这是UART通信中帧的结束信号
-        .stop_bits = UART_STOP_BITS_1,
-        // 禁用硬件流控，UART通信中不使用硬件握手信号来控制数据传输
-        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
-        // 设置UART的时钟源为默认值，这是UART通信中用于生成波特率的时钟源
-        .source_clk = UART_SCLK_DEFAULT,
-    };
-    uart_driver_install(UART_NUM_1, RX_BUF_SIZE, 0, 0, NULL, 0);
-    uart_param_config(UART_NUM_1, &uart_config);
-    // 为串口1分配tx和rx引脚
-    uart_set_pin(UART_NUM_1, FINGER_UART_TX_PIN, FINGER_UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+#if CONFIG_IDF_TARGET_LINUX
+    finger_port = &finger_port_sim;
+#else
+    finger_port = &finger_port_uart;
+#endif
+    finger_port->init();
+
     // 中断
     gpio_config_t io_conf = {0};
     io_conf.intr_type     = GPIO_INTR_POSEDGE;
@@ -54,452 +182,306 @@ void Fingerprint_Init(void)
     Finger_SetSecurityLevel(0);
     // 获取有效模板数量
     Finger_ValidTemplateNum(&finger_num);
-    while (Finger_Sleep()) {
+    for (int i = 0; Finger_Sleep() != 0; i++) {
+        if (i >= FINGER_INIT_SLEEP_RETRIES) {
+            printf("指纹模块无响应，跳过指纹功能。\r\n");
+            return -1;
+        }
         DelayMs(10);
     }
 
     printf("指纹模块初始化成功。\r\n");
+    return 0;
 }
 
-/// 获取指纹芯片的序列号
-static int8_t Finger_GetSN(void)
+// 指令码
+#define FINGER_CODE_GET_IMAGE     0x01 // PS_GetImage      录入图像
+#define FINGER_CODE_GEN_CHAR      0x02 // PS_GenChar       生成特征
+#define FINGER_CODE_SEARCH        0x04 // PS_Search        搜索指纹
+#define FINGER_CODE_REG_MODEL     0x05 // PS_RegModel      合并特征
+#define FINGER_CODE_STORE_CHAR    0x06 // PS_StoreChar     储存模板
+#define FINGER_CODE_WRITE_REG     0x0E // PS_WriteReg      写系统寄存器
+#define FINGER_CODE_VALID_TEMPLET 0x1D // PS_ValidTempleteNum 读有效模板个数
+#define FINGER_CODE_AUTO_IDENTIFY 0x32 // PS_AutoIdentify  自动验证（采图 + 生成特征 + 搜索）
+#define FINGER_CODE_SLEEP         0x33 // PS_Sleep         休眠
+#define FINGER_CODE_GET_CHIP_SN   0x34 // PS_GetChipSN     获取序列号
+
+// 系统寄存器：安全等级
+#define FINGER_REG_SECURITY_LEVEL 0x07
+
+// 确认码：传感器上无手指（采集图像时的正常情况）
+#define FINGER_CONFIRM_NO_FINGER 0x02
+
+/*
+ * 编译期生成固定指令包
+ * 包头 设备地址 包标识 包长度 指令码 参数... 校验和
+ * 校验和 = 包标识 + 包长度 + 指令码 + 参数 各字节之和
+ */
+#define FINGER_HI(x)      (((x) >> 8) & 0xFF)
+#define FINGER_LO(x)      ((x) & 0xFF)
+#define FINGER_FRAME_HEAD 0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01
+#define FINGER_SUM(len, sum) FINGER_HI(0x01 + (len) + (sum)), FINGER_LO(0x01 + (len) + (sum))
+
+// 无参数指令包
+#define FINGER_FRAME0(code) \
+    {FINGER_FRAME_HEAD, 0x00, 0x03, code, FINGER_SUM(0x03, code)}
+// 1 字节参数的指令包
+#define FINGER_FRAME1(code, p0) \
+    {FINGER_FRAME_HEAD, 0x00, 0x04, code, p0, FINGER_SUM(0x04, (code) + (p0))}
+// 5 字节参数的指令包
+#define FINGER_FRAME5(code, p0, p1, p2, p3, p4) \
+    {FINGER_FRAME_HEAD, 0x00, 0x08, code, p0, p1, p2, p3, p4, FINGER_SUM(0x08, (code) + (p0) + (p1) + (p2) + (p3) + (p4))}
+
+static const uint8_t finger_frame_get_image[]   = FINGER_FRAME0(FINGER_CODE_GET_IMAGE);
+static const uint8_t finger_frame_reg_model[]   = FINGER_FRAME0(FINGER_CODE_REG_MODEL);
+static const uint8_t finger_frame_valid_num[]   = FINGER_FRAME0(FINGER_CODE_VALID_TEMPLET);
+static const uint8_t finger_frame_sleep[]       = FINGER_FRAME0(FINGER_CODE_SLEEP);
+static const uint8_t finger_frame_get_chip_sn[] = FINGER_FRAME1(FINGER_CODE_GET_CHIP_SN, 0x00);
+// 在缓冲区1的特征中搜索整个指纹库：StartPage = 0，PageNum = 0xFFFF
+static const uint8_t finger_frame_search[] = FINGER_FRAME5(FINGER_CODE_SEARCH, 0x01, 0x00, 0x00, 0xFF, 0xFF);
+// 自动验证：安全等级 0，ID = 0xFFFF 搜索整个指纹库，参数 0x0000（点亮背光、返回每个阶段的应答）
+static const uint8_t finger_frame_auto_identify[] = FINGER_FRAME5(FINGER_CODE_AUTO_IDENTIFY, 0x00, 0xFF, 0xFF, 0x00, 0x00);
+
+/**
+ * @brief 指令描述符
+ *
+ * frame      固定指令包（编译期生成），带运行时参数的指令为 NULL，由 Finger_Encode() 组包
+ * param_len  参数字节数
+ * reply_len  成功时应答包中确认码之后的数据字节数
+ * timeout_ms 等待应答的最长时间
+ */
+typedef struct {
+    uint8_t code;
+    uint8_t param_len;
+    uint8_t reply_len;
+    uint16_t timeout_ms;
+    const char *name;
+    const uint8_t *frame;
+    uint8_t frame_len;
+} finger_cmd_desc_t;
+
+typedef enum {
+    FINGER_CMD_GET_IMAGE,
+    FINGER_CMD_GEN_CHAR,
+    FINGER_CMD_SEARCH,
+    FINGER_CMD_REG_MODEL,
+    FINGER_CMD_STORE_CHAR,
+    FINGER_CMD_WRITE_REG,
+    FINGER_CMD_VALID_TEMPLET,
+    FINGER_CMD_SLEEP,
+    FINGER_CMD_GET_CHIP_SN,
+} finger_cmd_t;
+
+#define FINGER_FIXED(frame) frame, sizeof(frame)
+
+static const finger_cmd_desc_t finger_cmds[] = {
+    // 生成特征、合并、储存、搜索需要的时间比较长
+    [FINGER_CMD_GET_IMAGE]     = {FINGER_CODE_GET_IMAGE, 0, 0, 100, "指纹获取", FINGER_FIXED(finger_frame_get_image)},
+    [FINGER_CMD_GEN_CHAR]      = {FINGER_CODE_GEN_CHAR, 1, 0, 500, "指纹特征生成", NULL, 0},
+    [FINGER_CMD_SEARCH]        = {FINGER_CODE_SEARCH, 5, 4, 500, "指纹检索", FINGER_FIXED(finger_frame_search)},
+    [FINGER_CMD_REG_MODEL]     = {FINGER_CODE_REG_MODEL, 0, 0, 500, "合并特征", FINGER_FIXED(finger_frame_reg_model)},
+    [FINGER_CMD_STORE_CHAR]    = {FINGER_CODE_STORE_CHAR, 3, 0, 500, "保存模板", NULL, 0},
+    [FINGER_CMD_WRITE_REG]     = {FINGER_CODE_WRITE_REG, 2, 0, 100, "写寄存器", NULL, 0},
+    [FINGER_CMD_VALID_TEMPLET] = {FINGER_CODE_VALID_TEMPLET, 0, 2, 100, "获取有效模板数量", FINGER_FIXED(finger_frame_valid_num)},
+    [FINGER_CMD_SLEEP]         = {FINGER_CODE_SLEEP, 0, 0, 100, "休眠", FINGER_FIXED(finger_frame_sleep)},
+    [FINGER_CMD_GET_CHIP_SN]   = {FINGER_CODE_GET_CHIP_SN, 1, 32, 100, "指纹模块序列号", FINGER_FIXED(finger_frame_get_chip_sn)},
+};
+
+// 确认码描述表，所有指令共用
+typedef struct {
+    uint8_t code;
+    const char *msg;
+} finger_error_t;
+
+static const finger_error_t finger_errors[] = {
+    {0x00, "成功"},
+    {0x01, "收包错误"},
+    {0x02, "传感器上无手指"},
+    {0x06, "指纹图像太乱而生不成特征"},
+    {0x07, "指纹图像正常,但特征点太少而生不成特征"},
+    {0x08, "当前指纹特征与之前特征之间无关联"},
+    {0x09, "未找到指纹"},
+    {0x0a, "合并失败"},
+    {0x0b, "PageID超出指纹库范围"},
+    {0x15, "图像缓冲区内没有有效原始图而生不成图像"},
+    {0x17, "残留指纹或两次采集之间手指没有移动过"},
+    {0x18, "读写FLASH错误"},
+    {0x1a, "寄存器序号错误"},
+    {0x1b, "寄存器设定内容错误"},
+    {0x28, "当前指纹特征与之前特征之间有关联"},
+    {0x31, "功能与加密等级不匹配"},
+};
+
+static const char *Finger_ErrorString(uint8_t code)
 {
-    uint8_t cmd[13] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x04,             // 包长度
-        0x34,                   // 指令码
-        0x00,                   // 参数
-        0x00, 0x39              // 校验和
-    };
-
-    uart_write_bytes(UART_NUM_1, cmd, 13);
-
-    uint8_t recv_data[64];
-    int length = uart_read_bytes(UART_NUM_1, recv_data, 1024, 100 / portTICK_PERIOD_MS);
-    if (length > 0) {
-        if (recv_data[9] == 0) {
-            printf("指纹模块序列号:%.32s\r\n", &recv_data[10]);
-        } else if (recv_data[9] == 0x01) {
-            printf("指纹模块序列号:收包错误\r\n");
-        }
-        return recv_data[9];
+    for (size_t i = 0; i < sizeof(finger_errors) / sizeof(finger_errors[0]); i++) {
+        if (finger_errors[i].code == code) return finger_errors[i].msg;
     }
-
-    printf("指纹模块序列号:无响应\r\n");
-    return -1;
+    return "未知错误";
 }
 
-// 3.3.1.19 休眠指令PS_Sleep
-// 包头 设备地址 包标识 包长度 指令码 校验和
-// 2 bytes 4bytes 1 byte 2bytes 1 byte 2bytes
-// 0xEF01 xxxx 01H 0003H 33H 0037H
-int8_t Finger_Sleep(void)
+// 带参数的指令在运行时组包，返回指令包长度
+static size_t Finger_Encode(const finger_cmd_desc_t *desc, const uint8_t *params, uint8_t *cmd)
 {
-    uint8_t cmd[12] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x03,             // 包长度
-        0x33,                   // 指令码
-        0x00, 0x37              // 校验和
-    };
-
-    uart_write_bytes(UART_NUM_1, cmd, 12);
-
-    uint8_t recv_data[64];
-    int length = uart_read_bytes(UART_NUM_1, recv_data, 1024, 100 / portTICK_PERIOD_MS);
-    if (length > 0) {
-        if (recv_data[9] == 0) {
-            printf("休眠成功\r\n");
-        } else if (recv_data[9] == 0x01) {
-            printf("休眠失败:收包错误\r\n");
-        }
-        return recv_data[9];
-    }
+    static const uint8_t head[] = {FINGER_FRAME_HEAD};
+    uint16_t pkt_len            = 1 + desc->param_len + 2;
+    size_t n                    = sizeof(head);
 
-    printf("休眠失败:无响应\r\n");
-    return -1;
+    memcpy(cmd, head, sizeof(head));
+    cmd[n++] = pkt_len >> 8;
+    cmd[n++] = pkt_len & 0xFF;
+    cmd[n++] = desc->code;
+    memcpy(&cmd[n], params, desc->param_len);
+    n += desc->param_len;
+
+    uint16_t checksum = 0;
+    for (size_t i = 6; i < n; i++) {
+        checksum += cmd[i];
+    }
+    cmd[n++] = checksum >> 8;
+    cmd[n++] = checksum & 0xFF;
+    return n;
 }
 
 /**
- * @brief 获取指纹图像
+ * @brief 执行一条指令：组包（或使用固定指令包）、收应答、解码确认码
  *
- * 本函数通过UART向指纹模块发送命令以获取指纹图像，并根据返回数据判断操作结果。
- *
- * @return static int8_t 返回结果代码：
- *         - 0x00: 指纹获取成功
- *         - 0x01: 收包错误
- *         - 0x02: 传感器上无手指
- *         - -1: 无响应
+ * @param cmd_id 指令
+ * @param params 参数，固定指令包传 NULL
+ * @param data   成功时拷贝应答中确认码之后的 reply_len 字节，可以为 NULL
+ * @return int8_t 确认码，无响应返回 -1
  */
-static int8_t Finger_GetImage(void)
+static int8_t Finger_Exec(finger_cmd_t cmd_id, const uint8_t *params, uint8_t *data)
 {
+    const finger_cmd_desc_t *desc = &finger_cmds[cmd_id];
+    uint8_t cmd[FINGER_PACKET_MAX];
+    const uint8_t *frame = desc->frame;
+    size_t frame_len     = desc->frame_len;
+
+    if (frame == NULL) {
+        frame_len = Finger_Encode(desc, params, cmd);
+        frame     = cmd;
+    }
+
+    uint8_t recv_data[FINGER_PACKET_MAX];
+    int length = Finger_Transact(frame, frame_len, recv_data, desc->timeout_ms);
+    if (length < 0) {
+        printf("%s:无响应\r\n", desc->name);
+        return -1;
+    }
 
-    // 表 3-5 录入图像指令包格式
-    //  包头    设备地址   包标识     包长度       指令码     校验和
-    // 2bytes   4bytes    1byte   2 bytes     1 byte     2 bytes
-    // 0xEF 01   xxxx      01H      00 03H        01H      00 05H
-
-    // 构造发送给指纹模块的命令包
-    uint8_t cmd[12] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x03,             // 包长度
-        0x01,                   // 指令码
-        0x00, 0x05              // 校验和
-    };
-
-    // 通过UART发送命令包
-    uart_write_bytes(UART_NUM_1, cmd, 12);
-
-    // 接收指纹模块返回的数据
-    uint8_t recv_data[64];
-    int length = uart_read_bytes(UART_NUM_1, recv_data, 1024, 100 / portTICK_PERIOD_MS);
-
-    // 根据接收的数据长度和内容判断操作结果
-    if (length > 0) {
-        if (recv_data[9] == 0) {
-            printf("指纹获取成功\r\n");
-        } else if (recv_data[9] == 0x01) {
-            printf("指纹获取:收包错误\r\n");
-        } else if (recv_data[9] == 0x02) {
-            printf("指纹获取:传感器上无手指\r\n");
+    uint8_t confirm = recv_data[9];
+    if (confirm == 0x00) {
+        // 包长度 = 确认码 + 数据 + 校验和
+        if (length - FINGER_HEADER_LEN - 3 < desc->reply_len) {
+            printf("%s:应答长度错误\r\n", desc->name);
+            return -1;
         }
-        return recv_data[9];
+        if (data) {
+            memcpy(data, &recv_data[10], desc->reply_len);
+        }
+        ESP_LOGD(TAG, "%s:成功", desc->name);
+    } else if (cmd_id == FINGER_CMD_GET_IMAGE && confirm == FINGER_CONFIRM_NO_FINGER) {
+        // 等手指放上时会一直收到，不打印
+        ESP_LOGD(TAG, "%s:%s", desc->name, Finger_ErrorString(confirm));
+    } else {
+        printf("%s:%s\r\n", desc->name, Finger_ErrorString(confirm));
     }
-    printf("指纹获取:无响应\r\n");
-    return -1;
+    return confirm;
 }
 
-/**
- * @brief  生成指纹特征 将图像缓冲区中的原始图像生成指纹特征文件存于模板缓冲区。
- *
- * @param  BufferID 缓冲区编号（正整数），指定此次提取的特征存放位置。
- *
- * @return uint8_t 返回确认码:
- *         - 0: 生成特征成功
- *         - other: 失败
- **/
-static int8_t Finger_GenChar(uint8_t BufferID)
+#if CONFIG_IDF_TARGET_LINUX
+int8_t Finger_SimExec(uint8_t code, const uint8_t *params, uint8_t *data)
 {
-    uint8_t cmd[13] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x04,             // 包长度（注意这里是 0x04）
-        0x02,                   // 指令码:PS_GenChar
-        BufferID,               // 缓冲区编号（用户输入参数）
-        0x00, 0x00              // 校验和（高位 + 低位，可根据实际指令计算）
-    };
-
-    uint16_t checksum = cmd[6] + cmd[7] + cmd[8] + cmd[9] + cmd[10];
-    cmd[11]           = checksum >> 8;
-    cmd[12]           = checksum & 0xFF;
-
-    uart_write_bytes(UART_NUM_1, cmd, 13);
-
-    uint8_t recv_data[64];
-    int length = uart_read_bytes(UART_NUM_1, recv_data, 1024, 500 / portTICK_PERIOD_MS);
-    if (length > 0) {
-        if (recv_data[9] == 0x00) {
-            printf("指纹特征生成:成功\r\n");
-        } else if (recv_data[9] == 0x01) {
-            printf("指纹特征生成:收包错误\r\n");
-        } else if (recv_data[9] == 0x06) {
-            printf("指纹特征生成:指纹图像太乱而生不成特征\r\n");
-        } else if (recv_data[9] == 0x07) {
-            printf("指纹特征生成:指纹图像正常,但特征点太少而生不成特征\r\n");
-        } else if (recv_data[9] == 0x08) {
-            printf("指纹特征生成:当前指纹特征与之前特征之间无关联\r\n");
-        } else if (recv_data[9] == 0x0a) {
-            printf("指纹特征生成:合并失败\r\n");
-        } else if (recv_data[9] == 0x15) {
-            printf("指纹特征生成:图像缓冲区内没有有效原始图而生不成图像\r\n");
-        } else if (recv_data[9] == 0x28) {
-            printf("指纹特征生成:当前指纹特征与之前特征之间有关联\r\n");
-        }
-        return recv_data[9];
+    for (size_t i = 0; i < sizeof(finger_cmds) / sizeof(finger_cmds[0]); i++) {
+        if (finger_cmds[i].code == code) return Finger_Exec(i, params, data);
     }
-    printf("指纹特征生成:无响应\r\n");
-    return -1;
+    return -2;
 }
+#endif
 
-// 3.3.1.5 合并特征（生成模板）PS_RegModel
-// 包头 设备地址 包标识 包长度 指令码 校验和
-// 2 bytes 4bytes 1 byte 2 bytes 1 byte 2 bytes
-// 0xEF01 xxxx 01H 0003H 05H 0009H
-static int8_t Finger_RegModel(void)
+/// 获取指纹芯片的序列号
+static int8_t Finger_GetSN(void)
 {
-    uint8_t cmd[12] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x03,             // 包长度
-        0x05,                   // 指令码
-        0x00, 0x09              // 校验和
-    };
-
-    uart_write_bytes(UART_NUM_1, cmd, 12);
-
-    uint8_t recv_data[64];
-    // 合并特征需要的时间也比较长，给500ms的延时
-    int length =
-        uart_read_bytes(UART_NUM_1, recv_data, 1024, 500 / portTICK_PERIOD_MS);
-    if (length > 0) {
-        if (recv_data[9] == 0) {
-            printf("合并特征:成功\r\n");
-        } else if (recv_data[9] == 1) {
-            printf("合并特征:收包错误\r\n");
-        } else if (recv_data[9] == 0x0a) {
-            printf("合并特征:合并失败\r\n");
-        }
-        return recv_data[9];
+    uint8_t sn[33] = {0};
+    int8_t ret     = Finger_Exec(FINGER_CMD_GET_CHIP_SN, NULL, sn);
+    if (ret == 0) {
+        printf("指纹模块序列号:%s\r\n", sn);
     }
+    return ret;
+}
 
-    printf("合并特征:无响应\r\n");
-    return -1;
+/// 休眠，0 表示成功
+int8_t Finger_Sleep(void)
+{
+    return Finger_Exec(FINGER_CMD_SLEEP, NULL, NULL);
 }
 
-/**
- * @brief 储存指纹模板字符
- *
- * 本函数通过UART接口向指纹模块发送命令，以储存指纹模板字符到指定的PageID位置。
- * 它首先构造一个命令包，计算校验和，然后发送给指纹模块，并等待响应。
- * 根据响应内容判断储存操作是否成功，或遇到何种错误。
- *
- * @param PageID 指纹模板储存的位置ID
- * @return int8_t 返回储存结果的错误代码，0表示成功，其他值表示不同错误。
- *
- */
-static int8_t Finger_StoreChar(uint8_t PageID)
+/// 获取指纹图像，0x00 成功，0x02 传感器上无手指，-1 无响应
+static int8_t Finger_GetImage(void)
 {
-    // 3.3.1.6 储存模板PS_StoreChar
-    // 包头 设备地址 包标识 包长度 指令码 缓冲区号 位置号 校验和
-    // 2 bytes 4bytes 1 byte 2 bytes 1 byte 1 byte 2 bytes 2 bytes
-    // 0xEF01 xxxx 01H 0006H 06H BufferID PageID sum
-
-    uint8_t cmd[15] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x06,             // 包长度
-        0x06,                   // 指令码
-        0x01,                   // 缓冲区号，默认为1
-        0x00, PageID,           // PageID
-        0x00, 0x00              // 校验和
-    };
+    return Finger_Exec(FINGER_CMD_GET_IMAGE, NULL, NULL);
+}
 
-    uint16_t checksum = 0;
-    for (size_t i = 6; i < 13; i++) {
-        checksum += cmd[i];
-    }
-    cmd[13] = checksum >> 8;
-    cmd[14] = checksum;
-
-    uart_write_bytes(UART_NUM_1, cmd, 15);
-
-    uint8_t recv_data[64];
-    // 保存模板需要时间比较长
-    int length =
-        uart_read_bytes(UART_NUM_1, recv_data, 1024, 500 / portTICK_PERIOD_MS);
-    if (length > 0) {
-        if (recv_data[9] == 0x00) {
-            printf("保存模板:成功\r\n");
-        } else if (recv_data[9] == 0x01) {
-            printf("保存模板:收包错误\r\n");
-        } else if (recv_data[9] == 0x0b) {
-            printf("保存模板:PageID超出指纹库范围\r\n");
-        } else if (recv_data[9] == 0x18) {
-            printf("保存模板:写FLASH错误\r\n");
-        } else if (recv_data[9] == 0x31) {
-            printf("保存模板:加密等级不匹配\r\n");
-        }
-        return recv_data[9];
-    }
-    printf("保存模板:无响应\r\n");
-    return -1;
+/// 把图像缓冲区中的原始图像生成指纹特征，存于 BufferID 号模板缓冲区
+static int8_t Finger_GenChar(uint8_t BufferID)
+{
+    return Finger_Exec(FINGER_CMD_GEN_CHAR, &BufferID, NULL);
 }
 
-/**
- *  @brief 设置指纹模块的安全级别为零
- *
- * 本函数通过发送特定指令给指纹模块，以设置其安全级别为零
- * 安全级别影响指纹匹配的严格程度，级别越低，匹配越容易
- *
- * @param uint8_t security_level 安全等级 0~255
- * @return int8_t 返回设置结果的代码
- *         0x00: 设置成功
- *         0x01: 收包错误
- *         0x18: 读写Flash错误
- *         0x1a: 寄存器序号错误
- *         0x1b: 存器设定内容错误
- *         -1: 无响应
- */
+/// 合并特征（生成模板）
+static int8_t Finger_RegModel(void)
+{
+    return Finger_Exec(FINGER_CMD_REG_MODEL, NULL, NULL);
+}
+
+/// 把缓冲区1的模板储存到指纹库的 PageID 位置
+static int8_t Finger_StoreChar(uint8_t PageID)
+{
+    const uint8_t params[3] = {0x01, 0x00, PageID};
+    return Finger_Exec(FINGER_CMD_STORE_CHAR, params, NULL);
+}
+
+/// 设置安全等级 0~255，级别越低，匹配越容易
 static int8_t Finger_SetSecurityLevel(uint8_t security_level)
 {
-    // 3.3.1.12 写系统寄存器PS_WriteReg
-    // 将安全等级设置为0
-    // 包头 设备地址 包标识 包长度 指令码 寄存器序号 内容 校验和
-    // 2 bytes 4bytes 1 byte 2 bytes 1 byte 1byte 1byte 2 bytes
-    // 0xEF01 xxxx 01H 0005H 0eH xxH xxH sum
-
-    // 构造发送给指纹模块的指令包
-    uint8_t cmd[14] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x05,             // 包长度
-        0x0E,                   // 指令码
-        0x07,                   // 寄存器序号
-        security_level,         // 内容
-        0x00, 0x00              // 校验和
-    };
-
-    // 计算校验和
-    uint16_t checksum = 0;
-    for (int i = 6; i < 12; i++) {
-        checksum += cmd[i];
+    const uint8_t params[2] = {FINGER_REG_SECURITY_LEVEL, security_level};
+    int8_t ret              = Finger_Exec(FINGER_CMD_WRITE_REG, params, NULL);
+    if (ret == 0) {
+        printf("设置安全等级%d:成功\r\n", security_level);
     }
-    cmd[12] = checksum >> 8;
-    cmd[13] = checksum & 0xFF;
-
-    // 发送指令包到指纹模块
-    uart_write_bytes(UART_NUM_1, cmd, 14);
-
-    // 接收指纹模块的响应数据
-    uint8_t recv_data[64] = {0};
-    int length            = uart_read_bytes(UART_NUM_1, recv_data, 64, 100 / portTICK_PERIOD_MS);
-
-    // 根据响应数据判断设置结果
-    if (length > 0) {
-        if (recv_data[9] == 0x00) {
-            printf("设置安全等级%d:成功\r\n", security_level);
-        } else if (recv_data[9] == 0x01) {
-            printf("安全等级设置:收包错误\r\n");
-        } else if (recv_data[9] == 0x18) {
-            printf("安全等级设置:读写Flash错误\r\n");
-        } else if (recv_data[9] == 0x1a) {
-            printf("安全等级设置:寄存器序号错误\r\n");
-        } else if (recv_data[9] == 0x1b) {
-            printf("安全等级设置:存器设定内容错误\r\n");
-        }
-        return recv_data[9];
-    }
-    printf("安全等级设置:无响应\r\n");
-    return -1;
+    return ret;
 }
 
-/**
- * @brief 获取有效指纹模板数量
- *
- * @param valid_template_num 获取有效指纹模板数量
- * @return int8_t 0x00成功
- *          0x01: 收包失败
- *          -1: 无响应
- */
+/// 获取有效指纹模板数量
 static int8_t Finger_ValidTemplateNum(uint8_t *valid_template_num)
 {
-    // 3.3.1.16 读有效模板个数PS_ValidTempleteNum
-    // 包头 设备地址 包标识 包长度 指令码 校验和
-    // 2 bytes 4bytes 1 byte 2 bytes 1 byte 2 bytes
-    // 0xEF01 xxxx 01H 0003H 1dH 0021H
-
-    // 构造发送给指纹识别模块的命令包。
-    uint8_t cmd[12] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x03,             // 包长度
-        0x1D,                   // 指令码
-        0x00, 0x21              // 校验和
-    };
-
-    // 通过UART串口发送命令包。
-    uart_write_bytes(UART_NUM_1, cmd, 12);
-
-    // 准备接收指纹识别模块的响应数据。
-    uint8_t recv_data[64];
-    int length =
-        uart_read_bytes(UART_NUM_1, recv_data, 1024, 100 / portTICK_PERIOD_MS);
-
-    // 检查接收到的数据长度，以确定响应是否有效。
-    if (length > 0) {
-        // 根据响应数据的第9字节判断操作结果。
-        if (recv_data[9] == 0) {
-            // 成功获取有效模板数量，打印数量并返回0x00。
-            printf("有效模板个数:%d\r\n", recv_data[11]);
-            *valid_template_num = recv_data[11];
-        } else if (recv_data[9] == 0x01) {
-            // 收包错误，打印错误信息并返回0x01。
-            printf("获取有效模板数量:收包错误\r\n");
-        }
-        return recv_data[9];
+    uint8_t data[2];
+    int8_t ret = Finger_Exec(FINGER_CMD_VALID_TEMPLET, NULL, data);
+    if (ret == 0) {
+        *valid_template_num = data[1];
+        printf("有效模板个数:%d\r\n", data[1]);
     }
-
-    // 如果没有接收到任何数据，打印无响应信息并返回-1。
-    printf("获取有效模板数量:无响应\r\n");
-    return -1;
+    return ret;
 }
 
-/**
- * @brief 指纹检索
- *
- * @return int8_t 0: 成功 -1: 失败
- */
-int8_t Finger_Search(void)
+/// 在整个指纹库中搜索缓冲区1的特征，0 表示找到，page_id/score 为匹配到的位置和得分
+static int8_t Finger_Search(uint16_t *page_id, uint16_t *score)
 {
-    // 3.3.1.4 搜索指纹PS_Search
-    // 包头 设备地址 包标识 包长度 指令码 缓冲区号 参数 参数 校验和
-    // 2 bytes 4bytes 1 byte 2 bytes 1 byte 1 byte   2 bytes   2 bytes 2 bytes
-    // 0xEF01  xxxx   01H    0008H   04H    BufferID StartPage PageNum sum
-
-    uint8_t cmd[17] = {
-        0xEF, 0x01,             // 包头
-        0xFF, 0xFF, 0xFF, 0xFF, // 默认设备地址
-        0x01,                   // 包标识
-        0x00, 0x08,             // 包长度
-        0x04,                   // 指令码
-        0x01,                   // 缓冲区号
-        0x00, 0x00,             // StartPage
-        0xFF, 0xFF,             // PageNum
-        0x00, 0x00              // 校验和
-    };
-
-    uint16_t checksum = 0;
-    for (int i = 6; i <= 14; i++) {
-        checksum += cmd[i];
+    uint8_t data[4];
+    int8_t ret = Finger_Exec(FINGER_CMD_SEARCH, NULL, data);
+    if (ret == 0) {
+        *page_id = (data[0] << 8) | data[1];
+        *score   = (data[2] << 8) | data[3];
     }
-    cmd[15] = checksum >> 8;
-    cmd[16] = checksum;
-
-    uart_write_bytes(UART_NUM_1, cmd, 17);
-
-    uint8_t recv_data[64];
-    // 搜索时间长一点
-    int length =
-        uart_read_bytes(UART_NUM_1, recv_data, 1024, 500 / portTICK_PERIOD_MS);
-    if (length > 0) {
-        if (recv_data[9] == 0) {
-            printf("指纹检索:成功\r\n");
-        } else if (recv_data[9] == 0x01) {
-            printf("指纹检索:收包失败\r\n");
-        } else if (recv_data[9] == 0x09) {
-            printf("指纹检索:未找到指纹\r\n");
-        } else if (recv_data[9] == 0x17) {
-            printf("指纹检索:残留指纹或两次采集之间手指没有移动过\r\n");
-        } else if (recv_data[9] == 0x31) {
-            printf("指纹检索:功能与加密等级不匹配\r\n");
-        }
-        return recv_data[9];
-    }
-
-    printf("指纹检索:无响应\r\n");
-    return -1;
+    return ret;
 }
 
+// 两次成功采集之间的最长间隔
+#define FINGER_ENROLL_TIMEOUT_US (5000 * 1000)
+// 录入时手指没放上，隔这么久再采集一次
+#define FINGER_ENROLL_POLL_MS 100
+
 /**
  * @brief 执行指纹录入流程
  *
@@ -507,32 +489,39 @@ int8_t Finger_Search(void)
  * 最后注册模型并存储特征值整个过程包括多次提示用户放置和拿开手指，以确保
  * 获取不同角度的指纹图像
  *
+ * 超时由定时器服务计时，到期后给调用者任务发送 FINGER_NOTIFY_ENROLL_TIMEOUT 通知位，
+ * 每次成功采集后重新计时。
+ *
  * @return
  *  0: 成功录入指纹
  *  1: 录入过程中发生错误
  */
 uint8_t Finger_Enroll(void)
 {
-    static uint32_t finger_enroll_run_time = 0;
+    uint8_t ret = 1;
 
     printf("进入指纹录入模式\r\n");
     // 按下指纹的次数
     int N = 4;
     int n = 1;
 
+    TimerService_BindTask(TIMER_FINGER_ENROLL, xTaskGetCurrentTaskHandle(), FINGER_NOTIFY_ENROLL_TIMEOUT);
+    ulTaskNotifyValueClear(NULL, FINGER_NOTIFY_ENROLL_TIMEOUT);
+    TimerService_Start(TIMER_FINGER_ENROLL, FINGER_ENROLL_TIMEOUT_US);
+
     // 获取指纹图像并生成特征值的循环过程
 SendGetImageCmd:
 
-    // 超时检测
-    if (finger_enroll_run_time == 0) {
-        finger_enroll_run_time = xTaskGetTickCount();
-    } else if (xTaskGetTickCount() - finger_enroll_run_time > pdMS_TO_TICKS(5000)) {
+    // 超时检测：只查看通知位，不等待
+    if (ulTaskNotifyValueClear(NULL, 0) & FINGER_NOTIFY_ENROLL_TIMEOUT) {
         printf("指纹录入超时,退出指纹录入\r\n");
-        finger_enroll_run_time = 0;
-        return 1;
+        goto out;
+    }
+    // 指示用户放置手指并获取图像如果获取失败，则等一会儿重新尝试
+    if (Finger_GetImage()) {
+        DelayMs(FINGER_ENROLL_POLL_MS);
+        goto SendGetImageCmd;
     }
-    // 指示用户放置手指并获取图像如果获取失败，则重新尝试
-    if (Finger_GetImage()) goto SendGetImageCmd;
     // 生成特征值如果失败，则重新尝试获取图像
     if (Finger_GenChar(n)) goto SendGetImageCmd;
     // 提示用户拿开手指
@@ -543,7 +532,7 @@ SendGetImageCmd:
     // 如果尚未达到预定的指纹数量，则继续循环
     if (n < N) {
         // 如果录制成功了 更新超时时间
-        finger_enroll_run_time = xTaskGetTickCount();
+        TimerService_Start(TIMER_FINGER_ENROLL, FINGER_ENROLL_TIMEOUT_US);
         n++;
         goto SendGetImageCmd;
     }
@@ -556,18 +545,182 @@ SendGetImageCmd:
     // 获取当前有效的模板数量
     if (Finger_ValidTemplateNum(&finger_num)) goto ERROR;
     // 成功完成指纹录入
-    return 0;
+    ret = 0;
+    goto out;
 
 ERROR:
     printf("指纹录入失败\r\n");
     // 录入过程中发生错误
-    return 1;
+out:
+    TimerService_Stop(TIMER_FINGER_ENROLL);
+    ulTaskNotifyValueClear(NULL, FINGER_NOTIFY_ENROLL_TIMEOUT);
+    return ret;
 }
 
-uint8_t Finger_Identifiy(void)
+// 自动验证的阶段（应答包中确认码之后的第一个字节）
+#define FINGER_AUTO_STAGE_CHECK  0x00 // 指令合法性检查
+#define FINGER_AUTO_STAGE_IMAGE  0x01 // 获取图像
+#define FINGER_AUTO_STAGE_SEARCH 0x05 // 搜索结果
+// 自动验证应答：确认码 + 阶段 + ID(2) + 得分(2)
+#define FINGER_AUTO_REPLY_LEN (FINGER_HEADER_LEN + 1 + 5 + 2)
+// 从发送指令到搜索结果的最长时间
+#define FINGER_AUTO_TIMEOUT_MS 1000
+
+// 最近一次识别的结果
+static finger_identify_t finger_last_identify = {.page_id = -1};
+
+#if CONFIG_FINGER_AUTO_IDENTIFY
+// 模块是否支持自动验证，第一次不支持后不再尝试
+static uint8_t finger_auto_supported = 1;
+
+/**
+ * @brief 用 PS_AutoIdentify 一条指令完成采图、生成特征和搜索
+ *
+ * 模块在每个阶段结束时各发一个应答包，这里按到达时间记录各阶段耗时。
+ *
+ * @return int8_t 确认码；-2 表示模块不支持该指令，调用者应改用分步流程
+ */
+static int8_t Finger_AutoIdentify(finger_identify_t *result)
 {
-    if (Finger_GetImage()) return 1;
-    if (Finger_GenChar(1)) return 1;
-    if (Finger_Search()) return 1;
+    uint8_t reply[FINGER_PACKET_MAX];
+    int64_t start = esp_timer_get_time();
+    int64_t last  = start;
+
+    Finger_Send(finger_frame_auto_identify, sizeof(finger_frame_auto_identify));
+    while (1) {
+        int64_t remain_ms = FINGER_AUTO_TIMEOUT_MS - (esp_timer_get_time() - start) / 1000;
+        int length        = remain_ms > 0 ? Finger_Receive(reply, remain_ms) : -1;
+        if (length < 0) {
+            printf("自动验证:无响应\r\n");
+            return -1;
+        }
+        if (length < FINGER_AUTO_REPLY_LEN) {
+            // 不支持的模块只回一个不带阶段的应答
+            return -2;
+        }
+
+        int64_t now   = esp_timer_get_time();
+        uint8_t stage = reply[10];
+        if (stage == FINGER_AUTO_STAGE_IMAGE) {
+            result->capture_us = now - last;
+        } else if (stage == FINGER_AUTO_STAGE_SEARCH) {
+            // 模块内部的生成特征和搜索没有单独的应答，计入搜索阶段
+            result->search_us = now - last;
+        }
+        last = now;
+
+        if (reply[9] != 0x00) {
+            printf("自动验证:%s\r\n", Finger_ErrorString(reply[9]));
+            return reply[9];
+        }
+        if (stage == FINGER_AUTO_STAGE_SEARCH) {
+            result->page_id = (reply[11] << 8) | reply[12];
+            result->score   = (reply[13] << 8) | reply[14];
+            return 0;
+        }
+    }
+}
+#endif
+
+// 分步识别：PS_GetImage -> PS_GenChar -> PS_Search
+static int8_t Finger_StepIdentify(finger_identify_t *result)
+{
+    uint16_t page_id = 0;
+    uint16_t score   = 0;
+    int8_t ret;
+    int64_t t = esp_timer_get_time();
+
+    ret                = Finger_GetImage();
+    result->capture_us = esp_timer_get_time() - t;
+    if (ret) return ret;
+
+    t                  = esp_timer_get_time();
+    ret                = Finger_GenChar(1);
+    result->extract_us = esp_timer_get_time() - t;
+    if (ret) return ret;
+
+    t                 = esp_timer_get_time();
+    ret               = Finger_Search(&page_id, &score);
+    result->search_us = esp_timer_get_time() - t;
+    if (ret) return ret;
+
+    result->page_id = page_id;
+    result->score   = score;
     return 0;
 }
+
+/**
+ * @brief 识别传感器上的手指
+ *
+ * 开启 CONFIG_FINGER_AUTO_IDENTIFY 时优先使用模块的自动验证指令，只需一次往返；
+ * 模块不支持时自动退回分步流程。识别结束后不会让模块休眠，调用者先处理开锁，再调用 Finger_Sleep()。
+ *
+ * @return 0: 识别成功  1: 识别失败
+ */
+uint8_t Finger_Identifiy(void)
+{
+    finger_identify_t result = {.page_id = -1};
+    int8_t ret               = -2;
+    int64_t start            = esp_timer_get_time();
+
+#if CONFIG_FINGER_AUTO_IDENTIFY
+    if (finger_auto_supported) {
+        result.auto_identify = 1;
+        ret                  = Finger_AutoIdentify(&result);
+        if (ret == -2) {
+            ESP_LOGW(TAG, "PS_AutoIdentify not supported, falling back to step identify");
+            finger_auto_supported = 0;
+            result                = (finger_identify_t){.page_id = -1};
+        }
+    }
+#endif
+    if (ret == -2) {
+        ret = Finger_StepIdentify(&result);
+    }
+    if (ret != 0) {
+        result.page_id = -1;
+    }
+    result.total_us      = esp_timer_get_time() - start;
+    finger_last_identify = result;
+
+    ESP_LOGI(TAG, "identify %s in %" PRIu32 " us (%s: capture %" PRIu32 ", extract %" PRIu32 ", search %" PRIu32 ")",
+             ret ? "failed" : "ok", result.total_us, result.auto_identify ? "auto" : "step",
+             result.capture_us, result.extract_us, result.search_us);
+    return ret ? 1 : 0;
+}
+
+void Finger_GetLastIdentify(finger_identify_t *result)
+{
+    *result = finger_last_identify;
+}
+
+#if CONFIG_FINGER_BENCHMARK
+// 保留最近的样本数
+#define FINGER_BENCH_SAMPLES 64
+// 每收集多少个样本打印一次
+#define FINGER_BENCH_REPORT 16
+
+static uint32_t finger_bench_samples[FINGER_BENCH_SAMPLES];
+static uint32_t finger_bench_count = 0;
+
+static int Finger_BenchCompare(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void Finger_BenchmarkRecord(int64_t touch_us, int64_t decision_us)
+{
+    finger_bench_samples[finger_bench_count % FINGER_BENCH_SAMPLES] = decision_us - touch_us;
+    finger_bench_count++;
+    if (finger_bench_count % FINGER_BENCH_REPORT) return;
+
+    uint32_t sorted[FINGER_BENCH_SAMPLES];
+    size_t n = finger_bench_count < FINGER_BENCH_SAMPLES ? finger_bench_count : FINGER_BENCH_SAMPLES;
+    memcpy(sorted, finger_bench_samples, n * sizeof(sorted[0]));
+    qsort(sorted, n, sizeof(sorted[0]), Finger_BenchCompare);
+    printf("指纹 触摸->判定 %" PRIu32 " 次: p50 %" PRIu32 " us, p99 %" PRIu32 " us, max %" PRIu32 " us\r\n",
+           finger_bench_count, sorted[n / 2], sorted[(n * 99) / 100], sorted[n - 1]);
+}
+#endif
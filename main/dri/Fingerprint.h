@@ -3,11 +3,70 @@
 
 #define FINGER_TOUCH_INT_PIN GPIO_NUM_10
 
-/// 初始化指纹模块
-void Fingerprint_Init(void);
+// 一个数据包的最大长度：包头2 + 地址4 + 标识1 + 长度2 + 内容 + 校验和2
+// 模块最长的应答是 PS_GetChipSN（32字节序列号），64 字节足够，超长的包直接丢弃
+#define FINGER_PACKET_MAX 64
+// 包长度字段之前的字节数（包头 + 地址 + 标识 + 长度）
+#define FINGER_HEADER_LEN 9
+
+/**
+ * @brief 指纹模块的传输端口
+ *
+ * init  初始化串口
+ * flush 丢弃接收缓冲中残留的数据
+ * write 发送数据
+ * read  等待数据到达，最多读取 len 字节，返回实际读取的字节数；超时返回 0，出错返回 -1
+ */
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void (*flush)(void);
+    int (*write)(const uint8_t *data, size_t len);
+    int (*read)(uint8_t *buf, size_t len, uint32_t timeout_ms);
+} finger_port_t;
+
+// UART1 + 事件队列
+extern const finger_port_t finger_port_uart;
+
+#if CONFIG_IDF_TARGET_LINUX
+// 主机仿真的假指纹模块
+extern const finger_port_t finger_port_sim;
+// 模拟手指放上/拿开，page_id 为放上的手指在指纹库中的位置，-1 表示未录入的手指
+void Finger_SimTouch(uint8_t present, int16_t page_id);
+// 下一条指令不按指令码生成应答，而是原样回 reply；split 不为 0 时前 split 字节先到，其余的分开晚到
+void Finger_SimScript(const uint8_t *reply, size_t len, size_t split);
+// 模块最近收到的指令包，返回长度
+size_t Finger_SimLastCommand(uint8_t *cmd);
+// 按指令码执行指令表中的一条指令，返回值同各指令函数：确认码，无响应 -1，指令码不在表中 -2
+int8_t Finger_SimExec(uint8_t code, const uint8_t *params, uint8_t *data);
+#endif
+
+/// 初始化指纹模块，返回 0 成功，-1 表示模块无响应
+int8_t Fingerprint_Init(void);
 
 int8_t Finger_Sleep(void);
 
+// 录入超时由定时器服务通知调用者任务的这个通知位，调用 Finger_Enroll() 的任务不能把它另作他用
+#define FINGER_NOTIFY_ENROLL_TIMEOUT (1UL << 31)
 uint8_t Finger_Enroll(void);
 
-uint8_t Finger_Identifiy(void);
\ No newline at end of file
+uint8_t Finger_Identifiy(void);
+
+// 一次识别的结果和各阶段耗时（微秒）
+typedef struct {
+    int16_t page_id;       // 匹配到的指纹库位置，失败为 -1
+    uint16_t score;        // 匹配得分
+    uint8_t auto_identify; // 1: 使用了 PS_AutoIdentify  0: 分步流程
+    uint32_t capture_us;   // 采集图像
+    uint32_t extract_us;   // 生成特征（自动验证时计入 search_us）
+    uint32_t search_us;    // 搜索指纹库
+    uint32_t total_us;
+} finger_identify_t;
+
+// 最近一次 Finger_Identifiy() 的结果
+void Finger_GetLastIdentify(finger_identify_t *result);
+
+#if CONFIG_FINGER_BENCHMARK
+// 记录一次 触摸->判定 耗时，每 16 次打印最近 64 次的 p50/p99
+void Finger_BenchmarkRecord(int64_t touch_us, int64_t decision_us);
+#endif
@@ -0,0 +1,102 @@
+#include "Fingerprint.h"
+#include "driver/uart.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+
+#define FINGER_UART_NUM    UART_NUM_1
+#define FINGER_UART_TX_PIN GPIO_NUM_21
+#define FINGER_UART_RX_PIN GPIO_NUM_20
+
+#define RX_BUF_SIZE        2048
+// UART 事件队列长度
+#define FINGER_EVENT_QUEUE_LEN 8
+// 接收 FIFO 中的数据达到这么多字节就触发 UART_DATA 事件；
+// 不足时由接收超时（总线空闲若干字符时间）触发，所以短应答也能立即上报
+#define FINGER_RX_FULL_THRESH 16
+// 接收超时：总线空闲多少个字符时间后上报数据
+#define FINGER_RX_TIMEOUT_SYMBOLS 2
+
+static const char *TAG = "finger uart";
+
+static QueueHandle_t finger_uart_queue = NULL;
+
+static void Finger_UartInit(void)
+{
+    // UART 配置
+    // 定义一个UART配置结构体变量uart_config，用于设置UART的通信参数
+    uart_config_t uart_config = {
+        // 设置波特率为57600，这是UART通信的数据传输速率
+        .baud_rate = 57600,
+        // 设置数据位为8位，这是UART通信中数据帧的数据部分的位数
+        .data_bits = UART_DATA_8_BITS,
+        // 禁用奇偶校验，UART通信中不使用奇偶校验位来检测传输错误
+        .parity = UART_PARITY_DISABLE,
+        // 设置停止位为1位，这是UART通信中帧的结束信号
+        .stop_bits = UART_STOP_BITS_1,
+        // 禁用硬件流控，UART通信中不使用硬件握手信号来控制数据传输
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        // 设置UART的时钟源为默认值，这是UART通信中用于生成波特率的时钟源
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    // 安装驱动时创建事件队列，数据到达、溢出等事件都会投递到这个队列
+    uart_driver_install(FINGER_UART_NUM, RX_BUF_SIZE, 0, FINGER_EVENT_QUEUE_LEN, &finger_uart_queue, 0);
+    uart_param_config(FINGER_UART_NUM, &uart_config);
+    // 为串口1分配tx和rx引脚
+    uart_set_pin(FINGER_UART_NUM, FINGER_UART_TX_PIN, FINGER_UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+    uart_set_rx_full_threshold(FINGER_UART_NUM, FINGER_RX_FULL_THRESH);
+    uart_set_rx_timeout(FINGER_UART_NUM, FINGER_RX_TIMEOUT_SYMBOLS);
+}
+
+static void Finger_UartFlush(void)
+{
+    uart_flush_input(FINGER_UART_NUM);
+    xQueueReset(finger_uart_queue);
+}
+
+static int Finger_UartWrite(const uint8_t *data, size_t len)
+{
+    return uart_write_bytes(FINGER_UART_NUM, data, len);
+}
+
+/**
+ * @brief 读取已经到达的数据；没有数据时在事件队列上等待，直到数据到达或超时
+ */
+static int Finger_UartRead(uint8_t *buf, size_t len, uint32_t timeout_ms)
+{
+    size_t buffered = 0;
+    uart_event_t event;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t wait  = pdMS_TO_TICKS(timeout_ms);
+
+    while (1) {
+        uart_get_buffered_data_len(FINGER_UART_NUM, &buffered);
+        if (buffered > 0) {
+            return uart_read_bytes(FINGER_UART_NUM, buf, buffered < len ? buffered : len, 0);
+        }
+
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= wait) return 0;
+        if (xQueueReceive(finger_uart_queue, &event, wait - elapsed) != pdTRUE) return 0;
+
+        switch (event.type) {
+            case UART_DATA:
+                break;
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                // 溢出后缓冲中的数据已经不完整，丢弃后由上层重新同步
+                ESP_LOGW(TAG, "rx overflow, event %d", event.type);
+                Finger_UartFlush();
+                return -1;
+            default:
+                break;
+        }
+    }
+}
+
+const finger_port_t finger_port_uart = {
+    .name  = "uart1",
+    .init  = Finger_UartInit,
+    .flush = Finger_UartFlush,
+    .write = Finger_UartWrite,
+    .read  = Finger_UartRead,
+};
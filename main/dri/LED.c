@@ -3,36 +3,12 @@
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-/// ESP32 错误处理的API
-#include "esp_check.h"
-/// RMT编码器相关API
-#include "driver/rmt_encoder.h"
-/// RMT发送数据的API
-#include "driver/rmt_tx.h"
-
-// 10MHz的分辨率，1 tick = 0.1us，LED条带需要高分辨率。
-#define RMT_LED_STRIP_RESOLUTION_HZ 10000000
-// 只需要一个引脚，引脚号为6。
-#define RMT_LED_STRIP_GPIO_NUM GPIO_NUM_6
-
-// 共12个LED灯。
-#define LED_NUMBERS 12
-
-// LED编码器配置结构体，主要配置编码器的频率。
-typedef struct
-{
-    uint32_t resolution;
-} led_strip_encoder_config_t;
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "timer_service.h"
 
-// 编码器结构体
-typedef struct
-{
-    rmt_encoder_t base;
-    rmt_encoder_t *bytes_encoder;
-    rmt_encoder_t *copy_encoder;
-    int state;
-    rmt_symbol_word_t reset_code;
-} rmt_led_strip_encoder_t;
+// 后端忙时，隔多久重试一次提交（微秒）；一帧 12 个灯约 0.5ms
+#define LED_RETRY_US 1000
 
 // 颜色的初始值。
 uint32_t red   = 0;
@@ -40,127 +16,22 @@ uint32_t green = 0;
 uint32_t blue  = 0;
 uint16_t hue   = 0;
 
-// 日志前缀
-const char *TAG = "LED ENCODER";
+static const led_backend_t *led_backend = NULL;
 
 // 每个灯需要发送RGB三个颜色，所以一共发送的数量要乘以3。
-// 这个数组用来存放待发送的RGB像素值。
-uint8_t led_strip_pixels[LED_NUMBERS * 3];
-
-// LED通道
-rmt_channel_handle_t led_chan = NULL;
-// LED编码器
-rmt_encoder_handle_t led_encoder = NULL;
-// 发送配置，不进行循环发送
-rmt_transmit_config_t tx_config = {
-    .loop_count = 0,
-};
-
-size_t rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
-{
-    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_encoder_handle_t bytes_encoder   = led_encoder->bytes_encoder;
-    rmt_encoder_handle_t copy_encoder    = led_encoder->copy_encoder;
-    rmt_encode_state_t session_state     = RMT_ENCODING_RESET;
-    rmt_encode_state_t state             = RMT_ENCODING_RESET;
-    size_t encoded_symbols               = 0;
-    switch (led_encoder->state) {
-        case 0: // send RGB data
-            encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, primary_data, data_size, &session_state);
-            if (session_state & RMT_ENCODING_COMPLETE) {
-                led_encoder->state = 1; // switch to next state when current encoding session finished
-            }
-            if (session_state & RMT_ENCODING_MEM_FULL) {
-                state |= RMT_ENCODING_MEM_FULL;
-                goto out; // yield if there's no free space for encoding artifacts
-            }
-        // fall-through
-        case 1: // send reset code
-            encoded_symbols += copy_encoder->encode(copy_encoder, channel, &led_encoder->reset_code,
-                                                    sizeof(led_encoder->reset_code), &session_state);
-            if (session_state & RMT_ENCODING_COMPLETE) {
-                led_encoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
-                state |= RMT_ENCODING_COMPLETE;
-            }
-            if (session_state & RMT_ENCODING_MEM_FULL) {
-                state |= RMT_ENCODING_MEM_FULL;
-                goto out; // yield if there's no free space for encoding artifacts
-            }
-    }
-out:
-    *ret_state = state;
-    return encoded_symbols;
-}
+// 这个数组是工作帧：所有修改都写在这里，提交时由后端拷贝到发送缓冲
+static uint8_t led_strip_pixels[LED_FRAME_BYTES];
+// 工作帧相对于上一次发送的帧是否有变化
+static uint8_t led_dirty = 0;
+// 保护工作帧和定时效果（定时器任务和 LED 任务都会修改）
+static portMUX_TYPE led_lock = portMUX_INITIALIZER_UNLOCKED;
+// 串行化提交
+static SemaphoreHandle_t led_commit_mutex = NULL;
 
-esp_err_t rmt_del_led_strip_encoder(rmt_encoder_t *encoder)
-{
-    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_del_encoder(led_encoder->bytes_encoder);
-    rmt_del_encoder(led_encoder->copy_encoder);
-    free(led_encoder);
-    return ESP_OK;
-}
+// 定时效果：每个灯的熄灭时间（esp_timer 时间，0 表示没有定时效果）
+static int64_t led_off_at_us[LED_NUMBERS];
 
-esp_err_t rmt_led_strip_encoder_reset(rmt_encoder_t *encoder)
-{
-    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
-    rmt_encoder_reset(led_encoder->bytes_encoder);
-    rmt_encoder_reset(led_encoder->copy_encoder);
-    led_encoder->state = RMT_ENCODING_RESET;
-    return ESP_OK;
-}
-
-esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
-{
-    esp_err_t ret                        = ESP_OK;
-    rmt_led_strip_encoder_t *led_encoder = NULL;
-    ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
-    led_encoder = calloc(1, sizeof(rmt_led_strip_encoder_t));
-    ESP_GOTO_ON_FALSE(led_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for led strip encoder");
-    led_encoder->base.encode = rmt_encode_led_strip;
-    led_encoder->base.del    = rmt_del_led_strip_encoder;
-    led_encoder->base.reset  = rmt_led_strip_encoder_reset;
-    // different led strip might have its own timing requirements, following parameter is for WS2812
-    rmt_bytes_encoder_config_t bytes_encoder_config = {
-        .bit0 = {
-            .level0    = 1,
-            .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
-            .level1    = 0,
-            .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
-        },
-        .bit1 = {
-            .level0    = 1,
-            .duration0 = 0.9 * config->resolution / 1000000, // T1H=0.9us
-            .level1    = 0,
-            .duration1 = 0.3 * config->resolution / 1000000, // T1L=0.3us
-        },
-        .flags.msb_first = 1 // WS2812 transfer bit order: G7...G0R7...R0B7...B0
-    };
-    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
-    rmt_copy_encoder_config_t copy_encoder_config = {};
-    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
-
-    uint32_t reset_ticks    = config->resolution / 1000000 * 50 / 2; // reset code duration defaults to 50us
-    led_encoder->reset_code = (rmt_symbol_word_t){
-        .level0    = 0,
-        .duration0 = reset_ticks,
-        .level1    = 0,
-        .duration1 = reset_ticks,
-    };
-    *ret_encoder = &led_encoder->base;
-    return ESP_OK;
-err:
-    if (led_encoder) {
-        if (led_encoder->bytes_encoder) {
-            rmt_del_encoder(led_encoder->bytes_encoder);
-        }
-        if (led_encoder->copy_encoder) {
-            rmt_del_encoder(led_encoder->copy_encoder);
-        }
-        free(led_encoder);
-    }
-    return ret;
-}
+static led_stats_t led_stats = {0};
 
 void led_strip_hsv2rgb(uint32_t h, uint32_t s, uint32_t v, uint32_t *r, uint32_t *g, uint32_t *b)
 {
@@ -208,31 +79,165 @@ void led_strip_hsv2rgb(uint32_t h, uint32_t s, uint32_t v, uint32_t *r, uint32_t
     }
 }
 
+// 写一个像素（调用者持有 led_lock），值有变化时标记脏帧
+static void LED_WritePixelLocked(uint8_t led_num, uint8_t g, uint8_t b, uint8_t r)
+{
+    uint8_t *pixel = &led_strip_pixels[led_num * 3];
+    if (pixel[0] != g || pixel[1] != b || pixel[2] != r) {
+        pixel[0]  = g; // Green 分量放在第一位
+        pixel[1]  = b; // Blue 分量放在第二位
+        pixel[2]  = r; // Red 分量放在第三位
+        led_dirty = 1;
+    }
+}
+
+void LED_SetRange(uint8_t first, uint8_t count, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness)
+{
+    if (first >= LED_NUMBERS) return;
+    if (count > LED_NUMBERS - first) {
+        count = LED_NUMBERS - first;
+    }
+
+    // 根据亮度调整 RGB 值
+    if (brightness > 100) {
+        brightness = 100;
+    }
+    uint8_t adjusted_red   = (uint32_t)red * brightness / 100;
+    uint8_t adjusted_green = (uint32_t)green * brightness / 100;
+    uint8_t adjusted_blue  = (uint32_t)blue * brightness / 100;
+
+    taskENTER_CRITICAL(&led_lock);
+    for (uint8_t i = first; i < first + count; i++) {
+        LED_WritePixelLocked(i, adjusted_green, adjusted_blue, adjusted_red);
+        // 直接设置颜色会取消该灯上的定时熄灭
+        led_off_at_us[i] = 0;
+    }
+    taskEXIT_CRITICAL(&led_lock);
+}
+
+void LED_SetPixel(uint8_t led_num, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness)
+{
+    LED_SetRange(led_num, 1, red, green, blue, brightness);
+}
+
+void LED_Clear(void)
+{
+    LED_SetRange(0, LED_NUMBERS, 0, 0, 0, 0);
+}
+
+void LED_Commit(void)
+{
+    uint8_t frame[LED_FRAME_BYTES];
+
+    xSemaphoreTake(led_commit_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&led_lock);
+    uint8_t dirty = led_dirty;
+    if (dirty) {
+        memcpy(frame, led_strip_pixels, sizeof(frame));
+        led_dirty = 0;
+    }
+    taskEXIT_CRITICAL(&led_lock);
+
+    if (!dirty) {
+        led_stats.skipped++;
+    } else if (led_backend->transmit(frame, sizeof(frame)) == 0) {
+        led_stats.commits++;
+    } else {
+        // 两个发送缓冲都在使用中：保留脏标记，稍后由定时器重试，调用者不等待
+        taskENTER_CRITICAL(&led_lock);
+        led_dirty = 1;
+        taskEXIT_CRITICAL(&led_lock);
+        led_stats.retries++;
+        if (!TimerService_IsActive(TIMER_LED_RETRY)) {
+            TimerService_Start(TIMER_LED_RETRY, LED_RETRY_US);
+        }
+    }
+    xSemaphoreGive(led_commit_mutex);
+}
+
+void LED_GetStats(led_stats_t *stats)
+{
+    xSemaphoreTake(led_commit_mutex, portMAX_DELAY);
+    *stats = led_stats;
+    xSemaphoreGive(led_commit_mutex);
+}
+
+// 重新设置效果定时器到最早的熄灭时间；整个过程持有提交锁，避免两个调用者交错设置定时器
+static void LED_ArmEffectTimer(void)
+{
+    int64_t next = 0;
+    xSemaphoreTake(led_commit_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&led_lock);
+    for (uint8_t i = 0; i < LED_NUMBERS; i++) {
+        if (led_off_at_us[i] && (next == 0 || led_off_at_us[i] < next)) {
+            next = led_off_at_us[i];
+        }
+    }
+    taskEXIT_CRITICAL(&led_lock);
+
+    if (next) {
+        int64_t delay = next - esp_timer_get_time();
+        TimerService_Start(TIMER_LED_EFFECT, delay > 0 ? delay : 1);
+    } else {
+        TimerService_Stop(TIMER_LED_EFFECT);
+    }
+    xSemaphoreGive(led_commit_mutex);
+}
+
+static void LED_EffectTimerCallback(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&led_lock);
+    for (uint8_t i = 0; i < LED_NUMBERS; i++) {
+        if (led_off_at_us[i] && led_off_at_us[i] <= now) {
+            led_off_at_us[i] = 0;
+            LED_WritePixelLocked(i, 0, 0, 0);
+        }
+    }
+    taskEXIT_CRITICAL(&led_lock);
+
+    LED_Commit();
+    LED_ArmEffectTimer();
+}
+
+static void LED_RetryTimerCallback(void *arg)
+{
+    LED_Commit();
+}
+
+void LED_FlashKey(uint8_t led_num, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness, uint16_t duration_ms)
+{
+    if (led_num >= LED_NUMBERS) return;
+
+    LED_SetPixel(led_num, red, green, blue, brightness);
+    taskENTER_CRITICAL(&led_lock);
+    led_off_at_us[led_num] = esp_timer_get_time() + (int64_t)duration_ms * 1000;
+    taskEXIT_CRITICAL(&led_lock);
+
+    LED_Commit();
+    LED_ArmEffectTimer();
+}
+
 void LED_RMT_Init(void)
 {
-    rmt_tx_channel_config_t tx_chan_config = {
-        .clk_src           = RMT_CLK_SRC_DEFAULT,    // 选择时钟源
-        .gpio_num          = RMT_LED_STRIP_GPIO_NUM, // GPIO引脚设置
-        .mem_block_symbols = 64,                     // increase the block size can make the LED less flickering
-        .resolution_hz     = RMT_LED_STRIP_RESOLUTION_HZ,
-        .trans_queue_depth = 4, // set the number of transactions that can be pending in the background
-    };
-    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &led_chan));
-
-    led_strip_encoder_config_t encoder_config = {
-        .resolution = RMT_LED_STRIP_RESOLUTION_HZ,
-    };
-    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &led_encoder));
-
-    ESP_ERROR_CHECK(rmt_enable(led_chan));
+    led_commit_mutex = xSemaphoreCreateMutex();
+
+    TimerService_BindCallback(TIMER_LED_EFFECT, LED_EffectTimerCallback, NULL);
+    TimerService_BindCallback(TIMER_LED_RETRY, LED_RetryTimerCallback, NULL);
+
+#if CONFIG_IDF_TARGET_LINUX
+    led_backend = &led_backend_sim;
+#else
+    led_backend = &led_backend_rmt;
+#endif
+    led_backend->init();
 }
 
-// LED 背景灯
+// LED 背景灯：一次修改全部像素，只发送一帧
 void LED_Background_Light(uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness)
 {
-    for (uint8_t i = 1; i <= 12; i++) {
-        LED_Keyoard_Light(i, red, green, blue, brightness, 0);
-    }
+    LED_SetRange(0, LED_NUMBERS, red, green, blue, brightness);
+    LED_Commit();
 }
 
 /**
@@ -240,42 +245,21 @@ void LED_Background_Light(uint8_t red, uint8_t green, uint8_t blue, uint8_t brig
  *
  * 该函数用于设置指定编号的 LED 的 RGB 颜色，并通过 RMT 发送数据点亮 LED。
  * 支持亮度调节功能，通过比例缩放 RGB 值实现。
+ * 函数不会阻塞：delay_ms 大于 0 时由定时器在到期后熄灭该 LED。
  *
  * @param led_num      要设置的 LED 编号 (0 到 LED_NUMBERS - 1)
  * @param red          红色分量 (0 到 255)
  * @param green        绿色分量 (0 到 255)
  * @param blue         蓝色分量 (0 到 255)
  * @param brightness   亮度百分比 (0 到 100)，0 表示熄灭，100 表示原始颜色亮度
- * @param delay_ms     延迟时间，单位毫秒
+ * @param delay_ms     点亮时长，单位毫秒，0 表示常亮
  */
 void LED_Keyoard_Light(uint8_t led_num, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness, uint16_t delay_ms)
 {
-    // 根据亮度调整 RGB 值
-    if (brightness > 100) {
-        brightness = 100;
-    }
-
-    uint8_t adjusted_red   = (uint32_t)red * brightness / 100;
-    uint8_t adjusted_green = (uint32_t)green * brightness / 100;
-    uint8_t adjusted_blue  = (uint32_t)blue * brightness / 100;
-
-    // 设置像素值到对应 LED
-    led_strip_pixels[led_num * 3 + 0] = adjusted_green; // Green 分量放在第一位
-    led_strip_pixels[led_num * 3 + 1] = adjusted_blue;  // Blue 分量放在第二位
-    led_strip_pixels[led_num * 3 + 2] = adjusted_red;   // Red 分量放在第三位
-
-    // 发送数据到 LED
-    ESP_ERROR_CHECK(rmt_transmit(led_chan, led_encoder, led_strip_pixels, sizeof(led_strip_pixels), &tx_config));
-    ESP_ERROR_CHECK(rmt_tx_wait_all_done(led_chan, portMAX_DELAY));
-
     if (delay_ms > 0) {
-        DelayMs(delay_ms); // 等待一段时间
-
-        // 清空像素数组，熄灭 LED
-        memset(led_strip_pixels, 0, sizeof(led_strip_pixels));
-
-        // 再次发送清零数据，确保 LED 熄灭
-        ESP_ERROR_CHECK(rmt_transmit(led_chan, led_encoder, led_strip_pixels, sizeof(led_strip_pixels), &tx_config));
-        ESP_ERROR_CHECK(rmt_tx_wait_all_done(led_chan, portMAX_DELAY));
+        LED_FlashKey(led_num, red, green, blue, brightness, delay_ms);
+    } else {
+        LED_SetPixel(led_num, red, green, blue, brightness);
+        LED_Commit();
     }
-}
\ No newline at end of file
+}
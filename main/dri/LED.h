@@ -1,6 +1,52 @@
 #pragma once
 #include "utils.h"
 
+// 共12个LED灯。
+#define LED_NUMBERS 12
+// 每个灯 G、R、B 三个字节
+#define LED_FRAME_BYTES (LED_NUMBERS * 3)
+
+/**
+ * @brief LED 后端：负责把一帧像素发送到灯带
+ *
+ * init     初始化外设
+ * transmit 非阻塞发送一帧，后端内部拷贝数据；返回 0 已提交，1 后端忙（双缓冲都在发送中）
+ */
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    uint8_t (*transmit)(const uint8_t *frame, size_t len);
+} led_backend_t;
+
+// RMT + WS2812 编码器
+extern const led_backend_t led_backend_rmt;
+
+#if CONFIG_IDF_TARGET_LINUX
+// 主机仿真的灯带
+extern const led_backend_t led_backend_sim;
+// 打印最近一次发送的帧
+void LED_SimDump(void);
+#endif
+
 void LED_RMT_Init(void);
+
+// 帧缓冲操作：只修改内存中的像素，LED_Commit() 时才发送
+void LED_SetPixel(uint8_t led_num, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness);
+void LED_SetRange(uint8_t first, uint8_t count, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness);
+void LED_Clear(void);
+// 提交帧缓冲：帧没有变化时直接返回，不会阻塞调用者
+void LED_Commit(void);
+
+// 点亮一个灯 duration_ms 毫秒后由定时器自动熄灭，调用者不会被阻塞
+void LED_FlashKey(uint8_t led_num, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness, uint16_t duration_ms);
+
+// 提交统计
+typedef struct {
+    uint32_t commits; // 实际发送的帧数
+    uint32_t skipped; // 帧没有变化而跳过的提交数
+    uint32_t retries; // 后端忙而延后的提交数
+} led_stats_t;
+void LED_GetStats(led_stats_t *stats);
+
 void LED_Keyoard_Light(uint8_t led_num, uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness, uint16_t delay_ms);
-void LED_Background_Light(uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness);
\ No newline at end of file
+void LED_Background_Light(uint8_t red, uint8_t green, uint8_t blue, uint8_t brightness);
@@ -0,0 +1,234 @@
+#include "LED.h"
+#include <inttypes.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+/// ESP32 错误处理的API
+#include "esp_check.h"
+/// RMT编码器相关API
+#include "driver/rmt_encoder.h"
+/// RMT发送数据的API
+#include "driver/rmt_tx.h"
+
+// 10MHz的分辨率，1 tick = 0.1us，LED条带需要高分辨率。
+#define RMT_LED_STRIP_RESOLUTION_HZ 10000000
+// 只需要一个引脚，引脚号为6。
+#define RMT_LED_STRIP_GPIO_NUM GPIO_NUM_6
+
+// 发送缓冲个数：一个在发送时另一个可以准备下一帧
+#define LED_TX_BUFFERS 2
+
+// LED编码器配置结构体，主要配置编码器的频率。
+typedef struct
+{
+    uint32_t resolution;
+} led_strip_encoder_config_t;
+
+// 编码器结构体
+typedef struct
+{
+    rmt_encoder_t base;
+    rmt_encoder_t *bytes_encoder;
+    rmt_encoder_t *copy_encoder;
+    int state;
+    rmt_symbol_word_t reset_code;
+} rmt_led_strip_encoder_t;
+
+// 日志前缀
+static const char *TAG = "LED ENCODER";
+
+// 发送缓冲：rmt_transmit 在后台读取数据，发送完成前缓冲不能被改写
+static uint8_t led_tx_buffers[LED_TX_BUFFERS][LED_FRAME_BYTES];
+// 下一个使用的发送缓冲
+static uint8_t led_tx_next = 0;
+// 正在发送中的帧数，在发送完成回调（ISR）中递减
+static volatile uint8_t led_tx_inflight = 0;
+static portMUX_TYPE led_tx_lock         = portMUX_INITIALIZER_UNLOCKED;
+
+// LED通道
+rmt_channel_handle_t led_chan = NULL;
+// LED编码器
+rmt_encoder_handle_t led_encoder = NULL;
+// 发送配置，不进行循环发送；队列满时不阻塞调用者
+rmt_transmit_config_t tx_config = {
+    .loop_count              = 0,
+    .flags.queue_nonblocking = 1,
+};
+
+size_t rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_encoder_handle_t bytes_encoder   = led_encoder->bytes_encoder;
+    rmt_encoder_handle_t copy_encoder    = led_encoder->copy_encoder;
+    rmt_encode_state_t session_state     = RMT_ENCODING_RESET;
+    rmt_encode_state_t state             = RMT_ENCODING_RESET;
+    size_t encoded_symbols               = 0;
+    switch (led_encoder->state) {
+        case 0: // send RGB data
+            encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, primary_data, data_size, &session_state);
+            if (session_state & RMT_ENCODING_COMPLETE) {
+                led_encoder->state = 1; // switch to next state when current encoding session finished
+            }
+            if (session_state & RMT_ENCODING_MEM_FULL) {
+                state |= RMT_ENCODING_MEM_FULL;
+                goto out; // yield if there's no free space for encoding artifacts
+            }
+        // fall-through
+        case 1: // send reset code
+            encoded_symbols += copy_encoder->encode(copy_encoder, channel, &led_encoder->reset_code,
+                                                    sizeof(led_encoder->reset_code), &session_state);
+            if (session_state & RMT_ENCODING_COMPLETE) {
+                led_encoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
+                state |= RMT_ENCODING_COMPLETE;
+            }
+            if (session_state & RMT_ENCODING_MEM_FULL) {
+                state |= RMT_ENCODING_MEM_FULL;
+                goto out; // yield if there's no free space for encoding artifacts
+            }
+    }
+out:
+    *ret_state = state;
+    return encoded_symbols;
+}
+
+esp_err_t rmt_del_led_strip_encoder(rmt_encoder_t *encoder)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_del_encoder(led_encoder->bytes_encoder);
+    rmt_del_encoder(led_encoder->copy_encoder);
+    free(led_encoder);
+    return ESP_OK;
+}
+
+esp_err_t rmt_led_strip_encoder_reset(rmt_encoder_t *encoder)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_encoder_reset(led_encoder->bytes_encoder);
+    rmt_encoder_reset(led_encoder->copy_encoder);
+    led_encoder->state = RMT_ENCODING_RESET;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret                        = ESP_OK;
+    rmt_led_strip_encoder_t *led_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    led_encoder = calloc(1, sizeof(rmt_led_strip_encoder_t));
+    ESP_GOTO_ON_FALSE(led_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for led strip encoder");
+    led_encoder->base.encode = rmt_encode_led_strip;
+    led_encoder->base.del    = rmt_del_led_strip_encoder;
+    led_encoder->base.reset  = rmt_led_strip_encoder_reset;
+    // different led strip might have its own timing requirements, following parameter is for WS2812
+    rmt_bytes_encoder_config_t bytes_encoder_config = {
+        .bit0 = {
+            .level0    = 1,
+            .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
+            .level1    = 0,
+            .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
+        },
+        .bit1 = {
+            .level0    = 1,
+            .duration0 = 0.9 * config->resolution / 1000000, // T1H=0.9us
+            .level1    = 0,
+            .duration1 = 0.3 * config->resolution / 1000000, // T1L=0.3us
+        },
+        .flags.msb_first = 1 // WS2812 transfer bit order: G7...G0R7...R0B7...B0
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+
+    uint32_t reset_ticks    = config->resolution / 1000000 * 50 / 2; // reset code duration defaults to 50us
+    led_encoder->reset_code = (rmt_symbol_word_t){
+        .level0    = 0,
+        .duration0 = reset_ticks,
+        .level1    = 0,
+        .duration1 = reset_ticks,
+    };
+    *ret_encoder = &led_encoder->base;
+    return ESP_OK;
+err:
+    if (led_encoder) {
+        if (led_encoder->bytes_encoder) {
+            rmt_del_encoder(led_encoder->bytes_encoder);
+        }
+        if (led_encoder->copy_encoder) {
+            rmt_del_encoder(led_encoder->copy_encoder);
+        }
+        free(led_encoder);
+    }
+    return ret;
+}
+
+// 一帧发送完成（ISR 上下文）
+static bool IRAM_ATTR LED_TxDoneCallback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    portENTER_CRITICAL_ISR(&led_tx_lock);
+    if (led_tx_inflight > 0) {
+        led_tx_inflight--;
+    }
+    portEXIT_CRITICAL_ISR(&led_tx_lock);
+    return false;
+}
+
+static void LED_RmtInit(void)
+{
+    rmt_tx_channel_config_t tx_chan_config = {
+        .clk_src           = RMT_CLK_SRC_DEFAULT,    // 选择时钟源
+        .gpio_num          = RMT_LED_STRIP_GPIO_NUM, // GPIO引脚设置
+        .mem_block_symbols = 64,                     // increase the block size can make the LED less flickering
+        .resolution_hz     = RMT_LED_STRIP_RESOLUTION_HZ,
+        .trans_queue_depth = 4, // set the number of transactions that can be pending in the background
+    };
+    ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_chan_config, &led_chan));
+
+    led_strip_encoder_config_t encoder_config = {
+        .resolution = RMT_LED_STRIP_RESOLUTION_HZ,
+    };
+    ESP_ERROR_CHECK(rmt_new_led_strip_encoder(&encoder_config, &led_encoder));
+
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = LED_TxDoneCallback,
+    };
+    ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(led_chan, &cbs, NULL));
+
+    ESP_ERROR_CHECK(rmt_enable(led_chan));
+}
+
+/**
+ * @brief 非阻塞发送一帧
+ *
+ * 按顺序轮流使用两个发送缓冲。发送按提交顺序完成，所以只要在途帧数小于缓冲个数，
+ * 下一个缓冲一定已经发送完毕，可以安全改写。调用者（LED_Commit）已经串行化。
+ */
+static uint8_t LED_RmtTransmit(const uint8_t *frame, size_t len)
+{
+    taskENTER_CRITICAL(&led_tx_lock);
+    if (led_tx_inflight >= LED_TX_BUFFERS) {
+        taskEXIT_CRITICAL(&led_tx_lock);
+        return 1;
+    }
+    led_tx_inflight++;
+    taskEXIT_CRITICAL(&led_tx_lock);
+
+    uint8_t *buffer = led_tx_buffers[led_tx_next];
+    memcpy(buffer, frame, len);
+
+    if (rmt_transmit(led_chan, led_encoder, buffer, len, &tx_config) != ESP_OK) {
+        taskENTER_CRITICAL(&led_tx_lock);
+        led_tx_inflight--;
+        taskEXIT_CRITICAL(&led_tx_lock);
+        ESP_LOGW(TAG, "rmt transmit failed");
+        return 1;
+    }
+    // 只有提交成功才轮换缓冲，保证缓冲顺序与发送完成顺序一致
+    led_tx_next = (led_tx_next + 1) % LED_TX_BUFFERS;
+    return 0;
+}
+
+const led_backend_t led_backend_rmt = {
+    .name     = "rmt",
+    .init     = LED_RmtInit,
+    .transmit = LED_RmtTransmit,
+};
@@ -1,39 +1,138 @@
-#include "motor.h"
+#include "Motor.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_log.h"
 #include "utils.h"
+#include <inttypes.h>
+#include "trace.h"
+#include "timer_service.h"
+#include "boot.h"
+
+#define MOTOR_PIN_A GPIO_NUM_4
+#define MOTOR_PIN_B GPIO_NUM_5
+
+static const char *TAG = "motor";
+
+// 每个阶段两个引脚的电平和持续时间
+typedef struct {
+    uint8_t level_a;
+    uint8_t level_b;
+    uint32_t duration_ms;
+} motor_phase_desc_t;
+
+static const motor_phase_desc_t motor_phases[] = {
+    [MOTOR_PHASE_IDLE]    = {1, 1, 0},    // 停止
+    [MOTOR_PHASE_FORWARD] = {1, 0, 2000}, // 正转2s
+    [MOTOR_PHASE_HOLD]    = {1, 1, 2000}, // 停止2s
+    [MOTOR_PHASE_REVERSE] = {0, 1, 2000}, // 反转2s
+};
+
+typedef struct {
+    motor_done_cb_t cb;
+    void *arg;
+} motor_waiter_t;
+
+static portMUX_TYPE motor_lock            = portMUX_INITIALIZER_UNLOCKED;
+static volatile motor_phase_t motor_phase = MOTOR_PHASE_IDLE;
+static motor_waiter_t motor_waiters[MOTOR_MAX_WAITERS];
+static uint8_t motor_waiter_count = 0;
+// 本次开锁流程开始的时间，用于打印各阶段的时间点
+static int64_t motor_cycle_start = 0;
+
+static void Motor_ApplyPhase(motor_phase_t phase)
+{
+    gpio_set_level(MOTOR_PIN_A, motor_phases[phase].level_a);
+    gpio_set_level(MOTOR_PIN_B, motor_phases[phase].level_b);
+    if (motor_phases[phase].duration_ms > 0) {
+        TimerService_Start(TIMER_MOTOR_PHASE, (uint64_t)motor_phases[phase].duration_ms * 1000);
+    }
+    ESP_LOGD(TAG, "phase %d at +%" PRId64 " ms", phase, (esp_timer_get_time() - motor_cycle_start) / 1000);
+}
+
+// 阶段定时到期：进入下一阶段，最后一个阶段结束后通知所有等待者
+static void Motor_TimerCallback(void *arg)
+{
+    motor_waiter_t waiters[MOTOR_MAX_WAITERS];
+    uint8_t count = 0;
+
+    taskENTER_CRITICAL(&motor_lock);
+    motor_phase_t next = motor_phase + 1;
+    if (next > MOTOR_PHASE_REVERSE) {
+        next  = MOTOR_PHASE_IDLE;
+        count = motor_waiter_count;
+        memcpy(waiters, motor_waiters, count * sizeof(motor_waiter_t));
+        motor_waiter_count = 0;
+    }
+    motor_phase = next;
+    taskEXIT_CRITICAL(&motor_lock);
+
+    Motor_ApplyPhase(next);
+
+    if (next == MOTOR_PHASE_IDLE) {
+        ESP_LOGI(TAG, "unlock cycle done in %" PRId64 " ms", (esp_timer_get_time() - motor_cycle_start) / 1000);
+        for (uint8_t i = 0; i < count; i++) {
+            waiters[i].cb(waiters[i].arg);
+        }
+    }
+}
 
 void Motor_Init(void)
 {
     gpio_config_t io_conf = {};
     io_conf.mode = GPIO_MODE_OUTPUT;
     io_conf.intr_type = GPIO_INTR_DISABLE;
-    io_conf.pin_bit_mask = (1ULL << 4) | (1ULL << 5);
+    io_conf.pin_bit_mask = (1ULL << MOTOR_PIN_A) | (1ULL << MOTOR_PIN_B);
     gpio_config(&io_conf);
 
+    TimerService_BindCallback(TIMER_MOTOR_PHASE, Motor_TimerCallback, NULL);
+
     // 将4和5引脚拉高
-    gpio_set_level(4, 1);
-    gpio_set_level(5, 1);
+    Motor_ApplyPhase(MOTOR_PHASE_IDLE);
     DelayMs(10);
 }
+
+uint8_t Motor_OpenLockAsync(motor_done_cb_t cb, void *arg)
+{
+    uint8_t ret = 0;
+
+    taskENTER_CRITICAL(&motor_lock);
+    uint8_t start = motor_phase == MOTOR_PHASE_IDLE;
+    if (start) {
+        motor_phase       = MOTOR_PHASE_FORWARD;
+        motor_cycle_start = esp_timer_get_time();
+    } else {
+        ret = 1;
+    }
+    if (cb) {
+        if (motor_waiter_count < MOTOR_MAX_WAITERS) {
+            motor_waiters[motor_waiter_count++] = (motor_waiter_t){cb, arg};
+        } else {
+            ret = 2;
+        }
+    }
+    taskEXIT_CRITICAL(&motor_lock);
+
+    TRACE(TRACE_MOTOR_START, !start);
+    if (start) {
+        Boot_RecordUnlock();
+        Motor_ApplyPhase(MOTOR_PHASE_FORWARD);
+    } else {
+        ESP_LOGI(TAG, "unlock already in progress, request merged");
+    }
+    return ret;
+}
+
 void Motor_OpenLock(void)
 {
-    // 正转2s
-    gpio_set_level(4, 1);
-    gpio_set_level(5, 0);
-    DelayMs(2000);
-
-    // 停止2s
-    gpio_set_level(4, 1);
-    gpio_set_level(5, 1);
-    DelayMs(2000);
-
-    // 反转2s
-    gpio_set_level(4, 0);
-    gpio_set_level(5, 1);
-    DelayMs(2000);
-
-    // 停止
-    gpio_set_level(4, 1);
-    gpio_set_level(5, 1);
-    DelayMs(10);
-}
\ No newline at end of file
+    Motor_OpenLockAsync(NULL, NULL);
+}
+
+motor_phase_t Motor_GetPhase(void)
+{
+    return motor_phase;
+}
+
+uint32_t Motor_PhaseDurationMs(motor_phase_t phase)
+{
+    return phase <= MOTOR_PHASE_REVERSE ? motor_phases[phase].duration_ms : 0;
+}
@@ -1,4 +1,31 @@
 #pragma once
+#include <stdint.h>
+
+// 同一个开锁流程上最多挂几个完成回调
+#define MOTOR_MAX_WAITERS 4
+
+// 开锁流程的阶段：正转 -> 停止 -> 反转 -> 空闲
+typedef enum {
+    MOTOR_PHASE_IDLE = 0,
+    MOTOR_PHASE_FORWARD,
+    MOTOR_PHASE_HOLD,
+    MOTOR_PHASE_REVERSE,
+} motor_phase_t;
+
+// 开锁流程结束的回调，在定时器任务中调用，不能阻塞
+typedef void (*motor_done_cb_t)(void *arg);
 
 void Motor_Init(void);
-void Motor_OpenLock(void);
\ No newline at end of file
+// 非阻塞：请求一次开锁后立即返回
+void Motor_OpenLock(void);
+/**
+ * @brief 请求一次开锁，流程结束时调用 cb(arg)
+ *
+ * 开锁流程进行中时，新的请求不会重新开始流程，只把回调挂到当前流程上。
+ *
+ * @return 0: 已开始新的开锁流程  1: 与进行中的流程合并  2: 回调队列已满（请求仍被合并，但不会回调）
+ */
+uint8_t Motor_OpenLockAsync(motor_done_cb_t cb, void *arg);
+motor_phase_t Motor_GetPhase(void);
+// 阶段表中这个阶段的持续时间，空闲为 0
+uint32_t Motor_PhaseDurationMs(motor_phase_t phase);
@@ -0,0 +1,297 @@
+#include "ble_adv.h"
+#include "ble_bond.h"
+#include "bluetooth.h"
+#include "timer_service.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <inttypes.h>
+
+static const char *TAG = "ble_adv";
+
+// 广播间隔单位 0.625 ms
+#define BLE_ADV_BURST_MIN 0x20 // 20 ms
+#define BLE_ADV_BURST_MAX 0x30 // 30 ms
+#define BLE_ADV_SLOW      (CONFIG_BLE_ADV_SLOW_INTERVAL_MS * 8 / 5)
+#define BLE_ADV_BURST_US  ((uint64_t)CONFIG_BLE_ADV_BURST_MS * 1000)
+
+// 高占空比定向广播最长 1.28 s（规范限制），之后换下一部手机
+#define BLE_ADV_DIRECTED_US 1280000
+
+// 一次广播事件在 3 个信道上发送并等待扫描请求的射频时间；每次广播还有 0~10 ms 的随机延迟
+#define BLE_ADV_EVENT_US 1800
+#define BLE_ADV_DELAY_US 5000
+// 高占空比定向广播不超过 3.75 ms 一次，没有随机延迟
+#define BLE_ADV_DIRECTED_PERIOD_US 3750
+
+static portMUX_TYPE ble_adv_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static ble_adv_state_t ble_adv_state = BLE_ADV_OFF;
+static int64_t ble_adv_since_us      = 0; // 当前状态开始的时间
+static int64_t ble_adv_trigger_us    = 0; // 最近一次触发或开始广播的时间
+static uint8_t ble_adv_target        = 0; // 正在定向广播的是第几部手机
+static uint8_t ble_adv_bonded_only   = 0; // 突发广播是否只接受已绑定的手机
+static uint64_t ble_adv_time_us[BLE_ADV_STATES];
+static uint64_t ble_adv_radio_us         = 0;
+static uint64_t ble_adv_connect_total_ms = 0;
+static ble_adv_report_t ble_adv_stats;
+
+// 最近一次连接：连上时的状态，等第一条命令算靠近到开锁时间
+static ble_adv_state_t ble_adv_path = BLE_ADV_OFF;
+static uint8_t ble_adv_awaiting     = 0;
+static uint64_t ble_adv_path_connect_total_ms[BLE_ADV_STATES];
+static uint64_t ble_adv_path_approach_total_ms[BLE_ADV_STATES];
+static uint32_t ble_adv_path_approaches[BLE_ADV_STATES];
+
+static uint16_t BleAdv_StateInterval(ble_adv_state_t state)
+{
+    if (state == BLE_ADV_BURST) return BLE_ADV_BURST_MAX;
+    if (state == BLE_ADV_SLOW) return BLE_ADV_SLOW;
+    return 0;
+}
+
+// 两次广播事件之间的平均时间，不广播时为 0
+static uint32_t BleAdv_StatePeriodUs(ble_adv_state_t state)
+{
+    if (state == BLE_ADV_DIRECTED) return BLE_ADV_DIRECTED_PERIOD_US;
+    uint16_t interval = BleAdv_StateInterval(state);
+    return interval ? (uint32_t)interval * 625 + BLE_ADV_DELAY_US : 0;
+}
+
+// 离开当前状态：计入时间和估算的射频时间，调用前持有 ble_adv_lock
+static void BleAdv_Enter(ble_adv_state_t state, int64_t now)
+{
+    uint64_t elapsed = now - ble_adv_since_us;
+    uint32_t period  = BleAdv_StatePeriodUs(ble_adv_state);
+    ble_adv_time_us[ble_adv_state] += elapsed;
+    if (period) {
+        ble_adv_radio_us += elapsed * BLE_ADV_EVENT_US / period;
+    }
+    ble_adv_state    = state;
+    ble_adv_since_us = now;
+}
+
+/*
+ * 开始 state 对应的广播，不持有 ble_adv_lock 时调用。
+ * 定向广播之后的突发只接受已绑定的手机：这时门口的人已经有机会用绑定的手机回连，
+ * 不让路过的手机的扫描请求和连接占用门锁。
+ */
+static void BleAdv_Apply(ble_adv_state_t state, const ble_bond_peer_t *target)
+{
+    if (state == BLE_ADV_DIRECTED) {
+        Bluetooth_StartDirectedAdvertising(target);
+    } else if (state == BLE_ADV_BURST) {
+        Bluetooth_StartAdvertising(BLE_ADV_BURST_MIN, BLE_ADV_BURST_MAX, ble_adv_bonded_only);
+    } else if (state == BLE_ADV_SLOW) {
+        Bluetooth_StartAdvertising(BLE_ADV_SLOW, BLE_ADV_SLOW, 0);
+    }
+}
+
+// 定向广播换下一部手机，或者突发广播结束
+static void BleAdv_TimerCallback(void *arg)
+{
+    ble_bond_peer_t peer;
+    ble_adv_state_t next = BLE_ADV_OFF;
+
+    taskENTER_CRITICAL(&ble_adv_lock);
+    uint8_t target = ble_adv_target + 1;
+    taskEXIT_CRITICAL(&ble_adv_lock);
+    uint8_t more = target < BLE_ADV_DIRECTED_TARGETS && BleBond_Get(target, &peer);
+
+    taskENTER_CRITICAL(&ble_adv_lock);
+    if (ble_adv_state == BLE_ADV_DIRECTED) {
+        if (more) {
+            ble_adv_target = target;
+            next           = BLE_ADV_DIRECTED;
+            ble_adv_stats.directed++;
+        } else {
+            BleAdv_Enter(BLE_ADV_BURST, esp_timer_get_time());
+            ble_adv_stats.bursts++;
+            ble_adv_bonded_only = 1;
+            next                = BLE_ADV_BURST;
+        }
+    } else if (ble_adv_state == BLE_ADV_BURST) {
+        BleAdv_Enter(BLE_ADV_SLOW, esp_timer_get_time());
+        next = BLE_ADV_SLOW;
+    }
+    taskEXIT_CRITICAL(&ble_adv_lock);
+
+    BleAdv_Apply(next, &peer);
+    if (next == BLE_ADV_DIRECTED) {
+        TimerService_Start(TIMER_BLE_ADV, BLE_ADV_DIRECTED_US);
+    } else if (next == BLE_ADV_BURST) {
+        TimerService_Start(TIMER_BLE_ADV, BLE_ADV_BURST_US);
+    }
+}
+
+// 进入（或延长）突发广播
+static void BleAdv_Burst(uint8_t from_off)
+{
+    int64_t now   = esp_timer_get_time();
+    uint8_t start = 0;
+
+    taskENTER_CRITICAL(&ble_adv_lock);
+    if (ble_adv_state == BLE_ADV_SLOW || (from_off && ble_adv_state != BLE_ADV_BURST && ble_adv_state != BLE_ADV_DIRECTED)) {
+        BleAdv_Enter(BLE_ADV_BURST, now);
+        ble_adv_stats.bursts++;
+        ble_adv_bonded_only = 0;
+        start               = 1;
+    }
+    if (ble_adv_state == BLE_ADV_BURST) {
+        ble_adv_trigger_us = now;
+    }
+    uint8_t bursting = ble_adv_state == BLE_ADV_BURST;
+    taskEXIT_CRITICAL(&ble_adv_lock);
+
+    if (start) {
+        BleAdv_Apply(BLE_ADV_BURST, NULL);
+    }
+    if (bursting) {
+        TimerService_Start(TIMER_BLE_ADV, BLE_ADV_BURST_US);
+    }
+}
+
+// 从最近使用的手机开始定向广播，正在定向广播时不打断；没有绑定的手机时返回 0
+static uint8_t BleAdv_Directed(void)
+{
+    int64_t now = esp_timer_get_time();
+    ble_bond_peer_t peer;
+    uint8_t start = 0;
+
+    if (!BleBond_Get(0, &peer)) return 0;
+
+    taskENTER_CRITICAL(&ble_adv_lock);
+    if (ble_adv_state == BLE_ADV_BURST || ble_adv_state == BLE_ADV_SLOW) {
+        BleAdv_Enter(BLE_ADV_DIRECTED, now);
+        ble_adv_target = 0;
+        ble_adv_stats.directed++;
+        start = 1;
+    }
+    if (ble_adv_state == BLE_ADV_DIRECTED) {
+        ble_adv_trigger_us = now;
+    }
+    taskEXIT_CRITICAL(&ble_adv_lock);
+
+    if (start) {
+        BleAdv_Apply(BLE_ADV_DIRECTED, &peer);
+        TimerService_Start(TIMER_BLE_ADV, BLE_ADV_DIRECTED_US);
+    }
+    return 1;
+}
+
+void BleAdv_Init(void)
+{
+    TimerService_BindCallback(TIMER_BLE_ADV, BleAdv_TimerCallback, NULL);
+}
+
+void BleAdv_Ready(void)
+{
+    ESP_LOGI(TAG, "advertising ready, burst %d ms, slow interval %d ms, %u bonded devices",
+             CONFIG_BLE_ADV_BURST_MS, CONFIG_BLE_ADV_SLOW_INTERVAL_MS, BleBond_Count());
+    BleAdv_Burst(1);
+}
+
+void BleAdv_Activity(ble_adv_trigger_t trigger)
+{
+    // 已连接或者广播还没准备好时忽略
+    ESP_LOGD(TAG, "activity %d", trigger);
+    if (trigger == BLE_ADV_TRIGGER_DISCONNECT || !BleAdv_Directed()) {
+        BleAdv_Burst(0);
+    }
+}
+
+void BleAdv_Connected(uint8_t full)
+{
+    int64_t now           = esp_timer_get_time();
+    uint8_t restart_burst = 0;
+    ble_adv_state_t path  = BLE_ADV_OFF;
+    uint32_t ms           = 0;
+
+    taskENTER_CRITICAL(&ble_adv_lock);
+    if (ble_adv_state == BLE_ADV_DIRECTED || ble_adv_state == BLE_ADV_BURST || ble_adv_state == BLE_ADV_SLOW) {
+        ms   = (now - ble_adv_trigger_us) / 1000;
+        path = ble_adv_state;
+        ble_adv_stats.connects++;
+        ble_adv_stats.path_connects[ble_adv_state]++;
+        ble_adv_stats.last_connect_ms = ms;
+        ble_adv_connect_total_ms += ms;
+        ble_adv_path_connect_total_ms[ble_adv_state] += ms;
+        if (ms > ble_adv_stats.max_connect_ms) {
+            ble_adv_stats.max_connect_ms = ms;
+        }
+        ble_adv_path     = ble_adv_state;
+        ble_adv_awaiting = 1;
+    }
+    if (full) {
+        BleAdv_Enter(BLE_ADV_CONNECTED, now);
+    } else if (ble_adv_state == BLE_ADV_DIRECTED) {
+        // 定向广播的手机已经连上，剩下的手机用突发广播
+        BleAdv_Enter(BLE_ADV_BURST, now);
+        ble_adv_stats.bursts++;
+        restart_burst = 1;
+    }
+    ble_adv_state_t state = ble_adv_state;
+    taskEXIT_CRITICAL(&ble_adv_lock);
+
+    if (path != BLE_ADV_OFF) {
+        ESP_LOGI(TAG, "connected in %" PRIu32 " ms (%s)", ms, BleAdv_StateName(path));
+    }
+
+    // 可连接广播在连上时由控制器停止；没到连接上限时按原来的状态重新开始，别的手机还能连
+    if (full) {
+        TimerService_Stop(TIMER_BLE_ADV);
+        return;
+    }
+    BleAdv_Apply(state, NULL);
+    if (restart_burst) {
+        TimerService_Start(TIMER_BLE_ADV, BLE_ADV_BURST_US);
+    }
+}
+
+void BleAdv_Disconnected(void)
+{
+    BleAdv_Burst(1);
+}
+
+void BleAdv_FirstCommand(uint32_t since_connect_ms)
+{
+    taskENTER_CRITICAL(&ble_adv_lock);
+    if (ble_adv_awaiting) {
+        uint32_t ms                    = ble_adv_stats.last_connect_ms + since_connect_ms;
+        ble_adv_awaiting               = 0;
+        ble_adv_stats.last_approach_ms = ms;
+        ble_adv_path_approach_total_ms[ble_adv_path] += ms;
+        ble_adv_path_approaches[ble_adv_path]++;
+    }
+    taskEXIT_CRITICAL(&ble_adv_lock);
+}
+
+void BleAdv_GetReport(ble_adv_report_t *report)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&ble_adv_lock);
+    BleAdv_Enter(ble_adv_state, now);
+    *report       = ble_adv_stats;
+    report->state = ble_adv_state;
+    for (int i = 0; i < BLE_ADV_STATES; i++) {
+        report->time_ms[i]          = ble_adv_time_us[i] / 1000;
+        report->path_connect_ms[i]  = report->path_connects[i] ? ble_adv_path_connect_total_ms[i] / report->path_connects[i] : 0;
+        report->path_approach_ms[i] = ble_adv_path_approaches[i] ? ble_adv_path_approach_total_ms[i] / ble_adv_path_approaches[i] : 0;
+    }
+    uint64_t advertising_us = ble_adv_time_us[BLE_ADV_DIRECTED] + ble_adv_time_us[BLE_ADV_BURST] + ble_adv_time_us[BLE_ADV_SLOW];
+    report->duty_ppm        = advertising_us ? ble_adv_radio_us * 1000000 / advertising_us : 0;
+    report->avg_connect_ms  = ble_adv_stats.connects ? ble_adv_connect_total_ms / ble_adv_stats.connects : 0;
+    taskEXIT_CRITICAL(&ble_adv_lock);
+}
+
+const char *BleAdv_StateName(ble_adv_state_t state)
+{
+    static const char *names[BLE_ADV_STATES] = {"off", "connected", "directed", "burst", "slow"};
+    return state < BLE_ADV_STATES ? names[state] : "?";
+}
+
+uint16_t BleAdv_Interval(void)
+{
+    return BleAdv_StateInterval(ble_adv_state);
+}
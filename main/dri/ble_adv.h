@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * 广播调度：
+ *  - 定向：有已绑定的手机时，按键、触摸指纹后依次向最近使用的 BLE_ADV_DIRECTED_TARGETS 部手机
+ *    做高占空比定向广播（每部 1.28 s），主人的手机在后台自动回连，不用等普通广播
+ *  - 突发：上电、断开连接后（或者没有绑定的手机时按键、触摸指纹）以最短间隔广播 CONFIG_BLE_ADV_BURST_MS，
+ *    站在门口的手机能马上连上；紧接在定向广播之后的突发只接受白名单（已绑定）中的手机扫描和连接
+ *  - 慢速：其余时间以 CONFIG_BLE_ADV_SLOW_INTERVAL_MS 广播，手机在后台仍然能发现门锁，新手机也能在这时配对
+ *  - 连接数达到上限时不广播，没到上限时连上一部手机后继续原来的广播
+ * 统计各状态的时间、估算的广播占空比、从触发（或开始广播）到连上的时间，
+ * 以及按连上时的广播状态分开统计的“靠近到开锁”时间（触发到第一条命令）。
+ *
+ * 与协议栈无关：蓝牙后端（bluetooth.c / bluetooth_nimble.c / bluetooth_sim.c）实现 Bluetooth_StartAdvertising() / Bluetooth_StartDirectedAdvertising() /
+ * Bluetooth_StopAdvertising()，广播数据配置完成后调用 BleAdv_Ready()。
+ */
+
+#define BLE_ADV_DIRECTED_TARGETS 2
+
+typedef enum {
+    BLE_ADV_OFF = 0,   // 广播数据还没配置好
+    BLE_ADV_CONNECTED, // 连接数已满，不广播
+    BLE_ADV_DIRECTED,
+    BLE_ADV_BURST,
+    BLE_ADV_SLOW,
+    BLE_ADV_STATES,
+} ble_adv_state_t;
+
+typedef enum {
+    BLE_ADV_TRIGGER_BOOT = 0,
+    BLE_ADV_TRIGGER_KEYPAD,
+    BLE_ADV_TRIGGER_FINGER,
+    BLE_ADV_TRIGGER_DISCONNECT,
+} ble_adv_trigger_t;
+
+void BleAdv_Init(void);
+// 广播数据已配置，可以开始广播
+void BleAdv_Ready(void);
+// 本地有人操作（任务上下文调用，不能在中断中调用）：进入定向广播或突发广播
+void BleAdv_Activity(ble_adv_trigger_t trigger);
+// 连上一部手机，full 为 1 表示连接数已达到上限
+void BleAdv_Connected(uint8_t full);
+void BleAdv_Disconnected(void);
+// 连上后收到第一条命令（由 BleConn 调用），since_connect_ms 是从连上到这条命令的时间
+void BleAdv_FirstCommand(uint32_t since_connect_ms);
+
+typedef struct {
+    ble_adv_state_t state;
+    uint64_t time_ms[BLE_ADV_STATES]; // 各状态累计时间
+    uint32_t duty_ppm;                // 广播占空比（百万分之一，估算，不含已连接的时间）
+    uint32_t bursts;                  // 进入突发广播的次数
+    uint32_t directed;                // 开始定向广播的次数
+    uint32_t connects;
+    uint32_t last_connect_ms;         // 从最近的触发（或开始广播）到连上的时间
+    uint32_t avg_connect_ms;
+    uint32_t max_connect_ms;
+    uint32_t last_approach_ms;        // 从最近的触发到第一条命令的时间
+    // 按连上时的广播状态（定向 / 突发 / 慢速）分开统计
+    uint32_t path_connects[BLE_ADV_STATES];
+    uint32_t path_connect_ms[BLE_ADV_STATES];  // 平均连上时间
+    uint32_t path_approach_ms[BLE_ADV_STATES]; // 平均靠近到开锁时间
+} ble_adv_report_t;
+void BleAdv_GetReport(ble_adv_report_t *report);
+const char *BleAdv_StateName(ble_adv_state_t state);
+// 当前广播间隔（0.625 ms 单位），不广播或定向广播时为 0
+uint16_t BleAdv_Interval(void);
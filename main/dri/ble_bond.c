@@ -0,0 +1,181 @@
+#include "ble_bond.h"
+#include "freertos/FreeRTOS.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "ble_bond";
+
+#define BLE_BOND_NAMESPACE "ble_bond"
+#define BLE_BOND_KEY       "mru"
+#define BLE_BOND_MAGIC     0x31424c42 // "BLB1"
+
+typedef struct {
+    uint32_t magic;
+    uint8_t count;
+    ble_bond_peer_t peers[BLE_BOND_MAX];
+} ble_bond_record_t;
+
+static portMUX_TYPE ble_bond_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_bond_record_t ble_bond = {.magic = BLE_BOND_MAGIC};
+static nvs_handle_t ble_bond_nvs  = 0;
+
+static int BleBond_Find(const uint8_t bda[6])
+{
+    for (int i = 0; i < ble_bond.count; i++) {
+        if (!memcmp(ble_bond.peers[i].bda, bda, 6)) return i;
+    }
+    return -1;
+}
+
+// 去掉第 index 个，调用前持有 ble_bond_lock
+static void BleBond_RemoveAt(int index)
+{
+    memmove(&ble_bond.peers[index], &ble_bond.peers[index + 1], (ble_bond.count - index - 1) * sizeof(ble_bond_peer_t));
+    ble_bond.count--;
+}
+
+// 顺序变化不多（每次开锁最多一次），直接写整条记录
+static void BleBond_Store(void)
+{
+    ble_bond_record_t record;
+
+    taskENTER_CRITICAL(&ble_bond_lock);
+    record = ble_bond;
+    taskEXIT_CRITICAL(&ble_bond_lock);
+
+    if (ble_bond_nvs == 0) return;
+    esp_err_t err = nvs_set_blob(ble_bond_nvs, BLE_BOND_KEY, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = nvs_commit(ble_bond_nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "store bond order failed: %s", esp_err_to_name(err));
+    }
+}
+
+void BleBond_Init(void)
+{
+    ble_bond_record_t record;
+    size_t len = sizeof(record);
+
+    if (nvs_open(BLE_BOND_NAMESPACE, NVS_READWRITE, &ble_bond_nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "cannot open nvs, bond order not kept");
+        ble_bond_nvs = 0;
+        return;
+    }
+    if (nvs_get_blob(ble_bond_nvs, BLE_BOND_KEY, &record, &len) != ESP_OK || len != sizeof(record) ||
+        record.magic != BLE_BOND_MAGIC || record.count > BLE_BOND_MAX) {
+        ESP_LOGI(TAG, "no bonded devices");
+        return;
+    }
+    taskENTER_CRITICAL(&ble_bond_lock);
+    ble_bond = record;
+    taskEXIT_CRITICAL(&ble_bond_lock);
+    ESP_LOGI(TAG, "%u bonded devices", record.count);
+}
+
+void BleBond_Sync(const ble_bond_peer_t *peers, uint8_t count)
+{
+    uint8_t changed = 0;
+
+    taskENTER_CRITICAL(&ble_bond_lock);
+    for (int i = ble_bond.count - 1; i >= 0; i--) {
+        uint8_t found = 0;
+        for (uint8_t j = 0; j < count && !found; j++) {
+            found = !memcmp(ble_bond.peers[i].bda, peers[j].bda, 6);
+        }
+        if (!found) {
+            BleBond_RemoveAt(i);
+            changed = 1;
+        }
+    }
+    for (uint8_t j = 0; j < count && ble_bond.count < BLE_BOND_MAX; j++) {
+        if (BleBond_Find(peers[j].bda) < 0) {
+            ble_bond.peers[ble_bond.count++] = peers[j];
+            changed                          = 1;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_bond_lock);
+
+    if (changed) {
+        BleBond_Store();
+    }
+}
+
+void BleBond_Used(const uint8_t bda[6], uint8_t addr_type)
+{
+    uint8_t changed = 1;
+
+    taskENTER_CRITICAL(&ble_bond_lock);
+    int index = BleBond_Find(bda);
+    if (index == 0 && ble_bond.peers[0].addr_type == addr_type) {
+        changed = 0;
+    } else {
+        if (index > 0) {
+            BleBond_RemoveAt(index);
+        } else if (index < 0 && ble_bond.count == BLE_BOND_MAX) {
+            // 最久没用的手机仍然是绑定的，只是不再做定向广播
+            ble_bond.count--;
+        }
+        if (index != 0) {
+            memmove(&ble_bond.peers[1], &ble_bond.peers[0], ble_bond.count * sizeof(ble_bond_peer_t));
+            ble_bond.count++;
+        }
+        memcpy(ble_bond.peers[0].bda, bda, 6);
+        ble_bond.peers[0].addr_type = addr_type;
+    }
+    taskEXIT_CRITICAL(&ble_bond_lock);
+
+    if (changed) {
+        BleBond_Store();
+    }
+}
+
+void BleBond_Removed(const uint8_t bda[6])
+{
+    taskENTER_CRITICAL(&ble_bond_lock);
+    int index = BleBond_Find(bda);
+    if (index >= 0) {
+        BleBond_RemoveAt(index);
+    }
+    taskEXIT_CRITICAL(&ble_bond_lock);
+
+    if (index >= 0) {
+        BleBond_Store();
+    }
+}
+
+void BleBond_Clear(void)
+{
+    taskENTER_CRITICAL(&ble_bond_lock);
+    ble_bond.count = 0;
+    taskEXIT_CRITICAL(&ble_bond_lock);
+    BleBond_Store();
+}
+
+uint8_t BleBond_Count(void)
+{
+    return ble_bond.count;
+}
+
+uint8_t BleBond_Get(uint8_t index, ble_bond_peer_t *peer)
+{
+    uint8_t ok = 0;
+
+    taskENTER_CRITICAL(&ble_bond_lock);
+    if (index < ble_bond.count) {
+        *peer = ble_bond.peers[index];
+        ok    = 1;
+    }
+    taskEXIT_CRITICAL(&ble_bond_lock);
+    return ok;
+}
+
+uint8_t BleBond_IsBonded(const uint8_t bda[6])
+{
+    taskENTER_CRITICAL(&ble_bond_lock);
+    int index = BleBond_Find(bda);
+    taskEXIT_CRITICAL(&ble_bond_lock);
+    return index >= 0;
+}
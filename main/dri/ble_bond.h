@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * 已绑定手机的最近使用顺序：
+ * 配对或者加密成功（已绑定的手机重连）时把手机移到最前面，按这个顺序做定向广播快速回连。
+ * 密钥由协议栈保存；这里只在 NVS 中保存顺序，启动时用协议栈的绑定列表核对（BleBond_Sync()）。
+ * 地址都是身份地址（手机的可解析私有地址由控制器用 IRK 解析）。
+ *
+ * 与协议栈无关：蓝牙后端（bluetooth.c / bluetooth_nimble.c / bluetooth_sim.c）上报配对结果。
+ */
+
+#define BLE_BOND_MAX 8
+
+typedef struct {
+    uint8_t bda[6];
+    uint8_t addr_type; // 0: 公共地址，1: 随机静态地址
+} ble_bond_peer_t;
+
+void BleBond_Init(void);
+// 协议栈的绑定列表：去掉列表中没有的（密钥已丢失），列表中有但不认识的加到最后
+void BleBond_Sync(const ble_bond_peer_t *peers, uint8_t count);
+// 配对成功或者已绑定的手机加密成功
+void BleBond_Used(const uint8_t bda[6], uint8_t addr_type);
+void BleBond_Removed(const uint8_t bda[6]);
+void BleBond_Clear(void);
+uint8_t BleBond_Count(void);
+// 按最近使用的顺序取第 index 个，没有时返回 0
+uint8_t BleBond_Get(uint8_t index, ble_bond_peer_t *peer);
+uint8_t BleBond_IsBonded(const uint8_t bda[6]);
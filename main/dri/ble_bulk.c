@@ -0,0 +1,660 @@
+#include "ble_bulk.h"
+#include "bluetooth.h"
+#include "ble_adv.h"
+#include "ble_session.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "ble_bulk";
+
+// 批量传输任务：把收到的块写进流、从流读出块发出去，优先级低于命令任务，开锁命令不用等大块数据
+#define BLE_BULK_TASK_NAME       "ble_bulk_task"
+#define BLE_BULK_TASK_STACK_SIZE 3072
+#define BLE_BULK_TASK_PRIORITY   5
+// 协议栈发送缓冲满时每个 tick 重试一次，重试这么多次还不行就等手机回退重发
+#define BLE_BULK_SEND_RETRIES 50
+#define BLE_BULK_MTU_DEFAULT  23
+
+#define BLE_BULK_PATTERN_SIZE (64 * 1024)
+#define BLE_BULK_SINK_MAX     (1024 * 1024)
+#define BLE_BULK_DIAG_MAX     1024
+
+typedef struct {
+    const char *name;
+    uint8_t writable;
+    // 打开流：读时返回流的长度，写时检查 size，返回 0 表示失败
+    uint32_t (*open)(uint32_t size);
+    uint8_t (*read)(uint32_t offset, uint8_t *buf, uint16_t len);
+    uint8_t (*write)(uint32_t offset, const uint8_t *data, uint16_t len);
+} ble_bulk_stream_t;
+
+typedef struct {
+    uint32_t offset;
+    uint16_t len;
+    uint8_t data[BLE_BULK_BLOCK_MAX];
+} ble_bulk_slot_t;
+
+typedef struct {
+    uint8_t active;
+    uint8_t stream;
+    uint8_t writing;
+    uint8_t nacked;      // 写：已经让手机回退，在收到期望的块之前不再回复
+    uint16_t conn_id;    // 断开后为 BLE_SESSION_NONE，等续传
+    uint32_t gen;        // 每次打开或回退加一，发送中的块据此判断是否作废
+    uint32_t size;
+    uint32_t offset;     // 读：手机确认收到的偏移；写：已经写进流的偏移
+    uint32_t next;       // 读：下一个要发的块；写：下一个期望收到的块（含缓冲中的）
+    uint32_t window_end; // 读：手机允许发到的偏移，只增不减（回退时除外）
+    uint32_t sent_max;   // 读：发出过的最大偏移，回退之后在这之前的块算重发
+    uint8_t head;        // 写：缓冲队首
+    uint8_t count;
+    uint8_t freed;       // 写：上次回复之后处理完的块
+    int64_t start_us;
+} ble_bulk_transfer_t;
+
+typedef struct {
+    uint16_t conn_id;
+    uint16_t mtu;
+} ble_bulk_mtu_t;
+
+// 读、写的打开请求
+typedef struct {
+    uint16_t conn_id; // BLE_SESSION_NONE 表示空
+    uint8_t op;
+    uint8_t stream;
+    uint32_t offset;
+    uint32_t arg;
+} ble_bulk_open_t;
+
+// 传输状态由 ble_bulk_lock 保护；缓冲中队首到队尾之间的块只由批量传输任务读取，队尾之后的只由协议栈任务写入
+static portMUX_TYPE ble_bulk_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_bulk_transfer_t ble_bulk;
+static ble_bulk_slot_t ble_bulk_ring[BLE_BULK_WINDOW];
+static ble_bulk_mtu_t ble_bulk_mtus[BLE_CONN_MAX];
+static ble_bulk_report_t ble_bulk_stats;
+static TaskHandle_t ble_bulk_task_handle = NULL;
+
+// 待处理的打开请求，每个连接只保留最新的一条；由批量传输任务在两个块之间处理，不会和读写流同时进行
+static ble_bulk_open_t ble_bulk_opens[BLE_CONN_MAX];
+
+// 待发的控制通知（打开的回复、回退），只保留最新的一条
+static uint8_t ble_bulk_reply[BLE_BULK_NOTIFY_LEN];
+static uint16_t ble_bulk_reply_conn = BLE_SESSION_NONE;
+
+static uint8_t ble_bulk_tx[BLE_BULK_MTU - 3];
+// 诊断快照两份：打开时在后一份中生成，持有 ble_bulk_lock 换到前面，发送中的块只从前一份读
+static char ble_bulk_diag[2][BLE_BULK_DIAG_MAX];
+static uint8_t ble_bulk_diag_front = 0;
+
+static void BleBulk_Put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static uint32_t BleBulk_Get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* ---- 流 ---- */
+
+static uint32_t BleBulk_DiagOpen(uint32_t size)
+{
+    ble_adv_report_t adv;
+    ble_conn_report_t conn;
+    ble_session_report_t session;
+    // 后一份只在这里写
+    char *diag = ble_bulk_diag[!ble_bulk_diag_front];
+    int n      = 0;
+
+    // 打开时生成一份快照，续传时内容不变
+    BleAdv_GetReport(&adv);
+    n += snprintf(diag + n, BLE_BULK_DIAG_MAX - n, "uptime %" PRId64 " ms\n", esp_timer_get_time() / 1000);
+    n += snprintf(diag + n, BLE_BULK_DIAG_MAX - n, "adv %s, %" PRIu32 " connects, connect avg %" PRIu32 " ms max %" PRIu32 " ms, duty %" PRIu32 " ppm\n",
+                  BleAdv_StateName(adv.state), adv.connects, adv.avg_connect_ms, adv.max_connect_ms, adv.duty_ppm);
+    for (uint8_t i = 0; i < BLE_CONN_MAX && n < BLE_BULK_DIAG_MAX; i++) {
+        if (!BleConn_GetReport(i, &conn)) continue;
+        n += snprintf(diag + n, BLE_BULK_DIAG_MAX - n, "conn %u %s, interval %u, latency %u, %" PRIu32 " commands, rtt avg %" PRIu32 " us\n",
+                      conn.conn_id, BleConn_ModeName(conn.mode), conn.interval, conn.latency, conn.commands, conn.avg_rtt_us);
+    }
+    for (uint8_t i = 0; i < BLE_SESSION_MAX && n < BLE_BULK_DIAG_MAX; i++) {
+        if (!BleSession_GetReport(i, &session)) continue;
+        n += snprintf(diag + n, BLE_BULK_DIAG_MAX - n, "session %u, %" PRIu32 " commands, %" PRIu32 " dropped, latency avg %" PRIu32 " us\n",
+                      session.conn_id, session.commands, session.dropped, session.avg_latency_us);
+    }
+    if (n < BLE_BULK_DIAG_MAX) {
+        n += snprintf(diag + n, BLE_BULK_DIAG_MAX - n, "bulk %" PRIu32 " transfers, %" PRIu64 " bytes, %" PRIu32 " resent, %" PRIu32 " crc errors, %" PRIu32 " resumes, last %" PRIu32 " KB/s\n",
+                      ble_bulk_stats.transfers, ble_bulk_stats.bytes, ble_bulk_stats.resent, ble_bulk_stats.crc_errors, ble_bulk_stats.resumes, ble_bulk_stats.last_kbps);
+    }
+
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    ble_bulk_diag_front = !ble_bulk_diag_front;
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    return n < BLE_BULK_DIAG_MAX ? n : BLE_BULK_DIAG_MAX - 1;
+}
+
+static uint8_t BleBulk_DiagRead(uint32_t offset, uint8_t *buf, uint16_t len)
+{
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    const char *diag = ble_bulk_diag[ble_bulk_diag_front];
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    memcpy(buf, diag + offset, len);
+    return 1;
+}
+
+static uint32_t BleBulk_PatternOpen(uint32_t size)
+{
+    return BLE_BULK_PATTERN_SIZE;
+}
+
+static uint8_t BleBulk_PatternRead(uint32_t offset, uint8_t *buf, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        buf[i] = BleBulk_Pattern(offset + i);
+    }
+    return 1;
+}
+
+static uint32_t BleBulk_SinkOpen(uint32_t size)
+{
+    return size <= BLE_BULK_SINK_MAX ? size : 0;
+}
+
+static uint8_t BleBulk_SinkWrite(uint32_t offset, const uint8_t *data, uint16_t len)
+{
+    for (uint16_t i = 0; i < len; i++) {
+        if (data[i] != BleBulk_Pattern(offset + i)) ble_bulk_stats.mismatches++;
+    }
+    return 1;
+}
+
+static const ble_bulk_stream_t ble_bulk_streams[BLE_BULK_STREAMS] = {
+    [BLE_BULK_STREAM_DIAG]    = {"diag", 0, BleBulk_DiagOpen, BleBulk_DiagRead, NULL},
+    [BLE_BULK_STREAM_PATTERN] = {"pattern", 0, BleBulk_PatternOpen, BleBulk_PatternRead, NULL},
+    [BLE_BULK_STREAM_SINK]    = {"sink", 1, BleBulk_SinkOpen, NULL, BleBulk_SinkWrite},
+};
+
+/* ---- 传输 ---- */
+
+static uint16_t BleBulk_MtuOf(uint16_t conn_id)
+{
+    for (int i = 0; i < BLE_CONN_MAX; i++) {
+        if (ble_bulk_mtus[i].mtu && ble_bulk_mtus[i].conn_id == conn_id) return ble_bulk_mtus[i].mtu;
+    }
+    return BLE_BULK_MTU_DEFAULT;
+}
+
+uint16_t BleBulk_BlockSize(uint16_t conn_id)
+{
+    uint16_t mtu = BleBulk_MtuOf(conn_id);
+    if (mtu > BLE_BULK_MTU) mtu = BLE_BULK_MTU;
+    return mtu - 3 - BLE_BULK_HEADER - BLE_BULK_CRC;
+}
+
+// 调用前持有 ble_bulk_lock
+static void BleBulk_SetReply(uint16_t conn_id, uint8_t op, uint8_t status, uint32_t offset, uint32_t size, uint8_t credits)
+{
+    ble_bulk_reply[0] = op | 0x80;
+    ble_bulk_reply[1] = status;
+    BleBulk_Put32(&ble_bulk_reply[2], offset);
+    BleBulk_Put32(&ble_bulk_reply[6], size);
+    ble_bulk_reply[10]  = credits;
+    ble_bulk_reply_conn = conn_id;
+}
+
+// 传输完成或者放弃，调用前持有 ble_bulk_lock
+static void BleBulk_Finish(uint8_t complete)
+{
+    if (complete) {
+        int64_t us = esp_timer_get_time() - ble_bulk.start_us;
+        ble_bulk_stats.transfers++;
+        ble_bulk_stats.last_kbps = us > 0 ? (uint64_t)ble_bulk.size * 1000000 / 1024 / us : 0;
+    }
+    ble_bulk.active = 0;
+    ble_bulk.count  = 0;
+}
+
+// 写：缓冲中空着的块数，就是给手机的额度，调用前持有 ble_bulk_lock
+static uint8_t BleBulk_Credits(void)
+{
+    return BLE_BULK_WINDOW - ble_bulk.count;
+}
+
+// 打开、续传或回退（批量传输任务中调用）；生成诊断快照不能在临界区中做，打开流时不持有锁
+static void BleBulk_Open(uint16_t conn_id, uint8_t op, uint8_t stream_id, uint32_t offset, uint32_t arg)
+{
+    const ble_bulk_stream_t *stream = stream_id < BLE_BULK_STREAMS ? &ble_bulk_streams[stream_id] : NULL;
+    uint8_t writing                 = op == BLE_BULK_OP_WRITE;
+    uint16_t block                  = BleBulk_BlockSize(conn_id);
+    uint8_t status                  = BLE_BULK_OK;
+    uint32_t size                   = 0;
+
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    if (stream == NULL || stream->writable != writing) {
+        status = BLE_BULK_BAD_STREAM;
+    } else if (ble_bulk.active && ble_bulk.conn_id != BLE_SESSION_NONE && ble_bulk.conn_id != conn_id) {
+        status = BLE_BULK_BUSY;
+    }
+    // 偏移不为 0、同一个流（写时长度也相同）还没传完：续传或回退，不重新打开
+    uint8_t resume = status == BLE_BULK_OK && offset && ble_bulk.active && ble_bulk.stream == stream_id &&
+                     ble_bulk.writing == writing && (!writing || ble_bulk.size == arg);
+    if (resume && ble_bulk.conn_id == BLE_SESSION_NONE) {
+        ble_bulk_stats.resumes++;
+        ESP_LOGI(TAG, "conn %u resumes %s at %" PRIu32 "/%" PRIu32, conn_id, stream->name, writing ? ble_bulk.next : offset, ble_bulk.size);
+    }
+    if (status == BLE_BULK_OK && !resume) {
+        // 放弃原来的传输
+        ble_bulk.active = 0;
+        ble_bulk.count  = 0;
+    }
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+
+    if (status == BLE_BULK_OK && !resume) {
+        size = stream->open(arg);
+        if (size == 0) status = writing ? BLE_BULK_BAD_LENGTH : BLE_BULK_FAILED;
+    }
+
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    if (status != BLE_BULK_OK) {
+        BleBulk_SetReply(conn_id, op, status, 0, 0, 0);
+        taskEXIT_CRITICAL(&ble_bulk_lock);
+        return;
+    }
+    if (!resume) {
+        ble_bulk.active   = 1;
+        ble_bulk.stream   = stream_id;
+        ble_bulk.writing  = writing;
+        ble_bulk.nacked   = 0;
+        ble_bulk.size     = size;
+        ble_bulk.offset   = 0;
+        ble_bulk.next     = 0;
+        ble_bulk.sent_max = 0;
+        ble_bulk.freed    = 0;
+        ble_bulk.start_us = esp_timer_get_time();
+    }
+    ble_bulk.conn_id = conn_id;
+    ble_bulk.gen++;
+    if (writing) {
+        // 缓冲中的块已经校验过，续传从它们后面开始
+        ble_bulk.nacked = 0;
+        BleBulk_SetReply(conn_id, op, BLE_BULK_OK, ble_bulk.next, ble_bulk.size, BleBulk_Credits());
+    } else {
+        if (offset > ble_bulk.size) offset = ble_bulk.size;
+        if (offset > ble_bulk.offset) ble_bulk.offset = offset;
+        ble_bulk.next       = offset;
+        ble_bulk.window_end = offset + (arg > 255 ? 255 : arg) * block;
+        BleBulk_SetReply(conn_id, op, BLE_BULK_OK, offset, ble_bulk.size, 0);
+    }
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    if (!resume) {
+        ESP_LOGI(TAG, "conn %u opens %s for %s, %" PRIu32 " bytes, %u-byte blocks", conn_id, stream->name, writing ? "write" : "read", size, block);
+    }
+}
+
+// 读：手机确认收到的偏移和新的额度，调用前持有 ble_bulk_lock
+static void BleBulk_Credit(uint16_t conn_id, uint8_t credits, uint32_t offset)
+{
+    if (!ble_bulk.active || ble_bulk.writing || ble_bulk.conn_id != conn_id) {
+        BleBulk_SetReply(conn_id, BLE_BULK_OP_CREDIT, BLE_BULK_BAD_STREAM, 0, 0, 0);
+        return;
+    }
+    if (offset > ble_bulk.offset) ble_bulk.offset = offset < ble_bulk.size ? offset : ble_bulk.size;
+    if (ble_bulk.offset >= ble_bulk.size) {
+        BleBulk_Finish(1);
+        BleBulk_SetReply(conn_id, BLE_BULK_OP_CREDIT, BLE_BULK_DONE, ble_bulk.size, ble_bulk.size, 0);
+        return;
+    }
+    uint32_t end = offset + credits * BleBulk_BlockSize(conn_id);
+    if (end > ble_bulk.window_end) ble_bulk.window_end = end;
+}
+
+// 写：收到一个数据块，校验后放进缓冲，调用前持有 ble_bulk_lock；返回缓冲的位置，丢弃时返回 -1
+static int BleBulk_Accept(uint16_t conn_id, const uint8_t *value, uint16_t len)
+{
+    uint8_t status = BLE_BULK_OK;
+    uint32_t crc   = 0;
+
+    if (!ble_bulk.active || !ble_bulk.writing || ble_bulk.conn_id != conn_id) return -1;
+    if (len <= BLE_BULK_HEADER + BLE_BULK_CRC || len > BLE_BULK_HEADER + BLE_BULK_BLOCK_MAX + BLE_BULK_CRC) {
+        status = BLE_BULK_BAD_LENGTH;
+    } else {
+        crc = esp_rom_crc32_le(0, value, len - BLE_BULK_CRC);
+        if (crc != BleBulk_Get32(value + len - BLE_BULK_CRC)) {
+            status = BLE_BULK_BAD_CRC;
+            ble_bulk_stats.crc_errors++;
+        } else if (BleBulk_Get32(value) != ble_bulk.next || ble_bulk.count >= BLE_BULK_WINDOW) {
+            status = BLE_BULK_BAD_OFFSET;
+            ble_bulk_stats.offset_errors++;
+        } else if (BleBulk_Get32(value) + len - BLE_BULK_HEADER - BLE_BULK_CRC > ble_bulk.size) {
+            status = BLE_BULK_BAD_LENGTH;
+        }
+    }
+    if (status != BLE_BULK_OK) {
+        // 窗口中后面的块都会偏移不对，只让手机回退一次
+        if (!ble_bulk.nacked) {
+            ble_bulk.nacked = 1;
+            BleBulk_SetReply(conn_id, BLE_BULK_OP_ACK, status, ble_bulk.next, ble_bulk.size, BleBulk_Credits());
+        }
+        return -1;
+    }
+    ble_bulk.nacked = 0;
+    return (ble_bulk.head + ble_bulk.count) % BLE_BULK_WINDOW;
+}
+
+// 记下打开请求，同一个连接的新请求替换旧的，调用前持有 ble_bulk_lock
+static void BleBulk_QueueOpen(uint16_t conn_id, uint8_t op, uint8_t stream, uint32_t offset, uint32_t arg)
+{
+    int index = -1;
+    for (int i = 0; i < BLE_CONN_MAX; i++) {
+        if (ble_bulk_opens[i].conn_id == conn_id) {
+            index = i;
+            break;
+        }
+        if (index < 0 && ble_bulk_opens[i].conn_id == BLE_SESSION_NONE) index = i;
+    }
+    if (index < 0) {
+        BleBulk_SetReply(conn_id, op, BLE_BULK_BUSY, 0, 0, 0);
+        return;
+    }
+    ble_bulk_opens[index] = (ble_bulk_open_t){conn_id, op, stream, offset, arg};
+}
+
+// 处理一条待处理的打开请求，没有时返回 0
+static uint8_t BleBulk_RunOpen(void)
+{
+    ble_bulk_open_t req = {.conn_id = BLE_SESSION_NONE};
+
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    for (int i = 0; i < BLE_CONN_MAX; i++) {
+        if (ble_bulk_opens[i].conn_id != BLE_SESSION_NONE) {
+            req                       = ble_bulk_opens[i];
+            ble_bulk_opens[i].conn_id = BLE_SESSION_NONE;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    if (req.conn_id == BLE_SESSION_NONE) return 0;
+    BleBulk_Open(req.conn_id, req.op, req.stream, req.offset, req.arg);
+    return 1;
+}
+
+void BleBulk_Write(uint16_t conn_id, ble_bulk_chan_t chan, const uint8_t *value, uint16_t len)
+{
+    if (chan == BLE_BULK_CHAN_DATA) {
+        taskENTER_CRITICAL(&ble_bulk_lock);
+        int index = BleBulk_Accept(conn_id, value, len);
+        taskEXIT_CRITICAL(&ble_bulk_lock);
+        if (index >= 0) {
+            // 队尾的块只有这里写，拷贝时不用持有锁
+            ble_bulk_slot_t *slot = &ble_bulk_ring[index];
+            slot->offset          = BleBulk_Get32(value);
+            slot->len             = len - BLE_BULK_HEADER - BLE_BULK_CRC;
+            memcpy(slot->data, value + BLE_BULK_HEADER, slot->len);
+            taskENTER_CRITICAL(&ble_bulk_lock);
+            ble_bulk.count++;
+            ble_bulk.next += slot->len;
+            taskEXIT_CRITICAL(&ble_bulk_lock);
+        }
+        xTaskNotifyGive(ble_bulk_task_handle);
+        return;
+    }
+
+    if (len < BLE_BULK_CTRL_LEN) {
+        taskENTER_CRITICAL(&ble_bulk_lock);
+        BleBulk_SetReply(conn_id, len ? value[0] : 0, BLE_BULK_BAD_LENGTH, 0, 0, 0);
+        taskEXIT_CRITICAL(&ble_bulk_lock);
+        xTaskNotifyGive(ble_bulk_task_handle);
+        return;
+    }
+    uint8_t op      = value[0];
+    uint8_t arg     = value[1];
+    uint32_t offset = BleBulk_Get32(&value[2]);
+    uint32_t size   = BleBulk_Get32(&value[6]);
+
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    switch (op) {
+    case BLE_BULK_OP_READ:
+    case BLE_BULK_OP_WRITE:
+        // 正在写流时不能重新打开，交给批量传输任务在这个块写完之后处理
+        BleBulk_QueueOpen(conn_id, op, arg, offset, size);
+        break;
+    case BLE_BULK_OP_CREDIT:
+        BleBulk_Credit(conn_id, arg, offset);
+        break;
+    case BLE_BULK_OP_CLOSE:
+        if (ble_bulk.active && ble_bulk.conn_id == conn_id) {
+            BleBulk_Finish(0);
+        }
+        BleBulk_SetReply(conn_id, op, BLE_BULK_OK, 0, 0, 0);
+        break;
+    default:
+        BleBulk_SetReply(conn_id, op, BLE_BULK_BAD_STREAM, 0, 0, 0);
+        break;
+    }
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    xTaskNotifyGive(ble_bulk_task_handle);
+}
+
+// 协议栈发送缓冲满时重试，返回 0 表示一直发不出去
+static uint8_t BleBulk_Send(uint16_t conn_id, uint8_t chan, const uint8_t *data, size_t len)
+{
+    for (int i = 0; i < BLE_BULK_SEND_RETRIES; i++) {
+        if (Bluetooth_BulkSend(conn_id, chan, data, len)) return 1;
+        vTaskDelay(1);
+    }
+    ESP_LOGW(TAG, "conn %u: send failed", conn_id);
+    return 0;
+}
+
+// 发待发的控制通知，没有时返回 0
+static uint8_t BleBulk_SendReply(void)
+{
+    uint8_t frame[BLE_BULK_NOTIFY_LEN];
+
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    uint16_t conn_id = ble_bulk_reply_conn;
+    memcpy(frame, ble_bulk_reply, sizeof(frame));
+    ble_bulk_reply_conn = BLE_SESSION_NONE;
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    if (conn_id == BLE_SESSION_NONE) return 0;
+    BleBulk_Send(conn_id, BLE_BULK_CHAN_CTRL, frame, sizeof(frame));
+    return 1;
+}
+
+// 写：把缓冲队首的块写进流，缓冲空了或者腾出一半时告诉手机新的额度；没有块时返回 0
+static uint8_t BleBulk_Drain(void)
+{
+    const ble_bulk_stream_t *stream;
+    ble_bulk_slot_t *slot;
+
+    // 流和缓冲队首要和 ready 在同一个临界区中取，否则可能拿到刚重新打开的另一个流
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    uint8_t ready = ble_bulk.active && ble_bulk.writing && ble_bulk.count;
+    stream        = &ble_bulk_streams[ble_bulk.stream];
+    slot          = &ble_bulk_ring[ble_bulk.head];
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    if (!ready) return 0;
+
+    uint8_t ok = stream->write(slot->offset, slot->data, slot->len);
+
+    uint8_t frame[BLE_BULK_NOTIFY_LEN];
+    uint16_t conn_id = BLE_SESSION_NONE;
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    // 写的时候手机关闭了传输
+    if (!ble_bulk.active || !ble_bulk.count) {
+        taskEXIT_CRITICAL(&ble_bulk_lock);
+        return 1;
+    }
+    ble_bulk.head = (ble_bulk.head + 1) % BLE_BULK_WINDOW;
+    ble_bulk.count--;
+    ble_bulk.freed++;
+    ble_bulk.offset += slot->len;
+    ble_bulk_stats.bytes += slot->len;
+    ble_bulk_stats.blocks++;
+    uint8_t status = !ok ? BLE_BULK_FAILED : ble_bulk.offset >= ble_bulk.size ? BLE_BULK_DONE : BLE_BULK_OK;
+    if (status != BLE_BULK_OK || ble_bulk.count == 0 || ble_bulk.freed >= BLE_BULK_WINDOW / 2) {
+        frame[0] = BLE_BULK_OP_ACK | 0x80;
+        frame[1] = status;
+        BleBulk_Put32(&frame[2], ble_bulk.next);
+        BleBulk_Put32(&frame[6], ble_bulk.size);
+        frame[10]      = BleBulk_Credits();
+        conn_id        = ble_bulk.conn_id;
+        ble_bulk.freed = 0;
+    }
+    if (status != BLE_BULK_OK) {
+        BleBulk_Finish(status == BLE_BULK_DONE);
+    }
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    if (conn_id != BLE_SESSION_NONE) {
+        BleBulk_Send(conn_id, BLE_BULK_CHAN_CTRL, frame, sizeof(frame));
+    }
+    return 1;
+}
+
+// 读：在额度内发下一个块；不能发时返回 0
+static uint8_t BleBulk_Pump(void)
+{
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    const ble_bulk_stream_t *stream = &ble_bulk_streams[ble_bulk.stream];
+    uint16_t conn_id                = ble_bulk.conn_id;
+    uint32_t offset                 = ble_bulk.next;
+    uint32_t gen                    = ble_bulk.gen;
+    uint8_t ready                   = ble_bulk.active && !ble_bulk.writing && conn_id != BLE_SESSION_NONE && offset < ble_bulk.size && offset < ble_bulk.window_end;
+    uint32_t len                    = ready ? ble_bulk.size - offset : 0;
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    if (!ready) return 0;
+
+    uint16_t block = BleBulk_BlockSize(conn_id);
+    if (len > block) len = block;
+    BleBulk_Put32(ble_bulk_tx, offset);
+    if (!stream->read(offset, ble_bulk_tx + BLE_BULK_HEADER, len)) {
+        taskENTER_CRITICAL(&ble_bulk_lock);
+        BleBulk_SetReply(conn_id, BLE_BULK_OP_READ, BLE_BULK_FAILED, offset, ble_bulk.size, 0);
+        BleBulk_Finish(0);
+        taskEXIT_CRITICAL(&ble_bulk_lock);
+        return 1;
+    }
+    BleBulk_Put32(ble_bulk_tx + BLE_BULK_HEADER + len, esp_rom_crc32_le(0, ble_bulk_tx, BLE_BULK_HEADER + len));
+    if (!BleBulk_Send(conn_id, BLE_BULK_CHAN_DATA, ble_bulk_tx, BLE_BULK_HEADER + len + BLE_BULK_CRC)) {
+        // 等手机回退重发或者续传
+        return 0;
+    }
+
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    // 发送期间手机回退了，或者重新打开了流，这个块不算
+    if (ble_bulk.gen == gen && ble_bulk.next == offset) {
+        ble_bulk.next += len;
+        ble_bulk_stats.bytes += len;
+        ble_bulk_stats.blocks++;
+        if (offset < ble_bulk.sent_max) {
+            ble_bulk_stats.resent++;
+        } else {
+            ble_bulk.sent_max = offset + len;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    return 1;
+}
+
+static void ble_bulk_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uint8_t busy = 1;
+        while (busy) {
+            busy = BleBulk_SendReply();
+            busy |= BleBulk_RunOpen();
+            busy |= BleBulk_Drain();
+            busy |= BleBulk_Pump();
+        }
+    }
+}
+
+void BleBulk_Init(void)
+{
+    ble_bulk_stats.mtu       = BLE_BULK_MTU_DEFAULT;
+    ble_bulk_stats.tx_octets = 27;
+    ble_bulk_stats.phy       = 1;
+    for (int i = 0; i < BLE_CONN_MAX; i++) {
+        ble_bulk_opens[i].conn_id = BLE_SESSION_NONE;
+    }
+    xTaskCreate(ble_bulk_task, BLE_BULK_TASK_NAME, BLE_BULK_TASK_STACK_SIZE, NULL, BLE_BULK_TASK_PRIORITY, &ble_bulk_task_handle);
+}
+
+void BleBulk_Mtu(uint16_t conn_id, uint16_t mtu)
+{
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    int index = -1;
+    for (int i = 0; i < BLE_CONN_MAX; i++) {
+        if (ble_bulk_mtus[i].mtu && ble_bulk_mtus[i].conn_id == conn_id) {
+            index = i;
+            break;
+        }
+        if (index < 0 && !ble_bulk_mtus[i].mtu) index = i;
+    }
+    if (index >= 0) {
+        ble_bulk_mtus[index].conn_id = conn_id;
+        ble_bulk_mtus[index].mtu     = mtu;
+    }
+    ble_bulk_stats.mtu = mtu;
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    ESP_LOGI(TAG, "conn %u mtu %u, %u-byte blocks", conn_id, mtu, BleBulk_BlockSize(conn_id));
+}
+
+void BleBulk_Link(uint16_t tx_octets, uint8_t phy)
+{
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    if (tx_octets) ble_bulk_stats.tx_octets = tx_octets;
+    if (phy) ble_bulk_stats.phy = phy;
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    ESP_LOGI(TAG, "link %u-byte packets, %uM phy", ble_bulk_stats.tx_octets, ble_bulk_stats.phy);
+}
+
+void BleBulk_Disconnected(uint16_t conn_id)
+{
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    for (int i = 0; i < BLE_CONN_MAX; i++) {
+        if (ble_bulk_mtus[i].conn_id == conn_id) ble_bulk_mtus[i].mtu = 0;
+        if (ble_bulk_opens[i].conn_id == conn_id) ble_bulk_opens[i].conn_id = BLE_SESSION_NONE;
+    }
+    uint8_t suspended = ble_bulk.active && ble_bulk.conn_id == conn_id;
+    uint8_t stream    = ble_bulk.stream;
+    uint32_t offset   = ble_bulk.offset;
+    uint32_t size     = ble_bulk.size;
+    if (suspended) {
+        ble_bulk.conn_id = BLE_SESSION_NONE;
+    }
+    if (ble_bulk_reply_conn == conn_id) {
+        ble_bulk_reply_conn = BLE_SESSION_NONE;
+    }
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+    if (suspended) {
+        ESP_LOGI(TAG, "conn %u lost, %s suspended at %" PRIu32 "/%" PRIu32, conn_id, BleBulk_StreamName(stream), offset, size);
+    }
+}
+
+void BleBulk_GetReport(ble_bulk_report_t *report)
+{
+    taskENTER_CRITICAL(&ble_bulk_lock);
+    *report         = ble_bulk_stats;
+    report->active  = ble_bulk.active;
+    report->stream  = ble_bulk.stream;
+    report->writing = ble_bulk.writing;
+    report->offset  = ble_bulk.offset;
+    report->size    = ble_bulk.size;
+    taskEXIT_CRITICAL(&ble_bulk_lock);
+}
+
+const char *BleBulk_StreamName(uint8_t stream)
+{
+    return stream < BLE_BULK_STREAMS ? ble_bulk_streams[stream].name : "?";
+}
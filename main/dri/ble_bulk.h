@@ -0,0 +1,105 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 蓝牙批量传输服务：导出日志、诊断数据，备份 / 恢复大块数据，和命令特征值分开。
+ *  - 连接后请求数据长度扩展（DLE），控制器支持时切换到 2M PHY；块的 ATT 包不超过 247 字节，
+ *    正好放进一个 251 字节的链路层包，交换的 MTU 更小时按 MTU 切块
+ *  - 控制特征值（带响应的写入 + 通知）：打开流、授予额度、关闭；打开时偏移为 0 表示从头开始，
+ *    不为 0 表示续传（断开重连之后）或者回退重发（收到坏块之后）
+ *  - 数据特征值：手机到门锁用无响应写入，门锁到手机用通知，每个块带偏移和 CRC32
+ *  - 额度（窗口）流控：接收方告诉发送方从哪个偏移开始还能发几个块，
+ *    门锁收的数据先放进 BLE_BULK_WINDOW 个块的缓冲，处理完再给额度，不使用堆
+ *  - 收到偏移不对或者 CRC 错误的块时丢弃，让发送方回到接收方给的偏移重发；
+ *    断开后传输暂停，重新连接（任何一个连接）再打开同一个流时从确认过的偏移继续
+ *
+ * 帧格式（小端）：
+ *   控制请求  | 操作码 (1) | 参数 (1) | 偏移 (4) | 长度 (4) |
+ *   控制通知  | 操作码|0x80 (1) | 状态 (1) | 偏移 (4) | 长度 (4) | 额度 (1) |
+ *   数据块    | 偏移 (4) | 数据 | CRC32 (4) |，CRC32（与 zlib.crc32 相同）覆盖偏移和数据
+ * 额度的意思是发送方可以从通知中的偏移开始再发这么多个块（每块最多 BleBulk_BlockSize() 字节）。
+ *
+ * 与协议栈无关：蓝牙后端把两个特征值的写入交给 BleBulk_Write()，MTU、链路和断开通过
+ * BleBulk_Mtu() / BleBulk_Link() / BleBulk_Disconnected() 上报，并实现 Bluetooth_BulkSend()。
+ */
+
+#define BLE_BULK_MTU        247 // 块的 ATT 包（MTU）上限
+#define BLE_BULK_LL_OCTETS  251 // DLE 之后的链路层包长
+#define BLE_BULK_HEADER     4
+#define BLE_BULK_CRC        4
+#define BLE_BULK_BLOCK_MAX  (BLE_BULK_MTU - 3 - BLE_BULK_HEADER - BLE_BULK_CRC) // 一个块的数据，236 字节
+#define BLE_BULK_WINDOW     16                                                  // 收数据的块缓冲数，也是给发送方的最大额度
+#define BLE_BULK_CTRL_LEN   10
+#define BLE_BULK_NOTIFY_LEN 11
+
+typedef enum {
+    BLE_BULK_CHAN_CTRL = 0,
+    BLE_BULK_CHAN_DATA,
+} ble_bulk_chan_t;
+
+typedef enum {
+    BLE_BULK_OP_READ   = 0x01, // 参数 = 流，偏移 = 从哪里读，长度 = 额度 -> 偏移、流的总长度
+    BLE_BULK_OP_WRITE  = 0x02, // 参数 = 流，偏移 = 0 或续传，长度 = 总长度 -> 门锁实际续传的偏移、额度
+    BLE_BULK_OP_CREDIT = 0x03, // 读：参数 = 额度，偏移 = 手机已经连续收到的长度，等于总长度时传输完成
+    BLE_BULK_OP_CLOSE  = 0x04,
+    BLE_BULK_OP_ACK    = 0x05, // 写（只用于通知）：门锁处理到的偏移和新的额度，出错时带错误状态
+} ble_bulk_op_t;
+
+typedef enum {
+    BLE_BULK_OK = 0,
+    BLE_BULK_DONE,       // 整个流传输完成
+    BLE_BULK_BAD_STREAM, // 没有这个流，或者不支持这个方向，或者没有打开的传输
+    BLE_BULK_BAD_OFFSET, // 块的偏移不是期望的，从通知中的偏移重发
+    BLE_BULK_BAD_CRC,    // 块的 CRC 错误，从通知中的偏移重发
+    BLE_BULK_BUSY,       // 另一个连接正在传输
+    BLE_BULK_BAD_LENGTH, // 帧太短或太长，或者写入的总长度超过流的上限
+    BLE_BULK_FAILED,     // 流的读写失败
+} ble_bulk_status_t;
+
+typedef enum {
+    BLE_BULK_STREAM_DIAG = 0, // 读：诊断数据（文本）
+    BLE_BULK_STREAM_PATTERN,  // 读：测试数据，用于测量吞吐量
+    BLE_BULK_STREAM_SINK,     // 写：校验测试数据后丢弃，用于测量吞吐量
+    BLE_BULK_STREAMS,
+} ble_bulk_stream_id_t;
+
+// 测试数据的第 offset 个字节，手机端按同样的规则校验
+static inline uint8_t BleBulk_Pattern(uint32_t offset)
+{
+    return (uint8_t)(offset * 31 + (offset >> 8));
+}
+
+void BleBulk_Init(void);
+// 收到控制或数据特征值的写入（协议栈的任务中调用）
+void BleBulk_Write(uint16_t conn_id, ble_bulk_chan_t chan, const uint8_t *value, uint16_t len);
+// MTU 交换完成
+void BleBulk_Mtu(uint16_t conn_id, uint16_t mtu);
+// 链路变化：tx_octets 为数据长度扩展后的发送包长，phy 为 1 / 2（1M / 2M），0 表示没有变化
+void BleBulk_Link(uint16_t tx_octets, uint8_t phy);
+// 断开连接：传输暂停，可以在新连接上续传
+void BleBulk_Disconnected(uint16_t conn_id);
+// 这个连接上一个块最多带多少字节数据
+uint16_t BleBulk_BlockSize(uint16_t conn_id);
+
+typedef struct {
+    uint8_t active;      // 正在传输（或者断开后暂停，等续传）
+    uint8_t stream;
+    uint8_t writing;     // 1: 手机写入门锁
+    uint32_t offset;     // 读：手机确认收到的偏移；写：已经写进流的偏移
+    uint32_t size;
+    uint16_t mtu;        // 最近一次交换的 MTU
+    uint16_t tx_octets;  // 链路层发送包长
+    uint8_t phy;         // 1: 1M，2: 2M
+    uint32_t transfers;  // 完成的传输
+    uint64_t bytes;      // 门锁收发的数据（含重发）
+    uint32_t blocks;
+    uint32_t resent;     // 回退之后重发的块
+    uint32_t crc_errors;
+    uint32_t offset_errors;
+    uint32_t resumes;    // 断开后续传的次数
+    uint32_t mismatches; // 写入测试流时内容不对的字节
+    uint32_t last_kbps;  // 最近一次完成的传输，从打开到完成的平均速度（KB/s）
+} ble_bulk_report_t;
+void BleBulk_GetReport(ble_bulk_report_t *report);
+const char *BleBulk_StreamName(uint8_t stream);
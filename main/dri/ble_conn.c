@@ -0,0 +1,332 @@
+#include "ble_conn.h"
+#include "ble_adv.h"
+#include "bluetooth.h"
+#include "timer_service.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <string.h>
+#include <inttypes.h>
+
+static const char *TAG = "ble_conn";
+
+#define BLE_CONN_IDLE_US ((uint64_t)CONFIG_BLE_IDLE_TIMEOUT_MS * 1000)
+// 请求没能发给协议栈时，由空闲定时器隔这么久重试
+#define BLE_CONN_RETRY_US (500 * 1000)
+
+// 一个连接事件的射频时间（唤醒、空包往返），用于估算占空比
+#define BLE_CONN_EVENT_US 700
+
+/*
+ * iOS 的限制：最短间隔 15 ms；max_int * (latency + 1) <= 2 s；
+ * timeout > max_int * (latency + 1) * 3 且不超过 6 s。两组参数都满足，手机一般会接受。
+ */
+static const ble_conn_params_t ble_conn_params[BLE_CONN_MODES] = {
+    [BLE_CONN_FAST] = {.min_int = 12, .max_int = 24, .latency = 0, .timeout = 400},  // 15~30 ms，超时 4 s
+    [BLE_CONN_IDLE] = {.min_int = 80, .max_int = 100, .latency = 4, .timeout = 600}, // 100~125 ms，每 5 个事件收听一次，超时 6 s
+};
+
+typedef struct {
+    uint8_t used;
+    uint16_t conn_id;
+    uint8_t bda[6];
+    ble_conn_mode_t mode;   // 最近请求的参数
+    ble_conn_mode_t wanted; // 策略希望的参数
+    uint8_t pending;        // 有一个更新请求还没有结果
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+    int64_t connected_us;
+    int64_t since_us;         // 当前参数从什么时候开始生效
+    int64_t last_activity_us; // 最后一条命令的时间
+    int64_t command_us;       // 正在处理的命令的开始时间
+    int64_t first_command_us; // 第一条命令的时间，0 表示还没有命令
+    uint32_t command_wait_us; // 正在处理的命令在空口上等待的时间
+    uint64_t radio_us;        // 估算的射频时间（截止 since_us）
+    uint64_t rtt_total_us;
+    ble_conn_report_t stats;
+} ble_conn_t;
+
+static portMUX_TYPE ble_conn_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_conn_t ble_conns[BLE_CONN_MAX];
+
+static ble_conn_t *BleConn_Find(uint16_t conn_id)
+{
+    for (uint8_t i = 0; i < BLE_CONN_MAX; i++) {
+        if (ble_conns[i].used && ble_conns[i].conn_id == conn_id) return &ble_conns[i];
+    }
+    return NULL;
+}
+
+// 当前参数下的射频占空比（百万分之一）
+static uint32_t BleConn_DutyPpm(const ble_conn_t *conn)
+{
+    uint64_t period_us = (uint64_t)conn->interval * 1250 * (conn->latency + 1);
+    return period_us ? BLE_CONN_EVENT_US * 1000000ull / period_us : 0;
+}
+
+// 把当前参数下经过的时间计入射频时间
+static void BleConn_Account(ble_conn_t *conn, int64_t now)
+{
+    conn->radio_us += (uint64_t)(now - conn->since_us) * BleConn_DutyPpm(conn) / 1000000;
+    conn->since_us = now;
+}
+
+/*
+ * 需要时发起一次参数更新，调用前持有 ble_conn_lock。
+ * 同时只有一个请求，结果回来后再看是否还需要切换；返回 1 表示要把 params 发给协议栈。
+ */
+static uint8_t BleConn_Schedule(ble_conn_t *conn, ble_conn_params_t *params, uint8_t bda[6])
+{
+    if (conn->pending || conn->wanted == conn->mode) return 0;
+    conn->mode    = conn->wanted;
+    conn->pending = 1;
+    *params       = ble_conn_params[conn->mode];
+    memcpy(bda, conn->bda, 6);
+    return 1;
+}
+
+// 把请求发给协议栈，返回 0 表示没有发出去，已经安排重试
+static uint8_t BleConn_Request(const uint8_t bda[6], const ble_conn_params_t *params, ble_conn_mode_t mode)
+{
+    ESP_LOGI(TAG, "request %s params, interval %u~%u, latency %u", BleConn_ModeName(mode), params->min_int, params->max_int, params->latency);
+    if (Bluetooth_RequestConnParams(bda, params)) return 1;
+
+    // 不会有 BleConn_Updated()：清掉 pending，退回原来的模式，这样空闲定时器重试时 wanted 和 mode 不同
+    taskENTER_CRITICAL(&ble_conn_lock);
+    for (uint8_t i = 0; i < BLE_CONN_MAX; i++) {
+        ble_conn_t *conn = &ble_conns[i];
+        if (conn->used && conn->pending && conn->mode == mode && !memcmp(conn->bda, bda, 6)) {
+            conn->pending = 0;
+            conn->mode    = mode == BLE_CONN_FAST ? BLE_CONN_IDLE : BLE_CONN_FAST;
+            conn->stats.failed++;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+    TimerService_Start(TIMER_BLE_IDLE, BLE_CONN_RETRY_US);
+    return 0;
+}
+
+// 空闲定时器：切换空闲的连接、重试没发出去的请求，还没到时间的按最早的一个重新计时
+static void BleConn_IdleTimerCallback(void *arg)
+{
+    int64_t now   = esp_timer_get_time();
+    int64_t next  = INT64_MAX;
+    uint8_t count = 0;
+    uint8_t bda[BLE_CONN_MAX][6];
+    ble_conn_params_t params[BLE_CONN_MAX];
+    ble_conn_mode_t modes[BLE_CONN_MAX];
+
+    taskENTER_CRITICAL(&ble_conn_lock);
+    for (uint8_t i = 0; i < BLE_CONN_MAX; i++) {
+        ble_conn_t *conn = &ble_conns[i];
+        if (!conn->used) continue;
+        if (conn->wanted != BLE_CONN_IDLE) {
+            int64_t due = conn->last_activity_us + BLE_CONN_IDLE_US;
+            if (due > now) {
+                if (due < next) next = due;
+            } else {
+                conn->wanted = BLE_CONN_IDLE;
+            }
+        }
+        if (BleConn_Schedule(conn, &params[count], bda[count])) {
+            modes[count] = conn->mode;
+            count++;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+
+    for (uint8_t i = 0; i < count; i++) {
+        // 又失败了：BleConn_Request() 已经按重试间隔启动定时器，下面不能推迟它
+        if (!BleConn_Request(bda[i], &params[i], modes[i]) && now + (int64_t)BLE_CONN_RETRY_US < next) {
+            next = now + BLE_CONN_RETRY_US;
+        }
+    }
+    if (next != INT64_MAX) {
+        TimerService_Start(TIMER_BLE_IDLE, next - now);
+    }
+}
+
+void BleConn_Init(void)
+{
+    TimerService_BindCallback(TIMER_BLE_IDLE, BleConn_IdleTimerCallback, NULL);
+}
+
+void BleConn_Connected(uint16_t conn_id, const uint8_t bda[6], uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    int64_t now = esp_timer_get_time();
+    ble_conn_params_t params;
+    uint8_t peer[6];
+    uint8_t request = 0;
+
+    taskENTER_CRITICAL(&ble_conn_lock);
+    ble_conn_t *conn = BleConn_Find(conn_id);
+    for (uint8_t i = 0; conn == NULL && i < BLE_CONN_MAX; i++) {
+        if (!ble_conns[i].used) conn = &ble_conns[i];
+    }
+    if (conn) {
+        memset(conn, 0, sizeof(*conn));
+        conn->used             = 1;
+        conn->conn_id          = conn_id;
+        conn->interval         = interval;
+        conn->latency          = latency;
+        conn->timeout          = timeout;
+        conn->connected_us     = now;
+        conn->since_us         = now;
+        conn->last_activity_us = now;
+        memcpy(conn->bda, bda, 6);
+        // 连接后手机马上做服务发现和写命令，先用快速参数；mode 设为空闲，保证发出第一次请求
+        conn->mode   = BLE_CONN_IDLE;
+        conn->wanted = BLE_CONN_FAST;
+        request      = BleConn_Schedule(conn, &params, peer);
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+
+    if (conn == NULL) {
+        ESP_LOGW(TAG, "conn %u: no free slot", conn_id);
+        return;
+    }
+    if (request) {
+        BleConn_Request(peer, &params, BLE_CONN_FAST);
+    }
+    if (!TimerService_IsActive(TIMER_BLE_IDLE)) {
+        TimerService_Start(TIMER_BLE_IDLE, BLE_CONN_IDLE_US);
+    }
+}
+
+void BleConn_Disconnected(uint16_t conn_id)
+{
+    taskENTER_CRITICAL(&ble_conn_lock);
+    ble_conn_t *conn = BleConn_Find(conn_id);
+    if (conn) {
+        conn->used = 0;
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+}
+
+void BleConn_Updated(const uint8_t bda[6], uint8_t status, uint16_t interval, uint16_t latency, uint16_t timeout)
+{
+    int64_t now = esp_timer_get_time();
+    ble_conn_params_t params;
+    uint8_t peer[6];
+    uint8_t request      = 0;
+    ble_conn_mode_t mode = BLE_CONN_FAST;
+
+    taskENTER_CRITICAL(&ble_conn_lock);
+    ble_conn_t *conn = NULL;
+    for (uint8_t i = 0; i < BLE_CONN_MAX; i++) {
+        if (ble_conns[i].used && !memcmp(ble_conns[i].bda, bda, 6)) conn = &ble_conns[i];
+    }
+    if (conn) {
+        conn->pending = 0;
+        if (status == 0) {
+            BleConn_Account(conn, now);
+            conn->interval = interval;
+            conn->latency  = latency;
+            conn->timeout  = timeout;
+            conn->stats.updates++;
+        } else {
+            // 被拒绝：保持现在的参数，到下一次切换时再请求
+            conn->stats.rejected++;
+        }
+        request = BleConn_Schedule(conn, &params, peer);
+        mode    = conn->mode;
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+
+    if (conn) {
+        ESP_LOGI(TAG, "params %s: interval %u, latency %u, timeout %u", status ? "rejected" : "updated", interval, latency, timeout);
+    }
+    if (request) {
+        BleConn_Request(peer, &params, mode);
+    }
+}
+
+void BleConn_CommandStart(uint16_t conn_id)
+{
+    int64_t now = esp_timer_get_time();
+    ble_conn_params_t params;
+    uint8_t peer[6];
+    uint8_t request  = 0;
+    int32_t first_ms = -1;
+
+    taskENTER_CRITICAL(&ble_conn_lock);
+    ble_conn_t *conn = BleConn_Find(conn_id);
+    if (conn) {
+        // 手机写入前平均要等从机收听间隔的一半（参数在命令到达时才开始切换）
+        conn->command_us       = now;
+        conn->command_wait_us  = (uint32_t)conn->interval * 1250 * (conn->latency + 1) / 2;
+        conn->last_activity_us = now;
+        conn->wanted           = BLE_CONN_FAST;
+        request                = BleConn_Schedule(conn, &params, peer);
+        if (conn->first_command_us == 0) {
+            // 连接后的服务发现（或读数据库哈希）都算在里面
+            conn->first_command_us       = now;
+            conn->stats.first_command_ms = (now - conn->connected_us) / 1000;
+            first_ms                     = conn->stats.first_command_ms;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+
+    if (first_ms >= 0) {
+        ESP_LOGI(TAG, "conn %u: first command %" PRId32 " ms after connect", conn_id, first_ms);
+        BleAdv_FirstCommand(first_ms);
+    }
+
+    if (request) {
+        BleConn_Request(peer, &params, BLE_CONN_FAST);
+    }
+    if (conn && !TimerService_IsActive(TIMER_BLE_IDLE)) {
+        TimerService_Start(TIMER_BLE_IDLE, BLE_CONN_IDLE_US);
+    }
+}
+
+void BleConn_CommandDone(uint16_t conn_id)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&ble_conn_lock);
+    ble_conn_t *conn = BleConn_Find(conn_id);
+    if (conn && conn->command_us) {
+        // 响应在下一个连接事件发出
+        uint32_t rtt = conn->command_wait_us + (now - conn->command_us) + (uint32_t)conn->interval * 1250;
+        conn->command_us = 0;
+        conn->stats.commands++;
+        conn->stats.last_rtt_us = rtt;
+        conn->rtt_total_us += rtt;
+        if (rtt > conn->stats.max_rtt_us) {
+            conn->stats.max_rtt_us = rtt;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+}
+
+uint8_t BleConn_GetReport(uint8_t index, ble_conn_report_t *report)
+{
+    int64_t now = esp_timer_get_time();
+    uint8_t ok  = 0;
+
+    taskENTER_CRITICAL(&ble_conn_lock);
+    ble_conn_t *conn = index < BLE_CONN_MAX ? &ble_conns[index] : NULL;
+    if (conn && conn->used) {
+        BleConn_Account(conn, now);
+        *report              = conn->stats;
+        report->conn_id      = conn->conn_id;
+        report->mode         = conn->mode;
+        report->interval     = conn->interval;
+        report->latency      = conn->latency;
+        report->timeout      = conn->timeout;
+        report->connected_ms = (now - conn->connected_us) / 1000;
+        report->avg_rtt_us   = conn->stats.commands ? conn->rtt_total_us / conn->stats.commands : 0;
+        report->duty_ppm     = now > conn->connected_us ? conn->radio_us * 1000000 / (now - conn->connected_us) : 0;
+        ok                   = 1;
+    }
+    taskEXIT_CRITICAL(&ble_conn_lock);
+    return ok;
+}
+
+const char *BleConn_ModeName(ble_conn_mode_t mode)
+{
+    static const char *names[BLE_CONN_MODES] = {"fast", "idle"};
+    return mode < BLE_CONN_MODES ? names[mode] : "?";
+}
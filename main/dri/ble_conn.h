@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include "sdkconfig.h"
+
+/*
+ * 蓝牙连接参数策略：
+ *  - 收到命令时切换到快速参数（最短连接间隔、无从机延迟），命令和响应尽快往返
+ *  - 最后一条命令之后 CONFIG_BLE_IDLE_TIMEOUT_MS 没有新命令，切换到空闲参数
+ *    （长连接间隔加从机延迟），手机和门锁的射频大部分时间休眠
+ * 参数由手机决定是否接受，实际生效的参数以 BleConn_Updated() 上报的为准。
+ * 每个连接统计命令往返时间（估算）、射频占空比（估算），以及从连上到第一条命令的时间
+ * （手机做服务发现的耗时，已绑定的手机有 GATT 缓存时只需读一次数据库哈希）。
+ *
+ * 与协议栈无关：蓝牙后端（bluetooth.c / bluetooth_nimble.c / bluetooth_sim.c）上报连接事件，并实现 Bluetooth_RequestConnParams()。
+ */
+
+// 同时统计的连接数，等于协议栈允许的最大连接数；会话池、准备写缓冲池都按它分配。
+// 主机仿真没有蓝牙配置，用和 sdkconfig 相同的 4
+#if CONFIG_BT_NIMBLE_ENABLED
+#define BLE_CONN_MAX CONFIG_BT_NIMBLE_MAX_CONNECTIONS
+#elif CONFIG_BT_BLUEDROID_ENABLED
+#define BLE_CONN_MAX CONFIG_BT_ACL_CONNECTIONS
+#else
+#define BLE_CONN_MAX 4
+#endif
+
+// 连接参数，单位与 HCI 相同：间隔 1.25 ms，超时 10 ms
+typedef struct {
+    uint16_t min_int;
+    uint16_t max_int;
+    uint16_t latency;
+    uint16_t timeout;
+} ble_conn_params_t;
+
+typedef enum {
+    BLE_CONN_FAST = 0, // 正在交换命令
+    BLE_CONN_IDLE,     // 空闲
+    BLE_CONN_MODES,
+} ble_conn_mode_t;
+
+void BleConn_Init(void);
+
+// 协议栈上报的事件，可以在任何任务中调用
+void BleConn_Connected(uint16_t conn_id, const uint8_t bda[6], uint16_t interval, uint16_t latency, uint16_t timeout);
+void BleConn_Disconnected(uint16_t conn_id);
+// 连接参数更新完成（本机请求的或者手机主动发起的），status 不为 0 表示被拒绝
+void BleConn_Updated(const uint8_t bda[6], uint8_t status, uint16_t interval, uint16_t latency, uint16_t timeout);
+// 收到一条命令 / 命令处理完、响应已交给协议栈
+void BleConn_CommandStart(uint16_t conn_id);
+void BleConn_CommandDone(uint16_t conn_id);
+
+typedef struct {
+    uint16_t conn_id;
+    ble_conn_mode_t mode;      // 当前请求的参数
+    uint16_t interval;         // 实际生效的参数
+    uint16_t latency;
+    uint16_t timeout;
+    uint32_t connected_ms;     // 连接时长
+    uint32_t first_command_ms; // 从连上到第一条命令（服务发现的耗时），还没有命令时为 0
+    uint32_t commands;         // 处理的命令数
+    uint32_t last_rtt_us;      // 命令往返时间：等待从机收听 + 处理 + 下一个连接事件发回响应
+    uint32_t avg_rtt_us;
+    uint32_t max_rtt_us;
+    uint32_t updates;          // 生效的参数更新
+    uint32_t rejected;         // 被手机拒绝的参数更新
+    uint32_t failed;           // 没能发给协议栈、稍后重试的参数更新
+    uint32_t duty_ppm;         // 射频占空比（百万分之一）
+} ble_conn_report_t;
+// 第 index 个连接的统计，没有这个连接时返回 0
+uint8_t BleConn_GetReport(uint8_t index, ble_conn_report_t *report);
+const char *BleConn_ModeName(ble_conn_mode_t mode);
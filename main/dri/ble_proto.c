@@ -0,0 +1,339 @@
+#include "ble_proto.h"
+#include "bluetooth.h"
+#include "ble_session.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "flash.h"
+#include "Motor.h"
+#include "schedule.h"
+#include "trace.h"
+#include <string.h>
+#include <sys/time.h>
+
+static const char *TAG = "ble_proto";
+
+extern TaskHandle_t ota_task_handle;
+
+// 处理函数：data/len 是请求数据，响应数据写入 rsp（最多 BLE_PROTO_RSP_MAX 字节）
+typedef ble_status_t (*ble_proto_handler_t)(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len);
+
+/*
+ * 操作码表，按操作码直接索引。
+ * 数据长度必须在 [min_len, max_len] 内；unit 不为 0 时，超出 min_len 的部分必须是 unit 的整数倍（批量条目）。
+ */
+typedef struct {
+    ble_proto_handler_t handler;
+    uint16_t min_len;
+    uint16_t max_len;
+    uint8_t unit;
+} ble_proto_op_t;
+
+// 不是从会话来的命令（没有连接）用的重发识别记录；记录和统计都由 ble_proto_lock 保护，
+// 会话任务、仿真和 stats 命令会同时访问
+static portMUX_TYPE ble_proto_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_proto_session_t ble_proto_default;
+
+static ble_proto_stats_t ble_proto_stats = {0};
+
+static inline uint16_t BleProto_Get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static inline uint32_t BleProto_Get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void BleProto_Put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+static ble_status_t BleProto_Ping(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    rsp[0] = BLE_PROTO_VERSION;
+    BleProto_Put16(rsp + 1, BLE_PROTO_MAX_FRAME);
+    *rsp_len = 3;
+    return BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_Unlock(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    uint8_t allowed = Schedule_AllowsBle();
+    TRACE(TRACE_BLE_DECISION, allowed);
+    if (!allowed) return BLE_STATUS_DENIED;
+    Motor_OpenLock();
+    return BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_SetPassword(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    char password[7] = {0};
+    for (uint8_t i = 0; i < 6; i++) {
+        if (data[i] < '0' || data[i] > '9') return BLE_STATUS_BAD_VALUE;
+        password[i] = data[i];
+    }
+    Flash_WritePassword(password);
+    return BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_Ota(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    if (ota_task_handle == NULL) return BLE_STATUS_UNKNOWN_OP;
+    xTaskNotifyGive(ota_task_handle);
+    return BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_CredentialResult(uint16_t ok, uint16_t failed, uint8_t *rsp, uint16_t *rsp_len)
+{
+    BleProto_Put16(rsp, ok);
+    BleProto_Put16(rsp + 2, failed);
+    BleProto_Put16(rsp + 4, Flash_CredentialCount());
+    *rsp_len = 6;
+    return failed ? BLE_STATUS_PARTIAL : BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_CredentialAdd(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    char pin[FLASH_CRED_MAX_DIGITS];
+    uint16_t ok     = 0;
+    uint16_t failed = 0;
+
+    for (uint16_t i = 0; i < len; i += 5) {
+        size_t n = Flash_CredentialDecode(BleProto_Get32(data + i), pin);
+        // 已存在的密码只更新时间表，重发同一批也算成功
+        flash_cred_result_t result = FLASH_CRED_INVALID;
+        if (n >= FLASH_CRED_MIN_DIGITS && n <= FLASH_CRED_MAX_DIGITS && data[i + 4] < SCHEDULE_MAX) {
+            result = Flash_CredentialAdd(pin, n, data[i + 4]);
+        }
+        if (result == FLASH_CRED_OK || result == FLASH_CRED_EXISTS) {
+            ok++;
+        } else {
+            failed++;
+        }
+    }
+    memset(pin, 0, sizeof(pin));
+    return BleProto_CredentialResult(ok, failed, rsp, rsp_len);
+}
+
+static ble_status_t BleProto_CredentialRemove(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    char pin[FLASH_CRED_MAX_DIGITS];
+    uint16_t ok     = 0;
+    uint16_t failed = 0;
+
+    for (uint16_t i = 0; i < len; i += 4) {
+        size_t n = Flash_CredentialDecode(BleProto_Get32(data + i), pin);
+        if (n >= FLASH_CRED_MIN_DIGITS && n <= FLASH_CRED_MAX_DIGITS && Flash_CredentialRemove(pin, n) == FLASH_CRED_OK) {
+            ok++;
+        } else {
+            failed++;
+        }
+    }
+    memset(pin, 0, sizeof(pin));
+    return BleProto_CredentialResult(ok, failed, rsp, rsp_len);
+}
+
+static ble_status_t BleProto_CredentialTable(ble_op_t op, uint8_t *rsp, uint16_t *rsp_len)
+{
+    if (op == BLE_OP_CRED_CLEAR) {
+        Flash_CredentialClear();
+    } else if (op == BLE_OP_CRED_COMMIT) {
+        Flash_CredentialCommit();
+    } else {
+        Flash_CredentialAbort();
+    }
+    BleProto_Put16(rsp, Flash_CredentialCount());
+    *rsp_len = 2;
+    return BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_CredentialClear(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    return BleProto_CredentialTable(BLE_OP_CRED_CLEAR, rsp, rsp_len);
+}
+
+static ble_status_t BleProto_CredentialCommit(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    return BleProto_CredentialTable(BLE_OP_CRED_COMMIT, rsp, rsp_len);
+}
+
+static ble_status_t BleProto_CredentialAbort(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    return BleProto_CredentialTable(BLE_OP_CRED_ABORT, rsp, rsp_len);
+}
+
+static ble_status_t BleProto_ScheduleSet(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    schedule_t schedule;
+    if (data[0] >= SCHEDULE_MAX) return BLE_STATUS_BAD_VALUE;
+    if (Schedule_Compile((const char *)data + 1, len - 1, &schedule) != 0) return BLE_STATUS_BAD_VALUE;
+    return Schedule_Set(data[0], &schedule) == 0 ? BLE_STATUS_OK : BLE_STATUS_BAD_VALUE;
+}
+
+static ble_status_t BleProto_ScheduleFinger(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    uint16_t page = BleProto_Get16(data);
+    if (page >= SCHEDULE_FINGER_PAGES || data[2] >= SCHEDULE_MAX) return BLE_STATUS_BAD_VALUE;
+    Schedule_SetFinger(page, data[2]);
+    return BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_ScheduleBle(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    if (data[0] >= SCHEDULE_MAX) return BLE_STATUS_BAD_VALUE;
+    Schedule_SetBle(data[0]);
+    return BLE_STATUS_OK;
+}
+
+static ble_status_t BleProto_TimeSet(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    struct timeval tv = {.tv_sec = BleProto_Get32(data), .tv_usec = 0};
+    return settimeofday(&tv, NULL) == 0 ? BLE_STATUS_OK : BLE_STATUS_BAD_VALUE;
+}
+
+static ble_status_t BleProto_Timezone(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    char tz[32];
+    memcpy(tz, data, len);
+    tz[len] = 0;
+    Schedule_SetTimezone(tz);
+    return BLE_STATUS_OK;
+}
+
+#if CONFIG_TRACE_ENABLE
+static ble_status_t BleProto_TraceDump(const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    if (data[0] > 1) return BLE_STATUS_BAD_VALUE;
+    Trace_RequestDump(data[0] ? Trace_UartSink : Bluetooth_TraceSink);
+    return BLE_STATUS_OK;
+}
+#endif
+
+static const ble_proto_op_t ble_proto_ops[] = {
+    [BLE_OP_PING]         = {BleProto_Ping, 0, 0},
+    [BLE_OP_UNLOCK]       = {BleProto_Unlock, 0, 0},
+    [BLE_OP_SET_PASSWORD] = {BleProto_SetPassword, 6, 6},
+    [BLE_OP_OTA]          = {BleProto_Ota, 0, 0},
+    [BLE_OP_CRED_ADD]     = {BleProto_CredentialAdd, 5, BLE_PROTO_MAX_FRAME - BLE_PROTO_REQ_HEADER, 5},
+    [BLE_OP_CRED_REMOVE]  = {BleProto_CredentialRemove, 4, BLE_PROTO_MAX_FRAME - BLE_PROTO_REQ_HEADER, 4},
+    [BLE_OP_CRED_CLEAR]   = {BleProto_CredentialClear, 0, 0},
+    [BLE_OP_CRED_COMMIT]  = {BleProto_CredentialCommit, 0, 0},
+    [BLE_OP_CRED_ABORT]   = {BleProto_CredentialAbort, 0, 0},
+    [BLE_OP_SCHEDULE_SET] = {BleProto_ScheduleSet, 1, 1 + 200},
+    [BLE_OP_SCHEDULE_FP]  = {BleProto_ScheduleFinger, 3, 3},
+    [BLE_OP_SCHEDULE_BLE] = {BleProto_ScheduleBle, 1, 1},
+    [BLE_OP_TIME_SET]     = {BleProto_TimeSet, 4, 4},
+    [BLE_OP_TIMEZONE]     = {BleProto_Timezone, 1, 31},
+#if CONFIG_TRACE_ENABLE
+    [BLE_OP_TRACE_DUMP] = {BleProto_TraceDump, 1, 1},
+#endif
+};
+#define BLE_PROTO_OP_COUNT (sizeof(ble_proto_ops) / sizeof(ble_proto_ops[0]))
+
+static ble_status_t BleProto_Dispatch(uint8_t version, uint8_t op, const uint8_t *data, uint16_t len, uint8_t *rsp, uint16_t *rsp_len)
+{
+    if (version != BLE_PROTO_VERSION) return BLE_STATUS_BAD_VERSION;
+    if (op >= BLE_PROTO_OP_COUNT || ble_proto_ops[op].handler == NULL) return BLE_STATUS_UNKNOWN_OP;
+
+    const ble_proto_op_t *entry = &ble_proto_ops[op];
+    if (len < entry->min_len || len > entry->max_len || (entry->unit && (len - entry->min_len) % entry->unit)) {
+        return BLE_STATUS_BAD_LENGTH;
+    }
+    return entry->handler(data, len, rsp, rsp_len);
+}
+
+static void BleProto_HandleFrame(ble_proto_session_t *last, const uint8_t *frame, uint16_t len)
+{
+    uint8_t seq = frame[1];
+    uint8_t op  = frame[2];
+    uint8_t rsp[BLE_PROTO_RSP_HEADER + BLE_PROTO_RSP_MAX];
+    uint16_t rsp_len = 0;
+
+    // 重发的请求：直接重发上一次的响应
+    taskENTER_CRITICAL(&ble_proto_lock);
+    uint8_t again = last->len && last->rsp[1] == seq && last->rsp[2] == (op | BLE_PROTO_RSP_FLAG);
+    if (again) {
+        memcpy(rsp, last->rsp, last->len);
+        rsp_len = last->len;
+        ble_proto_stats.retransmits++;
+    }
+    taskEXIT_CRITICAL(&ble_proto_lock);
+    if (again) {
+        Bluetooth_Notify(rsp, rsp_len);
+        return;
+    }
+
+    int64_t start       = esp_timer_get_time();
+    ble_status_t status = BleProto_Dispatch(frame[0], op, frame + BLE_PROTO_REQ_HEADER, len - BLE_PROTO_REQ_HEADER,
+                                            rsp + BLE_PROTO_RSP_HEADER, &rsp_len);
+    uint32_t elapsed    = esp_timer_get_time() - start;
+
+    rsp[0] = BLE_PROTO_VERSION;
+    rsp[1] = seq;
+    rsp[2] = op | BLE_PROTO_RSP_FLAG;
+    rsp[3] = status;
+    BleProto_Put16(rsp + 4, rsp_len);
+    rsp_len += BLE_PROTO_RSP_HEADER;
+
+    taskENTER_CRITICAL(&ble_proto_lock);
+    memcpy(last->rsp, rsp, rsp_len);
+    last->len = rsp_len;
+    ble_proto_stats.frames++;
+    ble_proto_stats.last_us = elapsed;
+    if (elapsed > ble_proto_stats.max_us) {
+        ble_proto_stats.max_us = elapsed;
+    }
+    if (status != BLE_STATUS_OK) {
+        ble_proto_stats.errors++;
+    }
+    taskEXIT_CRITICAL(&ble_proto_lock);
+
+    if (status != BLE_STATUS_OK) {
+        ESP_LOGW(TAG, "op 0x%02x seq %u: status %d", op, seq, status);
+    }
+    Bluetooth_Notify(rsp, rsp_len);
+}
+
+void BleProto_Handle(const uint8_t *value, uint16_t len)
+{
+    ble_proto_session_t *last = BleSession_Proto();
+    if (last == NULL) {
+        last = &ble_proto_default;
+    }
+    while (len >= BLE_PROTO_REQ_HEADER) {
+        // 长度字段最大 0xFFFF，加上包头后 16 位会回绕
+        uint16_t payload   = BleProto_Get16(value + 3);
+        uint32_t frame_len = BLE_PROTO_REQ_HEADER + (uint32_t)payload;
+        if (payload > BLE_PROTO_MAX_FRAME - BLE_PROTO_REQ_HEADER || frame_len > len) {
+            // 超长或者数据不完整：回复长度错误，丢弃这次写入剩下的部分
+            uint8_t rsp[BLE_PROTO_RSP_HEADER] = {BLE_PROTO_VERSION, value[1], value[2] | BLE_PROTO_RSP_FLAG, BLE_STATUS_BAD_LENGTH, 0, 0};
+            taskENTER_CRITICAL(&ble_proto_lock);
+            ble_proto_stats.errors++;
+            taskEXIT_CRITICAL(&ble_proto_lock);
+            Bluetooth_Notify(rsp, sizeof(rsp));
+            return;
+        }
+        BleProto_HandleFrame(last, value, frame_len);
+        value += frame_len;
+        len -= frame_len;
+    }
+}
+
+void BleProto_Reset(ble_proto_session_t *session)
+{
+    taskENTER_CRITICAL(&ble_proto_lock);
+    session->len = 0;
+    taskEXIT_CRITICAL(&ble_proto_lock);
+}
+
+void BleProto_GetStats(ble_proto_stats_t *stats)
+{
+    taskENTER_CRITICAL(&ble_proto_lock);
+    *stats = ble_proto_stats;
+    taskEXIT_CRITICAL(&ble_proto_lock);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 蓝牙二进制命令协议（主机端编解码见 tools/ble_proto.py）
+ *
+ * 一次写入可以包含多个请求帧，多字节字段都是小端：
+ *   请求  | 版本 (1) | 序号 (1) | 操作码 (1) | 长度 (2) | 数据 |
+ *   响应  | 版本 (1) | 序号 (1) | 操作码|0x80 (1) | 状态 (1) | 长度 (2) | 数据 |
+ * 响应通过特征值通知发回。第一个字节是版本号（小于 0x20），
+ * 以可打印字符开头的写入仍然按原来的字符串命令处理。
+ *
+ * 序号和操作码与上一个请求相同时认为是手机重发，直接重发上一次的响应，不再执行（开锁不会执行两次）；
+ * 每个连接的会话有自己的记录（BleSession_Proto()），连接时 BleProto_Reset() 清掉上一次的记录。
+ * 请求在调用者的上下文中处理，响应在栈上组帧，整个处理过程不使用堆。
+ */
+
+#define BLE_PROTO_VERSION    0x01
+#define BLE_PROTO_REQ_HEADER 5
+#define BLE_PROTO_RSP_HEADER 6
+#define BLE_PROTO_RSP_MAX    32 // 响应数据的最大长度
+#define BLE_PROTO_RSP_FLAG   0x80
+#define BLE_PROTO_MAX_FRAME  512 // 一次写入的最大长度（ATT 属性值上限）
+
+typedef enum {
+    BLE_OP_PING         = 0x00, // -> 版本 (1)、最大帧长 (2)
+    BLE_OP_UNLOCK       = 0x01,
+    BLE_OP_SET_PASSWORD = 0x02, // 6 位数字 (ASCII)
+    BLE_OP_OTA          = 0x03,
+    BLE_OP_CRED_ADD     = 0x10, // n * (编码 (4)、时间表 (1)) -> 成功 (2)、失败 (2)、总数 (2)
+    BLE_OP_CRED_REMOVE  = 0x11, // n * 编码 (4)             -> 成功 (2)、失败 (2)、总数 (2)
+    BLE_OP_CRED_CLEAR   = 0x12, // -> 总数 (2)
+    BLE_OP_CRED_COMMIT  = 0x13, // -> 总数 (2)
+    BLE_OP_CRED_ABORT   = 0x14, // -> 总数 (2)
+    BLE_OP_SCHEDULE_SET = 0x20, // 编号 (1)、时间表文本（格式见 Schedule_Compile()）
+    BLE_OP_SCHEDULE_FP  = 0x21, // 指纹页 (2)、编号 (1)
+    BLE_OP_SCHEDULE_BLE = 0x22, // 编号 (1)
+    BLE_OP_TIME_SET     = 0x23, // unix 时间 (4)
+    BLE_OP_TIMEZONE     = 0x24, // POSIX TZ 文本
+    BLE_OP_TRACE_DUMP   = 0x30, // 0: 蓝牙通知，1: 控制台串口
+} ble_op_t;
+
+typedef enum {
+    BLE_STATUS_OK = 0,
+    BLE_STATUS_UNKNOWN_OP,  // 不支持的操作码
+    BLE_STATUS_BAD_LENGTH,  // 数据长度不对
+    BLE_STATUS_BAD_VALUE,   // 数据内容不合法
+    BLE_STATUS_DENIED,      // 不在允许的时段
+    BLE_STATUS_BAD_VERSION, // 协议版本不支持
+    BLE_STATUS_PARTIAL,     // 批量操作部分失败
+} ble_status_t;
+
+// 判断一次写入是不是二进制帧
+static inline uint8_t BleProto_IsFrame(const uint8_t *value, uint16_t len)
+{
+    return len >= BLE_PROTO_REQ_HEADER && value[0] < 0x20;
+}
+
+// 一个连接上一个请求的响应，用于识别重发
+typedef struct {
+    uint16_t len;
+    uint8_t rsp[BLE_PROTO_RSP_HEADER + BLE_PROTO_RSP_MAX];
+} ble_proto_session_t;
+
+// 处理一次写入中的所有请求帧，每个请求通过 Bluetooth_Notify() 发送一个响应
+void BleProto_Handle(const uint8_t *value, uint16_t len);
+// 新连接：忘掉上一个请求的序号
+void BleProto_Reset(ble_proto_session_t *session);
+
+typedef struct {
+    uint32_t frames;      // 处理的请求帧
+    uint32_t retransmits; // 重发的请求（没有再执行）
+    uint32_t errors;      // 状态不是 OK 的响应
+    uint32_t last_us;     // 最近一个请求的处理时间
+    uint32_t max_us;      // 最长处理时间
+} ble_proto_stats_t;
+void BleProto_GetStats(ble_proto_stats_t *stats);
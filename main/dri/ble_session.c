@@ -0,0 +1,243 @@
+#include "ble_session.h"
+#include "bluetooth.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "ble_session";
+
+// 命令任务：按连接轮流处理命令，处理函数会写 NVS、发通知，栈要留够
+#define BLE_SESSION_TASK_NAME       "ble_cmd_task"
+#define BLE_SESSION_TASK_STACK_SIZE 4096
+#define BLE_SESSION_TASK_PRIORITY   6
+#define BLE_SESSION_EVT_SUBMIT      (1 << BLE_SESSION_MAX) // 低 BLE_SESSION_MAX 位：对应会话处理完一条命令
+
+typedef struct {
+    uint16_t len;
+    int64_t submit_us;
+    uint8_t value[BLE_PROTO_MAX_FRAME];
+} ble_session_cmd_t;
+
+typedef struct {
+    uint8_t used;
+    uint8_t busy; // 命令任务正在处理队首的命令，处理完之前不能复用这个会话
+    uint16_t conn_id;
+    uint8_t head;
+    uint8_t count;
+    ble_session_cmd_t queue[BLE_SESSION_QUEUE];
+    ble_proto_session_t proto;
+    uint64_t latency_total_us;
+    ble_session_report_t stats;
+} ble_session_t;
+
+// 会话表由 ble_session_lock 保护；队首命令的内容只由命令任务读取
+static portMUX_TYPE ble_session_lock = portMUX_INITIALIZER_UNLOCKED;
+static ble_session_t ble_sessions[BLE_SESSION_MAX];
+static EventGroupHandle_t ble_session_events = NULL;
+static TaskHandle_t ble_session_task_handle  = NULL;
+static uint16_t ble_session_current          = BLE_SESSION_NONE;
+static ble_session_t *ble_session_running    = NULL;
+static uint8_t ble_session_next              = 0; // 下一轮从哪个会话开始
+
+static int BleSession_Find(uint16_t conn_id)
+{
+    for (int i = 0; i < BLE_SESSION_MAX; i++) {
+        if (ble_sessions[i].used && ble_sessions[i].conn_id == conn_id) return i;
+    }
+    return -1;
+}
+
+// 从 ble_session_next 开始找第一个有命令的会话，调用前持有 ble_session_lock
+static int BleSession_PickNext(void)
+{
+    for (int n = 0; n < BLE_SESSION_MAX; n++) {
+        int i = (ble_session_next + n) % BLE_SESSION_MAX;
+        if (ble_sessions[i].used && ble_sessions[i].count) {
+            ble_session_next = (i + 1) % BLE_SESSION_MAX;
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void ble_session_task(void *arg)
+{
+    while (1) {
+        xEventGroupWaitBits(ble_session_events, BLE_SESSION_EVT_SUBMIT, pdTRUE, pdFALSE, portMAX_DELAY);
+        while (1) {
+            taskENTER_CRITICAL(&ble_session_lock);
+            int index            = BleSession_PickNext();
+            ble_session_t *s     = index >= 0 ? &ble_sessions[index] : NULL;
+            ble_session_cmd_t *c = s ? &s->queue[s->head] : NULL;
+            if (s) {
+                s->busy             = 1;
+                ble_session_current = s->conn_id;
+                ble_session_running = s;
+            }
+            taskEXIT_CRITICAL(&ble_session_lock);
+            if (s == NULL) break;
+
+            Bluetooth_HandleCommand(c->value, c->len);
+            BleConn_CommandDone(s->conn_id);
+            uint32_t latency = esp_timer_get_time() - c->submit_us;
+
+            taskENTER_CRITICAL(&ble_session_lock);
+            ble_session_running = NULL;
+            s->busy             = 0;
+            if (s->used) {
+                s->head = (s->head + 1) % BLE_SESSION_QUEUE;
+                s->count--;
+                s->stats.commands++;
+                s->latency_total_us += latency;
+                if (latency > s->stats.max_latency_us) {
+                    s->stats.max_latency_us = latency;
+                }
+            }
+            taskEXIT_CRITICAL(&ble_session_lock);
+            xEventGroupSetBits(ble_session_events, 1 << index);
+        }
+    }
+}
+
+void BleSession_Init(void)
+{
+    ble_session_events = xEventGroupCreate();
+    xTaskCreate(ble_session_task, BLE_SESSION_TASK_NAME, BLE_SESSION_TASK_STACK_SIZE, NULL, BLE_SESSION_TASK_PRIORITY, &ble_session_task_handle);
+}
+
+uint8_t BleSession_Open(uint16_t conn_id)
+{
+    taskENTER_CRITICAL(&ble_session_lock);
+    int index = BleSession_Find(conn_id);
+    for (int i = 0; index < 0 && i < BLE_SESSION_MAX; i++) {
+        if (!ble_sessions[i].used && !ble_sessions[i].busy) index = i;
+    }
+    if (index >= 0) {
+        ble_session_t *s = &ble_sessions[index];
+        s->used          = 1;
+        s->conn_id       = conn_id;
+        s->head          = 0;
+        s->count         = 0;
+        memset(&s->stats, 0, sizeof(s->stats));
+        s->latency_total_us = 0;
+        s->stats.conn_id    = conn_id;
+    }
+    taskEXIT_CRITICAL(&ble_session_lock);
+
+    if (index < 0) {
+        ESP_LOGW(TAG, "conn %u: no free session", conn_id);
+        return 0;
+    }
+    BleProto_Reset(&ble_sessions[index].proto);
+    return 1;
+}
+
+void BleSession_Close(uint16_t conn_id)
+{
+    taskENTER_CRITICAL(&ble_session_lock);
+    int index = BleSession_Find(conn_id);
+    if (index >= 0) {
+        // 排队的命令直接丢弃，正在处理的那条处理完后不再计数
+        ble_sessions[index].used  = 0;
+        ble_sessions[index].count = 0;
+    }
+    if (ble_session_current == conn_id) {
+        ble_session_current = BLE_SESSION_NONE;
+    }
+    taskEXIT_CRITICAL(&ble_session_lock);
+
+    if (index >= 0) {
+        xEventGroupSetBits(ble_session_events, 1 << index);
+    }
+}
+
+uint8_t BleSession_Count(void)
+{
+    uint8_t count = 0;
+    for (int i = 0; i < BLE_SESSION_MAX; i++) {
+        count += ble_sessions[i].used;
+    }
+    return count;
+}
+
+uint8_t BleSession_Submit(uint16_t conn_id, const uint8_t *value, uint16_t len)
+{
+    uint8_t ok = 0;
+
+    if (len > BLE_PROTO_MAX_FRAME) return 0;
+    // 先记录命令到达，连接参数在排队的同时开始切换
+    BleConn_CommandStart(conn_id);
+
+    taskENTER_CRITICAL(&ble_session_lock);
+    int index = BleSession_Find(conn_id);
+    if (index >= 0) {
+        ble_session_t *s = &ble_sessions[index];
+        if (s->count < BLE_SESSION_QUEUE) {
+            ble_session_cmd_t *c = &s->queue[(s->head + s->count) % BLE_SESSION_QUEUE];
+            c->len               = len;
+            c->submit_us         = esp_timer_get_time();
+            memcpy(c->value, value, len);
+            s->count++;
+            if (s->count > s->stats.max_queued) {
+                s->stats.max_queued = s->count;
+            }
+            ok = 1;
+        } else {
+            s->stats.dropped++;
+        }
+    }
+    taskEXIT_CRITICAL(&ble_session_lock);
+
+    if (ok) {
+        xEventGroupSetBits(ble_session_events, BLE_SESSION_EVT_SUBMIT);
+    } else {
+        ESP_LOGW(TAG, "conn %u: command dropped", conn_id);
+    }
+    return ok;
+}
+
+void BleSession_Wait(uint16_t conn_id)
+{
+    while (1) {
+        taskENTER_CRITICAL(&ble_session_lock);
+        int index = BleSession_Find(conn_id);
+        taskEXIT_CRITICAL(&ble_session_lock);
+        if (index < 0) return;
+        // 先清完成位再看队列：命令任务先减计数再置位，之后处理完的命令不会漏掉
+        xEventGroupClearBits(ble_session_events, 1 << index);
+        taskENTER_CRITICAL(&ble_session_lock);
+        uint8_t pending = ble_sessions[index].used && ble_sessions[index].conn_id == conn_id && ble_sessions[index].count;
+        taskEXIT_CRITICAL(&ble_session_lock);
+        if (!pending) return;
+        xEventGroupWaitBits(ble_session_events, 1 << index, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+}
+
+uint16_t BleSession_Current(void)
+{
+    return ble_session_current;
+}
+
+ble_proto_session_t *BleSession_Proto(void)
+{
+    if (xTaskGetCurrentTaskHandle() != ble_session_task_handle) return NULL;
+    return ble_session_running ? &ble_session_running->proto : NULL;
+}
+
+uint8_t BleSession_GetReport(uint8_t index, ble_session_report_t *report)
+{
+    uint8_t ok = 0;
+
+    taskENTER_CRITICAL(&ble_session_lock);
+    if (index < BLE_SESSION_MAX && ble_sessions[index].used) {
+        ble_session_t *s       = &ble_sessions[index];
+        *report                = s->stats;
+        report->avg_latency_us = s->stats.commands ? s->latency_total_us / s->stats.commands : 0;
+        ok                     = 1;
+    }
+    taskEXIT_CRITICAL(&ble_session_lock);
+    return ok;
+}
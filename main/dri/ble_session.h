@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include "ble_conn.h"
+#include "ble_proto.h"
+
+/*
+ * 蓝牙会话：每个连接一个会话，来自固定的池（BLE_SESSION_MAX 个，等于控制器支持的最大连接数），不使用堆。
+ *  - 协议栈收到写入后只把数据拷贝进会话的队列（BLE_SESSION_QUEUE 条），马上返回
+ *  - 命令任务按连接轮流取命令（每个连接一次一条），一部手机连续发命令不会让别的手机一直等
+ *  - 响应通过 Bluetooth_Notify() 发回发出这条命令的连接（BleSession_Current()）
+ *  - 每个会话有自己的重发识别记录
+ * 每个会话统计命令数、队列满丢弃的写入和从收到写入到处理完的时间。
+ *
+ * 与协议栈无关：蓝牙后端（bluetooth.c / bluetooth_nimble.c / bluetooth_sim.c）在连接、断开和写入时调用。
+ */
+
+#define BLE_SESSION_MAX   BLE_CONN_MAX
+#define BLE_SESSION_QUEUE 2
+#define BLE_SESSION_NONE  0xffff
+
+void BleSession_Init(void);
+// 新连接，池满时返回 0
+uint8_t BleSession_Open(uint16_t conn_id);
+void BleSession_Close(uint16_t conn_id);
+uint8_t BleSession_Count(void);
+// 收到一次写入（协议栈的任务中调用），队列满或者没有这个连接时返回 0
+uint8_t BleSession_Submit(uint16_t conn_id, const uint8_t *value, uint16_t len);
+// 等这个连接排队的命令都处理完（不能在命令任务中调用）
+void BleSession_Wait(uint16_t conn_id);
+// 正在处理（或最近处理）的命令来自哪个连接，没有时为 BLE_SESSION_NONE
+uint16_t BleSession_Current(void);
+// 正在处理的命令所在会话的重发识别记录，不在命令任务中调用时返回 NULL
+ble_proto_session_t *BleSession_Proto(void);
+
+typedef struct {
+    uint16_t conn_id;
+    uint32_t commands;
+    uint32_t dropped;        // 队列满丢弃的写入
+    uint8_t max_queued;      // 队列最深的时候
+    uint32_t avg_latency_us; // 从收到写入到处理完
+    uint32_t max_latency_us;
+} ble_session_report_t;
+// 第 index 个会话的统计，没有这个会话时返回 0
+uint8_t BleSession_GetReport(uint8_t index, ble_session_report_t *report);
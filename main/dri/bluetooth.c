@@ -22,6 +22,7 @@
 #include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "esp_bt.h"
 
@@ -31,9 +32,12 @@
 #include "esp_bt_main.h"
 #include "esp_bt_device.h"
 #include "esp_gatt_common_api.h"
-#include "flash.h"
 #include "bluetooth.h"
-#include "Motor.h"
+#include "ble_proto.h"
+#include "ble_adv.h"
+#include "ble_session.h"
+#include "ble_bulk.h"
+#include "trace.h"
 
 #define GATTS_TAG "GATTS_DEMO"
 
@@ -42,129 +46,109 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
 
 #define GATTS_SERVICE_UUID_TEST_A 0x2002
 #define GATTS_CHAR_UUID_TEST_A    0x0226
-#define GATTS_DESCR_UUID_TEST_A   0x2002
-#define GATTS_NUM_HANDLE_TEST_A   4
+#define BULK_SERVICE_UUID         0x2003
+#define BULK_CHAR_UUID_CTRL       0x0227
+#define BULK_CHAR_UUID_DATA       0x0228
 
 static char test_device_name[ESP_BLE_ADV_NAME_LEN_MAX] = "Destiny_Smart_Lock";
 
 #define TEST_MANUFACTURER_DATA_LEN  17
 
-#define GATTS_DEMO_CHAR_VAL_LEN_MAX 0x40
+// 长写入（prepare write）拼接缓冲：固定的池，按连接分配，不使用堆
+#define PREPARE_BUF_MAX_SIZE BLE_PROTO_MAX_FRAME
+#define PREPARE_POOL_SIZE    BLE_SESSION_MAX
 
-#define PREPARE_BUF_MAX_SIZE        1024
+// 导出追踪数据时两个通知之间的间隔，避免占满协议栈的发送缓冲
+#define TRACE_NOTIFY_GAP_MS 10
 
-extern TaskHandle_t ota_task_handle;
-
-static uint8_t char1_str[]             = {0x11, 0x22, 0x33};
-static esp_gatt_char_prop_t a_property = 0;
-
-static esp_attr_value_t gatts_demo_char1_val =
-    {
-        .attr_max_len = GATTS_DEMO_CHAR_VAL_LEN_MAX,
-        .attr_len     = sizeof(char1_str),
-        .attr_value   = char1_str,
+/*
+ * 门锁服务的属性表，启动时一次创建（esp_ble_gatts_create_attr_tab），句柄固定。
+ * 打开 CONFIG_BT_GATTS_ROBUST_CACHING_ENABLED 后协议栈在 GATT 服务中提供数据库哈希，
+ * 加上 Service Changed，已绑定的手机重连时读一次哈希就能沿用缓存的句柄，不用重新做服务发现。
+ * 修改这张表会改变哈希，手机会自动重新发现。
+ */
+enum {
+    LOCK_IDX_SVC,
+    LOCK_IDX_CMD_CHAR,
+    LOCK_IDX_CMD_VAL, // 命令：手机写入，响应和追踪数据通过通知发回
+    LOCK_IDX_CMD_CFG, // 客户端特征配置（通知开关）
+    LOCK_IDX_NB,
 };
 
-static uint8_t adv_config_done = 0;
-#define adv_config_flag      (1 << 0)
-#define scan_rsp_config_flag (1 << 1)
-
-#ifdef CONFIG_EXAMPLE_SET_RAW_ADV_DATA
-static uint8_t raw_adv_data[] = {
-    /* Flags */
-    0x02, ESP_BLE_AD_TYPE_FLAG, 0x06, // Length 2, Data Type ESP_BLE_AD_TYPE_FLAG, Data 1 (LE General Discoverable Mode, BR/EDR Not Supported)
-    /* TX Power Level */
-    0x02, ESP_BLE_AD_TYPE_TX_PWR, 0xEB, // Length 2, Data Type ESP_BLE_AD_TYPE_TX_PWR, Data 2 (-21)
-    /* Complete 16-bit Service UUIDs */
-    0x03, ESP_BLE_AD_TYPE_16SRV_CMPL, 0xAB, 0xCD // Length 3, Data Type ESP_BLE_AD_TYPE_16SRV_CMPL, Data 3 (UUID)
+static const uint16_t primary_service_uuid         = ESP_GATT_UUID_PRI_SERVICE;
+static const uint16_t character_declaration_uuid   = ESP_GATT_UUID_CHAR_DECLARE;
+static const uint16_t character_client_config_uuid = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
+static const uint16_t lock_service_uuid            = GATTS_SERVICE_UUID_TEST_A;
+static const uint16_t lock_cmd_uuid                = GATTS_CHAR_UUID_TEST_A;
+static const uint8_t lock_cmd_property             = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t lock_cmd_ccc[2]               = {0x00, 0x00};
+
+// 命令特征值由应用回复（长写入要拼到 prepare_pool），其余由协议栈自动回复
+static const esp_gatts_attr_db_t lock_gatt_db[LOCK_IDX_NB] = {
+    [LOCK_IDX_SVC] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&primary_service_uuid, ESP_GATT_PERM_READ,
+                                            sizeof(uint16_t), sizeof(lock_service_uuid), (uint8_t *)&lock_service_uuid}},
+    [LOCK_IDX_CMD_CHAR] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ,
+                                                 sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&lock_cmd_property}},
+    [LOCK_IDX_CMD_VAL] = {{ESP_GATT_RSP_BY_APP}, {ESP_UUID_LEN_16, (uint8_t *)&lock_cmd_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                                  BLE_PROTO_MAX_FRAME, 0, NULL}},
+    [LOCK_IDX_CMD_CFG] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                                sizeof(uint16_t), sizeof(lock_cmd_ccc), (uint8_t *)lock_cmd_ccc}},
 };
 
-static uint8_t raw_scan_rsp_data[] = {
-    /* Complete Local Name */
-    0x0F, ESP_BLE_AD_TYPE_NAME_CMPL, 'E', 'S', 'P', '_', 'G', 'A', 'T', 'T', 'S', '_', 'D', 'E', 'M', 'O' // Length 15, Data Type ESP_BLE_AD_TYPE_NAME_CMPL, Data (ESP_GATTS_DEMO)
-};
-#else
-
-static uint8_t adv_service_uuid128[32] = {
-    /* LSB <--------------------------------------------------------------------------------> MSB */
-    // first uuid, 16bit, [12],[13] is the value
-    0xfb,
-    0x34,
-    0x9b,
-    0x5f,
-    0x80,
-    0x00,
-    0x00,
-    0x80,
-    0x00,
-    0x10,
-    0x00,
-    0x00,
-    0xEE,
-    0x00,
-    0x00,
-    0x00,
-    // second uuid, 32bit, [12], [13], [14], [15] is the value
-    0xfb,
-    0x34,
-    0x9b,
-    0x5f,
-    0x80,
-    0x00,
-    0x00,
-    0x80,
-    0x00,
-    0x10,
-    0x00,
-    0x00,
-    0xFF,
-    0x00,
-    0x00,
-    0x00,
+/*
+ * 批量传输服务（BleBulk）单独一张属性表，和门锁服务一起在启动时创建，句柄同样固定。
+ * 写入都由协议栈自动回复，数据特征值用无响应写入，写入的内容直接交给 BleBulk。
+ */
+enum {
+    BULK_IDX_SVC,
+    BULK_IDX_CTRL_CHAR,
+    BULK_IDX_CTRL_VAL, // 控制：带响应的写入，回复通过通知发回
+    BULK_IDX_CTRL_CFG,
+    BULK_IDX_DATA_CHAR,
+    BULK_IDX_DATA_VAL, // 数据：手机用无响应写入，门锁用通知
+    BULK_IDX_DATA_CFG,
+    BULK_IDX_NB,
 };
 
-// The length of adv data must be less than 31 bytes
-// static uint8_t test_manufacturer[TEST_MANUFACTURER_DATA_LEN] =  {0x12, 0x23, 0x45, 0x56};
-// adv data
-static esp_ble_adv_data_t adv_data = {
-    .set_scan_rsp        = false,
-    .include_name        = true,
-    .include_txpower     = false,
-    .min_interval        = 0x0006, // slave connection min interval, Time = min_interval * 1.25 msec
-    .max_interval        = 0x0010, // slave connection max interval, Time = max_interval * 1.25 msec
-    .appearance          = 0x00,
-    .manufacturer_len    = 0,    // TEST_MANUFACTURER_DATA_LEN,
-    .p_manufacturer_data = NULL, //&test_manufacturer[0],
-    .service_data_len    = 0,
-    .p_service_data      = NULL,
-    .service_uuid_len    = sizeof(adv_service_uuid128),
-    .p_service_uuid      = adv_service_uuid128,
-    .flag                = (ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT),
-};
-// scan response data
-static esp_ble_adv_data_t scan_rsp_data = {
-    .set_scan_rsp    = true,
-    .include_name    = true,
-    .include_txpower = true,
-    //.min_interval = 0x0006,
-    //.max_interval = 0x0010,
-    .appearance          = 0x00,
-    .manufacturer_len    = 0,    // TEST_MANUFACTURER_DATA_LEN,
-    .p_manufacturer_data = NULL, //&test_manufacturer[0],
-    .service_data_len    = 0,
-    .p_service_data      = NULL,
-    .service_uuid_len    = sizeof(adv_service_uuid128),
-    .p_service_uuid      = adv_service_uuid128,
-    .flag                = (ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT),
+static const uint16_t bulk_service_uuid = BULK_SERVICE_UUID;
+static const uint16_t bulk_ctrl_uuid    = BULK_CHAR_UUID_CTRL;
+static const uint16_t bulk_data_uuid    = BULK_CHAR_UUID_DATA;
+static const uint8_t bulk_ctrl_property = ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t bulk_data_property = ESP_GATT_CHAR_PROP_BIT_WRITE_NR | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
+static const uint8_t bulk_ctrl_ccc[2]   = {0x00, 0x00};
+static const uint8_t bulk_data_ccc[2]   = {0x00, 0x00};
+
+static const esp_gatts_attr_db_t bulk_gatt_db[BULK_IDX_NB] = {
+    [BULK_IDX_SVC] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&primary_service_uuid, ESP_GATT_PERM_READ,
+                                            sizeof(uint16_t), sizeof(bulk_service_uuid), (uint8_t *)&bulk_service_uuid}},
+    [BULK_IDX_CTRL_CHAR] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ,
+                                                  sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&bulk_ctrl_property}},
+    [BULK_IDX_CTRL_VAL] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&bulk_ctrl_uuid, ESP_GATT_PERM_WRITE,
+                                                 BLE_BULK_CTRL_LEN, 0, NULL}},
+    [BULK_IDX_CTRL_CFG] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                                 sizeof(uint16_t), sizeof(bulk_ctrl_ccc), (uint8_t *)bulk_ctrl_ccc}},
+    [BULK_IDX_DATA_CHAR] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_declaration_uuid, ESP_GATT_PERM_READ,
+                                                  sizeof(uint8_t), sizeof(uint8_t), (uint8_t *)&bulk_data_property}},
+    [BULK_IDX_DATA_VAL] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&bulk_data_uuid, ESP_GATT_PERM_WRITE,
+                                                 BLE_BULK_MTU - 3, 0, NULL}},
+    [BULK_IDX_DATA_CFG] = {{ESP_GATT_AUTO_RSP}, {ESP_UUID_LEN_16, (uint8_t *)&character_client_config_uuid, ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
+                                                 sizeof(uint16_t), sizeof(bulk_data_ccc), (uint8_t *)bulk_data_ccc}},
 };
+static uint16_t bulk_handles[BULK_IDX_NB];
 
-#endif /* CONFIG_SET_RAW_ADV_DATA */
+// 广播数据（原始格式，一次配置完成）：Flags、服务 UUID、设备名（放不下时截短）
+#define ADV_DATA_MAX 31
+static uint8_t raw_adv_data[ADV_DATA_MAX];
+static uint8_t raw_adv_len = 0;
+// 广播是否正在进行，改变间隔时要先停止
+static uint8_t adv_running = 0;
 
+// 间隔由 BleAdv 按突发 / 慢速设置
 static esp_ble_adv_params_t adv_params = {
     .adv_int_min   = 0x20,
-    .adv_int_max   = 0x40,
+    .adv_int_max   = 0x30,
     .adv_type      = ADV_TYPE_IND,
-    .own_addr_type = BLE_ADDR_TYPE_PUBLIC,
+    .own_addr_type = BLE_ADDR_TYPE_RPA_PUBLIC, // 可解析私有地址，只有绑定的手机能认出门锁
     //.peer_addr            =
     //.peer_addr_type       =
     .channel_map       = ADV_CHNL_ALL,
@@ -173,23 +157,21 @@ static esp_ble_adv_params_t adv_params = {
 
 #define PROFILE_NUM      1
 #define PROFILE_A_APP_ID 0
-#define PROFILE_B_APP_ID 1
 
 struct gatts_profile_inst {
     esp_gatts_cb_t gatts_cb;
     uint16_t gatts_if;
     uint16_t app_id;
-    uint16_t conn_id;
-    uint16_t service_handle;
-    esp_gatt_srvc_id_t service_id;
-    uint16_t char_handle;
-    esp_bt_uuid_t char_uuid;
-    esp_gatt_perm_t perm;
-    esp_gatt_char_prop_t property;
-    uint16_t descr_handle;
-    esp_bt_uuid_t descr_uuid;
+    uint16_t handles[LOCK_IDX_NB]; // 属性表中各属性的句柄
 };
 
+// 注册应用的时间，用于统计建立数据库的耗时
+static int64_t gatt_register_us = 0;
+
+// 协议栈占用：初始化前的空闲堆和开始初始化的时间
+static uint32_t host_heap_before = 0;
+static int64_t host_init_us      = 0;
+
 /* One gatt-based profile one app_id and one gatts_if, this array will store the gatts_if returned by ESP_GATTS_REG_EVT */
 static struct gatts_profile_inst gl_profile_tab[PROFILE_NUM] = {
     [PROFILE_A_APP_ID] = {
@@ -199,45 +181,100 @@ static struct gatts_profile_inst gl_profile_tab[PROFILE_NUM] = {
 };
 
 typedef struct {
-    uint8_t *prepare_buf;
-    int prepare_len;
+    uint16_t conn_id;
+    uint8_t used;
+    uint16_t prepare_len;
+    uint8_t prepare_buf[PREPARE_BUF_MAX_SIZE];
 } prepare_type_env_t;
 
-static prepare_type_env_t a_prepare_write_env;
+static prepare_type_env_t prepare_pool[PREPARE_POOL_SIZE];
+// 回复 prepare write 的响应，只在协议栈任务中使用
+static esp_gatt_rsp_t prepare_rsp;
 
-void example_write_event_env(esp_gatt_if_t gatts_if, prepare_type_env_t *prepare_write_env, esp_ble_gatts_cb_param_t *param);
-void example_exec_write_event_env(prepare_type_env_t *prepare_write_env, esp_ble_gatts_cb_param_t *param);
+static void example_write_event_env(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
+static void example_exec_write_event_env(esp_ble_gatts_cb_param_t *param);
+static void example_release_write_env(uint16_t conn_id);
+static void Bluetooth_BuildAdvData(void);
+
+/*
+ * 用协议栈保存的绑定列表核对最近使用顺序，并把已绑定的手机加入白名单。
+ * 手机用可解析私有地址连接时控制器先用 IRK 解析成身份地址，再和白名单比较。
+ */
+static void Bluetooth_SyncBonds(void)
+{
+    static esp_ble_bond_dev_t bonded[BLE_BOND_MAX];
+    ble_bond_peer_t peers[BLE_BOND_MAX];
+    int count = BLE_BOND_MAX;
+
+    if (esp_ble_get_bond_device_list(&count, bonded) != ESP_OK) {
+        count = 0;
+    }
+    esp_ble_gap_clear_whitelist();
+    for (int i = 0; i < count; i++) {
+        memcpy(peers[i].bda, bonded[i].bd_addr, 6);
+        peers[i].addr_type = (bonded[i].bond_key.key_mask & ESP_BLE_ID_KEY_MASK) ? bonded[i].bond_key.pid_key.addr_type : BLE_ADDR_TYPE_PUBLIC;
+        esp_ble_gap_update_whitelist(true, peers[i].bda, (esp_ble_wl_addr_type_t)peers[i].addr_type);
+    }
+    BleBond_Sync(peers, count);
+    ESP_LOGI(GATTS_TAG, "%d bonded devices", count);
+}
 
 static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param_t *param)
 {
     switch (event) {
-#ifdef CONFIG_SET_RAW_ADV_DATA
-        case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT:
-            adv_config_done &= (~adv_config_flag);
-            if (adv_config_done == 0) {
-                esp_ble_gap_start_advertising(&adv_params);
+        case ESP_GAP_BLE_SET_LOCAL_PRIVACY_COMPLETE_EVT: {
+            if (param->local_privacy_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(GATTS_TAG, "Set local privacy failed, status %d", param->local_privacy_cmpl.status);
+                break;
+            }
+            Bluetooth_SyncBonds();
+            Bluetooth_BuildAdvData();
+            esp_err_t raw_adv_ret = esp_ble_gap_config_adv_data_raw(raw_adv_data, raw_adv_len);
+            if (raw_adv_ret) {
+                ESP_LOGE(GATTS_TAG, "config raw adv data failed, error code = %x ", raw_adv_ret);
             }
             break;
-        case ESP_GAP_BLE_SCAN_RSP_DATA_RAW_SET_COMPLETE_EVT:
-            adv_config_done &= (~scan_rsp_config_flag);
-            if (adv_config_done == 0) {
-                esp_ble_gap_start_advertising(&adv_params);
+        }
+        case ESP_GAP_BLE_SEC_REQ_EVT:
+            // 手机请求加密：同意，新手机在这里配对并绑定
+            esp_ble_gap_security_rsp(param->ble_security.ble_req.bd_addr, true);
+            break;
+        case ESP_GAP_BLE_AUTH_CMPL_EVT: {
+            esp_ble_auth_cmpl_t *auth = &param->ble_security.auth_cmpl;
+            if (!auth->success) {
+                // 不配对的手机仍然可以使用，只是没有定向广播快速回连
+                ESP_LOGW(GATTS_TAG, "Pairing failed, remote " ESP_BD_ADDR_STR ", reason 0x%x", ESP_BD_ADDR_HEX(auth->bd_addr), auth->fail_reason);
+                break;
+            }
+            ESP_LOGI(GATTS_TAG, "Encrypted, remote " ESP_BD_ADDR_STR ", addr type %d, auth mode %d",
+                     ESP_BD_ADDR_HEX(auth->bd_addr), auth->addr_type, auth->auth_mode);
+            if (!BleBond_IsBonded(auth->bd_addr)) {
+                esp_ble_gap_update_whitelist(true, auth->bd_addr, (esp_ble_wl_addr_type_t)auth->addr_type);
             }
+            BleBond_Used(auth->bd_addr, auth->addr_type);
             break;
-#else
-        case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
-            adv_config_done &= (~adv_config_flag);
-            if (adv_config_done == 0) {
-                esp_ble_gap_start_advertising(&adv_params);
+        }
+        case ESP_GAP_BLE_REMOVE_BOND_DEV_COMPLETE_EVT:
+            if (param->remove_bond_dev_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+                BleBond_Removed(param->remove_bond_dev_cmpl.bd_addr);
             }
             break;
-        case ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT:
-            adv_config_done &= (~scan_rsp_config_flag);
-            if (adv_config_done == 0) {
-                esp_ble_gap_start_advertising(&adv_params);
+        case ESP_GAP_BLE_UPDATE_WHITELIST_COMPLETE_EVT:
+            if (param->update_whitelist_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(GATTS_TAG, "Update whitelist failed, status %d", param->update_whitelist_cmpl.status);
             }
             break;
-#endif
+        case ESP_GAP_BLE_ADV_DATA_RAW_SET_COMPLETE_EVT: {
+            if (param->adv_data_raw_cmpl.status != ESP_BT_STATUS_SUCCESS) {
+                ESP_LOGE(GATTS_TAG, "Set adv data failed, status %d", param->adv_data_raw_cmpl.status);
+                break;
+            }
+            uint32_t heap_after = esp_get_free_heap_size();
+            ESP_LOGI(GATTS_TAG, "host bluedroid ready %" PRId64 " ms after init, heap %" PRIu32 " -> %" PRIu32 " (%" PRIu32 " bytes)",
+                     (esp_timer_get_time() - host_init_us) / 1000, host_heap_before, heap_after, host_heap_before - heap_after);
+            BleAdv_Ready();
+            break;
+        }
         case ESP_GAP_BLE_ADV_START_COMPLETE_EVT:
             // advertising start complete event to indicate advertising start successfully or failed
             if (param->adv_start_cmpl.status != ESP_BT_STATUS_SUCCESS) {
@@ -259,52 +296,79 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
                      param->update_conn_params.conn_int,
                      param->update_conn_params.latency,
                      param->update_conn_params.timeout);
+            BleConn_Updated(param->update_conn_params.bda, param->update_conn_params.status != ESP_BT_STATUS_SUCCESS,
+                            param->update_conn_params.conn_int, param->update_conn_params.latency,
+                            param->update_conn_params.timeout);
             break;
         case ESP_GAP_BLE_SET_PKT_LENGTH_COMPLETE_EVT:
             ESP_LOGI(GATTS_TAG, "Packet length update, status %d, rx %d, tx %d",
                      param->pkt_data_length_cmpl.status,
                      param->pkt_data_length_cmpl.params.rx_len,
                      param->pkt_data_length_cmpl.params.tx_len);
+            if (param->pkt_data_length_cmpl.status == ESP_BT_STATUS_SUCCESS) {
+                BleBulk_Link(param->pkt_data_length_cmpl.params.tx_len, 0);
+            }
             break;
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+        case ESP_GAP_BLE_PHY_UPDATE_COMPLETE_EVT:
+            ESP_LOGI(GATTS_TAG, "PHY update, status %d, tx %d, rx %d",
+                     param->phy_update.status, param->phy_update.tx_phy, param->phy_update.rx_phy);
+            if (param->phy_update.status == ESP_BT_STATUS_SUCCESS) {
+                BleBulk_Link(0, param->phy_update.tx_phy == ESP_BLE_GAP_PHY_2M ? 2 : 1);
+            }
+            break;
+#endif
         default:
             break;
     }
 }
 
-void example_write_event_env(esp_gatt_if_t gatts_if, prepare_type_env_t *prepare_write_env, esp_ble_gatts_cb_param_t *param)
+// 找到连接正在使用的拼接缓冲，create 时没有就分配一个
+static prepare_type_env_t *example_find_write_env(uint16_t conn_id, uint8_t create)
+{
+    prepare_type_env_t *free_env = NULL;
+    for (uint8_t i = 0; i < PREPARE_POOL_SIZE; i++) {
+        if (prepare_pool[i].used && prepare_pool[i].conn_id == conn_id) {
+            return &prepare_pool[i];
+        }
+        if (!prepare_pool[i].used && free_env == NULL) {
+            free_env = &prepare_pool[i];
+        }
+    }
+    if (!create || free_env == NULL) return NULL;
+    free_env->used        = 1;
+    free_env->conn_id     = conn_id;
+    free_env->prepare_len = 0;
+    return free_env;
+}
+
+static void example_write_event_env(esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
 {
     esp_gatt_status_t status = ESP_GATT_OK;
     if (param->write.need_rsp) {
         if (param->write.is_prep) {
+            prepare_type_env_t *prepare_write_env = NULL;
             if (param->write.offset > PREPARE_BUF_MAX_SIZE) {
                 status = ESP_GATT_INVALID_OFFSET;
             } else if ((param->write.offset + param->write.len) > PREPARE_BUF_MAX_SIZE) {
                 status = ESP_GATT_INVALID_ATTR_LEN;
             }
-            if (status == ESP_GATT_OK && prepare_write_env->prepare_buf == NULL) {
-                prepare_write_env->prepare_buf = (uint8_t *)malloc(PREPARE_BUF_MAX_SIZE * sizeof(uint8_t));
-                prepare_write_env->prepare_len = 0;
-                if (prepare_write_env->prepare_buf == NULL) {
-                    ESP_LOGE(GATTS_TAG, "Gatt_server prep no mem");
-                    status = ESP_GATT_NO_RESOURCES;
+            if (status == ESP_GATT_OK) {
+                prepare_write_env = example_find_write_env(param->write.conn_id, 1);
+                if (prepare_write_env == NULL) {
+                    ESP_LOGE(GATTS_TAG, "Gatt_server prep pool full");
+                    status = ESP_GATT_PREPARE_Q_FULL;
                 }
             }
 
-            esp_gatt_rsp_t *gatt_rsp = (esp_gatt_rsp_t *)malloc(sizeof(esp_gatt_rsp_t));
-            if (gatt_rsp) {
-                gatt_rsp->attr_value.len      = param->write.len;
-                gatt_rsp->attr_value.handle   = param->write.handle;
-                gatt_rsp->attr_value.offset   = param->write.offset;
-                gatt_rsp->attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
-                memcpy(gatt_rsp->attr_value.value, param->write.value, param->write.len);
-                esp_err_t response_err = esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, gatt_rsp);
-                if (response_err != ESP_OK) {
-                    ESP_LOGE(GATTS_TAG, "Send response error\n");
-                }
-                free(gatt_rsp);
-            } else {
-                ESP_LOGE(GATTS_TAG, "malloc failed, no resource to send response error\n");
-                status = ESP_GATT_NO_RESOURCES;
+            prepare_rsp.attr_value.len      = param->write.len;
+            prepare_rsp.attr_value.handle   = param->write.handle;
+            prepare_rsp.attr_value.offset   = param->write.offset;
+            prepare_rsp.attr_value.auth_req = ESP_GATT_AUTH_REQ_NONE;
+            memcpy(prepare_rsp.attr_value.value, param->write.value, param->write.len);
+            esp_err_t response_err = esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, &prepare_rsp);
+            if (response_err != ESP_OK) {
+                ESP_LOGE(GATTS_TAG, "Send response error\n");
             }
             if (status != ESP_GATT_OK) {
                 return;
@@ -312,7 +376,9 @@ void example_write_event_env(esp_gatt_if_t gatts_if, prepare_type_env_t *prepare
             memcpy(prepare_write_env->prepare_buf + param->write.offset,
                    param->write.value,
                    param->write.len);
-            prepare_write_env->prepare_len += param->write.len;
+            if (param->write.offset + param->write.len > prepare_write_env->prepare_len) {
+                prepare_write_env->prepare_len = param->write.offset + param->write.len;
+            }
 
         } else {
             esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, NULL);
@@ -320,18 +386,50 @@ void example_write_event_env(esp_gatt_if_t gatts_if, prepare_type_env_t *prepare
     }
 }
 
-void example_exec_write_event_env(prepare_type_env_t *prepare_write_env, esp_ble_gatts_cb_param_t *param)
+static void example_exec_write_event_env(esp_ble_gatts_cb_param_t *param)
 {
+    prepare_type_env_t *prepare_write_env = example_find_write_env(param->exec_write.conn_id, 0);
+    if (prepare_write_env == NULL) return;
+
     if (param->exec_write.exec_write_flag == ESP_GATT_PREP_WRITE_EXEC) {
-        ESP_LOG_BUFFER_HEX(GATTS_TAG, prepare_write_env->prepare_buf, prepare_write_env->prepare_len);
+        // 拼接好的长写入（例如批量下发密码）按一次普通写入处理，拷贝进会话后拼接缓冲马上归还
+        BleSession_Submit(param->exec_write.conn_id, prepare_write_env->prepare_buf, prepare_write_env->prepare_len);
     } else {
         ESP_LOGI(GATTS_TAG, "Prepare write cancel");
     }
-    if (prepare_write_env->prepare_buf) {
-        free(prepare_write_env->prepare_buf);
-        prepare_write_env->prepare_buf = NULL;
+    example_release_write_env(param->exec_write.conn_id);
+}
+
+// 执行、取消或者断开连接时归还拼接缓冲
+static void example_release_write_env(uint16_t conn_id)
+{
+    prepare_type_env_t *prepare_write_env = example_find_write_env(conn_id, 0);
+    if (prepare_write_env) {
+        prepare_write_env->used        = 0;
+        prepare_write_env->prepare_len = 0;
     }
-    prepare_write_env->prepare_len = 0;
+}
+
+static void Bluetooth_BuildAdvData(void)
+{
+    // Flags 3 字节，服务 UUID 4 字节，设备名的长度和类型 2 字节
+    uint8_t *p         = raw_adv_data;
+    size_t name        = strlen(test_device_name);
+    size_t room        = ADV_DATA_MAX - 3 - 4 - 2;
+    uint8_t short_name = name > room;
+
+    *p++ = 2;
+    *p++ = ESP_BLE_AD_TYPE_FLAG;
+    *p++ = ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT;
+    *p++ = 3;
+    *p++ = ESP_BLE_AD_TYPE_16SRV_CMPL;
+    *p++ = GATTS_SERVICE_UUID_TEST_A & 0xff;
+    *p++ = GATTS_SERVICE_UUID_TEST_A >> 8;
+    if (short_name) name = room;
+    *p++ = name + 1;
+    *p++ = short_name ? ESP_BLE_AD_TYPE_NAME_SHORT : ESP_BLE_AD_TYPE_NAME_CMPL;
+    memcpy(p, test_device_name, name);
+    raw_adv_len = p + name - raw_adv_data;
 }
 
 static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param)
@@ -339,197 +437,126 @@ static void gatts_profile_a_event_handler(esp_gatts_cb_event_t event, esp_gatt_i
     switch (event) {
         case ESP_GATTS_REG_EVT:
             ESP_LOGI(GATTS_TAG, "GATT server register, status %d, app_id %d, gatts_if %d", param->reg.status, param->reg.app_id, gatts_if);
-            gl_profile_tab[PROFILE_A_APP_ID].service_id.is_primary          = true;
-            gl_profile_tab[PROFILE_A_APP_ID].service_id.id.inst_id          = 0x00;
-            gl_profile_tab[PROFILE_A_APP_ID].service_id.id.uuid.len         = ESP_UUID_LEN_16;
-            gl_profile_tab[PROFILE_A_APP_ID].service_id.id.uuid.uuid.uuid16 = GATTS_SERVICE_UUID_TEST_A;
-
+            gatt_register_us = esp_timer_get_time();
             esp_err_t set_dev_name_ret = esp_ble_gap_set_device_name(test_device_name);
             if (set_dev_name_ret) {
                 ESP_LOGE(GATTS_TAG, "set device name failed, error code = %x", set_dev_name_ret);
             }
-#ifdef CONFIG_EXAMPLE_SET_RAW_ADV_DATA
-            esp_err_t raw_adv_ret = esp_ble_gap_config_adv_data_raw(raw_adv_data, sizeof(raw_adv_data));
-            if (raw_adv_ret) {
-                ESP_LOGE(GATTS_TAG, "config raw adv data failed, error code = %x ", raw_adv_ret);
+            // 私有地址配置好后再配置广播数据（ESP_GAP_BLE_SET_LOCAL_PRIVACY_COMPLETE_EVT）
+            esp_err_t privacy_ret = esp_ble_gap_config_local_privacy(true);
+            if (privacy_ret) {
+                ESP_LOGE(GATTS_TAG, "config local privacy failed, error code = %x", privacy_ret);
             }
-            adv_config_done |= adv_config_flag;
-            esp_err_t raw_scan_ret = esp_ble_gap_config_scan_rsp_data_raw(raw_scan_rsp_data, sizeof(raw_scan_rsp_data));
-            if (raw_scan_ret) {
-                ESP_LOGE(GATTS_TAG, "config raw scan rsp data failed, error code = %x", raw_scan_ret);
+            esp_err_t create_attr_ret = esp_ble_gatts_create_attr_tab(lock_gatt_db, gatts_if, LOCK_IDX_NB, 0);
+            if (create_attr_ret) {
+                ESP_LOGE(GATTS_TAG, "create attr table failed, error code = %x", create_attr_ret);
             }
-            adv_config_done |= scan_rsp_config_flag;
-#else
-            // config adv data
-            esp_err_t ret = esp_ble_gap_config_adv_data(&adv_data);
-            if (ret) {
-                ESP_LOGE(GATTS_TAG, "config adv data failed, error code = %x", ret);
+            create_attr_ret = esp_ble_gatts_create_attr_tab(bulk_gatt_db, gatts_if, BULK_IDX_NB, 1);
+            if (create_attr_ret) {
+                ESP_LOGE(GATTS_TAG, "create bulk attr table failed, error code = %x", create_attr_ret);
             }
-            adv_config_done |= adv_config_flag;
-            // config scan response data
-            ret = esp_ble_gap_config_adv_data(&scan_rsp_data);
-            if (ret) {
-                ESP_LOGE(GATTS_TAG, "config scan response data failed, error code = %x", ret);
-            }
-            adv_config_done |= scan_rsp_config_flag;
-
-#endif
-            esp_ble_gatts_create_service(gatts_if, &gl_profile_tab[PROFILE_A_APP_ID].service_id, GATTS_NUM_HANDLE_TEST_A);
             break;
         case ESP_GATTS_READ_EVT: {
             ESP_LOGI(GATTS_TAG, "Characteristic read, conn_id %d, trans_id %" PRIu32 ", handle %d", param->read.conn_id, param->read.trans_id, param->read.handle);
             esp_gatt_rsp_t rsp;
             memset(&rsp, 0, sizeof(esp_gatt_rsp_t));
+            // 读命令特征值得到协议版本和最大帧长（与 PING 的响应相同）
             rsp.attr_value.handle   = param->read.handle;
-            rsp.attr_value.len      = 4;
-            rsp.attr_value.value[0] = 0xde;
-            rsp.attr_value.value[1] = 0xed;
-            rsp.attr_value.value[2] = 0xbe;
-            rsp.attr_value.value[3] = 0xef;
+            rsp.attr_value.len      = 3;
+            rsp.attr_value.value[0] = BLE_PROTO_VERSION;
+            rsp.attr_value.value[1] = BLE_PROTO_MAX_FRAME & 0xff;
+            rsp.attr_value.value[2] = BLE_PROTO_MAX_FRAME >> 8;
             esp_ble_gatts_send_response(gatts_if, param->read.conn_id, param->read.trans_id,
                                         ESP_GATT_OK, &rsp);
             break;
         }
         case ESP_GATTS_WRITE_EVT: {
+            // 批量传输的写入很多，不打印
+            if (param->write.handle == bulk_handles[BULK_IDX_CTRL_VAL] || param->write.handle == bulk_handles[BULK_IDX_DATA_VAL]) {
+                BleBulk_Write(param->write.conn_id, param->write.handle == bulk_handles[BULK_IDX_CTRL_VAL] ? BLE_BULK_CHAN_CTRL : BLE_BULK_CHAN_DATA,
+                              param->write.value, param->write.len);
+                break;
+            }
             ESP_LOGI(GATTS_TAG, "Characteristic write, conn_id %d, trans_id %" PRIu32 ", handle %d", param->write.conn_id, param->write.trans_id, param->write.handle);
-            if (!param->write.is_prep) {
+            if (!param->write.is_prep && param->write.handle == gl_profile_tab[PROFILE_A_APP_ID].handles[LOCK_IDX_CMD_VAL]) {
                 ESP_LOGI(GATTS_TAG, "value len %d, value ", param->write.len);
                 ESP_LOG_BUFFER_HEX(GATTS_TAG, param->write.value, param->write.len);
-                if (param->write.len == 8 && !memcmp(param->write.value, "openlock", 8)) {
-                    Motor_OpenLock();
-                }
-                printf("msg:%s len:%d\r\n", param->write.value, param->write.len);
-                if (param->write.len == 10) {
-                    if (!memcmp(param->write.value, "cpw:", 4)) {
-                        Flash_WritePassword((char *)(param->write.value + 4));
-                    }
-                }
-                if (ota_task_handle != NULL && param->write.len == 3) {
-                    if (!memcmp(param->write.value, "ota", 3)) {
-                        xTaskNotifyGive(ota_task_handle);
-                    }
-                }
-
-                if (gl_profile_tab[PROFILE_A_APP_ID].descr_handle == param->write.handle && param->write.len == 2) {
-                    uint16_t descr_value = param->write.value[1] << 8 | param->write.value[0];
-                    if (descr_value == 0x0001) {
-                        if (a_property & ESP_GATT_CHAR_PROP_BIT_NOTIFY) {
-                            ESP_LOGI(GATTS_TAG, "Notification enable");
-                            uint8_t notify_data[15];
-                            for (int i = 0; i < sizeof(notify_data); ++i) {
-                                notify_data[i] = i % 0xff;
-                            }
-                            // the size of notify_data[] need less than MTU size
-                            esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, gl_profile_tab[PROFILE_A_APP_ID].char_handle,
-                                                        sizeof(notify_data), notify_data, false);
-                        }
-                    } else if (descr_value == 0x0002) {
-                        if (a_property & ESP_GATT_CHAR_PROP_BIT_INDICATE) {
-                            ESP_LOGI(GATTS_TAG, "Indication enable");
-                            uint8_t indicate_data[15];
-                            for (int i = 0; i < sizeof(indicate_data); ++i) {
-                                indicate_data[i] = i % 0xff;
-                            }
-                            // the size of indicate_data[] need less than MTU size
-                            esp_ble_gatts_send_indicate(gatts_if, param->write.conn_id, gl_profile_tab[PROFILE_A_APP_ID].char_handle,
-                                                        sizeof(indicate_data), indicate_data, true);
-                        }
-                    } else if (descr_value == 0x0000) {
-                        ESP_LOGI(GATTS_TAG, "Notification/Indication disable");
-                    } else {
-                        ESP_LOGE(GATTS_TAG, "Unknown descriptor value");
-                        ESP_LOG_BUFFER_HEX(GATTS_TAG, param->write.value, param->write.len);
-                    }
-                }
+                // 命令在命令任务中按连接轮流处理，不占用协议栈的任务
+                BleSession_Submit(param->write.conn_id, param->write.value, param->write.len);
+            } else if (param->write.handle == gl_profile_tab[PROFILE_A_APP_ID].handles[LOCK_IDX_CMD_CFG] && param->write.len == 2) {
+                uint16_t descr_value = param->write.value[1] << 8 | param->write.value[0];
+                ESP_LOGI(GATTS_TAG, "Notification %s", descr_value & 0x0001 ? "enable" : "disable");
             }
-            example_write_event_env(gatts_if, &a_prepare_write_env, param);
+            example_write_event_env(gatts_if, param);
             break;
         }
         case ESP_GATTS_EXEC_WRITE_EVT:
             ESP_LOGI(GATTS_TAG, "Execute write");
             esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, ESP_GATT_OK, NULL);
-            example_exec_write_event_env(&a_prepare_write_env, param);
+            example_exec_write_event_env(param);
             break;
         case ESP_GATTS_MTU_EVT:
             ESP_LOGI(GATTS_TAG, "MTU exchange, MTU %d", param->mtu.mtu);
+            BleBulk_Mtu(param->mtu.conn_id, param->mtu.mtu);
             break;
         case ESP_GATTS_UNREG_EVT:
             break;
-        case ESP_GATTS_CREATE_EVT:
-            ESP_LOGI(GATTS_TAG, "Service create, status %d, service_handle %d", param->create.status, param->create.service_handle);
-            gl_profile_tab[PROFILE_A_APP_ID].service_handle        = param->create.service_handle;
-            gl_profile_tab[PROFILE_A_APP_ID].char_uuid.len         = ESP_UUID_LEN_16;
-            gl_profile_tab[PROFILE_A_APP_ID].char_uuid.uuid.uuid16 = GATTS_CHAR_UUID_TEST_A;
-
-            esp_ble_gatts_start_service(gl_profile_tab[PROFILE_A_APP_ID].service_handle);
-            a_property             = ESP_GATT_CHAR_PROP_BIT_READ | ESP_GATT_CHAR_PROP_BIT_WRITE | ESP_GATT_CHAR_PROP_BIT_NOTIFY;
-            esp_err_t add_char_ret = esp_ble_gatts_add_char(gl_profile_tab[PROFILE_A_APP_ID].service_handle, &gl_profile_tab[PROFILE_A_APP_ID].char_uuid,
-                                                            ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE,
-                                                            a_property,
-                                                            &gatts_demo_char1_val, NULL);
-            if (add_char_ret) {
-                ESP_LOGE(GATTS_TAG, "add char failed, error code =%x", add_char_ret);
-            }
-            break;
-        case ESP_GATTS_ADD_INCL_SRVC_EVT:
-            break;
-        case ESP_GATTS_ADD_CHAR_EVT: {
-            uint16_t length = 0;
-            const uint8_t *prf_char;
-
-            ESP_LOGI(GATTS_TAG, "Characteristic add, status %d, attr_handle %d, service_handle %d",
-                     param->add_char.status, param->add_char.attr_handle, param->add_char.service_handle);
-            gl_profile_tab[PROFILE_A_APP_ID].char_handle            = param->add_char.attr_handle;
-            gl_profile_tab[PROFILE_A_APP_ID].descr_uuid.len         = ESP_UUID_LEN_16;
-            gl_profile_tab[PROFILE_A_APP_ID].descr_uuid.uuid.uuid16 = ESP_GATT_UUID_CHAR_CLIENT_CONFIG;
-            esp_err_t get_attr_ret                                  = esp_ble_gatts_get_attr_value(param->add_char.attr_handle, &length, &prf_char);
-            if (get_attr_ret == ESP_FAIL) {
-                ESP_LOGE(GATTS_TAG, "ILLEGAL HANDLE");
-            }
-
-            ESP_LOGI(GATTS_TAG, "the gatts demo char length = %x", length);
-            for (int i = 0; i < length; i++) {
-                ESP_LOGI(GATTS_TAG, "prf_char[%x] =%x", i, prf_char[i]);
+        case ESP_GATTS_CREAT_ATTR_TAB_EVT:
+            if (param->add_attr_tab.svc_uuid.uuid.uuid16 == BULK_SERVICE_UUID) {
+                if (param->add_attr_tab.status != ESP_GATT_OK || param->add_attr_tab.num_handle != BULK_IDX_NB) {
+                    ESP_LOGE(GATTS_TAG, "create bulk attr table failed, status %d, num_handle %d",
+                             param->add_attr_tab.status, param->add_attr_tab.num_handle);
+                    break;
+                }
+                memcpy(bulk_handles, param->add_attr_tab.handles, sizeof(bulk_handles));
+                esp_ble_gatts_start_service(bulk_handles[BULK_IDX_SVC]);
+                break;
             }
-            esp_err_t add_descr_ret = esp_ble_gatts_add_char_descr(gl_profile_tab[PROFILE_A_APP_ID].service_handle, &gl_profile_tab[PROFILE_A_APP_ID].descr_uuid,
-                                                                   ESP_GATT_PERM_READ | ESP_GATT_PERM_WRITE, NULL, NULL);
-            if (add_descr_ret) {
-                ESP_LOGE(GATTS_TAG, "add char descr failed, error code =%x", add_descr_ret);
+            if (param->add_attr_tab.status != ESP_GATT_OK || param->add_attr_tab.num_handle != LOCK_IDX_NB) {
+                ESP_LOGE(GATTS_TAG, "create attr table failed, status %d, num_handle %d",
+                         param->add_attr_tab.status, param->add_attr_tab.num_handle);
+                break;
             }
-            break;
-        }
-        case ESP_GATTS_ADD_CHAR_DESCR_EVT:
-            gl_profile_tab[PROFILE_A_APP_ID].descr_handle = param->add_char_descr.attr_handle;
-            ESP_LOGI(GATTS_TAG, "Descriptor add, status %d, attr_handle %d, service_handle %d",
-                     param->add_char_descr.status, param->add_char_descr.attr_handle, param->add_char_descr.service_handle);
+            memcpy(gl_profile_tab[PROFILE_A_APP_ID].handles, param->add_attr_tab.handles, sizeof(gl_profile_tab[PROFILE_A_APP_ID].handles));
+            esp_ble_gatts_start_service(gl_profile_tab[PROFILE_A_APP_ID].handles[LOCK_IDX_SVC]);
             break;
         case ESP_GATTS_DELETE_EVT:
             break;
         case ESP_GATTS_START_EVT:
-            ESP_LOGI(GATTS_TAG, "Service start, status %d, service_handle %d",
-                     param->start.status, param->start.service_handle);
+            ESP_LOGI(GATTS_TAG, "Service start, status %d, service_handle %d, %" PRId64 " us after register",
+                     param->start.status, param->start.service_handle, esp_timer_get_time() - gatt_register_us);
             break;
         case ESP_GATTS_STOP_EVT:
             break;
-        case ESP_GATTS_CONNECT_EVT: {
-            esp_ble_conn_update_params_t conn_params = {0};
-            memcpy(conn_params.bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
-            /* For the IOS system, please reference the apple official documents about the ble connection parameters restrictions. */
-            conn_params.latency = 0;
-            conn_params.max_int = 0x20; // max_int = 0x20*1.25ms = 40ms
-            conn_params.min_int = 0x10; // min_int = 0x10*1.25ms = 20ms
-            conn_params.timeout = 400;  // timeout = 400*10ms = 4000ms
+        case ESP_GATTS_CONNECT_EVT:
             ESP_LOGI(GATTS_TAG, "Connected, conn_id %u, remote " ESP_BD_ADDR_STR "",
                      param->connect.conn_id, ESP_BD_ADDR_HEX(param->connect.remote_bda));
-            gl_profile_tab[PROFILE_A_APP_ID].conn_id = param->connect.conn_id;
-            // start sent the update connection parameters to the peer device.
-            esp_ble_gap_update_conn_params(&conn_params);
+            if (!BleSession_Open(param->connect.conn_id)) {
+                esp_ble_gap_disconnect(param->connect.remote_bda);
+                break;
+            }
+            // 已绑定的手机直接用保存的密钥加密，新手机开始配对（Just Works）
+            esp_ble_set_encryption(param->connect.remote_bda, ESP_BLE_SEC_ENCRYPT_NO_MITM);
+            // 批量传输：数据长度扩展，一个 247 字节的 ATT 包放进一个链路层包；控制器支持时换 2M PHY
+            esp_ble_gap_set_pkt_data_len(param->connect.remote_bda, BLE_BULK_LL_OCTETS);
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+            esp_ble_gap_set_preferred_phy(param->connect.remote_bda, 0, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+#endif
+            // 控制器在连上时停止广播；连接数没到上限时 BleAdv 重新开始
+            adv_running = 0;
+            BleAdv_Connected(BleSession_Count() >= BLE_SESSION_MAX);
+            // 连接参数由 BleConn 按命令活动切换
+            BleConn_Connected(param->connect.conn_id, param->connect.remote_bda, param->connect.conn_params.interval,
+                              param->connect.conn_params.latency, param->connect.conn_params.timeout);
             break;
-        }
         case ESP_GATTS_DISCONNECT_EVT:
             ESP_LOGI(GATTS_TAG, "Disconnected, remote " ESP_BD_ADDR_STR ", reason 0x%02x",
                      ESP_BD_ADDR_HEX(param->disconnect.remote_bda), param->disconnect.reason);
-            esp_ble_gap_start_advertising(&adv_params);
+            example_release_write_env(param->disconnect.conn_id);
+            BleBulk_Disconnected(param->disconnect.conn_id);
+            BleSession_Close(param->disconnect.conn_id);
+            BleConn_Disconnected(param->disconnect.conn_id);
+            BleAdv_Disconnected();
             break;
         case ESP_GATTS_CONF_EVT:
             ESP_LOGI(GATTS_TAG, "Confirm receive, status %d, attr_handle %d", param->conf.status, param->conf.handle);
@@ -576,22 +603,129 @@ static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_
     } while (0);
 }
 
+void Bluetooth_Notify(const uint8_t *data, size_t len)
+{
+    struct gatts_profile_inst *profile = &gl_profile_tab[PROFILE_A_APP_ID];
+    uint16_t conn_id                   = BleSession_Current();
+    if (profile->gatts_if == ESP_GATT_IF_NONE || conn_id == BLE_SESSION_NONE) return;
+
+    esp_ble_gatts_send_indicate(profile->gatts_if, conn_id, profile->handles[LOCK_IDX_CMD_VAL], len, (uint8_t *)data, false);
+}
+
+uint8_t Bluetooth_BulkSend(uint16_t conn_id, uint8_t chan, const uint8_t *data, size_t len)
+{
+    struct gatts_profile_inst *profile = &gl_profile_tab[PROFILE_A_APP_ID];
+    uint16_t handle                    = bulk_handles[chan == BLE_BULK_CHAN_CTRL ? BULK_IDX_CTRL_VAL : BULK_IDX_DATA_VAL];
+    if (profile->gatts_if == ESP_GATT_IF_NONE || handle == 0) return 0;
+    // 控制器的发送缓冲满了，BleBulk 等一个 tick 再发
+    if (esp_ble_get_cur_sendable_packets_num(conn_id) == 0) return 0;
+    return esp_ble_gatts_send_indicate(profile->gatts_if, conn_id, handle, len, (uint8_t *)data, false) == ESP_OK;
+}
+
+static void Bluetooth_RestartAdvertising(void)
+{
+    // 停止和开始按顺序排在协议栈的队列里，不用等停止完成
+    if (adv_running) {
+        esp_ble_gap_stop_advertising();
+    }
+    esp_err_t ret = esp_ble_gap_start_advertising(&adv_params);
+    if (ret != ESP_OK) {
+        ESP_LOGE(GATTS_TAG, "start advertising failed, error code = %x", ret);
+        return;
+    }
+    adv_running = 1;
+}
+
+void Bluetooth_StartAdvertising(uint16_t int_min, uint16_t int_max, uint8_t bonded_only)
+{
+    adv_params.adv_type          = ADV_TYPE_IND;
+    adv_params.adv_int_min       = int_min;
+    adv_params.adv_int_max       = int_max;
+    adv_params.adv_filter_policy = bonded_only ? ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST : ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    Bluetooth_RestartAdvertising();
+}
+
+void Bluetooth_StartDirectedAdvertising(const ble_bond_peer_t *peer)
+{
+    // 高占空比定向广播的间隔由控制器决定（不超过 3.75 ms），1.28 s 后自动结束
+    adv_params.adv_type          = ADV_TYPE_DIRECT_IND_HIGH;
+    adv_params.peer_addr_type    = peer->addr_type;
+    adv_params.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    memcpy(adv_params.peer_addr, peer->bda, sizeof(esp_bd_addr_t));
+    Bluetooth_RestartAdvertising();
+}
+
+void Bluetooth_StopAdvertising(void)
+{
+    if (!adv_running) return;
+    esp_ble_gap_stop_advertising();
+    adv_running = 0;
+}
+
+uint8_t Bluetooth_RequestConnParams(const uint8_t bda[6], const ble_conn_params_t *params)
+{
+    esp_ble_conn_update_params_t conn_params = {
+        .min_int = params->min_int,
+        .max_int = params->max_int,
+        .latency = params->latency,
+        .timeout = params->timeout,
+    };
+    memcpy(conn_params.bda, bda, sizeof(esp_bd_addr_t));
+    esp_err_t ret = esp_ble_gap_update_conn_params(&conn_params);
+    if (ret != ESP_OK) {
+        ESP_LOGE(GATTS_TAG, "update conn params failed, error code = %x", ret);
+        return 0;
+    }
+    return 1;
+}
+
+#if CONFIG_TRACE_ENABLE
+void Bluetooth_TraceSink(const uint8_t *data, size_t len)
+{
+    Bluetooth_Notify(data, len);
+    vTaskDelay(pdMS_TO_TICKS(TRACE_NOTIFY_GAP_MS));
+}
+#endif
+
+/*
+ * 配对参数：安全连接 + 绑定，交换加密密钥和身份密钥（IRK，用于解析双方的私有地址）。
+ * 门锁没有显示屏，用 Just Works。
+ */
+static void Bluetooth_SetSecurity(void)
+{
+    esp_ble_auth_req_t auth_req = ESP_LE_AUTH_REQ_SC_BOND;
+    esp_ble_io_cap_t iocap      = ESP_IO_CAP_NONE;
+    uint8_t key_size            = 16;
+    uint8_t init_key            = ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK;
+    uint8_t rsp_key             = ESP_BLE_ENC_KEY_MASK | ESP_BLE_ID_KEY_MASK;
+    uint8_t auth_option         = ESP_BLE_ONLY_ACCEPT_SPECIFIED_AUTH_DISABLE;
+
+    esp_ble_gap_set_security_param(ESP_BLE_SM_AUTHEN_REQ_MODE, &auth_req, sizeof(auth_req));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_IOCAP_MODE, &iocap, sizeof(iocap));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_MAX_KEY_SIZE, &key_size, sizeof(key_size));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_ONLY_ACCEPT_SPECIFIED_SEC_AUTH, &auth_option, sizeof(auth_option));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_SET_INIT_KEY, &init_key, sizeof(init_key));
+    esp_ble_gap_set_security_param(ESP_BLE_SM_SET_RSP_KEY, &rsp_key, sizeof(rsp_key));
+}
+
 void Bluetooth_Init(void)
 {
     esp_err_t ret;
 
-    // Initialize NVS.
-    ret = nvs_flash_init();
-    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret = nvs_flash_init();
-    }
-    ESP_ERROR_CHECK(ret);
+    // NVS 由 Flash_Init() 初始化、定时器服务由 TimerService_Init() 初始化，启动表保证它们先于蓝牙完成
+    BleSession_Init();
+    BleBulk_Init();
+    BleConn_Init();
+    BleBond_Init();
+    BleAdv_Init();
 
 #if CONFIG_EXAMPLE_CI_PIPELINE_ID
     memcpy(test_device_name, esp_bluedroid_get_example_name(), ESP_BLE_ADV_NAME_LEN_MAX);
 #endif
 
+    host_heap_before = esp_get_free_heap_size();
+    host_init_us     = esp_timer_get_time();
+
     ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
 
     esp_bt_controller_config_t bt_cfg = BT_CONTROLLER_INIT_CONFIG_DEFAULT();
@@ -628,16 +762,12 @@ void Bluetooth_Init(void)
         ESP_LOGE(GATTS_TAG, "gap register error, error code = %x", ret);
         return;
     }
+    Bluetooth_SetSecurity();
     ret = esp_ble_gatts_app_register(PROFILE_A_APP_ID);
     if (ret) {
         ESP_LOGE(GATTS_TAG, "gatts app register error, error code = %x", ret);
         return;
     }
-    ret = esp_ble_gatts_app_register(PROFILE_B_APP_ID);
-    if (ret) {
-        ESP_LOGE(GATTS_TAG, "gatts app register error, error code = %x", ret);
-        return;
-    }
     esp_err_t local_mtu_ret = esp_ble_gatt_set_local_mtu(500);
     if (local_mtu_ret) {
         ESP_LOGE(GATTS_TAG, "set local  MTU failed, error code = %x", local_mtu_ret);
@@ -1,3 +1,74 @@
 #pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "ble_conn.h"
+#include "ble_bond.h"
 
-void Bluetooth_Init(void);
\ No newline at end of file
+/*
+ * 蓝牙后端的接口，与具体的协议栈无关。按 menuconfig 的 Bluetooth host 选择编译其中一个实现：
+ *  - bluetooth.c：Bluedroid
+ *  - bluetooth_nimble.c：NimBLE，内存和固件空间占用更小
+ *  - sim/bluetooth_sim.c：主机仿真
+ * 后端初始化完成时打印协议栈占用的堆和初始化耗时，用 tools/ble_stack_report.py 对比。
+ */
+
+void Bluetooth_Init(void);
+
+// 处理手机写入特征值的一条命令（openlock / cpw:xxxxxx / ota），与具体的蓝牙协议栈无关
+void Bluetooth_HandleCommand(const uint8_t *value, uint16_t len);
+
+// 通过特征值通知发给正在处理的命令所在的连接（主机仿真时输出到控制台）
+void Bluetooth_Notify(const uint8_t *data, size_t len);
+
+// 以 int_min~int_max（0.625 ms 单位）开始可连接广播，正在广播时改为新的间隔；
+// bonded_only 为 1 时只接受白名单（已绑定）中的手机扫描和连接
+void Bluetooth_StartAdvertising(uint16_t int_min, uint16_t int_max, uint8_t bonded_only);
+// 向已绑定的手机做高占空比定向广播（最长 1.28 s）
+void Bluetooth_StartDirectedAdvertising(const ble_bond_peer_t *peer);
+void Bluetooth_StopAdvertising(void);
+// 向 bda 对应的手机请求新的连接参数，结果通过 BleConn_Updated() 上报；
+// 协议栈没有接受请求（找不到连接、正忙）时返回 0，这时不会有 BleConn_Updated()
+uint8_t Bluetooth_RequestConnParams(const uint8_t bda[6], const ble_conn_params_t *params);
+// 通过批量传输服务的控制（0）或数据（1）特征值通知 conn_id，协议栈发送缓冲满时返回 0
+uint8_t Bluetooth_BulkSend(uint16_t conn_id, uint8_t chan, const uint8_t *data, size_t len);
+
+#if CONFIG_TRACE_ENABLE
+// 把追踪数据发给最近一次写入命令的连接（主机仿真时输出到控制台）
+void Bluetooth_TraceSink(const uint8_t *data, size_t len);
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX
+// 模拟手机连接 / 断开，没有连接时写入会先自动连接；连接要等到门锁的下一次广播
+void Bluetooth_SimConnect(uint8_t connected);
+// 模拟手机丢掉 GATT 缓存（没有绑定或门锁固件改了服务），下次连接重新做完整的服务发现
+void Bluetooth_SimForgetCache(void);
+// 模拟手机是否同意配对（0 相当于以前不配对的行为），不同意时删除已有的绑定
+void Bluetooth_SimSetBonding(uint8_t bonding);
+// 模拟手机写入一次特征值
+void Bluetooth_SimWrite(const char *value);
+// 模拟手机写入一次二进制数据
+void Bluetooth_SimWriteRaw(const uint8_t *value, uint16_t len);
+// 模拟协议栈接下来 count 次不接受连接参数请求
+void Bluetooth_SimFailConnParams(uint8_t count);
+// 打开 / 关闭通知的控制台输出（性能测试时关闭）
+void Bluetooth_SimSetEcho(uint8_t echo);
+// 最近一次通知的内容，返回长度
+size_t Bluetooth_SimLastNotify(uint8_t *data, size_t size);
+// 多部模拟手机（负载测试）：client 0 就是上面的手机，其余手机不配对、不做服务发现，conn_id 等于 client
+void Bluetooth_SimClientConnect(uint8_t client, uint8_t connected);
+// client 写入一次，不等处理完，会话队列满时返回 0
+uint8_t Bluetooth_SimClientWrite(uint8_t client, const uint8_t *value, uint16_t len);
+// 每次通知时回调（在命令任务中），conn_id 是收到通知的连接
+typedef void (*bluetooth_sim_notify_hook_t)(uint16_t conn_id, const uint8_t *data, size_t len);
+void Bluetooth_SimSetNotifyHook(bluetooth_sim_notify_hook_t hook);
+// 模拟手机写入批量传输服务的控制（0）或数据（1）特征值，不经过会话队列
+void Bluetooth_SimBulkWrite(uint8_t chan, const uint8_t *value, uint16_t len);
+// 批量传输服务的每次通知都回调（在批量传输任务中）
+typedef void (*bluetooth_sim_bulk_hook_t)(uint8_t chan, const uint8_t *data, size_t len);
+void Bluetooth_SimSetBulkHook(bluetooth_sim_bulk_hook_t hook);
+// 模拟的链路：MTU 交换的结果、是否做了数据长度扩展、是否切换到 2M PHY
+void Bluetooth_SimSetLink(uint16_t mtu, uint8_t dle, uint8_t phy_2m);
+// 按模拟的链路估算一个 att_len 字节的 ATT 包（通知或无响应写入）占用的空口时间，
+// 包括分片、每个链路层包的开销、帧间隔和对方回的空包
+uint32_t Bluetooth_SimAirtimeUs(uint16_t att_len);
+#endif
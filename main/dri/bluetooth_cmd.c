@@ -0,0 +1,173 @@
+#include "bluetooth.h"
+#include "ble_proto.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "flash.h"
+#include "Motor.h"
+#include "trace.h"
+#include "schedule.h"
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+extern TaskHandle_t ota_task_handle;
+
+/*
+ * 访客密码批量下发：
+ *   c+:12345678,2345/3,.. 添加，"/3" 表示使用 3 号时间表（默认 0 号，始终允许）
+ *   c-:12345678,...       删除
+ *   c0                    删除全部
+ *   c!                    把当前的表写入 NVS（整张表一次提交）
+ *   cx                    放弃未提交的修改
+ * 一次写入可以带多个用逗号分隔的密码，数千个密码分多次写入后只提交一次。
+ */
+// 解析十进制数，至少一位
+static uint8_t Bluetooth_ParseUint(const char **p, const char *end, uint32_t *value)
+{
+    const char *start = *p;
+    *value            = 0;
+    while (*p < end && **p >= '0' && **p <= '9') {
+        *value = *value * 10 + (*(*p)++ - '0');
+    }
+    return *p != start;
+}
+
+static void Bluetooth_HandleCredentials(const uint8_t *value, uint16_t len)
+{
+    if (len == 2) {
+        if (value[1] == '0') {
+            Flash_CredentialClear();
+        } else if (value[1] == '!') {
+            Flash_CredentialCommit();
+        } else if (value[1] == 'x') {
+            Flash_CredentialAbort();
+        }
+        printf("credentials: %u\r\n", Flash_CredentialCount());
+        return;
+    }
+
+    uint8_t add     = value[1] == '+';
+    uint16_t ok     = 0;
+    uint16_t error  = 0;
+    const char *p   = (const char *)value + 3;
+    const char *end = (const char *)value + len;
+    while (p < end) {
+        const char *comma          = memchr(p, ',', end - p);
+        const char *next           = comma ? comma : end;
+        const char *slash          = memchr(p, '/', next - p);
+        size_t n                   = (slash ? slash : next) - p;
+        uint32_t schedule          = SCHEDULE_ALWAYS;
+        const char *q              = slash ? slash + 1 : next;
+        flash_cred_result_t result = FLASH_CRED_INVALID;
+        if (slash && (!Bluetooth_ParseUint(&q, next, &schedule) || q != next || schedule >= SCHEDULE_MAX)) {
+            // 时间表编号格式错误或超出范围（不能截断成 uint8_t，否则 256 会变成始终允许的 0 号）
+        } else if (add) {
+            result = Flash_CredentialAdd(p, n, schedule);
+        } else {
+            result = Flash_CredentialRemove(p, n);
+        }
+        // 与二进制协议一致：已存在的密码只更新时间表，重发同一批也算成功
+        if (result == FLASH_CRED_OK || result == FLASH_CRED_EXISTS) {
+            ok++;
+        } else {
+            error++;
+        }
+        p = next + 1;
+    }
+    printf("credentials %s: %u ok, %u failed, %u total\r\n", add ? "add" : "remove", ok, error, Flash_CredentialCount());
+}
+
+/*
+ * 时间表（和密码表一起由 c! 提交、cx 放弃）：
+ *   sch:<编号>:<时间表>   编译并设置时间表，格式见 Schedule_Compile()
+ *   sfp:<指纹页>:<编号>   指纹使用的时间表
+ *   sble:<编号>           蓝牙开锁使用的时间表
+ *   time:<unix 时间>      校时
+ *   tz:<POSIX TZ>         时区
+ */
+static void Bluetooth_HandleSchedule(const uint8_t *value, uint16_t len)
+{
+    const char *p   = memchr(value, ':', len) + 1;
+    const char *end = (const char *)value + len;
+    uint32_t a, b;
+    int8_t ret = -1;
+
+    if (!memcmp(value, "sch:", 4)) {
+        schedule_t schedule;
+        if (Bluetooth_ParseUint(&p, end, &a) && a < SCHEDULE_MAX && p < end && *p++ == ':' &&
+            Schedule_Compile(p, end - p, &schedule) == 0) {
+            ret = Schedule_Set(a, &schedule);
+        }
+    } else if (!memcmp(value, "sfp:", 4)) {
+        if (Bluetooth_ParseUint(&p, end, &a) && p < end && *p++ == ':' &&
+            Bluetooth_ParseUint(&p, end, &b) && p == end && a < SCHEDULE_FINGER_PAGES && b < SCHEDULE_MAX) {
+            Schedule_SetFinger(a, b);
+            ret = 0;
+        }
+    } else if (!memcmp(value, "sble:", 5)) {
+        if (Bluetooth_ParseUint(&p, end, &a) && p == end && a < SCHEDULE_MAX) {
+            Schedule_SetBle(a);
+            ret = 0;
+        }
+    } else if (!memcmp(value, "time:", 5)) {
+        if (Bluetooth_ParseUint(&p, end, &a) && p == end) {
+            struct timeval tv = {.tv_sec = a, .tv_usec = 0};
+            ret               = settimeofday(&tv, NULL);
+        }
+    } else if (!memcmp(value, "tz:", 3)) {
+        char tz[32];
+        if (end - p > 0 && end - p < (int)sizeof(tz)) {
+            memcpy(tz, p, end - p);
+            tz[end - p] = 0;
+            Schedule_SetTimezone(tz);
+            ret = 0;
+        }
+    }
+    printf("schedule command %s\r\n", ret == 0 ? "ok" : "failed");
+}
+
+void Bluetooth_HandleCommand(const uint8_t *value, uint16_t len)
+{
+    TRACE(TRACE_BLE_WRITE, len);
+    if (BleProto_IsFrame(value, len)) {
+        BleProto_Handle(value, len);
+        return;
+    }
+    if (len == 8 && !memcmp(value, "openlock", 8)) {
+        uint8_t allowed = Schedule_AllowsBle();
+        TRACE(TRACE_BLE_DECISION, allowed);
+        if (allowed) {
+            Motor_OpenLock();
+        }
+    }
+    printf("msg:%.*s len:%d\r\n", len, value, len);
+    if (len == 10) {
+        if (!memcmp(value, "cpw:", 4)) {
+            // 写入的值不带结束符，拷贝出 6 位密码
+            char password[7] = {0};
+            memcpy(password, value + 4, 6);
+            Flash_WritePassword(password);
+        }
+    }
+    if (len >= 2 && value[0] == 'c' && (len == 2 || (len > 3 && (value[1] == '+' || value[1] == '-') && value[2] == ':'))) {
+        Bluetooth_HandleCredentials(value, len);
+    }
+    if ((len > 4 && (!memcmp(value, "sch:", 4) || !memcmp(value, "sfp:", 4))) ||
+        (len > 5 && (!memcmp(value, "sble:", 5) || !memcmp(value, "time:", 5))) ||
+        (len > 3 && !memcmp(value, "tz:", 3))) {
+        Bluetooth_HandleSchedule(value, len);
+    }
+    if (ota_task_handle != NULL && len == 3) {
+        if (!memcmp(value, "ota", 3)) {
+            xTaskNotifyGive(ota_task_handle);
+        }
+    }
+#if CONFIG_TRACE_ENABLE
+    // trace：通过蓝牙通知导出追踪缓冲；traceu：导出到控制台串口
+    if (len == 5 && !memcmp(value, "trace", 5)) {
+        Trace_RequestDump(Bluetooth_TraceSink);
+    } else if (len == 6 && !memcmp(value, "traceu", 6)) {
+        Trace_RequestDump(Trace_UartSink);
+    }
+#endif
+}
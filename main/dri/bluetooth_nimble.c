@@ -0,0 +1,522 @@
+/*
+ * NimBLE 主机的蓝牙后端（menuconfig 中 Bluetooth host 选 NimBLE 时代替 bluetooth.c）。
+ *
+ * 与 bluetooth.c 提供相同的门锁服务、广播、配对和命令处理，协议栈无关的部分
+ * （BleSession / BleConn / BleAdv / BleBond）完全一样。NimBLE 只有外设需要的角色，
+ * 比 Bluedroid 少占不少内存和固件空间，对比方法见 tools/ble_stack_report.py。
+ *
+ * 和 Bluedroid 的差别：
+ *  - 长写入由协议栈拼接好再交给特征值的访问回调，不需要自己的 prepare 缓冲池
+ *  - NimBLE 的地址是小端的，这里换成和 Bluedroid 相同的顺序，BleBond 保存的顺序两种后端通用
+ *  - 连接用 conn_handle 标识，直接当作 conn_id
+ *  - 批量传输服务和门锁服务在同一张服务表里，2M PHY 由 CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT 决定
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "host/ble_hs.h"
+#include "host/util/util.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+#include "bluetooth.h"
+#include "ble_proto.h"
+#include "ble_adv.h"
+#include "ble_session.h"
+#include "ble_bulk.h"
+#include "trace.h"
+
+static const char *TAG = "bluetooth";
+
+// 与 bluetooth.c 相同的服务和特征值，手机端不用区分门锁用的是哪种协议栈
+#define LOCK_SERVICE_UUID 0x2002
+#define LOCK_CMD_UUID     0x0226
+#define BULK_SERVICE_UUID 0x2003
+#define BULK_CTRL_UUID    0x0227
+#define BULK_DATA_UUID    0x0228
+
+#define LOCK_DEVICE_NAME "Destiny_Smart_Lock"
+
+// 导出追踪数据时两个通知之间的间隔，避免占满协议栈的发送缓冲
+#define TRACE_NOTIFY_GAP_MS 10
+
+// 高占空比定向广播的持续时间（ms），规范限制 1.28 s
+#define DIRECTED_ADV_MS 1280
+
+// 数据长度扩展后 1M PHY 上发送一个 251 字节链路层包的时间（us）
+#define BULK_LL_TIME_US 2120
+
+// NimBLE 没有公开这个函数的头文件（与 ESP-IDF 的示例相同）
+void ble_store_config_init(void);
+
+static int Bluetooth_GapEvent(struct ble_gap_event *event, void *arg);
+static int Bluetooth_CmdAccess(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
+static int Bluetooth_BulkAccess(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+static uint16_t lock_cmd_handle  = 0;
+static uint16_t bulk_ctrl_handle = 0;
+static uint16_t bulk_data_handle = 0;
+
+/*
+ * 门锁服务：一个命令特征值，手机写入命令，响应和追踪数据通过通知发回。
+ * 批量传输服务（BleBulk）：控制特征值用带响应的写入，数据特征值用无响应写入，门锁都用通知。
+ * 通知开关（CCCD）由协议栈按 BLE_GATT_CHR_F_NOTIFY 自动生成。
+ */
+static const struct ble_gatt_svc_def lock_gatt_svcs[] = {
+    {
+        .type            = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid            = BLE_UUID16_DECLARE(LOCK_SERVICE_UUID),
+        .characteristics = (struct ble_gatt_chr_def[]){
+            {
+                .uuid       = BLE_UUID16_DECLARE(LOCK_CMD_UUID),
+                .access_cb  = Bluetooth_CmdAccess,
+                .flags      = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY,
+                .val_handle = &lock_cmd_handle,
+            },
+            {0},
+        },
+    },
+    {
+        .type            = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid            = BLE_UUID16_DECLARE(BULK_SERVICE_UUID),
+        .characteristics = (struct ble_gatt_chr_def[]){
+            {
+                .uuid       = BLE_UUID16_DECLARE(BULK_CTRL_UUID),
+                .access_cb  = Bluetooth_BulkAccess,
+                .flags      = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_NOTIFY,
+                .val_handle = &bulk_ctrl_handle,
+            },
+            {
+                .uuid       = BLE_UUID16_DECLARE(BULK_DATA_UUID),
+                .access_cb  = Bluetooth_BulkAccess,
+                .flags      = BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_NOTIFY,
+                .val_handle = &bulk_data_handle,
+            },
+            {0},
+        },
+    },
+    {0},
+};
+
+// 广播数据（原始格式，与 bluetooth.c 相同）：Flags、服务 UUID、设备名（放不下时截短）
+#define ADV_DATA_MAX 31
+static uint8_t raw_adv_data[ADV_DATA_MAX];
+static uint8_t raw_adv_len = 0;
+
+// 可解析私有地址，只有绑定的手机能认出门锁
+static uint8_t own_addr_type = BLE_OWN_ADDR_RPA_PUBLIC_DEFAULT;
+
+// 协议栈占用：初始化前的空闲堆和开始初始化的时间
+static uint32_t host_heap_before = 0;
+static int64_t host_init_us      = 0;
+
+// 命令写入拼接后的缓冲，只在协议栈任务中使用
+static uint8_t cmd_buf[BLE_PROTO_MAX_FRAME];
+// 批量传输的写入，同样只在协议栈任务中使用
+static uint8_t bulk_buf[BLE_BULK_MTU - 3];
+
+// NimBLE 的地址是小端，BleBond / BleConn 和 Bluedroid 一样用大端
+static void Bluetooth_AddrToBda(const ble_addr_t *addr, uint8_t bda[6])
+{
+    for (int i = 0; i < 6; i++) {
+        bda[i] = addr->val[5 - i];
+    }
+}
+
+static void Bluetooth_BdaToAddr(const uint8_t bda[6], uint8_t type, ble_addr_t *addr)
+{
+    addr->type = type;
+    for (int i = 0; i < 6; i++) {
+        addr->val[i] = bda[5 - i];
+    }
+}
+
+/*
+ * 用协议栈保存的绑定列表核对最近使用顺序，并把已绑定的手机设为白名单。
+ * NimBLE 一次设置整个白名单；白名单广播正在进行时控制器不允许修改，等下次再同步。
+ */
+static void Bluetooth_SyncBonds(void)
+{
+    ble_addr_t addrs[BLE_BOND_MAX];
+    ble_bond_peer_t peers[BLE_BOND_MAX];
+    int count = 0;
+
+    if (ble_store_util_bonded_peers(addrs, &count, BLE_BOND_MAX) != 0) {
+        count = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        Bluetooth_AddrToBda(&addrs[i], peers[i].bda);
+        peers[i].addr_type = addrs[i].type;
+    }
+    int rc = ble_gap_wl_set(addrs, count);
+    if (rc != 0) {
+        ESP_LOGW(TAG, "set whitelist failed, rc %d", rc);
+    }
+    BleBond_Sync(peers, count);
+    ESP_LOGI(TAG, "%d bonded devices", count);
+}
+
+static void Bluetooth_BuildAdvData(void)
+{
+    // Flags 3 字节，服务 UUID 4 字节，设备名的长度和类型 2 字节
+    uint8_t *p         = raw_adv_data;
+    size_t name        = strlen(LOCK_DEVICE_NAME);
+    size_t room        = ADV_DATA_MAX - 3 - 4 - 2;
+    uint8_t short_name = name > room;
+
+    *p++ = 2;
+    *p++ = BLE_HS_ADV_TYPE_FLAGS;
+    *p++ = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
+    *p++ = 3;
+    *p++ = BLE_HS_ADV_TYPE_COMP_UUIDS16;
+    *p++ = LOCK_SERVICE_UUID & 0xff;
+    *p++ = LOCK_SERVICE_UUID >> 8;
+    if (short_name) name = room;
+    *p++ = name + 1;
+    *p++ = short_name ? BLE_HS_ADV_TYPE_INCOMP_NAME : BLE_HS_ADV_TYPE_COMP_NAME;
+    memcpy(p, LOCK_DEVICE_NAME, name);
+    raw_adv_len = p + name - raw_adv_data;
+}
+
+static int Bluetooth_CmdAccess(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
+        // 读命令特征值得到协议版本和最大帧长（与 PING 的响应相同）
+        uint8_t info[3] = {BLE_PROTO_VERSION, BLE_PROTO_MAX_FRAME & 0xff, BLE_PROTO_MAX_FRAME >> 8};
+        return os_mbuf_append(ctxt->om, info, sizeof(info)) ? BLE_ATT_ERR_INSUFFICIENT_RES : 0;
+    }
+    if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
+        uint16_t len = OS_MBUF_PKTLEN(ctxt->om);
+        if (len > sizeof(cmd_buf)) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        if (ble_hs_mbuf_to_flat(ctxt->om, cmd_buf, sizeof(cmd_buf), &len) != 0) return BLE_ATT_ERR_UNLIKELY;
+        ESP_LOGI(TAG, "Characteristic write, conn %u, len %u", conn_handle, len);
+        // 命令在命令任务中按连接轮流处理，不占用协议栈的任务
+        BleSession_Submit(conn_handle, cmd_buf, len);
+        return 0;
+    }
+    return BLE_ATT_ERR_UNLIKELY;
+}
+
+// 批量传输的写入很多，不打印
+static int Bluetooth_BulkAccess(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg)
+{
+    if (ctxt->op != BLE_GATT_ACCESS_OP_WRITE_CHR) return BLE_ATT_ERR_UNLIKELY;
+    uint16_t len = OS_MBUF_PKTLEN(ctxt->om);
+    if (len > sizeof(bulk_buf)) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    if (ble_hs_mbuf_to_flat(ctxt->om, bulk_buf, sizeof(bulk_buf), &len) != 0) return BLE_ATT_ERR_UNLIKELY;
+    BleBulk_Write(conn_handle, attr_handle == bulk_ctrl_handle ? BLE_BULK_CHAN_CTRL : BLE_BULK_CHAN_DATA, bulk_buf, len);
+    return 0;
+}
+
+static void Bluetooth_RestartAdvertising(const struct ble_gap_adv_params *params, const ble_addr_t *peer, int32_t duration_ms)
+{
+    // ble_gap_adv_stop() 是同步的，停止后马上可以用新参数开始
+    if (ble_gap_adv_active()) {
+        ble_gap_adv_stop();
+    }
+    int rc = ble_gap_adv_start(own_addr_type, peer, duration_ms, params, Bluetooth_GapEvent, NULL);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "start advertising failed, rc %d", rc);
+    }
+}
+
+void Bluetooth_StartAdvertising(uint16_t int_min, uint16_t int_max, uint8_t bonded_only)
+{
+    struct ble_gap_adv_params params = {
+        .conn_mode     = BLE_GAP_CONN_MODE_UND,
+        .disc_mode     = BLE_GAP_DISC_MODE_GEN,
+        .itvl_min      = int_min,
+        .itvl_max      = int_max,
+        .filter_policy = bonded_only ? BLE_HCI_ADV_FILT_BOTH : BLE_HCI_ADV_FILT_NONE,
+    };
+    Bluetooth_RestartAdvertising(&params, NULL, BLE_HS_FOREVER);
+}
+
+void Bluetooth_StartDirectedAdvertising(const ble_bond_peer_t *peer)
+{
+    // 高占空比定向广播的间隔由控制器决定（不超过 3.75 ms）
+    struct ble_gap_adv_params params = {
+        .conn_mode       = BLE_GAP_CONN_MODE_DIR,
+        .disc_mode       = BLE_GAP_DISC_MODE_NON,
+        .high_duty_cycle = 1,
+    };
+    ble_addr_t addr;
+    Bluetooth_BdaToAddr(peer->bda, peer->addr_type, &addr);
+    Bluetooth_RestartAdvertising(&params, &addr, DIRECTED_ADV_MS);
+}
+
+void Bluetooth_StopAdvertising(void)
+{
+    if (ble_gap_adv_active()) {
+        ble_gap_adv_stop();
+    }
+}
+
+uint8_t Bluetooth_RequestConnParams(const uint8_t bda[6], const ble_conn_params_t *params)
+{
+    struct ble_gap_conn_desc desc;
+    ble_addr_t addr;
+
+    // BleConn 按地址请求，NimBLE 按连接句柄更新；先按公开地址找，再按随机地址找
+    Bluetooth_BdaToAddr(bda, BLE_ADDR_PUBLIC, &addr);
+    if (ble_gap_conn_find_by_addr(&addr, &desc) != 0) {
+        addr.type = BLE_ADDR_RANDOM;
+        if (ble_gap_conn_find_by_addr(&addr, &desc) != 0) {
+            ESP_LOGW(TAG, "update conn params: connection not found");
+            return 0;
+        }
+    }
+    struct ble_gap_upd_params upd = {
+        .itvl_min            = params->min_int,
+        .itvl_max            = params->max_int,
+        .latency             = params->latency,
+        .supervision_timeout = params->timeout,
+    };
+    int rc = ble_gap_update_params(desc.conn_handle, &upd);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "update conn params failed, rc %d", rc);
+        return 0;
+    }
+    return 1;
+}
+
+void Bluetooth_Notify(const uint8_t *data, size_t len)
+{
+    uint16_t conn_id = BleSession_Current();
+    if (lock_cmd_handle == 0 || conn_id == BLE_SESSION_NONE) return;
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+    if (om == NULL) {
+        ESP_LOGW(TAG, "notify dropped, no mbuf");
+        return;
+    }
+    ble_gatts_notify_custom(conn_id, lock_cmd_handle, om);
+}
+
+uint8_t Bluetooth_BulkSend(uint16_t conn_id, uint8_t chan, const uint8_t *data, size_t len)
+{
+    uint16_t handle = chan == BLE_BULK_CHAN_CTRL ? bulk_ctrl_handle : bulk_data_handle;
+    if (handle == 0) return 0;
+    // mbuf 用完说明协议栈的发送缓冲满了，BleBulk 等一个 tick 再发
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, len);
+    if (om == NULL) return 0;
+    return ble_gatts_notify_custom(conn_id, handle, om) == 0;
+}
+
+#if CONFIG_TRACE_ENABLE
+void Bluetooth_TraceSink(const uint8_t *data, size_t len)
+{
+    Bluetooth_Notify(data, len);
+    vTaskDelay(pdMS_TO_TICKS(TRACE_NOTIFY_GAP_MS));
+}
+#endif
+
+static void Bluetooth_OnConnect(struct ble_gap_event *event)
+{
+    struct ble_gap_conn_desc desc;
+    uint16_t handle = event->connect.conn_handle;
+    uint8_t bda[6];
+
+    if (event->connect.status != 0) {
+        ESP_LOGW(TAG, "Connect failed, status %d", event->connect.status);
+        return;
+    }
+    if (ble_gap_conn_find(handle, &desc) != 0) return;
+    Bluetooth_AddrToBda(&desc.peer_id_addr, bda);
+    ESP_LOGI(TAG, "Connected, conn %u, remote %02x:%02x:%02x:%02x:%02x:%02x",
+             handle, bda[0], bda[1], bda[2], bda[3], bda[4], bda[5]);
+    if (!BleSession_Open(handle)) {
+        ble_gap_terminate(handle, BLE_ERR_REM_USER_CONN_TERM);
+        return;
+    }
+    // 已绑定的手机直接用保存的密钥加密，新手机开始配对（Just Works）
+    ble_gap_security_initiate(handle);
+    // 批量传输：数据长度扩展，一个 247 字节的 ATT 包放进一个链路层包；控制器支持时换 2M PHY
+    ble_gap_set_data_len(handle, BLE_BULK_LL_OCTETS, BULK_LL_TIME_US);
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+    ble_gap_set_prefered_le_phy(handle, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_2M_MASK, BLE_GAP_LE_PHY_CODED_ANY);
+#endif
+    // 控制器在连上时停止广播；连接数没到上限时 BleAdv 重新开始
+    BleAdv_Connected(BleSession_Count() >= BLE_SESSION_MAX);
+    // 连接参数由 BleConn 按命令活动切换
+    BleConn_Connected(handle, bda, desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+}
+
+static void Bluetooth_OnEncrypted(struct ble_gap_event *event)
+{
+    struct ble_gap_conn_desc desc;
+    uint8_t bda[6];
+
+    if (ble_gap_conn_find(event->enc_change.conn_handle, &desc) != 0) return;
+    Bluetooth_AddrToBda(&desc.peer_id_addr, bda);
+    if (event->enc_change.status != 0) {
+        // 不配对的手机仍然可以使用，只是没有定向广播快速回连
+        ESP_LOGW(TAG, "Pairing failed, conn %u, status %d", event->enc_change.conn_handle, event->enc_change.status);
+        return;
+    }
+    ESP_LOGI(TAG, "Encrypted, conn %u, addr type %d, bonded %d", event->enc_change.conn_handle, desc.peer_id_addr.type, desc.sec_state.bonded);
+    if (!desc.sec_state.bonded) return;
+    if (!BleBond_IsBonded(bda)) {
+        Bluetooth_SyncBonds();
+    }
+    BleBond_Used(bda, desc.peer_id_addr.type);
+}
+
+static int Bluetooth_GapEvent(struct ble_gap_event *event, void *arg)
+{
+    struct ble_gap_conn_desc desc;
+    uint8_t bda[6];
+
+    switch (event->type) {
+        case BLE_GAP_EVENT_CONNECT:
+            Bluetooth_OnConnect(event);
+            break;
+        case BLE_GAP_EVENT_DISCONNECT:
+            ESP_LOGI(TAG, "Disconnected, conn %u, reason 0x%02x", event->disconnect.conn.conn_handle, event->disconnect.reason);
+            BleBulk_Disconnected(event->disconnect.conn.conn_handle);
+            BleSession_Close(event->disconnect.conn.conn_handle);
+            BleConn_Disconnected(event->disconnect.conn.conn_handle);
+            BleAdv_Disconnected();
+            break;
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            if (ble_gap_conn_find(event->conn_update.conn_handle, &desc) != 0) break;
+            ESP_LOGI(TAG, "Connection params update, status %d, conn_int %d, latency %d, timeout %d",
+                     event->conn_update.status, desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+            Bluetooth_AddrToBda(&desc.peer_id_addr, bda);
+            BleConn_Updated(bda, event->conn_update.status != 0, desc.conn_itvl, desc.conn_latency, desc.supervision_timeout);
+            break;
+        case BLE_GAP_EVENT_ENC_CHANGE:
+            Bluetooth_OnEncrypted(event);
+            break;
+        case BLE_GAP_EVENT_REPEAT_PAIRING:
+            // 手机删了配对又来配对：删掉旧的绑定，重新配对
+            if (ble_gap_conn_find(event->repeat_pairing.conn_handle, &desc) == 0) {
+                ble_store_util_delete_peer(&desc.peer_id_addr);
+                Bluetooth_AddrToBda(&desc.peer_id_addr, bda);
+                BleBond_Removed(bda);
+            }
+            return BLE_GAP_REPEAT_PAIRING_RETRY;
+        case BLE_GAP_EVENT_SUBSCRIBE:
+            if (event->subscribe.attr_handle == lock_cmd_handle) {
+                ESP_LOGI(TAG, "Notification %s", event->subscribe.cur_notify ? "enable" : "disable");
+            }
+            break;
+        case BLE_GAP_EVENT_MTU:
+            ESP_LOGI(TAG, "MTU exchange, MTU %d", event->mtu.value);
+            BleBulk_Mtu(event->mtu.conn_handle, event->mtu.value);
+            break;
+#ifdef BLE_GAP_EVENT_DATA_LEN_CHG
+        case BLE_GAP_EVENT_DATA_LEN_CHG:
+            ESP_LOGI(TAG, "Data length update, conn %u, tx %u, rx %u", event->data_len_chg.conn_handle,
+                     event->data_len_chg.max_tx_octets, event->data_len_chg.max_rx_octets);
+            BleBulk_Link(event->data_len_chg.max_tx_octets, 0);
+            break;
+#endif
+#if CONFIG_BT_NIMBLE_50_FEATURE_SUPPORT
+        case BLE_GAP_EVENT_PHY_UPDATE_COMPLETE:
+            ESP_LOGI(TAG, "PHY update, status %d, tx %d, rx %d",
+                     event->phy_updated.status, event->phy_updated.tx_phy, event->phy_updated.rx_phy);
+            if (event->phy_updated.status == 0) {
+                BleBulk_Link(0, event->phy_updated.tx_phy == BLE_GAP_LE_PHY_2M ? 2 : 1);
+            }
+            break;
+#endif
+        case BLE_GAP_EVENT_ADV_COMPLETE:
+            // 定向广播 1.28 s 到了；下一步由 BleAdv 的定时器决定
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static void Bluetooth_OnReset(int reason)
+{
+    ESP_LOGE(TAG, "host reset, reason %d", reason);
+}
+
+// 主机和控制器同步完成：配置地址、白名单和广播数据，然后开始广播
+static void Bluetooth_OnSync(void)
+{
+    int rc = ble_hs_util_ensure_addr(0);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "no identity address, rc %d", rc);
+        return;
+    }
+    Bluetooth_SyncBonds();
+    Bluetooth_BuildAdvData();
+    rc = ble_gap_adv_set_data(raw_adv_data, raw_adv_len);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "config raw adv data failed, rc %d", rc);
+        return;
+    }
+    uint32_t heap_after = esp_get_free_heap_size();
+    ESP_LOGI(TAG, "host nimble ready %" PRId64 " ms after init, heap %" PRIu32 " -> %" PRIu32 " (%" PRIu32 " bytes)",
+             (esp_timer_get_time() - host_init_us) / 1000, host_heap_before, heap_after, host_heap_before - heap_after);
+    BleAdv_Ready();
+}
+
+static void bluetooth_host_task(void *param)
+{
+    // 协议栈停止（nimble_port_stop()）后才返回
+    nimble_port_run();
+    nimble_port_freertos_deinit();
+}
+
+void Bluetooth_Init(void)
+{
+    // NVS 由 Flash_Init() 初始化、定时器服务由 TimerService_Init() 初始化，启动表保证它们先于蓝牙完成
+    BleSession_Init();
+    BleBulk_Init();
+    BleConn_Init();
+    BleBond_Init();
+    BleAdv_Init();
+
+    host_heap_before = esp_get_free_heap_size();
+    host_init_us     = esp_timer_get_time();
+
+    // 控制器也在这里初始化
+    esp_err_t ret = nimble_port_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "%s init nimble failed: %s", __func__, esp_err_to_name(ret));
+        return;
+    }
+
+    ble_hs_cfg.reset_cb        = Bluetooth_OnReset;
+    ble_hs_cfg.sync_cb         = Bluetooth_OnSync;
+    ble_hs_cfg.store_status_cb = ble_store_util_status_rr;
+
+    /*
+     * 配对参数：安全连接 + 绑定，交换加密密钥和身份密钥（IRK，用于解析双方的私有地址）。
+     * 门锁没有显示屏，用 Just Works。
+     */
+    ble_hs_cfg.sm_io_cap         = BLE_SM_IO_CAP_NO_IO;
+    ble_hs_cfg.sm_bonding        = 1;
+    ble_hs_cfg.sm_mitm           = 0;
+    ble_hs_cfg.sm_sc             = 1;
+    ble_hs_cfg.sm_our_key_dist   = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+    ble_hs_cfg.sm_their_key_dist = BLE_SM_PAIR_KEY_DIST_ENC | BLE_SM_PAIR_KEY_DIST_ID;
+
+    ble_svc_gap_init();
+    ble_svc_gatt_init();
+    int rc = ble_gatts_count_cfg(lock_gatt_svcs);
+    if (rc == 0) {
+        rc = ble_gatts_add_svcs(lock_gatt_svcs);
+    }
+    if (rc != 0) {
+        ESP_LOGE(TAG, "add lock service failed, rc %d", rc);
+        return;
+    }
+    ble_svc_gap_device_name_set(LOCK_DEVICE_NAME);
+    ble_att_set_preferred_mtu(500);
+    ble_store_config_init();
+
+    nimble_port_freertos_init(bluetooth_host_task);
+}
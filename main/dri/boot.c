@@ -0,0 +1,147 @@
+#include "boot.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_system.h"
+#endif
+#include <inttypes.h>
+#include <stdio.h>
+
+static const char *TAG = "boot";
+
+// 前台阶段执行期间调用者提升到这个优先级，后台阶段不会抢占开锁必需的初始化
+#define BOOT_FOREGROUND_PRIORITY 3
+#define BOOT_BACKGROUND_PRIORITY 2
+
+static const boot_stage_t *boot_stages = NULL;
+static uint8_t boot_count              = 0;
+static uint8_t boot_done               = 0;
+static EventGroupHandle_t boot_events  = NULL;
+static boot_stage_time_t boot_times[BOOT_STAGES_MAX];
+static int64_t boot_ready_us  = 0;
+static int64_t boot_unlock_us = 0;
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void Boot_Execute(uint8_t id)
+{
+    const boot_stage_t *stage = &boot_stages[id];
+
+    if (stage->deps) {
+        xEventGroupWaitBits(boot_events, stage->deps, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+    int64_t start = esp_timer_get_time();
+    stage->init();
+    int64_t end = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&boot_lock);
+    boot_times[id].start_us = start;
+    boot_times[id].end_us   = end;
+    uint8_t last            = ++boot_done == boot_count;
+    taskEXIT_CRITICAL(&boot_lock);
+
+    ESP_LOGI(TAG, "%s done at %" PRId64 " ms (%" PRId64 " ms)", stage->name, end / 1000, (end - start) / 1000);
+    xEventGroupSetBits(boot_events, BOOT_DEP(id));
+    if (last) {
+        Boot_PrintReport();
+    }
+}
+
+static void boot_task(void *arg)
+{
+    Boot_Execute((uint8_t)(uintptr_t)arg);
+    vTaskDelete(NULL);
+}
+
+void Boot_Run(const boot_stage_t *stages, uint8_t count)
+{
+    if (count > BOOT_STAGES_MAX) {
+        ESP_LOGE(TAG, "%d stages, only %d supported", count, BOOT_STAGES_MAX);
+        count = BOOT_STAGES_MAX;
+    }
+    boot_stages = stages;
+    boot_count  = count;
+    boot_events = xEventGroupCreate();
+
+    UBaseType_t priority = uxTaskPriorityGet(NULL);
+    vTaskPrioritySet(NULL, BOOT_FOREGROUND_PRIORITY);
+
+    // 后台阶段先创建任务，各自阻塞在依赖上，依赖满足后与前台并行
+    for (uint8_t i = 0; i < count; i++) {
+        if (stages[i].background) {
+            xTaskCreate(boot_task, stages[i].name, stages[i].stack_size, (void *)(uintptr_t)i, BOOT_BACKGROUND_PRIORITY, NULL);
+        }
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        if (!stages[i].background) {
+            Boot_Execute(i);
+        }
+    }
+
+    vTaskPrioritySet(NULL, priority);
+}
+
+uint8_t Boot_WaitAll(TickType_t timeout)
+{
+    EventBits_t all  = BOOT_DEP(boot_count) - 1;
+    EventBits_t bits = xEventGroupWaitBits(boot_events, all, pdFALSE, pdTRUE, timeout);
+    return (bits & all) == all;
+}
+
+void Boot_MarkUnlockReady(void)
+{
+    boot_ready_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "unlock ready at %" PRId64 " ms", boot_ready_us / 1000);
+}
+
+void Boot_RecordUnlock(void)
+{
+    taskENTER_CRITICAL(&boot_lock);
+    uint8_t first = boot_unlock_us == 0;
+    if (first) {
+        boot_unlock_us = esp_timer_get_time();
+    }
+    taskEXIT_CRITICAL(&boot_lock);
+
+    if (first) {
+        ESP_LOGI(TAG, "first unlock at %" PRId64 " ms after power-on", boot_unlock_us / 1000);
+    }
+}
+
+void Boot_GetStageTime(uint8_t id, boot_stage_time_t *time)
+{
+    taskENTER_CRITICAL(&boot_lock);
+    *time = id < boot_count ? boot_times[id] : (boot_stage_time_t){0};
+    taskEXIT_CRITICAL(&boot_lock);
+}
+
+int64_t Boot_UnlockReadyUs(void)
+{
+    return boot_ready_us;
+}
+
+int64_t Boot_FirstUnlockUs(void)
+{
+    return boot_unlock_us;
+}
+
+void Boot_PrintReport(void)
+{
+    printf("---- boot (ms since power-on) ----\r\n");
+    for (uint8_t i = 0; i < boot_count; i++) {
+        boot_stage_time_t time;
+        Boot_GetStageTime(i, &time);
+        if (time.end_us) {
+            printf("%-12s %s %6" PRId64 " -> %6" PRId64 " (%" PRId64 ")\r\n", boot_stages[i].name, boot_stages[i].background ? "bg" : "fg",
+                   time.start_us / 1000, time.end_us / 1000, (time.end_us - time.start_us) / 1000);
+        } else {
+            printf("%-12s %s pending\r\n", boot_stages[i].name, boot_stages[i].background ? "bg" : "fg");
+        }
+    }
+    printf("unlock ready %" PRId64 ", first unlock %" PRId64 "\r\n", boot_ready_us / 1000, boot_unlock_us / 1000);
+#if !CONFIG_IDF_TARGET_LINUX
+    // 启动完成后的空闲堆，比较蓝牙协议栈（Bluedroid / NimBLE）占用的内存
+    printf("free heap %" PRIu32 ", minimum %" PRIu32 "\r\n", esp_get_free_heap_size(), esp_get_minimum_free_heap_size());
+#endif
+}
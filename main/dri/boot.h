@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+/*
+ * 启动编排：每个初始化阶段声明自己依赖的阶段，
+ * 前台阶段在 app_main 中按表顺序执行，后台阶段各自在一个任务中等依赖完成后并行执行。
+ * 键盘、电机、密码等开锁必需的模块放在前台尽快完成，无线和指纹模块放在后台。
+ *
+ * 每个阶段记录开始和结束时间（esp_timer，从上电起算），全部完成后打印一次；
+ * 另外记录“可以开锁”的时刻和第一次开锁的时刻，作为启动到首次开锁的指标。
+ */
+
+#define BOOT_STAGES_MAX 16
+#define BOOT_DEP(id)    (1UL << (id))
+
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    uint32_t deps;       // 依赖的阶段，BOOT_DEP(id) 的组合
+    uint8_t background;  // 1: 在后台任务中执行
+    uint32_t stack_size; // 后台任务的栈大小
+} boot_stage_t;
+
+typedef struct {
+    int64_t start_us;
+    int64_t end_us; // 0 表示还没有完成
+} boot_stage_time_t;
+
+// 执行启动表：返回时前台阶段都已完成，后台阶段仍在运行；stages 必须一直有效
+void Boot_Run(const boot_stage_t *stages, uint8_t count);
+// 等待所有阶段（包括后台阶段）完成，返回 1 表示已完成
+uint8_t Boot_WaitAll(TickType_t timeout);
+
+// 可以接受开锁输入（按键任务已经运行）
+void Boot_MarkUnlockReady(void);
+// 开锁时调用，只记录第一次
+void Boot_RecordUnlock(void);
+
+void Boot_GetStageTime(uint8_t id, boot_stage_time_t *time);
+int64_t Boot_UnlockReadyUs(void);
+int64_t Boot_FirstUnlockUs(void);
+void Boot_PrintReport(void);
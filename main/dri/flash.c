@@ -1,6 +1,155 @@
 #include "flash.h"
 #include "nvs.h"
 #include "nvs_flash.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include "freertos/semphr.h"
+#include "schedule.h"
+#include <stdlib.h>
+
+static const char *TAG = "flash";
+
+// 存储任务
+#define FLASH_TASK_NAME       "flash_task"
+#define FLASH_TASK_STACK_SIZE 3072
+#define FLASH_TASK_PRIORITY   3
+// 收到修改后再等一会儿，把这段时间内的修改合并成一次提交
+#define FLASH_WRITE_BATCH_MS 200
+
+#define FLASH_NAMESPACE        "smart-lock"
+#define FLASH_LEGACY_KEY       "password"
+#define FLASH_DEFAULT_PASSWORD "123456"
+
+// 访客密码表单独放在 creds 分区；旧的分区表没有这个分区时退回到默认的 nvs 分区
+#define FLASH_CRED_PARTITION "creds"
+#define FLASH_CRED_KEY       "creds"
+#define FLASH_CRED_MAGIC     0x32445243 // "CRD2"
+
+/*
+ * 密码轮流写入两个槽位，每个槽位带版本号和校验和：
+ * 写入新版本时不覆盖当前有效的槽位，写到一半掉电时另一个槽位仍然完整，
+ * 开机时取校验正确且版本号最大的槽位。
+ */
+typedef struct {
+    uint32_t generation;
+    uint8_t len;
+    char password[FLASH_PASSWORD_MAX];
+    uint32_t checksum;
+} flash_slot_t;
+
+static const char *flash_slot_keys[2] = {"pw_slot0", "pw_slot1"};
+
+static nvs_handle_t flash_nvs         = 0;
+static TaskHandle_t flash_task_handle = NULL;
+static portMUX_TYPE flash_lock        = portMUX_INITIALIZER_UNLOCKED;
+
+// 内存镜像，保存当前密码（不足部分补 0）
+static char flash_password[FLASH_PASSWORD_MAX];
+static uint8_t flash_password_len = 0;
+// 内存镜像是否比 NVS 新
+static uint8_t flash_dirty = 0;
+
+static flash_stats_t flash_stats = {0};
+
+/*
+ * 访客密码表
+ *
+ * 每个密码编码成 4 字节：高位是位数，低 27 位是数值（8 位数字以内），
+ * 编码值互不相同，表就是这些编码值组成的紧凑数组，整张表作为一个 blob 存储。
+ * 索引是线性探测的哈希表，槽位保存数组下标 + 1（0 表示空），
+ * 槽位数至少是容量的两倍，查找和增删的探测次数与表中的密码数量无关。
+ * 整表重建时在另一份索引中进行，建好后在 flash_lock 内换指针，不在临界区内做哈希插入。
+ */
+#if FLASH_CRED_MAX <= 128
+#define FLASH_CRED_INDEX_BITS 8
+#elif FLASH_CRED_MAX <= 1024
+#define FLASH_CRED_INDEX_BITS 11
+#elif FLASH_CRED_MAX <= 4096
+#define FLASH_CRED_INDEX_BITS 13
+#elif FLASH_CRED_MAX <= 16384
+#define FLASH_CRED_INDEX_BITS 15
+#else
+#error "CONFIG_CREDENTIAL_MAX too large"
+#endif
+#define FLASH_CRED_INDEX_SIZE (1u << FLASH_CRED_INDEX_BITS)
+#define FLASH_CRED_INDEX_MASK (FLASH_CRED_INDEX_SIZE - 1)
+
+/*
+ * 存储格式：头 | 时间表 (schedule_store_t) | count 个编码 | count 个时间表编号
+ * 时间表和密码表在同一个 blob 里，一次提交，两者不会不一致。
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t generation;
+    uint32_t count;
+    uint32_t checksum; // 头之后全部内容的 FNV-1a
+} flash_cred_header_t;
+
+static flash_cred_header_t flash_cred_header;
+static uint32_t flash_cred_codes[FLASH_CRED_MAX];
+// 每个密码使用的时间表
+static uint8_t flash_cred_schedule[FLASH_CRED_MAX];
+static uint16_t flash_cred_index_bufs[2][FLASH_CRED_INDEX_SIZE];
+// 当前使用的索引，在 flash_lock 内读取和切换
+static uint16_t *flash_cred_index = flash_cred_index_bufs[0];
+
+static nvs_handle_t flash_cred_nvs = 0;
+// 串行化修改和写回：写 NVS 期间表不能变化，校验只需要 flash_lock
+static SemaphoreHandle_t flash_cred_mutex = NULL;
+static uint8_t flash_cred_dirty           = 0;
+// 管理员密码或访客密码表每次变化加一
+static uint32_t flash_cred_version = 0;
+
+static void flash_task(void *arg);
+
+// FNV-1a，只用来发现写坏的数据
+static uint32_t Flash_Fnv1a(const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t hash    = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t Flash_Checksum(const flash_slot_t *slot)
+{
+    return Flash_Fnv1a(slot, offsetof(flash_slot_t, checksum));
+}
+
+// 读取一个槽位，返回 1 表示有效
+static uint8_t Flash_LoadSlot(uint8_t index, flash_slot_t *slot)
+{
+    size_t len = sizeof(*slot);
+    if (nvs_get_blob(flash_nvs, flash_slot_keys[index], slot, &len) != ESP_OK || len != sizeof(*slot)) {
+        return 0;
+    }
+    return slot->len <= FLASH_PASSWORD_MAX && slot->checksum == Flash_Checksum(slot);
+}
+
+// 写入下一个版本的槽位并提交
+static esp_err_t Flash_StoreSlot(flash_slot_t *slot)
+{
+    slot->generation = flash_stats.generation + 1;
+    slot->checksum   = Flash_Checksum(slot);
+
+    esp_err_t err = nvs_set_blob(flash_nvs, flash_slot_keys[slot->generation & 1], slot, sizeof(*slot));
+    if (err == ESP_OK) {
+        err = nvs_commit(flash_nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "store generation %" PRIu32 " failed: %s", slot->generation, esp_err_to_name(err));
+        return err;
+    }
+    taskENTER_CRITICAL(&flash_lock);
+    flash_stats.generation = slot->generation;
+    flash_stats.nvs_commits++;
+    taskEXIT_CRITICAL(&flash_lock);
+    return ESP_OK;
+}
 
 void Flash_Init(void)
 {
@@ -15,40 +164,521 @@ void Flash_Init(void)
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
+
+    // 句柄一直保持打开，读写时不再反复 open/close
+    ESP_ERROR_CHECK(nvs_open(FLASH_NAMESPACE, NVS_READWRITE, &flash_nvs));
+
+    err = nvs_flash_init_partition(FLASH_CRED_PARTITION);
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES ||
+        err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        ESP_ERROR_CHECK(nvs_flash_erase_partition(FLASH_CRED_PARTITION));
+        err = nvs_flash_init_partition(FLASH_CRED_PARTITION);
+    }
+    if (err == ESP_OK) {
+        err = nvs_open_from_partition(FLASH_CRED_PARTITION, FLASH_NAMESPACE, NVS_READWRITE, &flash_cred_nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "no %s partition (%s), credentials stored in nvs", FLASH_CRED_PARTITION, esp_err_to_name(err));
+        flash_cred_nvs = flash_nvs;
+    }
+    flash_cred_mutex = xSemaphoreCreateMutex();
+    xTaskCreate(flash_task, FLASH_TASK_NAME, FLASH_TASK_STACK_SIZE, NULL, FLASH_TASK_PRIORITY, &flash_task_handle);
 }
 
 void Flash_InitPassword()
 {
-    // 将密码 123456 保存到nvs flash中
-    // 声明指向存储空间的句柄
-    nvs_handle_t my_handle;
-    nvs_open("smart-lock", NVS_READWRITE, &my_handle);
-    static size_t pw_len = 7;
-    if (nvs_get_str(my_handle, "password", NULL, &pw_len) == ESP_ERR_NVS_NOT_FOUND) {
-        // 如果不存在，则写入
-        nvs_set_str(my_handle, "password", "123456");
-        nvs_commit(my_handle);
+    flash_slot_t slots[2];
+    uint8_t valid[2];
+
+    valid[0] = Flash_LoadSlot(0, &slots[0]);
+    valid[1] = Flash_LoadSlot(1, &slots[1]);
+
+    const flash_slot_t *best = NULL;
+    for (int i = 0; i < 2; i++) {
+        if (valid[i] && (best == NULL || slots[i].generation > best->generation)) {
+            best = &slots[i];
+        }
+    }
+
+    if (best) {
+        memcpy(flash_password, best->password, sizeof(flash_password));
+        flash_password_len     = best->len;
+        flash_stats.generation = best->generation;
+        ESP_LOGI(TAG, "password loaded, generation %" PRIu32, best->generation);
+        return;
+    }
+
+    // 没有槽位：从旧版本的字符串键迁移，仍然没有则写入默认密码 123456
+    char legacy[FLASH_PASSWORD_MAX + 1] = {0};
+    size_t pw_len                       = sizeof(legacy);
+    if (nvs_get_str(flash_nvs, FLASH_LEGACY_KEY, legacy, &pw_len) != ESP_OK) {
+        strcpy(legacy, FLASH_DEFAULT_PASSWORD);
     }
-    nvs_close(my_handle);
+    flash_slot_t slot;
+    memset(&slot, 0, sizeof(slot)); // 填充字节也参与校验和
+    slot.len = strlen(legacy);
+    memcpy(slot.password, legacy, slot.len);
+    memcpy(flash_password, slot.password, sizeof(flash_password));
+    flash_password_len = slot.len;
+    Flash_StoreSlot(&slot);
 }
 
 void Flash_WritePassword(char *password)
 {
-    // 将密码 123456 保存到nvs flash中
-    // 声明指向存储空间的句柄
-    nvs_handle_t my_handle;
-    nvs_open("smart-lock", NVS_READWRITE, &my_handle);
-    // 将密码写入nvs flash
-    nvs_set_str(my_handle, "password", password);
-    nvs_commit(my_handle);
-    nvs_close(my_handle);
+    size_t len = strnlen(password, FLASH_PASSWORD_MAX + 1);
+    if (len == 0 || len > FLASH_PASSWORD_MAX) {
+        ESP_LOGW(TAG, "invalid password length %d", (int)len);
+        return;
+    }
+
+    taskENTER_CRITICAL(&flash_lock);
+    memset(flash_password, 0, sizeof(flash_password));
+    memcpy(flash_password, password, len);
+    flash_password_len = len;
+    flash_dirty        = 1;
+    flash_cred_version++;
+    flash_stats.updates++;
+    taskEXIT_CRITICAL(&flash_lock);
+
+    xTaskNotifyGive(flash_task_handle);
 }
 
 void Flash_ReadPassword(char *password, size_t *pw_len)
 {
-    // 读取密码
-    nvs_handle_t my_handle;
-    nvs_open("smart-lock", NVS_READWRITE, &my_handle);
-    nvs_get_str(my_handle, "password", password, pw_len);
-    nvs_close(my_handle);
-}
\ No newline at end of file
+    taskENTER_CRITICAL(&flash_lock);
+    size_t len = flash_password_len < *pw_len - 1 ? flash_password_len : *pw_len - 1;
+    memcpy(password, flash_password, len);
+    taskEXIT_CRITICAL(&flash_lock);
+    password[len] = 0;
+    *pw_len       = len + 1;
+}
+
+uint32_t Flash_CredentialEncode(const char *pin, size_t len)
+{
+    if (len < FLASH_CRED_MIN_DIGITS || len > FLASH_CRED_MAX_DIGITS) return 0;
+    uint32_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (pin[i] < '0' || pin[i] > '9') return 0;
+        value = value * 10 + (pin[i] - '0');
+    }
+    return ((uint32_t)len << 27) | value;
+}
+
+size_t Flash_CredentialDecode(uint32_t code, char *pin)
+{
+    size_t len     = code >> 27;
+    uint32_t value = code & ((1UL << 27) - 1);
+    for (size_t i = len; i > 0; i--) {
+        pin[i - 1] = '0' + value % 10;
+        value /= 10;
+    }
+    return len;
+}
+
+// Fibonacci 哈希，取高位作为起始槽位
+static inline uint32_t Flash_CredHome(uint32_t code)
+{
+    return (code * 2654435761u) >> (32 - FLASH_CRED_INDEX_BITS);
+}
+
+// 在 index 中查找编码值：找到时返回它的槽位，否则返回探测到的空槽位
+static uint32_t Flash_CredProbe(const uint16_t *index, uint32_t code, uint32_t *probes)
+{
+    uint32_t slot = Flash_CredHome(code);
+    uint32_t n    = 0;
+    while (index[slot] && flash_cred_codes[index[slot] - 1] != code) {
+        slot = (slot + 1) & FLASH_CRED_INDEX_MASK;
+        n++;
+    }
+    if (probes) *probes = n;
+    return slot;
+}
+
+// 在当前索引中查找编码值（调用者持有 flash_lock）
+static uint32_t Flash_CredFind(uint32_t code, uint32_t *probes)
+{
+    return Flash_CredProbe(flash_cred_index, code, probes);
+}
+
+// 把数组中 pos 位置的编码加入索引（调用者持有 flash_lock）
+static void Flash_CredIndexInsert(uint32_t pos)
+{
+    uint32_t probes;
+    uint32_t slot          = Flash_CredFind(flash_cred_codes[pos], &probes);
+    flash_cred_index[slot] = pos + 1;
+    if (probes > flash_stats.cred_max_probe) {
+        flash_stats.cred_max_probe = probes;
+    }
+}
+
+// 删除一个槽位：后面同一探测链上的元素前移填洞，不需要墓碑
+static void Flash_CredIndexDelete(uint32_t hole)
+{
+    uint32_t next = (hole + 1) & FLASH_CRED_INDEX_MASK;
+    while (flash_cred_index[next]) {
+        uint32_t home = Flash_CredHome(flash_cred_codes[flash_cred_index[next] - 1]);
+        // 空洞位于 [home, next) 之间时，这个元素可以移到空洞
+        if (((next - home) & FLASH_CRED_INDEX_MASK) >= ((next - hole) & FLASH_CRED_INDEX_MASK)) {
+            flash_cred_index[hole] = flash_cred_index[next];
+            hole                   = next;
+        }
+        next = (next + 1) & FLASH_CRED_INDEX_MASK;
+    }
+    flash_cred_index[hole] = 0;
+}
+
+/*
+ * 按数组重建索引（调用者持有 flash_cred_mutex，不持有 flash_lock）：
+ * 持有 flash_cred_mutex 时数组不会变化，在没有使用的那份索引中插入，
+ * 完成后在 flash_lock 内切换，校验只会看到旧索引或新索引。
+ */
+static void Flash_CredRebuildIndex(void)
+{
+    uint16_t *scratch  = flash_cred_index == flash_cred_index_bufs[0] ? flash_cred_index_bufs[1] : flash_cred_index_bufs[0];
+    uint32_t count     = flash_cred_header.count;
+    uint32_t max_probe = 0;
+
+    memset(scratch, 0, sizeof(flash_cred_index_bufs[0]));
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t probes;
+        uint32_t slot = Flash_CredProbe(scratch, flash_cred_codes[i], &probes);
+        scratch[slot] = i + 1;
+        if (probes > max_probe) max_probe = probes;
+    }
+
+    taskENTER_CRITICAL(&flash_lock);
+    flash_cred_index           = scratch;
+    flash_stats.cred_max_probe = max_probe;
+    flash_stats.credentials    = count;
+    flash_cred_version++;
+    taskEXIT_CRITICAL(&flash_lock);
+}
+
+uint8_t Flash_VerifyPassword(const char *input, size_t len)
+{
+    int64_t start = esp_timer_get_time();
+    // 无论在哪一位不同，都比较全部 FLASH_PASSWORD_MAX 字节，耗时与输入内容无关
+    uint8_t diff  = len > FLASH_PASSWORD_MAX;
+    uint32_t code = Flash_CredentialEncode(input, len);
+
+    taskENTER_CRITICAL(&flash_lock);
+    diff |= (uint8_t)(len ^ flash_password_len);
+    for (size_t i = 0; i < FLASH_PASSWORD_MAX; i++) {
+        uint8_t c = i < len ? (uint8_t)input[i] : 0;
+        diff |= c ^ (uint8_t)flash_password[i];
+    }
+    // 不是管理员密码时查访客密码表
+    uint32_t slot    = code ? Flash_CredFind(code, NULL) : 0;
+    uint8_t guest    = code && flash_cred_index[slot] != 0;
+    uint8_t schedule = guest ? flash_cred_schedule[flash_cred_index[slot] - 1] : SCHEDULE_ALWAYS;
+    taskEXIT_CRITICAL(&flash_lock);
+
+    // 访客密码还要在它的时间表允许的时段内
+    guest = guest && Schedule_Allows(schedule);
+
+    uint32_t elapsed = esp_timer_get_time() - start;
+    taskENTER_CRITICAL(&flash_lock);
+    flash_stats.verifies++;
+    flash_stats.last_verify_us = elapsed;
+    if (elapsed > flash_stats.max_verify_us) {
+        flash_stats.max_verify_us = elapsed;
+    }
+    taskEXIT_CRITICAL(&flash_lock);
+    return diff == 0 || guest;
+}
+
+void Flash_GetStats(flash_stats_t *stats)
+{
+    taskENTER_CRITICAL(&flash_lock);
+    *stats = flash_stats;
+    taskEXIT_CRITICAL(&flash_lock);
+}
+
+// blob 中头之后的长度
+static size_t Flash_CredBodySize(uint32_t count)
+{
+    return sizeof(schedule_store_t) + count * (sizeof(uint32_t) + sizeof(uint8_t));
+}
+
+// 从 NVS 读取访客密码表和时间表并重建索引（调用者持有 flash_cred_mutex）
+static void Flash_LoadCredentials(void)
+{
+    // 读取期间数组内容不完整：先换上空索引，校验不会访问数组
+    taskENTER_CRITICAL(&flash_lock);
+    flash_cred_header.count = 0;
+    taskEXIT_CRITICAL(&flash_lock);
+    Flash_CredRebuildIndex();
+
+    size_t len     = 0;
+    uint8_t *blob  = NULL;
+    esp_err_t err  = nvs_get_blob(flash_cred_nvs, FLASH_CRED_KEY, NULL, &len);
+    uint8_t loaded = 0;
+    // 读到了 blob 但内容不对时的原因，NULL 表示看 err
+    const char *reason = NULL;
+    if (err == ESP_OK && len >= sizeof(flash_cred_header_t) + Flash_CredBodySize(0)) {
+        blob = malloc(len);
+        err  = blob ? nvs_get_blob(flash_cred_nvs, FLASH_CRED_KEY, blob, &len) : ESP_ERR_NO_MEM;
+    } else if (err == ESP_OK) {
+        reason = "length mismatch";
+    }
+    if (blob && err == ESP_OK) {
+        flash_cred_header_t header;
+        memcpy(&header, blob, sizeof(header));
+        const uint8_t *body = blob + sizeof(header);
+        if (header.magic != FLASH_CRED_MAGIC) {
+            reason = "magic mismatch";
+        } else if (header.count > FLASH_CRED_MAX || len != sizeof(header) + Flash_CredBodySize(header.count)) {
+            reason = "length mismatch";
+        } else if (header.checksum != Flash_Fnv1a(body, len - sizeof(header))) {
+            reason = "checksum mismatch";
+        } else {
+            schedule_store_t schedules;
+            memcpy(&schedules, body, sizeof(schedules));
+            body += sizeof(schedules);
+            memcpy(flash_cred_codes, body, header.count * sizeof(uint32_t));
+            body += header.count * sizeof(uint32_t);
+            memcpy(flash_cred_schedule, body, header.count);
+            Schedule_Import(&schedules);
+            flash_cred_header = header;
+            loaded            = 1;
+        }
+    }
+    free(blob);
+
+    if (!loaded) {
+        if (err != ESP_ERR_NVS_NOT_FOUND) {
+            ESP_LOGW(TAG, "credential table invalid (%s), starting empty", reason ? reason : esp_err_to_name(err));
+        }
+        memset(&flash_cred_header, 0, sizeof(flash_cred_header));
+        Schedule_Reset();
+    }
+
+    Flash_CredRebuildIndex();
+    taskENTER_CRITICAL(&flash_lock);
+    flash_cred_dirty = 0;
+    taskEXIT_CRITICAL(&flash_lock);
+}
+
+// 把密码表和时间表拼成一个 blob 写入并提交（调用者持有 flash_cred_mutex）
+static esp_err_t Flash_StoreCredentials(void)
+{
+    uint32_t count = flash_cred_header.count;
+    size_t len     = sizeof(flash_cred_header_t) + Flash_CredBodySize(count);
+    uint8_t *blob  = malloc(len);
+    if (blob == NULL) {
+        ESP_LOGE(TAG, "store credentials: no memory for %d bytes", (int)len);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint8_t *body = blob + sizeof(flash_cred_header_t);
+    uint8_t *p    = body;
+    Schedule_Export((schedule_store_t *)p);
+    p += sizeof(schedule_store_t);
+    memcpy(p, flash_cred_codes, count * sizeof(uint32_t));
+    p += count * sizeof(uint32_t);
+    memcpy(p, flash_cred_schedule, count);
+
+    // 写入成功后才更新内存中的头，失败时下一次重试用同一个版本号
+    flash_cred_header_t header = flash_cred_header;
+    header.magic               = FLASH_CRED_MAGIC;
+    header.generation          = flash_cred_header.generation + 1;
+    header.checksum            = Flash_Fnv1a(body, len - sizeof(flash_cred_header_t));
+    memcpy(blob, &header, sizeof(header));
+
+    // NVS 写完新数据才擦除旧数据，掉电时读到的是旧表或新表
+    esp_err_t err = nvs_set_blob(flash_cred_nvs, FLASH_CRED_KEY, blob, len);
+    if (err == ESP_OK) {
+        err = nvs_commit(flash_cred_nvs);
+    }
+    free(blob);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "store credentials failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    taskENTER_CRITICAL(&flash_lock);
+    flash_cred_header.magic      = header.magic;
+    flash_cred_header.generation = header.generation;
+    flash_cred_header.checksum   = header.checksum;
+    flash_stats.cred_commits++;
+    flash_stats.nvs_commits++;
+    taskEXIT_CRITICAL(&flash_lock);
+    ESP_LOGI(TAG, "%" PRIu32 " credentials stored, generation %" PRIu32, count, header.generation);
+    return ESP_OK;
+}
+
+void Flash_InitCredentials(void)
+{
+    xSemaphoreTake(flash_cred_mutex, portMAX_DELAY);
+    Flash_LoadCredentials();
+    xSemaphoreGive(flash_cred_mutex);
+    ESP_LOGI(TAG, "%" PRIu32 " credentials loaded, index %u slots", flash_cred_header.count, FLASH_CRED_INDEX_SIZE);
+}
+
+flash_cred_result_t Flash_CredentialAdd(const char *pin, size_t len, uint8_t schedule)
+{
+    uint32_t code = Flash_CredentialEncode(pin, len);
+    if (code == 0 || schedule >= SCHEDULE_MAX) return FLASH_CRED_INVALID;
+
+    flash_cred_result_t result = FLASH_CRED_OK;
+    xSemaphoreTake(flash_cred_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&flash_lock);
+    uint32_t slot = Flash_CredFind(code, NULL);
+    if (flash_cred_index[slot]) {
+        // 已存在：更新它的时间表
+        flash_cred_schedule[flash_cred_index[slot] - 1] = schedule;
+        result                                          = FLASH_CRED_EXISTS;
+    } else if (flash_cred_header.count >= FLASH_CRED_MAX) {
+        result = FLASH_CRED_FULL;
+    } else {
+        uint32_t pos             = flash_cred_header.count++;
+        flash_cred_codes[pos]    = code;
+        flash_cred_schedule[pos] = schedule;
+        Flash_CredIndexInsert(pos);
+        flash_stats.credentials = flash_cred_header.count;
+        flash_cred_version++;
+    }
+    taskEXIT_CRITICAL(&flash_lock);
+    xSemaphoreGive(flash_cred_mutex);
+    return result;
+}
+
+flash_cred_result_t Flash_CredentialRemove(const char *pin, size_t len)
+{
+    uint32_t code = Flash_CredentialEncode(pin, len);
+    if (code == 0) return FLASH_CRED_INVALID;
+
+    flash_cred_result_t result = FLASH_CRED_OK;
+    xSemaphoreTake(flash_cred_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&flash_lock);
+    uint32_t slot = Flash_CredFind(code, NULL);
+    if (flash_cred_index[slot] == 0) {
+        result = FLASH_CRED_NOT_FOUND;
+    } else {
+        uint32_t pos  = flash_cred_index[slot] - 1;
+        uint32_t last = --flash_cred_header.count;
+        Flash_CredIndexDelete(slot);
+        // 用最后一个元素填补数组中的空位，保持数组紧凑
+        if (pos != last) {
+            uint32_t moved           = Flash_CredFind(flash_cred_codes[last], NULL);
+            flash_cred_codes[pos]    = flash_cred_codes[last];
+            flash_cred_schedule[pos] = flash_cred_schedule[last];
+            flash_cred_index[moved]  = pos + 1;
+        }
+        flash_stats.credentials = flash_cred_header.count;
+        flash_cred_version++;
+    }
+    taskEXIT_CRITICAL(&flash_lock);
+    xSemaphoreGive(flash_cred_mutex);
+    return result;
+}
+
+void Flash_CredentialClear(void)
+{
+    xSemaphoreTake(flash_cred_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&flash_lock);
+    flash_cred_header.count = 0;
+    taskEXIT_CRITICAL(&flash_lock);
+    Flash_CredRebuildIndex();
+    xSemaphoreGive(flash_cred_mutex);
+}
+
+void Flash_CredentialCommit(void)
+{
+    taskENTER_CRITICAL(&flash_lock);
+    flash_cred_dirty = 1;
+    taskEXIT_CRITICAL(&flash_lock);
+    xTaskNotifyGive(flash_task_handle);
+}
+
+void Flash_CredentialAbort(void)
+{
+    xSemaphoreTake(flash_cred_mutex, portMAX_DELAY);
+    Flash_LoadCredentials();
+    xSemaphoreGive(flash_cred_mutex);
+}
+
+uint32_t Flash_CredentialVersion(void)
+{
+    taskENTER_CRITICAL(&flash_lock);
+    uint32_t version = flash_cred_version;
+    taskEXIT_CRITICAL(&flash_lock);
+    return version;
+}
+
+void Flash_CredentialForEach(flash_cred_visit_t visit, void *arg)
+{
+    char admin[FLASH_PASSWORD_MAX];
+    xSemaphoreTake(flash_cred_mutex, portMAX_DELAY);
+    taskENTER_CRITICAL(&flash_lock);
+    memcpy(admin, flash_password, sizeof(admin));
+    uint8_t admin_len = flash_password_len;
+    taskEXIT_CRITICAL(&flash_lock);
+
+    // 管理员密码只有是 4~8 位数字时才能编码，其他的无法在键盘上输入
+    uint32_t code = Flash_CredentialEncode(admin, admin_len);
+    memset(admin, 0, sizeof(admin));
+    if (code) {
+        visit(code, arg);
+    }
+    // 持有 flash_cred_mutex 时数组不会变化
+    for (uint32_t i = 0; i < flash_cred_header.count; i++) {
+        visit(flash_cred_codes[i], arg);
+    }
+    xSemaphoreGive(flash_cred_mutex);
+}
+
+uint16_t Flash_CredentialCount(void)
+{
+    taskENTER_CRITICAL(&flash_lock);
+    uint16_t count = flash_cred_header.count;
+    taskEXIT_CRITICAL(&flash_lock);
+    return count;
+}
+
+// 存储任务：把内存镜像写回 NVS，NVS 的擦写只发生在这里
+static void flash_task(void *arg)
+{
+    flash_slot_t slot;
+    flash_stats_t stats;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        DelayMs(FLASH_WRITE_BATCH_MS);
+        // 等待期间的通知已经包含在这次写入里
+        ulTaskNotifyTake(pdTRUE, 0);
+
+        taskENTER_CRITICAL(&flash_lock);
+        uint8_t dirty = flash_dirty;
+        memset(&slot, 0, sizeof(slot));
+        memcpy(slot.password, flash_password, sizeof(slot.password));
+        slot.len    = flash_password_len;
+        flash_dirty = 0;
+        taskEXIT_CRITICAL(&flash_lock);
+
+        if (dirty && Flash_StoreSlot(&slot) != ESP_OK) {
+            // 写入失败：保留脏标记，下一次修改时重试
+            taskENTER_CRITICAL(&flash_lock);
+            flash_dirty = 1;
+            taskEXIT_CRITICAL(&flash_lock);
+        } else if (dirty) {
+            Flash_GetStats(&stats);
+            ESP_LOGI(TAG, "password stored, generation %" PRIu32 ", %" PRIu32 " updates in %" PRIu32 " commits",
+                     stats.generation, stats.updates, stats.nvs_commits);
+        }
+
+        // 访客密码表：整张表一次写入
+        taskENTER_CRITICAL(&flash_lock);
+        dirty            = flash_cred_dirty;
+        flash_cred_dirty = 0;
+        taskEXIT_CRITICAL(&flash_lock);
+        if (dirty) {
+            xSemaphoreTake(flash_cred_mutex, portMAX_DELAY);
+            if (Flash_StoreCredentials() != ESP_OK) {
+                taskENTER_CRITICAL(&flash_lock);
+                flash_cred_dirty = 1;
+                taskEXIT_CRITICAL(&flash_lock);
+            }
+            xSemaphoreGive(flash_cred_mutex);
+        }
+    }
+}
@@ -1,8 +1,71 @@
 #pragma once
 #include "utils.h"
 
+// 密码最大长度（不含结束符）
+#define FLASH_PASSWORD_MAX 16
+
 void Flash_Init(void);
 
+// 开机时把密码从 NVS 读到内存镜像，不存在时写入默认密码
 void Flash_InitPassword();
+// 更新内存镜像并交给存储任务写回 NVS，立即返回，可以在蓝牙回调中调用
 void Flash_WritePassword(char *password);
-void Flash_ReadPassword(char *password, size_t *pw_len);
\ No newline at end of file
+// 从内存镜像读取密码
+void Flash_ReadPassword(char *password, size_t *pw_len);
+// 与管理员密码做常数时间比较，再查访客密码表，1 表示密码正确
+uint8_t Flash_VerifyPassword(const char *input, size_t len);
+
+/*
+ * 访客密码表：最多 FLASH_CRED_MAX 个 4~8 位数字密码，内存中有哈希索引，
+ * 校验耗时与密码数量无关。每个密码关联一个时间表（schedule.h），只在允许的时段有效。
+ * 增删只修改内存并立即生效，Flash_CredentialCommit() 时才把整张表连同时间表
+ * 作为一个 blob 写入 NVS（一次提交）。
+ */
+#define FLASH_CRED_MAX        CONFIG_CREDENTIAL_MAX
+#define FLASH_CRED_MIN_DIGITS 4
+#define FLASH_CRED_MAX_DIGITS 8
+
+typedef enum {
+    FLASH_CRED_OK = 0,
+    FLASH_CRED_EXISTS,    // 添加时已存在
+    FLASH_CRED_NOT_FOUND, // 删除时不存在
+    FLASH_CRED_FULL,      // 表已满
+    FLASH_CRED_INVALID,   // 不是 4~8 位数字
+} flash_cred_result_t;
+
+// 开机时从 NVS 读取访客密码表并建立索引
+void Flash_InitCredentials(void);
+// 添加密码；已存在时只更新它的时间表并返回 FLASH_CRED_EXISTS
+flash_cred_result_t Flash_CredentialAdd(const char *pin, size_t len, uint8_t schedule);
+flash_cred_result_t Flash_CredentialRemove(const char *pin, size_t len);
+// 删除全部访客密码
+void Flash_CredentialClear(void);
+// 把当前的密码表和时间表交给存储任务写回 NVS
+void Flash_CredentialCommit(void);
+// 放弃未提交的修改（包括时间表），重新从 NVS 读取
+void Flash_CredentialAbort(void);
+uint16_t Flash_CredentialCount(void);
+
+// 密码的 4 字节编码：高位是位数，低 27 位是数值；不合法时返回 0
+uint32_t Flash_CredentialEncode(const char *pin, size_t len);
+// 解码到 pin（不加结束符），返回位数
+size_t Flash_CredentialDecode(uint32_t code, char *pin);
+// 管理员密码或访客密码表每次变化时加一，用来判断派生的数据是否需要重建
+uint32_t Flash_CredentialVersion(void);
+// 依次访问管理员密码（能编码时）和所有访客密码的编码，回调中不能调用 Flash_Credential*()
+typedef void (*flash_cred_visit_t)(uint32_t code, void *arg);
+void Flash_CredentialForEach(flash_cred_visit_t visit, void *arg);
+
+// 存储统计
+typedef struct {
+    uint32_t verifies;       // 校验次数
+    uint32_t last_verify_us; // 最近一次校验耗时
+    uint32_t max_verify_us;  // 最长校验耗时
+    uint32_t updates;        // 密码修改次数
+    uint32_t nvs_commits;    // 实际写入 NVS 的次数（多次修改合并为一次）
+    uint32_t generation;     // 当前存储的版本号
+    uint32_t credentials;    // 访客密码数量
+    uint32_t cred_commits;   // 访客密码表写入 NVS 的次数
+    uint32_t cred_max_probe; // 索引中最长的探测距离
+} flash_stats_t;
+void Flash_GetStats(flash_stats_t *stats);
@@ -10,5 +10,38 @@
 // 0 表示第 0 个引脚
 #define KEYBOARD_INT_PIN GPIO_NUM_0
 
+// 键盘芯片的7位I2C地址
+#define KEYBOARD_IIC_ADDR 0x42
+
+/**
+ * @brief 键盘后端：负责从键盘芯片读出16位按键字
+ *
+ * init      初始化总线（SDA/SCL）
+ * read_word 读取按键字，返回 0 成功，其他值失败
+ */
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    uint8_t (*read_word)(uint16_t *result);
+} keyboard_backend_t;
+
+// GPIO 软件模拟 I2C（微秒级定时）
+extern const keyboard_backend_t keyboard_backend_bitbang;
+// ESP-IDF i2c_master 外设驱动
+extern const keyboard_backend_t keyboard_backend_i2c;
+
+#if CONFIG_IDF_TARGET_LINUX
+// 主机仿真用的假键盘
+extern const keyboard_backend_t keyboard_backend_sim;
+// 模拟按下一个按键，key_word 为键盘芯片返回的16位按键字
+void Keyboard_SimPress(uint16_t key_word);
+// 按键值（0~9 数字，10 = #，11 = M）模拟按下
+void Keyboard_SimPressKey(uint8_t key);
+#endif
+
 void Keyboard_Init(void);
-uint8_t Keyboard_ReadKey(void);
\ No newline at end of file
+uint8_t Keyboard_ReadKey(void);
+
+// 最近一次 / 历史最长 读取按键字的耗时（微秒）
+uint32_t Keyboard_LastReadUs(void);
+uint32_t Keyboard_MaxReadUs(void);
@@ -0,0 +1,220 @@
+#include "keyboard.h"
+#include "driver/i2c_master.h"
+#include "esp_rom_sys.h"
+#include "esp_log.h"
+#include "utils.h"
+
+static const char *TAG = "keyboard iic";
+
+// sda引脚号
+#define IIC_SDA_PIN GPIO_NUM_2
+// scl引脚号
+#define IIC_SCL_PIN GPIO_NUM_1
+
+// 半个SCL周期的时间（微秒），100kHz 时为 5us
+#define IIC_HALF_PERIOD_US ((500000 + CONFIG_KEYBOARD_I2C_FREQ_HZ - 1) / CONFIG_KEYBOARD_I2C_FREQ_HZ)
+// 等待从机应答的最长时间（微秒）
+#define IIC_ACK_TIMEOUT_US 100
+// i2c_master 单次传输的超时时间（毫秒）
+#define IIC_XFER_TIMEOUT_MS 10
+
+// 微秒级忙等延时：软件I2C的每个边沿只需要几微秒，不能交给调度器
+#define IIC_DELAY esp_rom_delay_us(IIC_HALF_PERIOD_US)
+
+// 将SDA设置为输出方向
+#define IIC_SDA_OUT gpio_set_direction(IIC_SDA_PIN, GPIO_MODE_OUTPUT)
+// 将SDA设置为输入方向
+#define IIC_SDA_IN gpio_set_direction(IIC_SDA_PIN, GPIO_MODE_INPUT)
+
+// SDA输出高电平
+#define IIC_SDA_HIGH gpio_set_level(IIC_SDA_PIN, 1)
+// SDA输出低电平
+#define IIC_SDA_LOW gpio_set_level(IIC_SDA_PIN, 0)
+
+// SCL输出高电平
+#define IIC_SCL_HIGH gpio_set_level(IIC_SCL_PIN, 1)
+// SCL输出低电平
+#define IIC_SCL_LOW gpio_set_level(IIC_SCL_PIN, 0)
+
+// 读取SDA的电平
+#define IIC_SDA_READ        gpio_get_level(IIC_SDA_PIN)
+
+#define IIC_SDA_SCL_PIN_SEL (1ULL << IIC_SDA_PIN) | (1ULL << IIC_SCL_PIN)
+
+/* ---------------------------- GPIO 软件模拟 ---------------------------- */
+
+// IIC 启动信号函数
+static void IIC_Start(void)
+{
+    IIC_SDA_OUT;
+    IIC_SDA_HIGH;
+    IIC_SCL_HIGH;
+    IIC_DELAY;
+    IIC_SDA_LOW;
+    IIC_DELAY;
+    IIC_SCL_LOW;
+    IIC_DELAY;
+}
+
+// IIC 停止信号
+static void IIC_Stop(void)
+{
+    IIC_SCL_LOW;
+    IIC_SDA_OUT;
+    IIC_SDA_LOW;
+    IIC_DELAY;
+    IIC_SCL_HIGH;
+    IIC_DELAY;
+    IIC_SDA_HIGH;
+}
+
+// 发送一个字节并读取ACK
+static uint8_t IIC_SendByteAndGetNACK(uint8_t byte)
+{
+    uint8_t i = 0;
+    IIC_SDA_OUT;
+    for (i = 0; i < 8; i++) {
+        IIC_SCL_LOW;
+        if ((byte >> 7) & 0x01) {
+            IIC_SDA_HIGH;
+        } else {
+            IIC_SDA_LOW;
+        }
+        IIC_DELAY;
+        IIC_SCL_HIGH;
+        IIC_DELAY;
+        byte <<= 1;
+    }
+    IIC_SCL_LOW;
+    IIC_SDA_IN;
+    IIC_DELAY;
+    IIC_SCL_HIGH;
+    IIC_DELAY;
+    for (uint32_t us = 0; us < IIC_ACK_TIMEOUT_US; us++) {
+        if (!IIC_SDA_READ) {
+            IIC_SCL_LOW;
+            return 0;
+        }
+        esp_rom_delay_us(1);
+    }
+    IIC_SCL_LOW;
+    return 1;
+}
+
+// 下发应答命令
+static void IIC_Respond(uint8_t ack)
+{
+    IIC_SCL_LOW;
+    IIC_SDA_OUT;
+    if (ack) {
+        IIC_SDA_HIGH;
+    } else {
+        IIC_SDA_LOW;
+    }
+    IIC_DELAY;
+    IIC_SCL_HIGH;
+    IIC_DELAY;
+    IIC_SCL_LOW;
+}
+
+// 读取一个字节
+static uint8_t IIC_ReadByte(void)
+{
+    uint8_t i      = 0;
+    uint8_t buffer = 0;
+    IIC_SDA_IN;
+    IIC_SCL_LOW;
+    for (i = 0; i < 8; i++) {
+        IIC_DELAY;
+        IIC_SCL_HIGH;
+        buffer = (buffer << 1) | IIC_SDA_READ;
+        IIC_DELAY;
+        IIC_SCL_LOW;
+    }
+
+    return buffer;
+}
+
+static uint8_t IIC_SimpleRead(uint16_t *result)
+{
+    uint8_t buf1 = 0;
+    uint8_t buf2 = 0;
+    IIC_Start();
+    if (IIC_SendByteAndGetNACK((KEYBOARD_IIC_ADDR << 1) | 0x01)) {
+        IIC_Stop();
+        return 1;
+    }
+
+    buf1 = IIC_ReadByte();
+    IIC_Respond(0);
+    buf2 = IIC_ReadByte();
+    IIC_Respond(1);
+    IIC_Stop();
+    *result = ((uint16_t)buf1 << 8) | buf2;
+    return 0;
+}
+
+static void IIC_BitbangInit(void)
+{
+    // 初始化sda和scl引脚
+    gpio_config_t io_conf = {};
+    // 设置为输出模式
+    io_conf.mode = GPIO_MODE_OUTPUT;
+    // 禁用中断
+    io_conf.intr_type = GPIO_INTR_DISABLE;
+    // 设置要使用的引脚号
+    io_conf.pin_bit_mask = IIC_SDA_SCL_PIN_SEL;
+    gpio_config(&io_conf);
+    IIC_SDA_HIGH;
+    IIC_SCL_HIGH;
+}
+
+const keyboard_backend_t keyboard_backend_bitbang = {
+    .name      = "gpio bit-bang",
+    .init      = IIC_BitbangInit,
+    .read_word = IIC_SimpleRead,
+};
+
+/* ---------------------------- i2c_master 外设 ---------------------------- */
+
+static i2c_master_dev_handle_t keyboard_dev = NULL;
+
+static void IIC_MasterInit(void)
+{
+    i2c_master_bus_config_t bus_config = {
+        .i2c_port                     = -1, // 自动选择空闲的I2C控制器
+        .sda_io_num                   = IIC_SDA_PIN,
+        .scl_io_num                   = IIC_SCL_PIN,
+        .clk_source                   = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt            = 7,
+        .flags.enable_internal_pullup = true,
+    };
+    i2c_master_bus_handle_t bus = NULL;
+    ESP_ERROR_CHECK(i2c_new_master_bus(&bus_config, &bus));
+
+    i2c_device_config_t dev_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address  = KEYBOARD_IIC_ADDR,
+        .scl_speed_hz    = CONFIG_KEYBOARD_I2C_FREQ_HZ,
+    };
+    ESP_ERROR_CHECK(i2c_master_bus_add_device(bus, &dev_config, &keyboard_dev));
+}
+
+static uint8_t IIC_MasterRead(uint16_t *result)
+{
+    // 读两个字节：第一个字节回ACK，最后一个字节回NACK，与软件时序一致
+    uint8_t buf[2] = {0};
+    esp_err_t err  = i2c_master_receive(keyboard_dev, buf, sizeof(buf), IIC_XFER_TIMEOUT_MS);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "i2c receive failed: %s", esp_err_to_name(err));
+        return 1;
+    }
+    *result = ((uint16_t)buf[0] << 8) | buf[1];
+    return 0;
+}
+
+const keyboard_backend_t keyboard_backend_i2c = {
+    .name      = "i2c master",
+    .init      = IIC_MasterInit,
+    .read_word = IIC_MasterRead,
+};
@@ -0,0 +1,235 @@
+#include "pin_matcher.h"
+#include "flash.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "pin_matcher";
+
+#define PIN_MATCHER_DIGITS 10
+
+// 状态数上限：根 + 每个密码每一位一个状态（管理员密码能编码时也在自动机中），密码表满时也放得下
+#define PIN_MATCHER_MAX_STATES (1 + (FLASH_CRED_MAX + 1) * FLASH_CRED_MAX_DIGITS)
+#if PIN_MATCHER_MAX_STATES <= UINT16_MAX
+typedef uint16_t pin_state_t;
+#else
+typedef uint32_t pin_state_t;
+#endif
+
+/*
+ * 自动机：状态 0 是根。next 是展开后的完整转移表（没有失败指针，每次按键一次查表）；
+ * output 是在该状态结束的密码编码；dict 指向后缀链上下一个有输出的状态，
+ * 一个状态的输出最多是长度 4~8 的几个互为后缀的密码，检查次数有上限。
+ */
+typedef struct {
+    pin_state_t (*next)[PIN_MATCHER_DIGITS];
+    uint32_t *output;
+    pin_state_t *dict;
+    uint32_t states; // 0 表示没有自动机
+} pin_automaton_t;
+
+typedef struct {
+    pin_automaton_t *dfa;
+    uint32_t capacity;
+    uint32_t patterns;
+    uint8_t overflow;
+} pin_build_t;
+
+// 以下状态在启动的 credentials 阶段由 app_main 第一次写入（PinMatcher_Init），之后只在按键任务中访问
+static pin_automaton_t pin_dfa = {0};
+static uint8_t pin_built       = 0;
+static uint32_t pin_version    = 0;
+static pin_state_t pin_state   = 0;
+static uint8_t pin_length      = 0;
+
+static pin_matcher_stats_t pin_stats = {0};
+
+static void PinMatcher_Free(pin_automaton_t *dfa)
+{
+    free(dfa->next);
+    free(dfa->output);
+    free(dfa->dict);
+    memset(dfa, 0, sizeof(*dfa));
+}
+
+static void PinMatcher_Count(uint32_t code, void *arg)
+{
+    *(uint32_t *)arg += code >> 27;
+}
+
+// 把一个密码插入字典树
+static void PinMatcher_Insert(uint32_t code, void *arg)
+{
+    pin_build_t *build   = arg;
+    pin_automaton_t *dfa = build->dfa;
+    char digits[FLASH_CRED_MAX_DIGITS];
+    size_t len     = Flash_CredentialDecode(code, digits);
+    pin_state_t state = 0;
+
+    for (size_t i = 0; i < len && !build->overflow; i++) {
+        uint8_t d = digits[i] - '0';
+        if (dfa->next[state][d] == 0) {
+            // 子节点不会是根，构建期间 0 表示没有边
+            if (dfa->states >= build->capacity) {
+                build->overflow = 1;
+                break;
+            }
+            dfa->next[state][d] = dfa->states++;
+        }
+        state = dfa->next[state][d];
+    }
+    memset(digits, 0, sizeof(digits));
+    if (!build->overflow && dfa->output[state] == 0) {
+        dfa->output[state] = code;
+        build->patterns++;
+    }
+}
+
+// 按宽度优先计算失败指针，同时把缺失的边补成完整的转移
+static uint8_t PinMatcher_Link(pin_automaton_t *dfa)
+{
+    pin_state_t *fail  = calloc(dfa->states, sizeof(pin_state_t));
+    pin_state_t *queue = malloc(dfa->states * sizeof(pin_state_t));
+    if (fail == NULL || queue == NULL) {
+        free(fail);
+        free(queue);
+        return 0;
+    }
+
+    uint32_t head = 0;
+    uint32_t tail = 0;
+    for (uint8_t d = 0; d < PIN_MATCHER_DIGITS; d++) {
+        if (dfa->next[0][d]) {
+            queue[tail++] = dfa->next[0][d];
+        }
+    }
+    while (head < tail) {
+        pin_state_t s = queue[head++];
+        for (uint8_t d = 0; d < PIN_MATCHER_DIGITS; d++) {
+            pin_state_t c = dfa->next[s][d];
+            if (c) {
+                pin_state_t f = dfa->next[fail[s]][d];
+                fail[c]       = f;
+                dfa->dict[c]  = dfa->output[f] ? f : dfa->dict[f];
+                queue[tail++] = c;
+            } else {
+                dfa->next[s][d] = dfa->next[fail[s]][d];
+            }
+        }
+    }
+    free(fail);
+    free(queue);
+    return 1;
+}
+
+static void PinMatcher_Build(uint32_t version)
+{
+    int64_t start   = esp_timer_get_time();
+    uint32_t needed = 1;
+
+    PinMatcher_Free(&pin_dfa);
+    PinMatcher_Reset();
+    pin_built   = 1;
+    pin_version = version;
+    pin_stats.rebuilds++;
+
+    /*
+     * 状态数不超过 1 + 所有密码的位数之和（不超过 PIN_MATCHER_MAX_STATES，状态编号放得下），
+     * 共同前缀多时实际的字典树小一些，按这个上限分配。两次遍历之间密码表可能又变了，
+     * 这时版本号也变了，下一次按键会重建。
+     */
+    Flash_CredentialForEach(PinMatcher_Count, &needed);
+    pin_build_t build = {.dfa = &pin_dfa, .capacity = needed};
+    pin_dfa.next      = calloc(needed, sizeof(*pin_dfa.next));
+    pin_dfa.output    = calloc(needed, sizeof(uint32_t));
+    pin_dfa.dict      = calloc(needed, sizeof(pin_state_t));
+    if (pin_dfa.next && pin_dfa.output && pin_dfa.dict) {
+        pin_dfa.states = 1;
+        Flash_CredentialForEach(PinMatcher_Insert, &build);
+    }
+    if (pin_dfa.states == 0 || build.overflow || !PinMatcher_Link(&pin_dfa)) {
+        // 只有内存不足时会走到这里，密码表下一次变化时再试
+        ESP_LOGE(TAG, "no memory for a %" PRIu32 " state automaton, keypad PINs disabled", needed);
+        PinMatcher_Free(&pin_dfa);
+        build.patterns = 0;
+    }
+
+    pin_stats.states        = pin_dfa.states;
+    pin_stats.patterns      = build.patterns;
+    pin_stats.last_build_us = esp_timer_get_time() - start;
+    ESP_LOGI(TAG, "%" PRIu32 " pins, %" PRIu32 " states, built in %" PRIu32 " us",
+             pin_stats.patterns, pin_stats.states, pin_stats.last_build_us);
+}
+
+// 用密码表校验自动机找到的密码（撤销、时间表都在这里生效）
+static uint8_t PinMatcher_Check(uint32_t code)
+{
+    char digits[FLASH_CRED_MAX_DIGITS];
+    size_t len    = Flash_CredentialDecode(code, digits);
+    uint8_t match = Flash_VerifyPassword(digits, len);
+    memset(digits, 0, sizeof(digits));
+    return match;
+}
+
+static pin_match_result_t PinMatcher_StepAutomaton(uint8_t digit)
+{
+    pin_length++;
+    if (pin_dfa.states) {
+        pin_state = pin_dfa.next[pin_state][digit];
+        for (pin_state_t s = pin_dfa.output[pin_state] ? pin_state : pin_dfa.dict[pin_state]; s; s = pin_dfa.dict[s]) {
+            if (PinMatcher_Check(pin_dfa.output[s])) {
+                PinMatcher_Reset();
+                return PIN_MATCH_OK;
+            }
+        }
+    }
+    if (pin_length >= CONFIG_PIN_MAX_SEQUENCE) {
+        PinMatcher_Reset();
+        return PIN_MATCH_FAIL;
+    }
+    return PIN_MATCH_NONE;
+}
+
+void PinMatcher_Init(void)
+{
+    PinMatcher_Build(Flash_CredentialVersion());
+}
+
+void PinMatcher_Reset(void)
+{
+    pin_state  = 0;
+    pin_length = 0;
+}
+
+pin_match_result_t PinMatcher_Feed(uint8_t digit)
+{
+    if (digit >= PIN_MATCHER_DIGITS) return PIN_MATCH_NONE;
+
+    // 密码表变化后重建，正在输入的序列作废
+    uint32_t version = Flash_CredentialVersion();
+    if (!pin_built || version != pin_version) {
+        PinMatcher_Build(version);
+    }
+
+    int64_t start             = esp_timer_get_time();
+    pin_match_result_t result = PinMatcher_StepAutomaton(digit);
+    uint32_t elapsed          = esp_timer_get_time() - start;
+
+    pin_stats.keys++;
+    if (elapsed > pin_stats.max_step_us) {
+        pin_stats.max_step_us = elapsed;
+    }
+    return result;
+}
+
+uint8_t PinMatcher_Length(void)
+{
+    return pin_length;
+}
+
+void PinMatcher_GetStats(pin_matcher_stats_t *stats)
+{
+    *stats = pin_stats;
+}
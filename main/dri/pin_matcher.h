@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * 防偷窥密码输入：密码可以夹在更长的按键序列中间，例如 "93123456078" 中的 "123456"。
+ *
+ * 所有有效密码（管理员密码和访客密码）构成一个 Aho-Corasick 自动机，
+ * 预先展开成完整的状态转移表，每次按键只是一次查表，不保存已经输入的数字。
+ * 走到某个密码的结束状态时再交给 Flash_VerifyPassword() 校验（时间表、撤销都在那里判断）。
+ *
+ * 密码表变化后在下一次按键时重建。状态数上限按 CONFIG_CREDENTIAL_MAX 计算，密码表满时也放得下；
+ * 只保存自动机状态，不保存输入过的数字。管理员密码只有是 4~8 位数字时才能在键盘上输入。
+ */
+
+typedef enum {
+    PIN_MATCH_NONE = 0, // 继续输入
+    PIN_MATCH_OK,       // 序列中出现了有效密码
+    PIN_MATCH_FAIL,     // 输入了 CONFIG_PIN_MAX_SEQUENCE 位仍然没有有效密码
+} pin_match_result_t;
+
+void PinMatcher_Init(void);
+// 丢弃当前输入（超时、按下 #）
+void PinMatcher_Reset(void);
+// 输入一位数字（0~9）
+pin_match_result_t PinMatcher_Feed(uint8_t digit);
+// 已经输入的位数
+uint8_t PinMatcher_Length(void);
+
+typedef struct {
+    uint32_t states;        // 自动机状态数，0 表示内存不足没有建成
+    uint32_t patterns;      // 自动机中的密码数
+    uint32_t rebuilds;      // 重建次数
+    uint32_t last_build_us; // 最近一次重建耗时
+    uint32_t keys;          // 输入的数字数
+    uint32_t max_step_us;   // 单次按键最长处理时间（不含重建）
+} pin_matcher_stats_t;
+void PinMatcher_GetStats(pin_matcher_stats_t *stats);
@@ -0,0 +1,240 @@
+#include "schedule.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "schedule";
+
+#define SCHEDULE_WEEK_HOURS (7 * 24)
+
+static schedule_store_t schedule_store;
+static portMUX_TYPE schedule_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/*
+ * 本地时间缓存：[from, until) 这一个小时内本地日期和“本周第几小时”不变。
+ * until 为 0 表示无效。时钟被调整到区间以外时自然重新换算。
+ */
+static struct {
+    time_t from;
+    time_t until;
+    uint16_t day;
+    uint8_t hour;
+} schedule_clock = {0};
+
+int32_t Schedule_DaysFromCivil(int32_t year, uint32_t month, uint32_t day)
+{
+    // 以 3 月为一年的开始，闰日落在年末
+    year -= month <= 2;
+    int32_t era  = (year >= 0 ? year : year - 399) / 400;
+    uint32_t yoe = (uint32_t)(year - era * 400);
+    uint32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+static void Schedule_SetAll(schedule_t *schedule)
+{
+    memset(schedule, 0, sizeof(*schedule));
+    for (int h = 0; h < SCHEDULE_WEEK_HOURS; h++) {
+        schedule->week[h >> 5] |= 1UL << (h & 31);
+    }
+}
+
+void Schedule_Init(void)
+{
+    Schedule_Reset();
+    Schedule_SetTimezone(CONFIG_LOCK_TIMEZONE);
+}
+
+void Schedule_SetTimezone(const char *tz)
+{
+    setenv("TZ", tz, 1);
+    tzset();
+    taskENTER_CRITICAL(&schedule_lock);
+    schedule_clock.until = 0;
+    taskEXIT_CRITICAL(&schedule_lock);
+    ESP_LOGI(TAG, "timezone %s", tz);
+}
+
+// 解析 1~digits 位十进制数
+static int8_t Schedule_ParseNumber(const char **p, const char *end, uint8_t digits, uint32_t *value)
+{
+    uint8_t n = 0;
+    *value    = 0;
+    while (*p < end && n < digits && **p >= '0' && **p <= '9') {
+        *value = *value * 10 + (*(*p)++ - '0');
+        n++;
+    }
+    return n ? 0 : -1;
+}
+
+// 解析 YYYYMMDD
+static int8_t Schedule_ParseDate(const char **p, const char *end, uint16_t *day)
+{
+    const char *start = *p;
+    uint32_t value;
+    if (Schedule_ParseNumber(p, end, 8, &value) || *p - start != 8) return -1;
+
+    uint32_t year  = value / 10000;
+    uint32_t month = value / 100 % 100;
+    uint32_t mday  = value % 100;
+    if (year < 1970 || month < 1 || month > 12 || mday < 1 || mday > 31) return -1;
+    int32_t days = Schedule_DaysFromCivil(year, month, mday);
+    if (days <= 0 || days > UINT16_MAX) return -1;
+    *day = days;
+    return 0;
+}
+
+int8_t Schedule_Compile(const char *spec, size_t len, schedule_t *out)
+{
+    const char *p    = spec;
+    const char *end  = spec + len;
+    const char *at   = memchr(spec, '@', len);
+    const char *wend = at ? at : end;
+
+    memset(out, 0, sizeof(*out));
+    if (p == wend) {
+        // 没有时段：日期区间内全天有效
+        Schedule_SetAll(out);
+    }
+
+    while (p < wend) {
+        uint8_t days = 0;
+        if (*p == '*') {
+            days = 0x7F;
+            p++;
+        } else {
+            while (p < wend && *p >= '1' && *p <= '7') {
+                days |= 1 << (*p++ - '1');
+            }
+        }
+        if (days == 0 || p >= wend || *p++ != ' ') return -1;
+
+        uint32_t from, to;
+        if (Schedule_ParseNumber(&p, wend, 2, &from) || p >= wend || *p++ != '-' ||
+            Schedule_ParseNumber(&p, wend, 2, &to) || from > 23 || to > 24 || from == to) {
+            return -1;
+        }
+        // 结束小于开始：跨过午夜，后半段落在下一天（周日跨到周一）
+        uint32_t hours = to > from ? to - from : to + 24 - from;
+        for (uint32_t d = 0; d < 7; d++) {
+            if (!(days & (1 << d))) continue;
+            for (uint32_t h = 0; h < hours; h++) {
+                uint32_t bit = (d * 24 + from + h) % SCHEDULE_WEEK_HOURS;
+                out->week[bit >> 5] |= 1UL << (bit & 31);
+            }
+        }
+
+        if (p < wend && *p++ != ';') return -1;
+    }
+
+    if (at) {
+        p = at + 1;
+        if (Schedule_ParseDate(&p, end, &out->from_day) || p >= end || *p++ != '-' ||
+            Schedule_ParseDate(&p, end, &out->until_day) || p != end ||
+            out->from_day > out->until_day) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int8_t Schedule_Set(uint8_t id, const schedule_t *schedule)
+{
+    if (id == SCHEDULE_ALWAYS || id >= SCHEDULE_MAX) return -1;
+    taskENTER_CRITICAL(&schedule_lock);
+    schedule_store.schedules[id] = *schedule;
+    taskEXIT_CRITICAL(&schedule_lock);
+    return 0;
+}
+
+void Schedule_SetFinger(uint16_t page_id, uint8_t id)
+{
+    if (page_id >= SCHEDULE_FINGER_PAGES) return;
+    taskENTER_CRITICAL(&schedule_lock);
+    schedule_store.finger[page_id] = id;
+    taskEXIT_CRITICAL(&schedule_lock);
+}
+
+void Schedule_SetBle(uint8_t id)
+{
+    taskENTER_CRITICAL(&schedule_lock);
+    schedule_store.ble = id;
+    taskEXIT_CRITICAL(&schedule_lock);
+}
+
+uint8_t Schedule_AllowsAt(uint8_t id, time_t now)
+{
+    if (id == SCHEDULE_ALWAYS) return 1;
+    if (id >= SCHEDULE_MAX || now < SCHEDULE_MIN_VALID_TIME) return 0;
+
+    taskENTER_CRITICAL(&schedule_lock);
+    uint8_t cached = now >= schedule_clock.from && now < schedule_clock.until;
+    uint16_t day   = schedule_clock.day;
+    uint8_t hour   = schedule_clock.hour;
+    taskEXIT_CRITICAL(&schedule_lock);
+
+    if (!cached) {
+        // 每个本地小时只换算一次；localtime_r 会处理时区和夏令时
+        struct tm tm;
+        localtime_r(&now, &tm);
+        day  = Schedule_DaysFromCivil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+        hour = ((tm.tm_wday + 6) % 7) * 24 + tm.tm_hour;
+
+        taskENTER_CRITICAL(&schedule_lock);
+        schedule_clock.from  = now - tm.tm_min * 60 - tm.tm_sec;
+        schedule_clock.until = schedule_clock.from + 3600;
+        schedule_clock.day   = day;
+        schedule_clock.hour  = hour;
+        taskEXIT_CRITICAL(&schedule_lock);
+    }
+
+    taskENTER_CRITICAL(&schedule_lock);
+    const schedule_t *schedule = &schedule_store.schedules[id];
+    uint8_t allowed            = (schedule->week[hour >> 5] >> (hour & 31)) & 1;
+    allowed &= (schedule->from_day == 0 || day >= schedule->from_day) &&
+               (schedule->until_day == 0 || day <= schedule->until_day);
+    taskEXIT_CRITICAL(&schedule_lock);
+    return allowed;
+}
+
+uint8_t Schedule_Allows(uint8_t id)
+{
+    // 始终允许的凭据不需要读时钟
+    return id == SCHEDULE_ALWAYS || Schedule_AllowsAt(id, time(NULL));
+}
+
+uint8_t Schedule_AllowsFinger(int16_t page_id)
+{
+    if (page_id < 0 || page_id >= SCHEDULE_FINGER_PAGES) return 1;
+    return Schedule_Allows(schedule_store.finger[page_id]);
+}
+
+uint8_t Schedule_AllowsBle(void)
+{
+    return Schedule_Allows(schedule_store.ble);
+}
+
+void Schedule_Export(schedule_store_t *store)
+{
+    taskENTER_CRITICAL(&schedule_lock);
+    *store = schedule_store;
+    taskEXIT_CRITICAL(&schedule_lock);
+}
+
+void Schedule_Import(const schedule_store_t *store)
+{
+    taskENTER_CRITICAL(&schedule_lock);
+    schedule_store = *store;
+    Schedule_SetAll(&schedule_store.schedules[SCHEDULE_ALWAYS]);
+    taskEXIT_CRITICAL(&schedule_lock);
+}
+
+void Schedule_Reset(void)
+{
+    taskENTER_CRITICAL(&schedule_lock);
+    memset(&schedule_store, 0, sizeof(schedule_store));
+    Schedule_SetAll(&schedule_store.schedules[SCHEDULE_ALWAYS]);
+    taskEXIT_CRITICAL(&schedule_lock);
+}
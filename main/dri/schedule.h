@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * 访问时间表：限制访客密码、指纹和蓝牙开锁只在某些时段有效。
+ *
+ * 时间表在下发时编译成一周 168 小时的位图和一个日期区间，
+ * 开锁时只需要用当前的“本周第几小时”和“本地日期”查一位、比较两次。
+ * 当前本地时间按小时缓存，只在跨过本地整点时重新换算一次，夏令时切换也发生在整点。
+ *
+ * 0 号时间表固定为始终允许；没有下发过的时间表不允许任何时段（失败时关闭）。
+ */
+
+#define SCHEDULE_MAX    16
+#define SCHEDULE_ALWAYS 0
+// 指纹库中能单独指定时间表的页数，超出的页按始终允许处理
+#define SCHEDULE_FINGER_PAGES 256
+// 时钟早于这个时间（2024-01-01）说明还没有校时，受限的时间表一律拒绝
+#define SCHEDULE_MIN_VALID_TIME 1704067200
+
+typedef struct {
+    uint32_t week[6];   // bit (day * 24 + hour)，day 0 为周一，共 168 位
+    uint16_t from_day;  // 生效日期：本地日期，1970-01-01 起的天数，0 表示不限
+    uint16_t until_day; // 截止日期（含当天），0 表示不限
+} schedule_t;
+
+// 持久化的部分，和访客密码表存放在同一个 blob 中，一起提交
+typedef struct {
+    schedule_t schedules[SCHEDULE_MAX];
+    uint8_t finger[SCHEDULE_FINGER_PAGES]; // 指纹页 -> 时间表
+    uint8_t ble;                           // 蓝牙开锁使用的时间表
+    uint8_t reserved[3];
+} schedule_store_t;
+
+// 设置时区（CONFIG_LOCK_TIMEZONE），初始化 0 号时间表
+void Schedule_Init(void);
+// 修改时区（POSIX TZ 字符串），缓存的本地时间随之失效
+void Schedule_SetTimezone(const char *tz);
+
+/**
+ * @brief 编译时间表
+ *
+ * 格式：<时段>[;<时段>...][@YYYYMMDD-YYYYMMDD]
+ *   时段：<星期> <HH>-<HH>，星期为 1~7（周一~周日）的数字组合或 *，
+ *         小时左闭右开，结束小于开始时跨过午夜，例如 "67 22-06"
+ *   只有日期区间时全天有效，例如 "@20261001-20261007"
+ *
+ * @return 0 成功，-1 格式错误
+ */
+int8_t Schedule_Compile(const char *spec, size_t len, schedule_t *out);
+
+// 设置一个时间表（id 为 1 ~ SCHEDULE_MAX-1），返回 0 成功
+int8_t Schedule_Set(uint8_t id, const schedule_t *schedule);
+void Schedule_SetFinger(uint16_t page_id, uint8_t id);
+void Schedule_SetBle(uint8_t id);
+
+// 当前时刻是否允许
+uint8_t Schedule_Allows(uint8_t id);
+uint8_t Schedule_AllowsFinger(int16_t page_id);
+uint8_t Schedule_AllowsBle(void);
+// 指定时刻是否允许（共用同一个本地时间缓存，时间单调前进时开销与 Schedule_Allows() 相同）
+uint8_t Schedule_AllowsAt(uint8_t id, time_t now);
+
+void Schedule_Export(schedule_store_t *store);
+void Schedule_Import(const schedule_store_t *store);
+// 恢复出厂：除 0 号外全部清空，所有指纹页和蓝牙使用 0 号
+void Schedule_Reset(void);
+
+// 公历日期 -> 1970-01-01 起的天数
+int32_t Schedule_DaysFromCivil(int32_t year, uint32_t month, uint32_t day);
@@ -0,0 +1,98 @@
+#include "timer_service.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+static const char *TAG = "timer_service";
+
+typedef struct {
+    const char *name;
+    esp_timer_handle_t handle;
+    // 任务通知方式
+    TaskHandle_t task;
+    uint32_t bit;
+    // 回调方式
+    timer_service_cb_t cb;
+    void *arg;
+} timer_service_entry_t;
+
+static timer_service_entry_t timer_entries[TIMER_COUNT] = {
+    [TIMER_PASSWORD]      = {.name = "password"},
+    [TIMER_FINGER_ENROLL] = {.name = "finger_enroll"},
+    [TIMER_LED_EFFECT]    = {.name = "led_effect"},
+    [TIMER_LED_RETRY]     = {.name = "led_retry"},
+    [TIMER_MOTOR_PHASE]   = {.name = "motor_phase"},
+    [TIMER_WIFI_RETRY]    = {.name = "wifi_retry"},
+    [TIMER_BLE_IDLE]      = {.name = "ble_idle"},
+    [TIMER_BLE_ADV]       = {.name = "ble_adv"},
+};
+
+static portMUX_TYPE timer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// 所有定时器共用的到期处理，在 esp_timer 任务中执行
+static void TimerService_Dispatch(void *arg)
+{
+    timer_service_entry_t *entry = arg;
+
+    taskENTER_CRITICAL(&timer_lock);
+    TaskHandle_t task     = entry->task;
+    uint32_t bit          = entry->bit;
+    timer_service_cb_t cb = entry->cb;
+    void *cb_arg          = entry->arg;
+    taskEXIT_CRITICAL(&timer_lock);
+
+    if (task) {
+        xTaskNotify(task, bit, eSetBits);
+    } else if (cb) {
+        cb(cb_arg);
+    } else {
+        ESP_LOGW(TAG, "%s expired with no owner", entry->name);
+    }
+}
+
+void TimerService_Init(void)
+{
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        esp_timer_create_args_t timer_args = {
+            .callback = TimerService_Dispatch,
+            .arg      = &timer_entries[i],
+            .name     = timer_entries[i].name,
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_entries[i].handle));
+    }
+}
+
+void TimerService_BindTask(timer_id_t id, TaskHandle_t task, uint32_t bit)
+{
+    taskENTER_CRITICAL(&timer_lock);
+    timer_entries[id].task = task;
+    timer_entries[id].bit  = bit;
+    timer_entries[id].cb   = NULL;
+    taskEXIT_CRITICAL(&timer_lock);
+}
+
+void TimerService_BindCallback(timer_id_t id, timer_service_cb_t cb, void *arg)
+{
+    taskENTER_CRITICAL(&timer_lock);
+    timer_entries[id].task = NULL;
+    timer_entries[id].cb   = cb;
+    timer_entries[id].arg  = arg;
+    taskEXIT_CRITICAL(&timer_lock);
+}
+
+void TimerService_Start(timer_id_t id, uint64_t timeout_us)
+{
+    esp_timer_handle_t handle = timer_entries[id].handle;
+    // 重新计时只是把定时器从到期链表中摘下再插入，代价很小，每次按键都可以调用
+    esp_timer_stop(handle);
+    esp_timer_start_once(handle, timeout_us > 0 ? timeout_us : 1);
+}
+
+void TimerService_Stop(timer_id_t id)
+{
+    esp_timer_stop(timer_entries[id].handle);
+}
+
+uint8_t TimerService_IsActive(timer_id_t id)
+{
+    return esp_timer_is_active(timer_entries[id].handle);
+}
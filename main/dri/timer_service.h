@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/*
+ * 门锁的定时器服务：所有超时和定时效果都在这里登记，每个定时器只在到期时触发一次。
+ * 没有待到期的定时器时不会产生任何周期性唤醒。
+ *
+ * 到期后有两种投递方式：
+ *  - 给所属任务发送任务通知位（eSetBits），状态只在所属任务中修改，不需要额外加锁
+ *  - 在 esp_timer 任务中直接调用回调，回调不能阻塞
+ */
+
+typedef enum {
+    TIMER_PASSWORD = 0,  // 密码输入超时（按键任务）
+    TIMER_FINGER_ENROLL, // 指纹录入超时（指纹任务）
+    TIMER_LED_EFFECT,    // LED 定时熄灭
+    TIMER_LED_RETRY,     // LED 后端忙时重试提交
+    TIMER_MOTOR_PHASE,   // 电机开锁流程的阶段切换
+    TIMER_WIFI_RETRY,    // WiFi 重连退避（WiFi 管理任务）
+    TIMER_BLE_IDLE,      // 蓝牙连接空闲，切换到省电的连接参数
+    TIMER_BLE_ADV,       // 突发广播结束，切换到慢速广播
+    TIMER_COUNT,
+} timer_id_t;
+
+typedef void (*timer_service_cb_t)(void *arg);
+
+void TimerService_Init(void);
+
+// 到期时给 task 发送通知位 bit
+void TimerService_BindTask(timer_id_t id, TaskHandle_t task, uint32_t bit);
+// 到期时在 esp_timer 任务中调用 cb(arg)
+void TimerService_BindCallback(timer_id_t id, timer_service_cb_t cb, void *arg);
+
+// （重新）开始计时，已经在计时的定时器从现在起重新计算
+void TimerService_Start(timer_id_t id, uint64_t timeout_us);
+void TimerService_Stop(timer_id_t id);
+uint8_t TimerService_IsActive(timer_id_t id);
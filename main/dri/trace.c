@@ -0,0 +1,138 @@
+#include "trace.h"
+
+#if CONFIG_TRACE_ENABLE
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#if CONFIG_IDF_TARGET_LINUX
+#include "esp_timer.h"
+#else
+#include "esp_cpu.h"
+#endif
+
+static const char *TAG = "trace";
+
+// 导出任务
+#define TRACE_TASK_NAME       "trace_task"
+#define TRACE_TASK_STACK_SIZE 2048
+#define TRACE_TASK_PRIORITY   2
+
+#define TRACE_EVENTS CONFIG_TRACE_BUFFER_EVENTS
+#if (TRACE_EVENTS & (TRACE_EVENTS - 1)) != 0
+#error "CONFIG_TRACE_BUFFER_EVENTS must be a power of two"
+#endif
+// 每次交给 sink 的事件数：2 个事件 16 字节，放得进一个默认 MTU 的通知
+#define TRACE_CHUNK_EVENTS 2
+
+_Static_assert(sizeof(trace_event_t) == 8, "trace event must stay 8 bytes");
+_Static_assert(sizeof(trace_dump_header_t) == 20, "trace dump header must stay 20 bytes");
+
+static trace_event_t trace_ring[TRACE_EVENTS];
+// 写入过的事件总数，低位就是下一个槽位
+static uint32_t trace_head              = 0;
+static volatile uint8_t trace_paused    = 0;
+static volatile trace_sink_t trace_sink = NULL;
+static TaskHandle_t trace_task_handle   = NULL;
+
+static inline uint32_t Trace_Now(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return (uint32_t)esp_timer_get_time();
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+static uint32_t Trace_CyclesPerUs(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    return 1;
+#else
+    return CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+#endif
+}
+
+/**
+ * @brief 记录一个事件
+ *
+ * 先原子地占一个槽位再写入，任务和中断同时写入时各自写不同的槽位，不需要加锁。
+ * ESP32-C3 没有原子指令扩展，编译器把原子加法交给 IDF 的实现，只屏蔽几条指令的中断。
+ */
+void IRAM_ATTR Trace_Record(uint16_t id, uint16_t arg)
+{
+    if (trace_paused) return;
+    uint32_t slot    = __atomic_fetch_add(&trace_head, 1, __ATOMIC_RELAXED) & (TRACE_EVENTS - 1);
+    trace_ring[slot] = (trace_event_t){Trace_Now(), id, arg};
+}
+
+void Trace_UartSink(const uint8_t *data, size_t len)
+{
+    printf("T:");
+    for (size_t i = 0; i < len; i++) {
+        printf("%02x", data[i]);
+    }
+    printf("\r\n");
+}
+
+static void Trace_Dump(trace_sink_t sink)
+{
+    trace_event_t chunk[TRACE_CHUNK_EVENTS];
+
+    trace_paused = 1;
+    // 让已经通过暂停检查的写入者写完
+    vTaskDelay(1);
+
+    uint32_t head  = trace_head;
+    uint32_t count = head < TRACE_EVENTS ? head : TRACE_EVENTS;
+
+    trace_dump_header_t header = {
+        .version       = TRACE_DUMP_VERSION,
+        .event_size    = sizeof(trace_event_t),
+        .cycles_per_us = Trace_CyclesPerUs(),
+        .count         = count,
+        .overwritten   = head - count,
+    };
+    memcpy(header.magic, TRACE_DUMP_MAGIC, sizeof(header.magic));
+    sink((const uint8_t *)&header, sizeof(header));
+
+    // 从最旧的事件开始，环形缓冲回绕处的两个事件不连续，先拷贝出来
+    for (uint32_t i = head - count; i != head;) {
+        size_t n = 0;
+        while (n < TRACE_CHUNK_EVENTS && i != head) {
+            chunk[n++] = trace_ring[i++ & (TRACE_EVENTS - 1)];
+        }
+        sink((const uint8_t *)chunk, n * sizeof(trace_event_t));
+    }
+
+    trace_paused = 0;
+    ESP_LOGI(TAG, "dumped %" PRIu32 " events (%" PRIu32 " overwritten)", count, head - count);
+}
+
+static void trace_task(void *arg)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (trace_sink) {
+            Trace_Dump(trace_sink);
+        }
+    }
+}
+
+void Trace_RequestDump(trace_sink_t sink)
+{
+    trace_sink = sink;
+    if (trace_task_handle) {
+        xTaskNotifyGive(trace_task_handle);
+    }
+}
+
+void Trace_Init(void)
+{
+    xTaskCreate(trace_task, TRACE_TASK_NAME, TRACE_TASK_STACK_SIZE, NULL, TRACE_TASK_PRIORITY, &trace_task_handle);
+}
+
+#endif
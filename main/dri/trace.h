@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * 开锁路径的延迟追踪
+ *
+ * 每个事件 8 字节：时间戳（CPU 周期计数）+ 事件号 + 参数，写入一个 2 的幂大小的环形缓冲，
+ * 写满后覆盖最旧的事件。写入只做一次原子加法取槽位，可以在中断里调用。
+ * 关闭 CONFIG_TRACE_ENABLE 时 TRACE() 不产生任何代码。
+ *
+ * 导出格式（小端）：trace_dump_header_t + count 个 trace_event_t，由 tools/trace_decode.py 解析。
+ */
+
+typedef enum {
+    TRACE_NONE = 0,
+    // 按键路径
+    TRACE_KEY_ISR,         // 键盘中断，arg = 引脚
+    TRACE_KEY_WAKE,        // 按键任务被唤醒
+    TRACE_KEY_READ,        // 读出按键，arg = 键值
+    TRACE_AUDIO_PLAY,      // 提示音入队，arg = 语音编号
+    TRACE_PIN_MATCH_START, // 数字键交给密码匹配器，arg = 键值
+    TRACE_PIN_MATCH_DONE,  // 匹配完成，arg = 匹配结果
+    TRACE_KEY_DECISION,    // 密码判定，arg = 1 通过
+    // 指纹路径
+    TRACE_FINGER_ISR,      // 指纹触摸中断
+    TRACE_FINGER_WAKE,     // 指纹任务被唤醒
+    TRACE_FINGER_TX,       // 发出指令包，arg = 指令码
+    TRACE_FINGER_RX,       // 收到应答包，arg = 确认码
+    TRACE_FINGER_DECISION, // 指纹判定，arg = 1 通过
+    // 蓝牙路径
+    TRACE_BLE_WRITE,       // 收到特征值写入，arg = 长度
+    TRACE_BLE_DECISION,    // 蓝牙开锁命令，arg = 1 通过
+    // 公共
+    TRACE_MOTOR_START,     // 开锁请求，arg = 0 新流程 1 合并
+    TRACE_EVENT_MAX,
+} trace_event_id_t;
+
+typedef struct {
+    uint32_t cycles;
+    uint16_t id;
+    uint16_t arg;
+} trace_event_t;
+
+#define TRACE_DUMP_MAGIC   "TRC1"
+#define TRACE_DUMP_VERSION 1
+
+typedef struct {
+    char magic[4];
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t cycles_per_us; // 时间戳每微秒的计数
+    uint32_t count;         // 后面跟随的事件数
+    uint32_t overwritten;   // 被覆盖的旧事件数
+} trace_dump_header_t;
+
+// 导出数据的输出函数，每次最多 20 字节（一个默认 MTU 的通知）
+typedef void (*trace_sink_t)(const uint8_t *data, size_t len);
+
+#if CONFIG_TRACE_ENABLE
+
+void Trace_Init(void);
+void Trace_Record(uint16_t id, uint16_t arg);
+// 请求由追踪任务把当前缓冲导出到 sink，导出期间暂停记录
+void Trace_RequestDump(trace_sink_t sink);
+// 以 "T:<hex>" 行输出到控制台串口
+void Trace_UartSink(const uint8_t *data, size_t len);
+
+#define TRACE(id, arg) Trace_Record((id), (arg))
+
+#else
+
+#define Trace_Init()
+#define TRACE(id, arg)
+
+#endif
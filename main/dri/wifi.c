@@ -1,194 +1,487 @@
 #include "wifi.h"
-
-/* WiFi station Example
-
-   This example code is in the Public Domain (or CC0 licensed, at your option.)
-
-   Unless required by applicable law or agreed to in writing, this
-   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
-   CONDITIONS OF ANY KIND, either express or implied.
-*/
-#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
-#include "esp_system.h"
-#include "esp_wifi.h"
-#include "esp_event.h"
+#include "nvs.h"
+#include "esp_timer.h"
 #include "esp_log.h"
-#include "nvs_flash.h"
-
-#include "lwip/err.h"
-#include "lwip/sys.h"
-
-/* The examples use WiFi configuration that you can set via project configuration menu
-
-   If you'd rather not, just change the below entries to strings with
-   the config you want - ie #define EXAMPLE_WIFI_SSID "mywifissid"
-*/
-#define EXAMPLE_ESP_WIFI_SSID     CONFIG_ESP_WIFI_SSID
-#define EXAMPLE_ESP_WIFI_PASS     CONFIG_ESP_WIFI_PASSWORD
-#define EXAMPLE_ESP_MAXIMUM_RETRY CONFIG_ESP_MAXIMUM_RETRY
-
-#if CONFIG_ESP_WPA3_SAE_PWE_HUNT_AND_PECK
-#define ESP_WIFI_SAE_MODE      WPA3_SAE_PWE_HUNT_AND_PECK
-#define EXAMPLE_H2E_IDENTIFIER ""
-#elif CONFIG_ESP_WPA3_SAE_PWE_HASH_TO_ELEMENT
-#define ESP_WIFI_SAE_MODE      WPA3_SAE_PWE_HASH_TO_ELEMENT
-#define EXAMPLE_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
-#elif CONFIG_ESP_WPA3_SAE_PWE_BOTH
-#define ESP_WIFI_SAE_MODE      WPA3_SAE_PWE_BOTH
-#define EXAMPLE_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
-#endif
-#if CONFIG_ESP_WIFI_AUTH_OPEN
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_OPEN
-#elif CONFIG_ESP_WIFI_AUTH_WEP
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WEP
-#elif CONFIG_ESP_WIFI_AUTH_WPA_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA2_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA_WPA2_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_WPA2_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA3_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA3_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WPA2_WPA3_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_WPA3_PSK
-#elif CONFIG_ESP_WIFI_AUTH_WAPI_PSK
-#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WAPI_PSK
-#endif
+#include "timer_service.h"
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+
+static const char *TAG = "wifi";
+
+// WiFi 管理任务：发起连接、处理后端事件、保存缓存，所有状态只在这个任务中修改
+#define WIFI_TASK_NAME       "wifi_task"
+#define WIFI_TASK_STACK_SIZE 4096
+#define WIFI_TASK_PRIORITY   2
+#define WIFI_EVT_CONNECT     (1 << 0) // 发起连接（退避定时器到期）
+#define WIFI_EVT_GOT_IP      (1 << 1)
+#define WIFI_EVT_LINK_DOWN   (1 << 2)
+#define WIFI_EVT_DEMAND      (1 << 3) // 使用者变化
+
+// 对外的连接状态
+#define WIFI_CONNECTED_BIT    BIT0
+#define WIFI_DISCONNECTED_BIT BIT1
+
+/*
+ * 重试：前 CONFIG_ESP_MAXIMUM_RETRY 次失败后等待 WIFI_BACKOFF_MIN_MS，
+ * 之后每次翻倍，最长 WIFI_BACKOFF_MAX_MS，再加上最多 1/4 的随机抖动，
+ * 避免停电恢复后所有设备同时连路由器。连上之后断开时立即重连。
+ */
+#define WIFI_BACKOFF_MIN_MS 1000
+#define WIFI_BACKOFF_MAX_MS (5 * 60 * 1000)
+
+/*
+ * 租约到期按墙上时间判断，能跨重启。冷启动还没校时的时候 time() 从 1970 年开始，
+ * 这时无法判断租约是否过期：不记录到期时间，也不沿用缓存的 IP。
+ * 只在续租时间（T1，租约的一半）之前沿用，再留出 WIFI_LEASE_MARGIN_S 的余量。
+ */
+#define WIFI_CLOCK_VALID_S  1700000000
+#define WIFI_LEASE_MARGIN_S 60
+
+/*
+ * 估算耗电用的射频电流（ESP32-C3 典型值，不含 CPU）。
+ * 最大 modem sleep 时每 CONFIG_WIFI_LISTEN_INTERVAL 个信标间隔醒来约 3ms 接收信标。
+ */
+#define WIFI_CURRENT_RX_UA      82000 // 接收机常开
+#define WIFI_CURRENT_CONNECT_UA 95000 // 扫描和关联，有较多发射
+#define WIFI_BEACON_INTERVAL_US 102400
+#define WIFI_BEACON_WAKE_US     3000
+
+static const uint32_t wifi_power_current_ua[WIFI_POWER_STATES] = {
+    [WIFI_POWER_OFF]        = 0,
+    [WIFI_POWER_CONNECTING] = WIFI_CURRENT_CONNECT_UA,
+    [WIFI_POWER_SLEEP]      = (uint64_t)WIFI_CURRENT_RX_UA * WIFI_BEACON_WAKE_US / (WIFI_BEACON_INTERVAL_US * CONFIG_WIFI_LISTEN_INTERVAL),
+    [WIFI_POWER_ACTIVE]     = WIFI_CURRENT_RX_UA,
+};
+
+static const char *wifi_power_names[WIFI_POWER_STATES] = {
+    [WIFI_POWER_OFF]        = "off",
+    [WIFI_POWER_CONNECTING] = "connecting",
+    [WIFI_POWER_SLEEP]      = "sleep",
+    [WIFI_POWER_ACTIVE]     = "active",
+};
+
+#define WIFI_NAMESPACE   "wifi"
+#define WIFI_CACHE_KEY   "ap_cache"
+#define WIFI_CACHE_MAGIC 0x32435057 // "WPC2"
+
+// NVS 中的缓存记录，SSID 变了（重新配网）时缓存作废
+typedef struct {
+    uint32_t magic;
+    char ssid[33];
+    wifi_ap_cache_t ap;
+} wifi_cache_record_t;
+
+static const wifi_backend_t *wifi_backend = NULL;
+static EventGroupHandle_t wifi_events     = NULL;
+static TaskHandle_t wifi_task_handle      = NULL;
+static nvs_handle_t wifi_nvs              = 0;
 
-/* FreeRTOS event group to signal when we are connected*/
-static EventGroupHandle_t s_wifi_event_group;
+// 后端上报的数据、使用者计数和耗电统计，由 wifi_lock 保护
+static portMUX_TYPE wifi_lock = portMUX_INITIALIZER_UNLOCKED;
+static wifi_ap_cache_t wifi_reported;
+static uint8_t wifi_demand[WIFI_DEMAND_COUNT] = {0};
+static wifi_power_state_t wifi_power          = WIFI_POWER_OFF;
+static int64_t wifi_power_since_us            = 0;
+static uint64_t wifi_power_us[WIFI_POWER_STATES];
+static uint32_t wifi_power_transitions = 0;
 
-/* The event group allows multiple bits for each event, but we only care about two events:
- * - we are connected to the AP with an IP
- * - we failed to connect after the maximum amount of retries */
-#define WIFI_CONNECTED_BIT BIT0
-#define WIFI_FAIL_BIT      BIT1
+// 以下状态只在管理任务中修改
+static wifi_ap_cache_t wifi_cache;
+static uint8_t wifi_cache_valid = 0;
+static uint8_t wifi_using_cache = 0;
+static uint8_t wifi_using_lease = 0;
+static uint8_t wifi_skip_cache  = 0;
+static uint8_t wifi_connected   = 0;
+static uint8_t wifi_radio_on    = 0;
+static int64_t wifi_attempt_us  = 0;
+static int64_t wifi_down_us     = 0;
 
-static const char *TAG = "wifi station";
+static wifi_stats_t wifi_stats = {0};
 
-static int s_retry_num = 0;
+static void wifi_task(void *arg);
 
-static void event_handler(void *arg, esp_event_base_t event_base,
-                          int32_t event_id, void *event_data)
+static void Wifi_LoadCache(void)
 {
-    // 如果事件类型为：wifi基站模式开始连接事件
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
-        // 连接wifi
-        esp_wifi_connect();
+    wifi_cache_record_t record;
+    size_t len = sizeof(record);
+
+    if (nvs_open(WIFI_NAMESPACE, NVS_READWRITE, &wifi_nvs) != ESP_OK) {
+        ESP_LOGW(TAG, "cannot open nvs, fast reconnect disabled");
+        wifi_nvs = 0;
+        return;
+    }
+    if (nvs_get_blob(wifi_nvs, WIFI_CACHE_KEY, &record, &len) != ESP_OK || len != sizeof(record) ||
+        record.magic != WIFI_CACHE_MAGIC || strncmp(record.ssid, CONFIG_ESP_WIFI_SSID, sizeof(record.ssid)) != 0) {
+        ESP_LOGI(TAG, "no cached AP, full scan");
+        return;
     }
-    // 如果事件类型是断开wifi
-    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < EXAMPLE_ESP_MAXIMUM_RETRY) {
-            esp_wifi_connect();
-            s_retry_num++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
-        } else {
-            // 将事件组中的wifi失败置为1
-            xEventGroupSetBits(s_wifi_event_group, WIFI_FAIL_BIT);
+    wifi_cache       = record.ap;
+    wifi_cache_valid = 1;
+    ESP_LOGI(TAG, "cached AP %02x:%02x:%02x:%02x:%02x:%02x channel %d",
+             wifi_cache.bssid[0], wifi_cache.bssid[1], wifi_cache.bssid[2],
+             wifi_cache.bssid[3], wifi_cache.bssid[4], wifi_cache.bssid[5], wifi_cache.channel);
+}
+
+static void Wifi_StoreCache(void)
+{
+    wifi_cache_record_t record = {.magic = WIFI_CACHE_MAGIC, .ap = wifi_cache};
+    strncpy(record.ssid, CONFIG_ESP_WIFI_SSID, sizeof(record.ssid) - 1);
+
+    if (wifi_nvs == 0) return;
+    esp_err_t err = nvs_set_blob(wifi_nvs, WIFI_CACHE_KEY, &record, sizeof(record));
+    if (err == ESP_OK) {
+        err = nvs_commit(wifi_nvs);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "store AP cache failed: %s", esp_err_to_name(err));
+    }
+}
+
+// 缓存的租约是否还能直接沿用
+static uint8_t Wifi_LeaseUsable(const wifi_ap_cache_t *ap)
+{
+    int64_t now = time(NULL);
+
+    if (ap->ip == 0 || ap->lease_expire == 0 || now < WIFI_CLOCK_VALID_S) return 0;
+    return now + WIFI_LEASE_MARGIN_S < ap->lease_expire - ap->lease_s / 2;
+}
+
+// 只在 AP 或租约变化时写 NVS
+static void Wifi_UpdateCache(const wifi_ap_cache_t *ap)
+{
+    if (!wifi_cache_valid || memcmp(ap, &wifi_cache, sizeof(*ap)) != 0) {
+        wifi_cache       = *ap;
+        wifi_cache_valid = 1;
+        Wifi_StoreCache();
+    }
+}
+
+static void Wifi_PowerEnter(wifi_power_state_t state)
+{
+    int64_t now = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&wifi_lock);
+    uint8_t changed = state != wifi_power;
+    if (changed) {
+        wifi_power_us[wifi_power] += now - wifi_power_since_us;
+        wifi_power_since_us = now;
+        wifi_power          = state;
+        wifi_power_transitions++;
+    }
+    taskEXIT_CRITICAL(&wifi_lock);
+
+    if (changed) {
+        ESP_LOGI(TAG, "power: %s", wifi_power_names[state]);
+    }
+}
+
+// 按当前的使用者，连上后应该处于的状态
+static wifi_power_state_t Wifi_WantedPower(void)
+{
+    wifi_power_state_t want = WIFI_POWER_OFF;
+
+    taskENTER_CRITICAL(&wifi_lock);
+    if (wifi_demand[WIFI_DEMAND_ACTIVE]) {
+        want = WIFI_POWER_ACTIVE;
+    } else if (wifi_demand[WIFI_DEMAND_BACKGROUND]) {
+        want = WIFI_POWER_SLEEP;
+    }
+    taskEXIT_CRITICAL(&wifi_lock);
+    return want;
+}
+
+static void Wifi_RadioOff(void)
+{
+    if (wifi_radio_on) {
+        wifi_backend->stop();
+        wifi_radio_on = 0;
+    }
+    if (wifi_connected) {
+        wifi_connected = 0;
+        xEventGroupClearBits(wifi_events, WIFI_CONNECTED_BIT);
+        xEventGroupSetBits(wifi_events, WIFI_DISCONNECTED_BIT);
+    }
+    Wifi_PowerEnter(WIFI_POWER_OFF);
+}
+
+static void Wifi_Connect(void)
+{
+    if (!wifi_radio_on) {
+        wifi_backend->start();
+        wifi_radio_on = 1;
+    }
+    Wifi_PowerEnter(WIFI_POWER_CONNECTING);
+    wifi_using_cache = wifi_cache_valid && !wifi_skip_cache;
+    wifi_using_lease = wifi_using_cache && Wifi_LeaseUsable(&wifi_cache);
+    wifi_skip_cache  = 0;
+    wifi_attempt_us  = esp_timer_get_time();
+    wifi_stats.attempts++;
+    // 租约过期或无法判断时仍然直连缓存的 AP，但走 DHCP
+    wifi_ap_cache_t request = wifi_cache;
+    if (!wifi_using_lease) {
+        request.ip = 0;
+    }
+    ESP_LOGI(TAG, "connecting (%s)", wifi_using_lease ? "cached AP and lease" : wifi_using_cache ? "cached AP" : "full scan");
+    wifi_backend->connect(wifi_using_cache ? &request : NULL);
+}
+
+static void Wifi_ScheduleRetry(void)
+{
+    uint32_t delay_ms = WIFI_BACKOFF_MIN_MS;
+    if (wifi_stats.failures > CONFIG_ESP_MAXIMUM_RETRY) {
+        uint32_t shift = wifi_stats.failures - CONFIG_ESP_MAXIMUM_RETRY;
+        delay_ms       = shift >= 9 ? WIFI_BACKOFF_MAX_MS : WIFI_BACKOFF_MIN_MS << shift;
+        if (delay_ms > WIFI_BACKOFF_MAX_MS) delay_ms = WIFI_BACKOFF_MAX_MS;
+    }
+    // 抖动取自时钟的低位
+    delay_ms += (uint32_t)(esp_timer_get_time() % (delay_ms / 4 + 1));
+
+    wifi_stats.last_backoff_ms = delay_ms;
+    ESP_LOGI(TAG, "retry %" PRIu32 " in %" PRIu32 " ms", wifi_stats.failures, delay_ms);
+    // 等待期间关闭射频
+    Wifi_RadioOff();
+    TimerService_Start(TIMER_WIFI_RETRY, (uint64_t)delay_ms * 1000);
+}
+
+// 按使用者开关射频、切换休眠模式
+static void Wifi_ApplyDemand(void)
+{
+    wifi_power_state_t want = Wifi_WantedPower();
+
+    if (want == WIFI_POWER_OFF) {
+        // 没有使用者：关闭射频，放弃正在进行的连接和重试
+        TimerService_Stop(TIMER_WIFI_RETRY);
+        Wifi_RadioOff();
+    } else if (wifi_connected) {
+        if (want != wifi_power) {
+            wifi_backend->set_power_save(want == WIFI_POWER_SLEEP);
+            Wifi_PowerEnter(want);
         }
-        ESP_LOGI(TAG, "connect to the AP fail");
-    }
-    // 获得ip地址事件
-    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        s_retry_num = 0;
-        // 将WIFI连接成功置位
-        xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
-    }
-}
-
-/// 初始化wifi的基站模式
-void wifi_init_sta(void)
-{
-    // 创建事件组
-    s_wifi_event_group = xEventGroupCreate();
-
-    // 初始化网络相关软件栈，tcp/ip软件栈
-    ESP_ERROR_CHECK(esp_netif_init());
-
-    // 创建一个事件轮询
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-
-    // 创建默认的wifi 基站模式
-    esp_netif_create_default_wifi_sta();
-
-    // 生成默认配置
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    // 使能配置项
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
-
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    // 注册某种类型事件的回调函数
-    // 注册处理所有WIFI事件的回调函数：event_hander
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    // 注册处理IP事件中的IP_EVENT_STA_GOT_IP事件的回调函数：event_handler
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    wifi_config_t wifi_config = {
-        .sta = {
-            .ssid     = EXAMPLE_ESP_WIFI_SSID, // 热点名称
-            .password = EXAMPLE_ESP_WIFI_PASS, // 密码
-            /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (password len => 8).
-             * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
-             * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
-             * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
-             */
-            .threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
-            .sae_pwe_h2e        = ESP_WIFI_SAE_MODE,
-            .sae_h2e_identifier = EXAMPLE_H2E_IDENTIFIER,
-        },
-    };
-    // 设置为sta模式
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    // 使用配置
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    // 开始连接wifi
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    ESP_LOGI(TAG, "wifi_init_sta finished.");
-
-    /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
-     * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
-    // 阻塞执行
-    // 直到`WIFI_CONNECTED_BIT | WIFI_FAIL_BIT`中的一个事件发生为止
-    EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
-                                           WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
-                                           pdFALSE,
-                                           pdFALSE,
-                                           portMAX_DELAY);
-
-    /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
-     * happened. */
-    // 判断发生的事件类型
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "connected to ap SSID:%s password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGI(TAG, "Failed to connect to SSID:%s, password:%s",
-                 EXAMPLE_ESP_WIFI_SSID, EXAMPLE_ESP_WIFI_PASS);
+    } else if (!wifi_radio_on && !TimerService_IsActive(TIMER_WIFI_RETRY)) {
+        // 有了新的使用者：打开射频并连接；正在退避时等定时器到期
+        Wifi_Connect();
+    }
+}
+
+static void Wifi_HandleGotIp(void)
+{
+    // 射频已经关闭（使用者都释放了），是之前那次连接的事件
+    if (!wifi_radio_on) return;
+
+    taskENTER_CRITICAL(&wifi_lock);
+    wifi_ap_cache_t ap = wifi_reported;
+    taskEXIT_CRITICAL(&wifi_lock);
+
+    // DHCP 给了新租约时记下到期时间；沿用缓存的 IP 时保留原来的租约
+    int64_t wall = time(NULL);
+    if (ap.lease_s) {
+        ap.lease_expire = wall >= WIFI_CLOCK_VALID_S ? wall + ap.lease_s : 0;
+    } else if (wifi_cache_valid && ap.ip == wifi_cache.ip) {
+        ap.lease_s      = wifi_cache.lease_s;
+        ap.lease_expire = wifi_cache.lease_expire;
     } else {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
+        ap.lease_expire = 0;
+    }
+
+    // 已经连上时是续租拿到的租约，只更新缓存
+    if (wifi_connected) {
+        Wifi_UpdateCache(&ap);
+        return;
+    }
+
+    int64_t now                = esp_timer_get_time();
+    wifi_connected             = 1;
+    wifi_stats.failures        = 0;
+    wifi_stats.last_connect_ms = (now - wifi_attempt_us) / 1000;
+    wifi_stats.connects++;
+    if (wifi_using_cache) {
+        wifi_stats.fast_connects++;
+    }
+    if (wifi_using_lease) {
+        wifi_stats.lease_reuses++;
+    }
+    if (wifi_down_us) {
+        wifi_stats.last_reconnect_ms = (now - wifi_down_us) / 1000;
+        wifi_down_us                 = 0;
+    }
+    ESP_LOGI(TAG, "connected in %" PRIu32 " ms%s", wifi_stats.last_connect_ms,
+             wifi_using_lease ? " (cached AP and lease)" : wifi_using_cache ? " (cached AP)" : "");
+
+    Wifi_UpdateCache(&ap);
+
+    xEventGroupClearBits(wifi_events, WIFI_DISCONNECTED_BIT);
+    xEventGroupSetBits(wifi_events, WIFI_CONNECTED_BIT);
+    // 按使用者进入休眠或活跃状态
+    Wifi_ApplyDemand();
+}
+
+static void Wifi_HandleLinkDown(void)
+{
+    if (!wifi_radio_on) return;
+
+    if (wifi_connected) {
+        // 连上之后断开：立即重连（有缓存时不扫描）
+        wifi_connected = 0;
+        wifi_down_us   = esp_timer_get_time();
+        wifi_stats.disconnects++;
+        xEventGroupClearBits(wifi_events, WIFI_CONNECTED_BIT);
+        xEventGroupSetBits(wifi_events, WIFI_DISCONNECTED_BIT);
+        Wifi_Connect();
+    } else if (wifi_using_cache) {
+        // 缓存的 AP 连不上（换了信道、换了路由器或者 AP 断电）：这一次立即完整扫描，
+        // 成功后覆盖缓存；扫描也失败时缓存保留，退避之后仍然先试缓存
+        wifi_skip_cache = 1;
+        wifi_stats.cache_misses++;
+        Wifi_Connect();
+    } else {
+        wifi_stats.failures++;
+        Wifi_ScheduleRetry();
+    }
+}
+
+static void wifi_task(void *arg)
+{
+    uint32_t events;
+
+    // 协议栈的初始化也不占用启动路径；射频在有使用者时才打开
+    wifi_backend->init();
+    wifi_power_since_us = esp_timer_get_time();
+    Wifi_ApplyDemand();
+    while (1) {
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+
+        if (events & WIFI_EVT_GOT_IP) {
+            Wifi_HandleGotIp();
+        }
+        if (events & WIFI_EVT_LINK_DOWN) {
+            Wifi_HandleLinkDown();
+        }
+        if (events & WIFI_EVT_DEMAND) {
+            Wifi_ApplyDemand();
+        }
+        if ((events & WIFI_EVT_CONNECT) && !wifi_radio_on && Wifi_WantedPower() != WIFI_POWER_OFF) {
+            Wifi_Connect();
+        }
     }
 }
 
-// wifi两种模式
-//     - ap模式：esp32自己作为热点
-//     - sta模式：station模式，esp32需要连接无线路由器或者其他热点
+// 关联成功只说明链路可用，拿到 IP 才算连上，这里只记下 AP
+void Wifi_BackendLinkUp(const uint8_t bssid[6], uint8_t channel)
+{
+    taskENTER_CRITICAL(&wifi_lock);
+    memcpy(wifi_reported.bssid, bssid, sizeof(wifi_reported.bssid));
+    wifi_reported.channel = channel;
+    taskEXIT_CRITICAL(&wifi_lock);
+}
+
+void Wifi_BackendGotIp(uint32_t ip, uint32_t netmask, uint32_t gw, uint32_t lease_s)
+{
+    taskENTER_CRITICAL(&wifi_lock);
+    wifi_reported.ip      = ip;
+    wifi_reported.netmask = netmask;
+    wifi_reported.gw      = gw;
+    wifi_reported.lease_s = lease_s;
+    taskEXIT_CRITICAL(&wifi_lock);
+    xTaskNotify(wifi_task_handle, WIFI_EVT_GOT_IP, eSetBits);
+}
+
+void Wifi_BackendLinkDown(uint8_t reason)
+{
+    ESP_LOGD(TAG, "link down, reason %d", reason);
+    xTaskNotify(wifi_task_handle, WIFI_EVT_LINK_DOWN, eSetBits);
+}
+
 void Wifi_Init(void)
 {
-    // 启动wifi的基站模式
-    wifi_init_sta();
+#if CONFIG_IDF_TARGET_LINUX
+    wifi_backend = &wifi_backend_sim;
+#else
+    wifi_backend = &wifi_backend_esp;
+#endif
+    wifi_events = xEventGroupCreate();
+    xEventGroupSetBits(wifi_events, WIFI_DISCONNECTED_BIT);
+    Wifi_LoadCache();
+
+    xTaskCreate(wifi_task, WIFI_TASK_NAME, WIFI_TASK_STACK_SIZE, NULL, WIFI_TASK_PRIORITY, &wifi_task_handle);
+    TimerService_BindTask(TIMER_WIFI_RETRY, wifi_task_handle, WIFI_EVT_CONNECT);
+    ESP_LOGI(TAG, "wifi backend: %s", wifi_backend->name);
+}
+
+void Wifi_Acquire(wifi_demand_t demand)
+{
+    taskENTER_CRITICAL(&wifi_lock);
+    wifi_demand[demand]++;
+    taskEXIT_CRITICAL(&wifi_lock);
+    // 管理任务启动时会检查一次使用者
+    if (wifi_task_handle) {
+        xTaskNotify(wifi_task_handle, WIFI_EVT_DEMAND, eSetBits);
+    }
+}
+
+void Wifi_Release(wifi_demand_t demand)
+{
+    taskENTER_CRITICAL(&wifi_lock);
+    if (wifi_demand[demand]) {
+        wifi_demand[demand]--;
+    }
+    taskEXIT_CRITICAL(&wifi_lock);
+    if (wifi_task_handle) {
+        xTaskNotify(wifi_task_handle, WIFI_EVT_DEMAND, eSetBits);
+    }
+}
+
+uint8_t Wifi_IsConnected(void)
+{
+    return wifi_events && (xEventGroupGetBits(wifi_events) & WIFI_CONNECTED_BIT);
+}
+
+uint8_t Wifi_WaitConnected(TickType_t timeout)
+{
+    if (wifi_events == NULL) return 0;
+    return (xEventGroupWaitBits(wifi_events, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE, timeout) & WIFI_CONNECTED_BIT) != 0;
+}
+
+uint8_t Wifi_WaitDisconnected(TickType_t timeout)
+{
+    if (wifi_events == NULL) return 0;
+    return (xEventGroupWaitBits(wifi_events, WIFI_DISCONNECTED_BIT, pdFALSE, pdTRUE, timeout) & WIFI_DISCONNECTED_BIT) != 0;
+}
+
+void Wifi_GetStats(wifi_stats_t *stats)
+{
+    *stats = wifi_stats;
+}
+
+void Wifi_GetPowerReport(wifi_power_report_t *report)
+{
+    uint64_t total_us     = 0;
+    uint64_t total_charge = 0; // uA * us
+    int64_t now           = esp_timer_get_time();
+
+    taskENTER_CRITICAL(&wifi_lock);
+    for (int i = 0; i < WIFI_POWER_STATES; i++) {
+        uint64_t us = wifi_power_us[i];
+        // 当前状态加上到现在为止的时间
+        if (i == wifi_power && wifi_power_since_us) {
+            us += now - wifi_power_since_us;
+        }
+        report->time_ms[i]    = us / 1000;
+        report->charge_uah[i] = us * wifi_power_current_ua[i] / 3600000000ULL;
+        total_us += us;
+        total_charge += us * wifi_power_current_ua[i];
+    }
+    report->transitions = wifi_power_transitions;
+    report->state       = wifi_power;
+    taskEXIT_CRITICAL(&wifi_lock);
+
+    report->average_ua = total_us ? total_charge / total_us : 0;
+}
+
+const char *Wifi_PowerStateName(wifi_power_state_t state)
+{
+    return state < WIFI_POWER_STATES ? wifi_power_names[state] : "?";
 }
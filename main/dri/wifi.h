@@ -1,3 +1,118 @@
+#pragma once
 #include "utils.h"
 
-void Wifi_Init(void);
\ No newline at end of file
+/*
+ * WiFi 管理：Wifi_Init() 只启动管理任务，连接在后台进行，不阻塞启动。
+ *
+ * 连上后把 AP 的 BSSID、信道和 DHCP 租约（包括到期时间）保存在 NVS，下次（重启或断线重连）
+ * 直接连这个 BSSID/信道，跳过全信道扫描；租约还没到续租时间（T1）时沿用这个 IP，
+ * 连 DHCP 也跳过，否则照常走 DHCP。快速连接失败时退回完整扫描。连接失败后按指数退避一直重试，不会放弃，
+ * 退避等待期间射频关闭。
+ *
+ * 射频按使用者开关：需要网络的功能先 Wifi_Acquire()，用完 Wifi_Release()。
+ *  - 没有使用者：WiFi 完全关闭
+ *  - 只有后台使用者：最大 modem sleep，每 CONFIG_WIFI_LISTEN_INTERVAL 个信标醒来一次
+ *  - 有活跃使用者（OTA 等）：最小 modem sleep，每个 DTIM 都醒来（与蓝牙共存时不能关闭休眠）
+ * 使用者用 Wifi_WaitConnected() 等待连上，不要假设已经联网。
+ * 每次状态切换都计入各状态的时间和估算的射频耗电（Wifi_GetPowerReport()）。
+ */
+
+// 上次成功连接的 AP 和 IP 租约
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint32_t ip; // 网络字节序，0 表示没有租约
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t lease_s;     // 租约时长（秒），0 表示不知道
+    int64_t lease_expire; // 租约到期的墙上时间（time()，秒），0 表示不知道，不能沿用
+} wifi_ap_cache_t;
+
+/**
+ * @brief WiFi 后端：负责实际的扫描、关联和获取 IP
+ *
+ * init           初始化协议栈（射频保持关闭），之后通过 Wifi_Backend*() 上报事件
+ * start / stop   打开 / 关闭射频，关闭时已有的连接直接断开
+ * connect        开始一次连接，不能阻塞；cache 不为 NULL 时只连 cache 中的 BSSID/信道，
+ *                cache->ip 不为 0 时连上后使用 cache 中的 IP，不走 DHCP，
+ *                到了续租时间（lease_expire - lease_s / 2）后台再交给 DHCP 续租
+ * set_power_save 1: 最大 modem sleep（按 listen interval 醒来），0: 最小 modem sleep
+ */
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    void (*start)(void);
+    void (*stop)(void);
+    void (*connect)(const wifi_ap_cache_t *cache);
+    void (*set_power_save)(uint8_t sleep);
+} wifi_backend_t;
+
+// ESP-IDF esp_wifi + esp_netif
+extern const wifi_backend_t wifi_backend_esp;
+
+#if CONFIG_IDF_TARGET_LINUX
+// 主机仿真用的假 AP，模拟扫描、关联和 DHCP 的耗时
+extern const wifi_backend_t wifi_backend_sim;
+// AP 上电/断电，断电时已有的连接断开
+void Wifi_SimSetAp(uint8_t up);
+// AP 换到另一个信道（路由器重启），已有的连接断开
+void Wifi_SimSetChannel(uint8_t channel);
+// 模拟信号丢失，已有的连接断开
+void Wifi_SimDrop(void);
+#endif
+
+// 后端上报的事件，可以在任何任务中调用
+void Wifi_BackendLinkUp(const uint8_t bssid[6], uint8_t channel);
+// lease_s 是 DHCP 给的租约时长，沿用缓存的 IP 时为 0
+void Wifi_BackendGotIp(uint32_t ip, uint32_t netmask, uint32_t gw, uint32_t lease_s);
+// 连接失败或者连接断开
+void Wifi_BackendLinkDown(uint8_t reason);
+
+void Wifi_Init(void);
+
+typedef enum {
+    WIFI_DEMAND_BACKGROUND = 0, // 后台流量（上报等），允许较长的下行延迟
+    WIFI_DEMAND_ACTIVE,         // 需要吞吐量和低延迟（OTA）
+    WIFI_DEMAND_COUNT,
+} wifi_demand_t;
+// 增加 / 减少一个网络使用者，可以在任何任务中调用
+void Wifi_Acquire(wifi_demand_t demand);
+void Wifi_Release(wifi_demand_t demand);
+
+uint8_t Wifi_IsConnected(void);
+// 等待连上并拿到 IP，返回 1 表示已连接
+uint8_t Wifi_WaitConnected(TickType_t timeout);
+// 等待连接断开，返回 1 表示已断开
+uint8_t Wifi_WaitDisconnected(TickType_t timeout);
+
+typedef struct {
+    uint32_t attempts;          // 发起连接的次数
+    uint32_t connects;          // 拿到 IP 的次数
+    uint32_t fast_connects;     // 其中使用缓存的 AP（不扫描）的次数
+    uint32_t lease_reuses;      // 其中还沿用了缓存的租约（不走 DHCP）的次数
+    uint32_t cache_misses;      // 缓存的 AP 连不上，退回完整扫描的次数
+    uint32_t disconnects;       // 连上之后断开的次数
+    uint32_t failures;          // 当前连续失败次数
+    uint32_t last_connect_ms;   // 最近一次发起连接到拿到 IP 的耗时
+    uint32_t last_reconnect_ms; // 最近一次断开到重新拿到 IP 的耗时（包括重试等待）
+    uint32_t last_backoff_ms;   // 最近一次退避等待时间
+} wifi_stats_t;
+void Wifi_GetStats(wifi_stats_t *stats);
+
+typedef enum {
+    WIFI_POWER_OFF = 0,    // 射频关闭（没有使用者，或者在退避等待）
+    WIFI_POWER_CONNECTING, // 扫描、关联、DHCP
+    WIFI_POWER_SLEEP,      // 已连接，最大 modem sleep
+    WIFI_POWER_ACTIVE,     // 已连接，活跃使用
+    WIFI_POWER_STATES,
+} wifi_power_state_t;
+
+typedef struct {
+    uint64_t time_ms[WIFI_POWER_STATES];    // 各状态累计时间
+    uint32_t charge_uah[WIFI_POWER_STATES]; // 各状态估算的射频耗电
+    uint32_t average_ua;                    // 全部时间的平均射频电流
+    uint32_t transitions;                   // 状态切换次数
+    wifi_power_state_t state;               // 当前状态
+} wifi_power_report_t;
+void Wifi_GetPowerReport(wifi_power_report_t *report);
+const char *Wifi_PowerStateName(wifi_power_state_t state);
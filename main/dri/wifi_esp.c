@@ -0,0 +1,257 @@
+#include "wifi.h"
+
+/* WiFi station Example
+
+   This example code is in the Public Domain (or CC0 licensed, at your option.)
+
+   Unless required by applicable law or agreed to in writing, this
+   software is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+   CONDITIONS OF ANY KIND, either express or implied.
+*/
+#include <string.h>
+#include <time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_netif_net_stack.h"
+#include "esp_timer.h"
+
+#include "lwip/err.h"
+#include "lwip/sys.h"
+#include "lwip/dhcp.h"
+
+/* The examples use WiFi configuration that you can set via project configuration menu
+
+   If you'd rather not, just change the below entries to strings with
+   the config you want - ie #define EXAMPLE_WIFI_SSID "mywifissid"
+*/
+#define EXAMPLE_ESP_WIFI_SSID CONFIG_ESP_WIFI_SSID
+#define EXAMPLE_ESP_WIFI_PASS CONFIG_ESP_WIFI_PASSWORD
+
+#if CONFIG_ESP_WPA3_SAE_PWE_HUNT_AND_PECK
+#define ESP_WIFI_SAE_MODE      WPA3_SAE_PWE_HUNT_AND_PECK
+#define EXAMPLE_H2E_IDENTIFIER ""
+#elif CONFIG_ESP_WPA3_SAE_PWE_HASH_TO_ELEMENT
+#define ESP_WIFI_SAE_MODE      WPA3_SAE_PWE_HASH_TO_ELEMENT
+#define EXAMPLE_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
+#elif CONFIG_ESP_WPA3_SAE_PWE_BOTH
+#define ESP_WIFI_SAE_MODE      WPA3_SAE_PWE_BOTH
+#define EXAMPLE_H2E_IDENTIFIER CONFIG_ESP_WIFI_PW_ID
+#endif
+#if CONFIG_ESP_WIFI_AUTH_OPEN
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_OPEN
+#elif CONFIG_ESP_WIFI_AUTH_WEP
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WEP
+#elif CONFIG_ESP_WIFI_AUTH_WPA_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA2_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA_WPA2_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA_WPA2_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA3_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA3_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WPA2_WPA3_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WPA2_WPA3_PSK
+#elif CONFIG_ESP_WIFI_AUTH_WAPI_PSK
+#define ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD WIFI_AUTH_WAPI_PSK
+#endif
+
+static const char *TAG = "wifi station";
+
+static esp_netif_t *s_sta_netif = NULL;
+// 本次连接使用的缓存（快速连接），连上后在 WIFI_EVENT_STA_CONNECTED 中设置静态 IP
+static wifi_ap_cache_t s_cache;
+static uint8_t s_use_cache = 0;
+// 沿用缓存的租约时，到续租时间（T1）重新打开 DHCP
+static esp_timer_handle_t s_renew_timer = NULL;
+
+static void wifi_renew_cb(void *arg)
+{
+    ESP_LOGI(TAG, "cached lease due for renewal, start DHCP");
+    esp_netif_dhcpc_start(s_sta_netif);
+}
+
+// DHCP 这次给的租约时长，没有走 DHCP（静态 IP）时返回 0
+static uint32_t wifi_dhcp_lease_s(void)
+{
+    esp_netif_dhcp_status_t status = ESP_NETIF_DHCP_INIT;
+    if (esp_netif_dhcpc_get_status(s_sta_netif, &status) != ESP_OK || status != ESP_NETIF_DHCP_STARTED) {
+        return 0;
+    }
+    struct netif *netif = esp_netif_get_netif_impl(s_sta_netif);
+    struct dhcp *dhcp   = netif ? netif_dhcp_data(netif) : NULL;
+    return dhcp ? dhcp->offered_t0_lease : 0;
+}
+
+static void event_handler(void *arg, esp_event_base_t event_base,
+                          int32_t event_id, void *event_data)
+{
+    // 关联成功：快速连接时直接使用缓存的 IP，不走 DHCP
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *)event_data;
+        if (s_use_cache && s_cache.ip) {
+            esp_netif_ip_info_t info = {
+                .ip.addr      = s_cache.ip,
+                .netmask.addr = s_cache.netmask,
+                .gw.addr      = s_cache.gw,
+            };
+            esp_netif_dns_info_t dns = {
+                .ip.type            = ESP_IPADDR_TYPE_V4,
+                .ip.u_addr.ip4.addr = s_cache.gw,
+            };
+            esp_netif_set_ip_info(s_sta_netif, &info);
+            esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+            // 静态 IP 不会自己续租，到 T1 交回给 DHCP
+            int64_t renew_s = s_cache.lease_expire - s_cache.lease_s / 2 - time(NULL);
+            esp_timer_start_once(s_renew_timer, (renew_s > 0 ? renew_s : 1) * 1000000LL);
+        }
+        Wifi_BackendLinkUp(event->bssid, event->channel);
+    }
+    // 如果事件类型是断开wifi（连接失败也是这个事件），是否重试由管理任务决定
+    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *)event_data;
+        ESP_LOGI(TAG, "connect to the AP fail, reason %d", event->reason);
+        esp_timer_stop(s_renew_timer);
+        Wifi_BackendLinkDown(event->reason);
+    }
+    // 获得ip地址事件
+    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+        Wifi_BackendGotIp(event->ip_info.ip.addr, event->ip_info.netmask.addr, event->ip_info.gw.addr, wifi_dhcp_lease_s());
+    }
+}
+
+/// 初始化wifi的基站模式，只启动协议栈，连接由管理任务发起
+static void wifi_init_sta(void)
+{
+    // 初始化网络相关软件栈，tcp/ip软件栈
+    ESP_ERROR_CHECK(esp_netif_init());
+
+    // 创建一个事件轮询
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+
+    // 创建默认的wifi 基站模式
+    s_sta_netif = esp_netif_create_default_wifi_sta();
+
+    const esp_timer_create_args_t renew_args = {
+        .callback = wifi_renew_cb,
+        .name     = "wifi_renew",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&renew_args, &s_renew_timer));
+
+    // 生成默认配置
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    // 使能配置项
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    // 注册某种类型事件的回调函数
+    // 注册处理所有WIFI事件的回调函数：event_hander
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &event_handler,
+                                                        NULL,
+                                                        &instance_any_id));
+    // 注册处理IP事件中的IP_EVENT_STA_GOT_IP事件的回调函数：event_handler
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &event_handler,
+                                                        NULL,
+                                                        &instance_got_ip));
+
+    // 设置为sta模式
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+
+    ESP_LOGI(TAG, "wifi_init_sta finished.");
+}
+
+static void wifi_start_sta(void)
+{
+    ESP_ERROR_CHECK(esp_wifi_start());
+}
+
+static void wifi_stop_sta(void)
+{
+    esp_timer_stop(s_renew_timer);
+    esp_err_t err = esp_wifi_stop();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_stop: %s", esp_err_to_name(err));
+    }
+}
+
+// 与蓝牙共存时不允许 WIFI_PS_NONE，活跃时用最小 modem sleep（每个 DTIM 醒来）
+static void wifi_set_power_save(uint8_t sleep)
+{
+    esp_err_t err = esp_wifi_set_ps(sleep ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_set_ps: %s", esp_err_to_name(err));
+    }
+}
+
+static void wifi_connect_sta(const wifi_ap_cache_t *cache)
+{
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid     = EXAMPLE_ESP_WIFI_SSID, // 热点名称
+            .password = EXAMPLE_ESP_WIFI_PASS, // 密码
+            /* Authmode threshold resets to WPA2 as default if password matches WPA2 standards (password len => 8).
+             * If you want to connect the device to deprecated WEP/WPA networks, Please set the threshold value
+             * to WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK and set the password with length and format matching to
+             * WIFI_AUTH_WEP/WIFI_AUTH_WPA_PSK standards.
+             */
+            .threshold.authmode = ESP_WIFI_SCAN_AUTH_MODE_THRESHOLD,
+            .sae_pwe_h2e        = ESP_WIFI_SAE_MODE,
+            .sae_h2e_identifier = EXAMPLE_H2E_IDENTIFIER,
+            // 最大 modem sleep 时每隔几个信标醒来一次
+            .listen_interval    = CONFIG_WIFI_LISTEN_INTERVAL,
+        },
+    };
+
+    s_use_cache = cache != NULL;
+    if (cache) {
+        // 快速连接：只在缓存的信道上找缓存的 BSSID
+        s_cache                     = *cache;
+        wifi_config.sta.bssid_set   = true;
+        wifi_config.sta.channel     = cache->channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+        memcpy(wifi_config.sta.bssid, cache->bssid, sizeof(wifi_config.sta.bssid));
+    } else {
+        // 完整扫描所有信道，选信号最强的 AP
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        wifi_config.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    // 租约还能沿用时（管理任务判断，否则 ip 为 0）停掉 DHCP，连上后设置静态 IP；否则（重新）启动 DHCP
+    esp_timer_stop(s_renew_timer);
+    if (cache && cache->ip) {
+        esp_netif_dhcpc_stop(s_sta_netif);
+    } else {
+        esp_netif_dhcpc_start(s_sta_netif);
+    }
+
+    // 使用配置
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    // 开始连接wifi，结果通过事件上报
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "esp_wifi_connect: %s", esp_err_to_name(err));
+        Wifi_BackendLinkDown(0);
+    }
+}
+
+// wifi两种模式
+//     - ap模式：esp32自己作为热点
+//     - sta模式：station模式，esp32需要连接无线路由器或者其他热点
+const wifi_backend_t wifi_backend_esp = {
+    .name           = "esp_wifi",
+    .init           = wifi_init_sta,
+    .start          = wifi_start_sta,
+    .stop           = wifi_stop_sta,
+    .connect        = wifi_connect_sta,
+    .set_power_save = wifi_set_power_save,
+};
@@ -11,7 +11,7 @@
 #include "portmacro.h"
 #include "utils.h"
 #include "inttypes.h"
-#include "esp_intr_alloc.h"
+#include "esp_timer.h"
 
 #include "dri/keyboard.h"
 #include "dri/Motor.h"
@@ -20,13 +20,23 @@
 #include "dri/Fingerprint.h"
 #include "dri/flash.h"
 #include "dri/bluetooth.h"
+#include "dri/ble_adv.h"
 #include "dri/wifi.h"
 #include "dri/ota.h"
+#include "dri/trace.h"
+#include "dri/timer_service.h"
+#include "dri/schedule.h"
+#include "dri/pin_matcher.h"
+#include "dri/boot.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "scenario.h"
+#endif
 
 // OTA 任务
 #define OTA_TASK_NAME       "ota_task"
 #define OTA_TASK_STACK_SIZE 8192
 #define OTA_TASK_PRIORITY   10
+#define OTA_WIFI_WAIT_MS    (30 * 1000) // 收到升级命令后等待 WiFi 连上的最长时间
 TaskHandle_t ota_task_handle;
 static void ota_task(void *pvParameters);
 
@@ -35,22 +45,23 @@ static void ota_task(void *pvParameters);
 #define READ_KEY_TASK_STACK_SIZE 2048
 #define READ_KEY_TASK_PRIORITY   5
 #define READ_KEY_TASK_CYCLE_MS   10
+#define KEY_EVT_PRESS            (1 << 0) // 键盘中断
+#define KEY_EVT_TIMEOUT          (1 << 1) // 密码输入超时
 static void read_key_task(void *arg);
 static TaskHandle_t read_key_task_handle;
 
-// 按键获取任务
-#define PASSWORD_LEN        6                   // 密码是长度
-#define PASSWORD_TIMEOUT_MS pdMS_TO_TICKS(5000) // 超时间隔 (每两次按键按下的间隔 ms)
+// 按键获取任务：密码匹配器只在按键任务中使用，不保存已经输入的数字
+#define PASSWORD_TIMEOUT_US (5000 * 1000) // 超时间隔 (每两次按键按下的间隔 us)
 static void led_task(void *arg);
-char password[PASSWORD_LEN + 1]     = {0}; // 密码
-static uint8_t pw_index             = 0;   // 密码输入索引
-static TickType_t pw_input_run_time = 0;   // 密码输入运行时间
 
 // 指纹识别任务
 #define FINGERPRINT_TASK_NAME       "fingerprint_task"
 #define FINGERPRINT_TASK_STACK_SIZE 2048
 #define FINGERPRINT_TASK_PRIORITY   5
 #define FINGERPRINT_TASK_CYCLE_MS   10
+#define FINGER_SLEEP_RETRIES        3        // 休眠指令失败时的重试次数
+#define FINGER_EVT_TOUCH            (1 << 0) // 手指触摸中断
+#define FINGER_EVT_ENROLL           (1 << 1) // 进入录入模式
 TaskHandle_t fingerprint_task_handle;
 static void fingerprint_task(void *arg);
 
@@ -61,94 +72,161 @@ static void fingerprint_task(void *arg);
 #define LED_TASK_CYCLE_MS   10
 TaskHandle_t led_task_handle;
 
-// 超时检测任务
-#define TIMEOUT_TASK_NAME       "timeout_task"
-#define TIMEOUT_TASK_STACK_SIZE 2048
-#define TIMEOUT_TASK_PRIORITY   6
-#define TIMEOUT_TASK_CYCLE_MS   1000
-TaskHandle_t timeout_task_handle;
-static void timeout_task(void *arg);
-
-static uint8_t finger_enroll       = 0;
 static uint8_t finger_enroll_count = 0;
 
 static uint8_t finger_xx = 0;
+// 最近一次手指触摸中断的时间
+static volatile int64_t finger_touch_us = 0;
+
+#if CONFIG_FINGER_BENCHMARK && CONFIG_IDF_TARGET_LINUX
+// 基准测试：周期性地在仿真模块上放上/拿开手指
+#define FINGER_BENCH_TASK_NAME       "finger_bench_task"
+#define FINGER_BENCH_TASK_STACK_SIZE 2048
+#define FINGER_BENCH_TASK_PRIORITY   4
+#define FINGER_BENCH_PERIOD_MS       500
+static void finger_bench_task(void *arg);
+#endif
 
 // 中断处理函数
 static void IRAM_ATTR gpio_isr_handler(void *arg)
 {
-    int32_t gpio_num = (int32_t)arg;
+    int32_t gpio_num = (int32_t)(intptr_t)arg;
     if (gpio_num == KEYBOARD_INT_PIN) {
+        TRACE(TRACE_KEY_ISR, gpio_num);
         // 直接任务通知：通知读取按键任务
-        vTaskNotifyGiveFromISR(read_key_task_handle, NULL);
+        xTaskNotifyFromISR(read_key_task_handle, KEY_EVT_PRESS, eSetBits, NULL);
     } else if (gpio_num == FINGER_TOUCH_INT_PIN && finger_xx == 0) {
-        finger_xx = 1;
+        finger_xx       = 1;
+        finger_touch_us = esp_timer_get_time();
+        TRACE(TRACE_FINGER_ISR, gpio_num);
         // 直接任务通知：通知指纹任务处理中断
-        vTaskNotifyGiveFromISR(fingerprint_task_handle, NULL);
+        xTaskNotifyFromISR(fingerprint_task_handle, FINGER_EVT_TOUCH, eSetBits, NULL);
     }
     gpio_num = -1;
 }
 
-void app_main(void)
+/*
+ * 启动阶段：键盘、电机、密码和中断服务在前台尽快完成，之后立即可以用密码开锁；
+ * 蓝牙、WiFi 和指纹模块在后台并行初始化。
+ */
+enum {
+    BOOT_TIMER = 0,
+    BOOT_NVS,
+    BOOT_CREDENTIALS,
+    BOOT_MOTOR,
+    BOOT_KEYBOARD,
+    BOOT_AUDIO,
+    BOOT_LED,
+    BOOT_ISR,
+    BOOT_KEYPAD,
+    BOOT_OTA,
+    BOOT_BLUETOOTH,
+    BOOT_WIFI,
+    BOOT_FINGER,
+    BOOT_STAGE_COUNT,
+};
+
+static void boot_stage_credentials(void)
 {
-
-    // 初始化蓝牙
-    Bluetooth_Init();
-
-    // 初始化wifi
-    Wifi_Init();
-    // 中断配置
-
-    // 初始化NVS_Flash
-    Flash_Init();
-
     // 初始化 原始密码
     Flash_InitPassword();
+    // 时区和时间表，然后读取访客密码表（时间表和密码表存放在一起）
+    Schedule_Init();
+    Flash_InitCredentials();
+    // 由所有有效密码构建按键匹配自动机
+    PinMatcher_Init();
+}
 
-    // 初始化keyboard
-    Keyboard_Init();
-
-    // 初始化电机
-    Motor_Init();
-
-    // 初始化音频
-    Audio_Init();
-
-    // 初始化RTM模块
-    LED_RMT_Init();
-
-    // 初始化指纹模块
-    Fingerprint_Init();
-
+static void boot_stage_isr(void)
+{
     // 启用esp32的gpio中断，使用默认配置启用中断
     gpio_install_isr_service(0);
+}
 
-    // 将KEYBOARD_INT和gpio_isr_handler绑定起来
-    gpio_isr_handler_add(KEYBOARD_INT_PIN, gpio_isr_handler, (void *)KEYBOARD_INT_PIN);
-    gpio_isr_handler_add(FINGER_TOUCH_INT_PIN, gpio_isr_handler, (void *)FINGER_TOUCH_INT_PIN);
-
+static void boot_stage_keypad(void)
+{
     // 创建 按键读取任务
     xTaskCreate(read_key_task, READ_KEY_TASK_NAME, READ_KEY_TASK_STACK_SIZE, NULL, READ_KEY_TASK_PRIORITY, &read_key_task_handle);
+    // 创建 LED任务
+    xTaskCreate(led_task, LED_TASK_NAME, LED_TASK_STACK_SIZE, NULL, LED_TASK_PRIORITY, &led_task_handle);
+    // 任务创建之后才绑定按键中断
+    gpio_isr_handler_add(KEYBOARD_INT_PIN, gpio_isr_handler, (void *)KEYBOARD_INT_PIN);
+    Boot_MarkUnlockReady();
+}
 
+static void boot_stage_ota(void)
+{
+    xTaskCreate(ota_task, OTA_TASK_NAME, OTA_TASK_STACK_SIZE, NULL, OTA_TASK_PRIORITY, &ota_task_handle);
+}
+
+static void boot_stage_finger(void)
+{
+    // 初始化指纹模块（有上电等待和串口往返，在后台进行）
+    if (Fingerprint_Init() != 0) {
+        // 没接模块时不创建任务，fingerprint_task_handle 保持 NULL
+        return;
+    }
     // 创建 指纹读取任务
     xTaskCreate(fingerprint_task, FINGERPRINT_TASK_NAME, FINGERPRINT_TASK_STACK_SIZE, NULL, FINGERPRINT_TASK_PRIORITY, &fingerprint_task_handle);
+    gpio_isr_handler_add(FINGER_TOUCH_INT_PIN, gpio_isr_handler, (void *)FINGER_TOUCH_INT_PIN);
+}
 
-    // 创建 LED任务
-    xTaskCreate(led_task, LED_TASK_NAME, LED_TASK_STACK_SIZE, NULL, LED_TASK_PRIORITY, &led_task_handle);
+static const boot_stage_t boot_stages[BOOT_STAGE_COUNT] = {
+    // 定时器服务，LED 和电机初始化时会登记自己的定时器
+    [BOOT_TIMER]       = {"timer", TimerService_Init, 0},
+    // NVS 只在这里初始化一次，蓝牙和 WiFi 依赖它
+    [BOOT_NVS]         = {"nvs", Flash_Init, 0},
+    [BOOT_CREDENTIALS] = {"credentials", boot_stage_credentials, BOOT_DEP(BOOT_NVS)},
+    [BOOT_MOTOR]       = {"motor", Motor_Init, BOOT_DEP(BOOT_TIMER)},
+    [BOOT_KEYBOARD]    = {"keyboard", Keyboard_Init, 0},
+    [BOOT_AUDIO]       = {"audio", Audio_Init, 0},
+    [BOOT_LED]         = {"led", LED_RMT_Init, BOOT_DEP(BOOT_TIMER)},
+    [BOOT_ISR]         = {"isr", boot_stage_isr, 0},
+    [BOOT_KEYPAD]      = {"keypad", boot_stage_keypad,
+                          BOOT_DEP(BOOT_CREDENTIALS) | BOOT_DEP(BOOT_MOTOR) | BOOT_DEP(BOOT_KEYBOARD) |
+                              BOOT_DEP(BOOT_AUDIO) | BOOT_DEP(BOOT_LED) | BOOT_DEP(BOOT_ISR)},
+    [BOOT_OTA]         = {"ota", boot_stage_ota, 0},
+    // 蓝牙命令会修改密码和开锁
+    [BOOT_BLUETOOTH]   = {"bluetooth", Bluetooth_Init, BOOT_DEP(BOOT_TIMER) | BOOT_DEP(BOOT_CREDENTIALS) | BOOT_DEP(BOOT_MOTOR), 1, 4096},
+    [BOOT_WIFI]        = {"wifi", Wifi_Init, BOOT_DEP(BOOT_NVS), 1, 4096},
+    [BOOT_FINGER]      = {"finger", boot_stage_finger, BOOT_DEP(BOOT_ISR) | BOOT_DEP(BOOT_TIMER) | BOOT_DEP(BOOT_MOTOR), 1, 3072},
+};
+
+void app_main(void)
+{
+    // 最先初始化追踪，后面的初始化过程也可以打点
+    Trace_Init();
 
-    // 创建 超时检测任务
-    xTaskCreate(timeout_task, TIMEOUT_TASK_NAME, TIMEOUT_TASK_STACK_SIZE, NULL, TIMEOUT_TASK_PRIORITY, &timeout_task_handle);
+    Boot_Run(boot_stages, BOOT_STAGE_COUNT);
 
-    // 创建OTA
-    xTaskCreate(ota_task, OTA_TASK_NAME, OTA_TASK_STACK_SIZE, NULL, OTA_TASK_PRIORITY, &ota_task_handle);
+#if CONFIG_FINGER_BENCHMARK && CONFIG_IDF_TARGET_LINUX
+    xTaskCreate(finger_bench_task, FINGER_BENCH_TASK_NAME, FINGER_BENCH_TASK_STACK_SIZE, NULL, FINGER_BENCH_TASK_PRIORITY, NULL);
+#elif CONFIG_IDF_TARGET_LINUX
+    // 主机仿真：由场景脚本驱动按键、指纹和蓝牙事件
+    Scenario_Start();
+#endif
 }
 
 static void read_key_task(void *arg)
 {
+    uint32_t events = 0;
+
+    // 密码输入超时由定时器服务通知本任务，和按键在同一个任务里处理
+    TimerService_BindTask(TIMER_PASSWORD, xTaskGetCurrentTaskHandle(), KEY_EVT_TIMEOUT);
 
     while (1) {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xTaskNotifyWait(0, KEY_EVT_PRESS | KEY_EVT_TIMEOUT, &events, portMAX_DELAY);
+
+        // 定时器到期后又被按键重新计时的，不算超时
+        if ((events & KEY_EVT_TIMEOUT) && PinMatcher_Length() > 0 && !TimerService_IsActive(TIMER_PASSWORD)) {
+            PinMatcher_Reset();
+            printf("密码输入超时,请重新输入\r\n");
+        }
+        if (!(events & KEY_EVT_PRESS)) continue;
+
+        TRACE(TRACE_KEY_WAKE, 0);
         uint8_t key_content = Keyboard_ReadKey();
+        TRACE(TRACE_KEY_READ, key_content);
 
         // key_content: 0~9 数字键，10=#，11=* （需确认实际键盘映射）
 
@@ -157,72 +235,82 @@ static void read_key_task(void *arg)
         Audio_Play(11);
 
         if (key_content == 10) { // 按下三次 "#" 进入录入指纹模式
-            pw_index = 0;
+            PinMatcher_Reset();
             finger_enroll_count++;
         } else {
             finger_enroll_count = 0;
         }
 
         if (finger_enroll_count == 3) {
-            xTaskNotifyGive(fingerprint_task_handle);
-            finger_enroll       = 1;
+            // 指纹阶段在后台初始化，任务可能还没创建或模块不存在
+            if (fingerprint_task_handle) {
+                xTaskNotify(fingerprint_task_handle, FINGER_EVT_ENROLL, eSetBits);
+            } else {
+                printf("指纹模块未就绪，无法录入指纹。\r\n");
+            }
             finger_enroll_count = 0;
         }
 
-        // 键盘按键 输入密码
+        // 键盘按键 输入密码：有效密码出现在输入序列中的任意位置即可开锁
         if (key_content < 10) {
-            // 触发 超时检测 任务
-            // xTaskNotifyGive(timeout_task_handle);
-            // 更新 密码输入时间
-            // 进入临界区
-            taskENTER_CRITICAL(NULL);
-            pw_input_run_time = xTaskGetTickCount();
-            taskEXIT_CRITICAL(NULL);
-            password[pw_index] = '0' + key_content;
-            pw_index++;
-        }
-
-        if (pw_index == PASSWORD_LEN) {
-            char password_flash[PASSWORD_LEN + 1] = {0};
-            size_t pw_len                         = sizeof(password_flash);
-            Flash_ReadPassword(password_flash, &pw_len);
-            if (memcmp(password, password_flash, sizeof(password)) == 0) {
+            // 每次按键重新开始超时计时
+            TimerService_Start(TIMER_PASSWORD, PASSWORD_TIMEOUT_US);
+            TRACE(TRACE_PIN_MATCH_START, key_content);
+            pin_match_result_t result = PinMatcher_Feed(key_content);
+            TRACE(TRACE_PIN_MATCH_DONE, result);
+            if (result != PIN_MATCH_NONE) {
+                TimerService_Stop(TIMER_PASSWORD);
+                TRACE(TRACE_KEY_DECISION, result == PIN_MATCH_OK);
+            }
+            if (result == PIN_MATCH_OK) {
                 printf("密码正确\r\n");
                 Motor_OpenLock();
-            } else {
+            } else if (result == PIN_MATCH_FAIL) {
                 printf("密码错误\r\n");
             }
-            // printf("pw1:%s,pw2:%s\r\n", password, password_flash);
-            pw_input_run_time = 0;
-            pw_index          = 0;
-            memset(password, 0, sizeof(password)); // 清空密码
         }
+        // 有人在门口：突发广播，手机能马上连上（放在开锁判定之后，不增加按键延迟）
+        BleAdv_Activity(BLE_ADV_TRIGGER_KEYPAD);
     }
 }
 
 // 指纹任务
 static void fingerprint_task(void *arg)
 {
+    uint32_t events = 0;
+
     while (1) {
-        // 等待任务通知，无限期阻塞
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // 阻塞直到下一次通知
-        if (finger_enroll == 1) {
+        // 等待任务通知，无限期阻塞；录入超时位由 Finger_Enroll() 自己处理，这里不清除
+        xTaskNotifyWait(0, FINGER_EVT_TOUCH | FINGER_EVT_ENROLL, &events, portMAX_DELAY);
+        if (!(events & (FINGER_EVT_TOUCH | FINGER_EVT_ENROLL))) continue;
+        TRACE(TRACE_FINGER_WAKE, (events & FINGER_EVT_ENROLL) != 0);
+        if (events & FINGER_EVT_ENROLL) {
             // 指纹录入模式
             finger_xx = 1;
             Finger_Enroll();
-            finger_enroll       = 0;
-            finger_enroll_count = 0;
         } else { // 指纹检索模式
-            if (Finger_Identifiy() == 0) {
-                printf("指纹验证成功\r\n");
+            uint8_t ret = Finger_Identifiy();
+            if (ret == 0) {
+                // 指纹匹配后还要在该指纹的时间表允许的时段内
+                finger_identify_t result;
+                Finger_GetLastIdentify(&result);
+                ret = !Schedule_AllowsFinger(result.page_id);
+            }
+            TRACE(TRACE_FINGER_DECISION, ret == 0);
+            // 先给出开锁判定：电机由定时器驱动，开锁过程和下面的休眠指令并行
+            if (ret == 0) {
                 Motor_OpenLock();
-            } else {
-                printf("指纹验证失败\r\n");
             }
+#if CONFIG_FINGER_BENCHMARK
+            Finger_BenchmarkRecord(finger_touch_us, esp_timer_get_time());
+#endif
+            printf(ret == 0 ? "指纹验证成功\r\n" : "指纹验证失败\r\n");
+            BleAdv_Activity(BLE_ADV_TRIGGER_FINGER);
         }
 
-        while (Finger_Sleep() != 0) {
-            DelayMs(50);
+        // 休眠失败时有限次重试，避免一直占用指纹任务
+        for (int i = 0; i <= FINGER_SLEEP_RETRIES && Finger_Sleep() != 0; i++) {
+            DelayMs(10);
         }
         finger_xx = 0;
     }
@@ -247,26 +335,34 @@ static void led_task(void *arg)
     }
 }
 
-static void timeout_task(void *arg)
+#if CONFIG_FINGER_BENCHMARK && CONFIG_IDF_TARGET_LINUX
+static void finger_bench_task(void *arg)
 {
+    uint32_t n = 0;
     while (1) {
-        // 密码输入 超时检测
-        if (pw_input_run_time > 0) {
-            if (xTaskGetTickCount() - pw_input_run_time > PASSWORD_TIMEOUT_MS) {
-                pw_input_run_time = 0;
-                pw_index          = 0;
-                memset(password, 0, sizeof(password)); // 清空密码
-                printf("密码输入超时,请重新输入\r\n");
-            }
-        }
-        DelayMs(TIMEOUT_TASK_CYCLE_MS);
+        DelayMs(FINGER_BENCH_PERIOD_MS);
+        // 四次中有一次是未录入的手指，触摸经过仿真 GPIO 中断进入指纹任务
+        Finger_SimTouch(1, (n++ % 4) ? 1 : -1);
+        Gpio_SimSetInput(FINGER_TOUCH_INT_PIN, 1);
+        DelayMs(FINGER_BENCH_PERIOD_MS);
+        Finger_SimTouch(0, -1);
+        Gpio_SimSetInput(FINGER_TOUCH_INT_PIN, 0);
     }
 }
+#endif
 
 static void ota_task(void *pvParameters)
 {
     while (1) {
         ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // 阻塞直到下一次通知
-        ota_init();
+        // 升级期间打开 WiFi，等连上再下载，不假设已经联网
+        Wifi_Acquire(WIFI_DEMAND_ACTIVE);
+        if (Wifi_WaitConnected(pdMS_TO_TICKS(OTA_WIFI_WAIT_MS))) {
+            ota_init();
+        } else {
+            printf("WiFi未连接,取消升级\r\n");
+        }
+        // 升级成功会重启，走到这里说明失败了，释放 WiFi
+        Wifi_Release(WIFI_DEMAND_ACTIVE);
     }
 }
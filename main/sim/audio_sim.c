@@ -0,0 +1,83 @@
+#include "Audio.h"
+#include "esp_timer.h"
+#include "utils.h"
+#include <stdio.h>
+
+// 主机仿真的 WTN6170：记录每一帧的发送时间和电平序列，并按帧长模拟播放时长
+#define AUDIO_SIM_LOG_FRAMES 32
+// 仿真的语音播放时长，期间 BUSY 有效
+#define AUDIO_SIM_PLAY_US 300000
+
+typedef struct {
+    int64_t start_us; // 帧开始发送的时间
+    size_t count;
+    audio_pulse_t pulses[AUDIO_FRAME_PULSES];
+} audio_sim_frame_t;
+
+static audio_sim_frame_t audio_sim_log[AUDIO_SIM_LOG_FRAMES];
+static uint32_t audio_sim_frames  = 0;
+static int64_t audio_sim_busy_end = 0;
+
+static void Audio_SimInit(void)
+{
+    audio_sim_frames   = 0;
+    audio_sim_busy_end = 0;
+}
+
+static void Audio_SimSend(const audio_pulse_t *pulses, size_t count)
+{
+    audio_sim_frame_t *frame = &audio_sim_log[audio_sim_frames % AUDIO_SIM_LOG_FRAMES];
+    frame->start_us          = esp_timer_get_time();
+    frame->count             = count;
+    uint32_t total_us        = 0;
+    for (size_t i = 0; i < count; i++) {
+        frame->pulses[i] = pulses[i];
+        total_us += pulses[i].duration_us;
+    }
+    audio_sim_frames++;
+
+    // 与 RMT 后端一样阻塞到整帧发完
+    DelayUs(total_us);
+    audio_sim_busy_end = esp_timer_get_time() + AUDIO_SIM_PLAY_US;
+}
+
+static uint8_t Audio_SimBusy(void)
+{
+    return esp_timer_get_time() < audio_sim_busy_end;
+}
+
+// 按协议把电平序列还原成语音编号，格式错误返回 -1
+static int Audio_SimDecode(const audio_sim_frame_t *frame)
+{
+    if (frame->count != AUDIO_FRAME_PULSES) return -1;
+    int data = 0;
+    for (int bit = 0; bit < 8; bit++) {
+        const audio_pulse_t *high = &frame->pulses[2 + bit * 2];
+        const audio_pulse_t *low  = &frame->pulses[3 + bit * 2];
+        if (high->level != 1 || low->level != 0) return -1;
+        if (high->duration_us > low->duration_us) {
+            data |= 1 << bit;
+        }
+    }
+    return data;
+}
+
+void Audio_SimDump(void)
+{
+    uint32_t first = audio_sim_frames > AUDIO_SIM_LOG_FRAMES ? audio_sim_frames - AUDIO_SIM_LOG_FRAMES : 0;
+    for (uint32_t i = first; i < audio_sim_frames; i++) {
+        const audio_sim_frame_t *frame = &audio_sim_log[i % AUDIO_SIM_LOG_FRAMES];
+        printf("audio frame %u @%lld us: prompt %d, pulses", (unsigned)i, (long long)frame->start_us, Audio_SimDecode(frame));
+        for (size_t p = 0; p < frame->count; p++) {
+            printf(" %c%u", frame->pulses[p].level ? 'H' : 'L', frame->pulses[p].duration_us);
+        }
+        printf("\r\n");
+    }
+}
+
+const audio_backend_t audio_backend_sim = {
+    .name = "host simulation",
+    .init = Audio_SimInit,
+    .send = Audio_SimSend,
+    .busy = Audio_SimBusy,
+};
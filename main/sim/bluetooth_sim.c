@@ -0,0 +1,383 @@
+#include "bluetooth.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "trace.h"
+#include "ble_proto.h"
+#include "ble_adv.h"
+#include "ble_session.h"
+#include "ble_bulk.h"
+
+// 主机仿真没有蓝牙协议栈：场景脚本的写入直接交给与真实 GATT 服务相同的命令处理函数
+static const char *TAG = "bluetooth_sim";
+
+// 最近一次通知，供场景脚本检查响应
+#define BLUETOOTH_SIM_NOTIFY_MAX 64
+
+static uint8_t bluetooth_sim_echo = 1;
+static uint8_t bluetooth_sim_notify[BLUETOOTH_SIM_NOTIFY_MAX];
+static size_t bluetooth_sim_notify_len = 0;
+static bluetooth_sim_notify_hook_t bluetooth_sim_notify_hook = NULL;
+
+/*
+ * 模拟的手机：连接时用 45 ms 间隔，接受门锁请求的参数（取最大间隔），
+ * 新参数按协议在 6 个连接事件之后生效。
+ */
+#define BLUETOOTH_SIM_CONN_ID       0
+#define BLUETOOTH_SIM_INTERVAL      36 // 45 ms
+#define BLUETOOTH_SIM_TIMEOUT       500
+#define BLUETOOTH_SIM_UPDATE_EVENTS 6
+
+static const uint8_t bluetooth_sim_phone[6] = {0x5c, 0xf9, 0x38, 0xa1, 0xb2, 0xc3};
+static uint8_t bluetooth_sim_connected      = 0;
+static uint32_t bluetooth_sim_clients       = 0; // 其余模拟手机（1 号开始）的连接位图
+static uint16_t bluetooth_sim_interval      = BLUETOOTH_SIM_INTERVAL;
+static ble_conn_params_t bluetooth_sim_update;
+static esp_timer_handle_t bluetooth_sim_update_timer;
+// 接下来这么多次连接参数请求直接失败（协议栈忙）
+static volatile uint8_t bluetooth_sim_param_failures = 0;
+
+/*
+ * 连上后手机先做服务发现：没有缓存时要交换 MTU、按类型找服务、找特征、找描述符、
+ * 打开通知，大约 10 个 ATT 请求，每个请求的响应在下一个连接事件发回；
+ * 已绑定且有缓存的手机只读一次数据库哈希，哈希不变就沿用缓存的句柄。
+ */
+#define BLUETOOTH_SIM_DISCOVERY_REQUESTS 10
+#define BLUETOOTH_SIM_HASH_REQUESTS      1
+
+static uint8_t bluetooth_sim_cached = 0;
+
+/*
+ * 配对（安全连接 Just Works）大约 8 个来回，已绑定的手机重连只要加密，2 个连接事件；
+ * 不同意配对的手机回一次拒绝。
+ */
+#define BLUETOOTH_SIM_PAIR_EVENTS    8
+#define BLUETOOTH_SIM_ENCRYPT_EVENTS 2
+#define BLUETOOTH_SIM_REJECT_EVENTS  1
+
+static uint8_t bluetooth_sim_bonding = 1;
+
+// 门锁的广播：手机在下一次广播时发起连接
+static uint8_t bluetooth_sim_advertising = 0;
+static uint16_t bluetooth_sim_adv_max    = 0;
+static uint8_t bluetooth_sim_bonded_only = 0;
+static uint8_t bluetooth_sim_directed    = 0;
+static ble_bond_peer_t bluetooth_sim_target;
+
+/*
+ * 模拟的链路（批量传输）：默认是没有做 MTU 交换和数据长度扩展的 1M 链路。
+ * 一个链路层数据包的空口时间 = (头部开销 + 载荷) * 每字节的时间，头部开销包括前导码、接入地址、
+ * 包头、MIC（加密的链路）和 CRC：1M 为 1+4+2+4+3 字节，2M 的前导码多 1 字节；
+ * 每个包之后对方回一个空包（不加密，没有 MIC），前后各一个 150 us 的帧间隔。
+ */
+#define BLUETOOTH_SIM_L2CAP_HEADER  4
+#define BLUETOOTH_SIM_LL_OCTETS     27
+#define BLUETOOTH_SIM_PDU_OVERHEAD  14
+#define BLUETOOTH_SIM_EMPTY_OCTETS  10
+#define BLUETOOTH_SIM_IFS_US        150
+
+static bluetooth_sim_bulk_hook_t bluetooth_sim_bulk_hook = NULL;
+static uint16_t bluetooth_sim_mtu                        = 23;
+static uint16_t bluetooth_sim_ll_octets                  = BLUETOOTH_SIM_LL_OCTETS;
+static uint8_t bluetooth_sim_phy                         = 1;
+
+// 最长等待门锁的广播（比如定向广播给别的手机、白名单广播）的时间
+#define BLUETOOTH_SIM_CONNECT_WAIT_MS 30000
+
+static void Bluetooth_SimUpdateCallback(void *arg)
+{
+    if (!bluetooth_sim_connected) return;
+    bluetooth_sim_interval = bluetooth_sim_update.max_int;
+    BleConn_Updated(bluetooth_sim_phone, 0, bluetooth_sim_update.max_int, bluetooth_sim_update.latency, bluetooth_sim_update.timeout);
+}
+
+void Bluetooth_Init(void)
+{
+    const esp_timer_create_args_t args = {
+        .callback = Bluetooth_SimUpdateCallback,
+        .name     = "ble_sim_update",
+    };
+    esp_timer_create(&args, &bluetooth_sim_update_timer);
+    BleSession_Init();
+    BleBulk_Init();
+    BleConn_Init();
+    BleBond_Init();
+    BleAdv_Init();
+    ESP_LOGI(TAG, "simulated BLE peripheral ready");
+    // 没有真实的广播数据要配置
+    BleAdv_Ready();
+}
+
+void Bluetooth_StartAdvertising(uint16_t int_min, uint16_t int_max, uint8_t bonded_only)
+{
+    ESP_LOGI(TAG, "advertising every %u.%03u ms%s", int_max * 5 / 8, int_max * 5000 / 8 % 1000, bonded_only ? ", bonded only" : "");
+    bluetooth_sim_adv_max     = int_max;
+    bluetooth_sim_bonded_only = bonded_only;
+    bluetooth_sim_directed    = 0;
+    bluetooth_sim_advertising = 1;
+}
+
+void Bluetooth_StartDirectedAdvertising(const ble_bond_peer_t *peer)
+{
+    ESP_LOGI(TAG, "directed advertising to %02x:%02x:%02x:%02x:%02x:%02x",
+             peer->bda[0], peer->bda[1], peer->bda[2], peer->bda[3], peer->bda[4], peer->bda[5]);
+    bluetooth_sim_target      = *peer;
+    bluetooth_sim_directed    = 1;
+    bluetooth_sim_advertising = 1;
+}
+
+// 这部模拟的手机现在能不能连上门锁的广播
+static uint8_t Bluetooth_SimCanConnect(const uint8_t bda[6])
+{
+    if (!bluetooth_sim_advertising) return 0;
+    if (bluetooth_sim_directed) return !memcmp(bluetooth_sim_target.bda, bda, 6);
+    return !bluetooth_sim_bonded_only || BleBond_IsBonded(bda);
+}
+
+// 等门锁的广播并连上，返回 0 表示一直没有能连的广播
+static uint8_t Bluetooth_SimWaitAdvertising(const uint8_t bda[6])
+{
+    uint32_t waited_ms = 0;
+    while (!Bluetooth_SimCanConnect(bda) && waited_ms < BLUETOOTH_SIM_CONNECT_WAIT_MS) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        waited_ms += 10;
+    }
+    if (!Bluetooth_SimCanConnect(bda)) return 0;
+    if (bluetooth_sim_directed) {
+        // 定向广播不超过 3.75 ms 一次，手机的控制器一收到就回连接请求
+        vTaskDelay(pdMS_TO_TICKS(rand() % 4 + 1));
+    } else {
+        // 扫描的手机在下一次广播时连上（间隔加 0~10 ms 随机延迟）
+        uint32_t wait_ms = rand() % ((uint32_t)bluetooth_sim_adv_max * 5 / 8 + 10 + 1);
+        vTaskDelay(pdMS_TO_TICKS(wait_ms));
+    }
+    return 1;
+}
+
+void Bluetooth_StopAdvertising(void)
+{
+    bluetooth_sim_advertising = 0;
+}
+
+uint8_t Bluetooth_RequestConnParams(const uint8_t bda[6], const ble_conn_params_t *params)
+{
+    // 其余模拟手机的连接参数不模拟，当作请求已发出、一直没有结果
+    if (memcmp(bda, bluetooth_sim_phone, 6)) return 1;
+    if (bluetooth_sim_param_failures) {
+        bluetooth_sim_param_failures--;
+        ESP_LOGW(TAG, "update conn params failed (simulated)");
+        return 0;
+    }
+    bluetooth_sim_update = *params;
+    esp_timer_stop(bluetooth_sim_update_timer);
+    esp_timer_start_once(bluetooth_sim_update_timer, (uint64_t)bluetooth_sim_interval * 1250 * BLUETOOTH_SIM_UPDATE_EVENTS);
+    return 1;
+}
+
+void Bluetooth_SimFailConnParams(uint8_t count)
+{
+    bluetooth_sim_param_failures = count;
+}
+
+void Bluetooth_SimConnect(uint8_t connected)
+{
+    if (connected == bluetooth_sim_connected) return;
+    bluetooth_sim_connected = connected;
+    if (connected) {
+        if (!Bluetooth_SimWaitAdvertising(bluetooth_sim_phone)) {
+            ESP_LOGW(TAG, "connect while not advertising");
+        }
+        if (!BleSession_Open(BLUETOOTH_SIM_CONN_ID)) {
+            bluetooth_sim_connected = 0;
+            return;
+        }
+        uint8_t bonded            = BleBond_IsBonded(bluetooth_sim_phone);
+        bluetooth_sim_advertising = 0;
+        BleAdv_Connected(BleSession_Count() >= BLE_SESSION_MAX);
+        bluetooth_sim_interval = BLUETOOTH_SIM_INTERVAL;
+        BleConn_Connected(BLUETOOTH_SIM_CONN_ID, bluetooth_sim_phone, BLUETOOTH_SIM_INTERVAL, 0, BLUETOOTH_SIM_TIMEOUT);
+        // 门锁连上后马上请求加密
+        uint32_t events = bonded ? BLUETOOTH_SIM_ENCRYPT_EVENTS : bluetooth_sim_bonding ? BLUETOOTH_SIM_PAIR_EVENTS : BLUETOOTH_SIM_REJECT_EVENTS;
+        vTaskDelay(pdMS_TO_TICKS(events * bluetooth_sim_interval * 5 / 4));
+        if (bonded || bluetooth_sim_bonding) {
+            BleBond_Used(bluetooth_sim_phone, 0);
+        }
+        uint32_t requests = bluetooth_sim_cached ? BLUETOOTH_SIM_HASH_REQUESTS : BLUETOOTH_SIM_DISCOVERY_REQUESTS;
+        vTaskDelay(pdMS_TO_TICKS(requests * bluetooth_sim_interval * 5 / 4));
+        ESP_LOGI(TAG, "service discovery: %s, %" PRIu32 " requests", bluetooth_sim_cached ? "cached" : "full", requests);
+        bluetooth_sim_cached = bluetooth_sim_bonding; // 只有绑定的手机保留缓存
+        BleBulk_Mtu(BLUETOOTH_SIM_CONN_ID, bluetooth_sim_mtu);
+        BleBulk_Link(bluetooth_sim_ll_octets, bluetooth_sim_phy);
+    } else {
+        esp_timer_stop(bluetooth_sim_update_timer);
+        BleBulk_Disconnected(BLUETOOTH_SIM_CONN_ID);
+        BleSession_Close(BLUETOOTH_SIM_CONN_ID);
+        BleConn_Disconnected(BLUETOOTH_SIM_CONN_ID);
+        BleAdv_Disconnected();
+    }
+}
+
+void Bluetooth_SimClientConnect(uint8_t client, uint8_t connected)
+{
+    uint8_t bda[6];
+
+    if (client == 0) {
+        Bluetooth_SimConnect(connected);
+        return;
+    }
+    if (client >= 32 || connected == ((bluetooth_sim_clients >> client) & 1)) return;
+    memcpy(bda, bluetooth_sim_phone, 6);
+    bda[5] += client;
+    if (connected) {
+        // 其余手机不配对、不做服务发现，连上就能写
+        if (!Bluetooth_SimWaitAdvertising(bda)) {
+            ESP_LOGW(TAG, "client %u: lock not advertising", client);
+            return;
+        }
+        if (!BleSession_Open(client)) return;
+        bluetooth_sim_clients |= 1u << client;
+        bluetooth_sim_advertising = 0;
+        BleAdv_Connected(BleSession_Count() >= BLE_SESSION_MAX);
+        BleConn_Connected(client, bda, BLUETOOTH_SIM_INTERVAL, 0, BLUETOOTH_SIM_TIMEOUT);
+    } else {
+        bluetooth_sim_clients &= ~(1u << client);
+        BleBulk_Disconnected(client);
+        BleSession_Close(client);
+        BleConn_Disconnected(client);
+        BleAdv_Disconnected();
+    }
+}
+
+uint8_t Bluetooth_SimClientWrite(uint8_t client, const uint8_t *value, uint16_t len)
+{
+    return BleSession_Submit(client, value, len);
+}
+
+void Bluetooth_SimSetNotifyHook(bluetooth_sim_notify_hook_t hook)
+{
+    bluetooth_sim_notify_hook = hook;
+}
+
+// 和真实协议栈一样经过会话队列，等命令任务处理完再返回
+static void Bluetooth_SimDeliver(const uint8_t *value, uint16_t len)
+{
+    Bluetooth_SimConnect(1);
+    if (BleSession_Submit(BLUETOOTH_SIM_CONN_ID, value, len)) {
+        BleSession_Wait(BLUETOOTH_SIM_CONN_ID);
+    }
+}
+
+void Bluetooth_Notify(const uint8_t *data, size_t len)
+{
+    bluetooth_sim_notify_len = len < sizeof(bluetooth_sim_notify) ? len : sizeof(bluetooth_sim_notify);
+    memcpy(bluetooth_sim_notify, data, bluetooth_sim_notify_len);
+    if (bluetooth_sim_notify_hook) {
+        bluetooth_sim_notify_hook(BleSession_Current(), data, len);
+    }
+    if (!bluetooth_sim_echo) return;
+    printf("ble notify:");
+    for (size_t i = 0; i < len; i++) {
+        printf(" %02x", data[i]);
+    }
+    printf("\r\n");
+}
+
+uint8_t Bluetooth_BulkSend(uint16_t conn_id, uint8_t chan, const uint8_t *data, size_t len)
+{
+    uint8_t connected = conn_id == BLUETOOTH_SIM_CONN_ID ? bluetooth_sim_connected : conn_id < 32 && ((bluetooth_sim_clients >> conn_id) & 1);
+    if (!connected) return 0;
+    if (bluetooth_sim_bulk_hook) {
+        bluetooth_sim_bulk_hook(chan, data, len);
+    }
+    return 1;
+}
+
+void Bluetooth_SimBulkWrite(uint8_t chan, const uint8_t *value, uint16_t len)
+{
+    Bluetooth_SimConnect(1);
+    if (len > bluetooth_sim_mtu - 3) {
+        ESP_LOGW(TAG, "bulk write of %u bytes exceeds mtu %u", len, bluetooth_sim_mtu);
+        return;
+    }
+    BleBulk_Write(BLUETOOTH_SIM_CONN_ID, chan, value, len);
+}
+
+void Bluetooth_SimSetBulkHook(bluetooth_sim_bulk_hook_t hook)
+{
+    bluetooth_sim_bulk_hook = hook;
+}
+
+void Bluetooth_SimSetLink(uint16_t mtu, uint8_t dle, uint8_t phy_2m)
+{
+    bluetooth_sim_mtu       = mtu;
+    bluetooth_sim_ll_octets = dle ? BLE_BULK_LL_OCTETS : BLUETOOTH_SIM_LL_OCTETS;
+    bluetooth_sim_phy       = phy_2m ? 2 : 1;
+    if (!bluetooth_sim_connected) return;
+    BleBulk_Mtu(BLUETOOTH_SIM_CONN_ID, mtu);
+    BleBulk_Link(bluetooth_sim_ll_octets, bluetooth_sim_phy);
+}
+
+uint32_t Bluetooth_SimAirtimeUs(uint16_t att_len)
+{
+    uint32_t remaining = att_len + BLUETOOTH_SIM_L2CAP_HEADER;
+    uint32_t us        = 0;
+
+    while (remaining) {
+        uint32_t octets = remaining < bluetooth_sim_ll_octets ? remaining : bluetooth_sim_ll_octets;
+        // 2M 每字节 4 us，前导码多 1 字节
+        uint32_t bytes = octets + BLUETOOTH_SIM_PDU_OVERHEAD + (bluetooth_sim_phy == 2);
+        uint32_t empty = BLUETOOTH_SIM_EMPTY_OCTETS + (bluetooth_sim_phy == 2);
+        us += (bytes + empty) * 8 / bluetooth_sim_phy + 2 * BLUETOOTH_SIM_IFS_US;
+        remaining -= octets;
+    }
+    return us;
+}
+
+#if CONFIG_TRACE_ENABLE
+void Bluetooth_TraceSink(const uint8_t *data, size_t len)
+{
+    Trace_UartSink(data, len);
+}
+#endif
+
+void Bluetooth_SimWrite(const char *value)
+{
+    Bluetooth_SimDeliver((const uint8_t *)value, strlen(value));
+}
+
+void Bluetooth_SimWriteRaw(const uint8_t *value, uint16_t len)
+{
+    Bluetooth_SimDeliver(value, len);
+}
+
+void Bluetooth_SimForgetCache(void)
+{
+    bluetooth_sim_cached = 0;
+}
+
+void Bluetooth_SimSetBonding(uint8_t bonding)
+{
+    bluetooth_sim_bonding = bonding;
+    if (!bonding) {
+        // 没有绑定的手机不保留 GATT 缓存
+        BleBond_Removed(bluetooth_sim_phone);
+        bluetooth_sim_cached = 0;
+    }
+}
+
+void Bluetooth_SimSetEcho(uint8_t echo)
+{
+    bluetooth_sim_echo = echo;
+}
+
+size_t Bluetooth_SimLastNotify(uint8_t *data, size_t size)
+{
+    size_t len = bluetooth_sim_notify_len < size ? bluetooth_sim_notify_len : size;
+    memcpy(data, bluetooth_sim_notify, len);
+    return len;
+}
@@ -0,0 +1,234 @@
+#include "Fingerprint.h"
+#include "esp_timer.h"
+#include "utils.h"
+
+// 主机仿真的指纹模块：按指令码生成应答包，并模拟模块处理时间和 57600 波特率下的传输时间。
+// 应答在“就绪时间”之前读不到，所以上层的等待逻辑和真实模块下一致。
+
+// 57600 8N1 每个字节约 174us
+#define FINGER_SIM_BYTE_US 174
+
+static uint8_t finger_sim_present    = 0;
+static int16_t finger_sim_page       = -1;
+static uint8_t finger_sim_image      = 0; // 图像缓冲中是否有有效图像
+static uint16_t finger_sim_templates = 0;
+
+// 一条指令最多产生的应答包数（PS_AutoIdentify 每个阶段一个）
+#define FINGER_SIM_MAX_REPLIES 3
+
+// 待读出的应答包按顺序排在一起，每个包有自己的就绪时间
+static uint8_t finger_sim_reply[FINGER_PACKET_MAX * FINGER_SIM_MAX_REPLIES];
+static size_t finger_sim_reply_len = 0;
+static size_t finger_sim_reply_pos = 0;
+static size_t finger_sim_pkt_end[FINGER_SIM_MAX_REPLIES];
+static int64_t finger_sim_ready_at[FINGER_SIM_MAX_REPLIES];
+static uint8_t finger_sim_pkt_count = 0;
+
+// 脚本应答（Finger_SimScript），只用于下一条指令
+static uint8_t finger_sim_script[FINGER_PACKET_MAX];
+static size_t finger_sim_script_len   = 0;
+static size_t finger_sim_script_split = 0;
+
+// 最近收到的指令包
+static uint8_t finger_sim_last_cmd[FINGER_PACKET_MAX];
+static size_t finger_sim_last_cmd_len = 0;
+
+void Finger_SimTouch(uint8_t present, int16_t page_id)
+{
+    finger_sim_present = present;
+    finger_sim_page    = page_id;
+}
+
+// 丢弃所有待读出的应答
+static void Finger_SimClear(void)
+{
+    finger_sim_reply_len = 0;
+    finger_sim_reply_pos = 0;
+    finger_sim_pkt_count = 0;
+}
+
+// 追加一段原始数据，在上一段就绪后再经过 process_us 加上传输时间就绪
+static void Finger_SimQueue(const uint8_t *data, size_t n, uint32_t process_us)
+{
+    if (finger_sim_pkt_count == FINGER_SIM_MAX_REPLIES) return;
+
+    int64_t base = finger_sim_pkt_count ? finger_sim_ready_at[finger_sim_pkt_count - 1] : esp_timer_get_time();
+    memcpy(&finger_sim_reply[finger_sim_reply_len], data, n);
+    finger_sim_reply_len += n;
+    finger_sim_pkt_end[finger_sim_pkt_count]  = finger_sim_reply_len;
+    finger_sim_ready_at[finger_sim_pkt_count] = base + process_us + n * FINGER_SIM_BYTE_US;
+    finger_sim_pkt_count++;
+}
+
+// 追加一个应答包：确认码 + 附加数据，在上一个包就绪后再经过 process_us 就绪
+static void Finger_SimReply(uint8_t confirm, const uint8_t *data, size_t data_len, uint32_t process_us)
+{
+    uint16_t pkt_len = 1 + data_len + 2;
+    size_t n         = 0;
+    uint8_t r[FINGER_PACKET_MAX];
+
+    r[n++] = 0xEF;
+    r[n++] = 0x01;
+    r[n++] = 0xFF;
+    r[n++] = 0xFF;
+    r[n++] = 0xFF;
+    r[n++] = 0xFF;
+    r[n++] = 0x07; // 应答包
+    r[n++] = pkt_len >> 8;
+    r[n++] = pkt_len & 0xFF;
+    r[n++] = confirm;
+    if (data_len > 0) {
+        memcpy(&r[n], data, data_len);
+        n += data_len;
+    }
+    uint16_t checksum = 0;
+    for (size_t i = 6; i < n; i++) {
+        checksum += r[i];
+    }
+    r[n++] = checksum >> 8;
+    r[n++] = checksum & 0xFF;
+    Finger_SimQueue(r, n, process_us);
+}
+
+void Finger_SimScript(const uint8_t *reply, size_t len, size_t split)
+{
+    if (len > sizeof(finger_sim_script)) len = sizeof(finger_sim_script);
+    memcpy(finger_sim_script, reply, len);
+    finger_sim_script_len   = len;
+    finger_sim_script_split = split < len ? split : 0;
+}
+
+size_t Finger_SimLastCommand(uint8_t *cmd)
+{
+    memcpy(cmd, finger_sim_last_cmd, finger_sim_last_cmd_len);
+    return finger_sim_last_cmd_len;
+}
+
+static void Finger_SimInit(void)
+{
+    Finger_SimClear();
+}
+
+static void Finger_SimFlush(void)
+{
+    Finger_SimClear();
+}
+
+static int Finger_SimWrite(const uint8_t *data, size_t len)
+{
+    finger_sim_last_cmd_len = len < sizeof(finger_sim_last_cmd) ? len : sizeof(finger_sim_last_cmd);
+    memcpy(finger_sim_last_cmd, data, finger_sim_last_cmd_len);
+    if (len < 12 || data[0] != 0xEF || data[1] != 0x01) return len;
+
+    uint8_t out[32] = {0};
+    // 指令包本身的传输时间
+    uint32_t tx_us = len * FINGER_SIM_BYTE_US;
+
+    Finger_SimClear();
+    if (finger_sim_script_len) {
+        // 脚本应答：分开的后半段再晚 5ms 到
+        size_t split = finger_sim_script_split ? finger_sim_script_split : finger_sim_script_len;
+        Finger_SimQueue(finger_sim_script, split, tx_us + 2000);
+        if (split < finger_sim_script_len) {
+            Finger_SimQueue(&finger_sim_script[split], finger_sim_script_len - split, 5000);
+        }
+        finger_sim_script_len = 0;
+        return len;
+    }
+    switch (data[9]) {
+        case 0x01: // PS_GetImage
+            finger_sim_image = finger_sim_present;
+            Finger_SimReply(finger_sim_present ? 0x00 : 0x02, NULL, 0, tx_us + 30000);
+            break;
+        case 0x02: // PS_GenChar
+            Finger_SimReply(finger_sim_image ? 0x00 : 0x15, NULL, 0, tx_us + 40000);
+            break;
+        case 0x04: // PS_Search
+            if (finger_sim_image && finger_sim_page >= 0) {
+                out[0] = finger_sim_page >> 8;
+                out[1] = finger_sim_page & 0xFF;
+                out[3] = 100; // 得分
+                Finger_SimReply(0x00, out, 4, tx_us + 50000);
+            } else {
+                Finger_SimReply(0x09, out, 4, tx_us + 50000);
+            }
+            break;
+        case 0x32: // PS_AutoIdentify：合法性检查、获取图像、搜索结果三个应答，数据为 阶段 + ID(2) + 得分(2)
+            Finger_SimReply(0x00, out, 5, tx_us + 1000);
+            finger_sim_image = finger_sim_present;
+            out[0]           = 0x01;
+            if (!finger_sim_present) {
+                Finger_SimReply(0x02, out, 5, 30000);
+                break;
+            }
+            Finger_SimReply(0x00, out, 5, 30000);
+            // 模块内部连续生成特征和搜索，省去两次串口往返
+            out[0] = 0x05;
+            if (finger_sim_page >= 0) {
+                out[1] = finger_sim_page >> 8;
+                out[2] = finger_sim_page & 0xFF;
+                out[4] = 100; // 得分
+                Finger_SimReply(0x00, out, 5, 90000);
+            } else {
+                Finger_SimReply(0x09, out, 5, 90000);
+            }
+            break;
+        case 0x05: // PS_RegModel
+            Finger_SimReply(0x00, NULL, 0, tx_us + 30000);
+            break;
+        case 0x06: // PS_StoreChar
+            finger_sim_templates++;
+            Finger_SimReply(0x00, NULL, 0, tx_us + 40000);
+            break;
+        case 0x1D: // PS_ValidTempleteNum
+            out[0] = finger_sim_templates >> 8;
+            out[1] = finger_sim_templates & 0xFF;
+            Finger_SimReply(0x00, out, 2, tx_us + 2000);
+            break;
+        case 0x34: // PS_GetChipSN
+            memcpy(out, "SIMULATED-FINGERPRINT-MODULE-001", 32);
+            Finger_SimReply(0x00, out, 32, tx_us + 2000);
+            break;
+        case 0x0E: // PS_WriteReg
+        case 0x33: // PS_Sleep
+        default:
+            Finger_SimReply(0x00, NULL, 0, tx_us + 2000);
+            break;
+    }
+    return len;
+}
+
+static int Finger_SimRead(uint8_t *buf, size_t len, uint32_t timeout_ms)
+{
+    int64_t now      = esp_timer_get_time();
+    int64_t deadline = now + (int64_t)timeout_ms * 1000;
+
+    // 找到当前读取位置所在的包
+    uint8_t pkt = 0;
+    while (pkt < finger_sim_pkt_count && finger_sim_pkt_end[pkt] <= finger_sim_reply_pos) {
+        pkt++;
+    }
+    if (pkt == finger_sim_pkt_count || finger_sim_ready_at[pkt] > deadline) {
+        // 超时之前不会有数据
+        DelayUs(timeout_ms * 1000);
+        return 0;
+    }
+    if (finger_sim_ready_at[pkt] > now) {
+        DelayUs(finger_sim_ready_at[pkt] - now);
+    }
+
+    // 一次最多读到当前包结束
+    size_t n = finger_sim_pkt_end[pkt] - finger_sim_reply_pos;
+    if (n > len) n = len;
+    memcpy(buf, &finger_sim_reply[finger_sim_reply_pos], n);
+    finger_sim_reply_pos += n;
+    return n;
+}
+
+const finger_port_t finger_port_sim = {
+    .name  = "host simulation",
+    .init  = Finger_SimInit,
+    .flush = Finger_SimFlush,
+    .write = Finger_SimWrite,
+    .read  = Finger_SimRead,
+};
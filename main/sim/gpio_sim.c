@@ -0,0 +1,133 @@
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+typedef struct {
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    uint8_t level;
+    uint32_t edges;
+    gpio_isr_t isr;
+    void *isr_arg;
+} gpio_sim_pin_t;
+
+static gpio_sim_pin_t gpio_sim_pins[GPIO_SIM_PIN_COUNT];
+static uint8_t gpio_sim_isr_installed = 0;
+static portMUX_TYPE gpio_sim_lock     = portMUX_INITIALIZER_UNLOCKED;
+static gpio_sim_output_hook_t gpio_sim_output_hook = NULL;
+
+static uint8_t Gpio_SimValid(gpio_num_t gpio_num)
+{
+    return gpio_num >= 0 && gpio_num < GPIO_SIM_PIN_COUNT;
+}
+
+esp_err_t gpio_config(const gpio_config_t *cfg)
+{
+    for (int i = 0; i < GPIO_SIM_PIN_COUNT; i++) {
+        if (cfg->pin_bit_mask & (1ULL << i)) {
+            gpio_sim_pins[i].mode      = cfg->mode;
+            gpio_sim_pins[i].intr_type = cfg->intr_type;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!Gpio_SimValid(gpio_num)) return ESP_ERR_INVALID_ARG;
+
+    taskENTER_CRITICAL(&gpio_sim_lock);
+    gpio_sim_pin_t *pin = &gpio_sim_pins[gpio_num];
+    uint8_t changed     = pin->level != !!level;
+    if (changed) {
+        pin->level = !!level;
+        pin->edges++;
+    }
+    gpio_sim_output_hook_t hook = gpio_sim_output_hook;
+    taskEXIT_CRITICAL(&gpio_sim_lock);
+
+    if (changed && hook) {
+        hook(gpio_num, !!level);
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (!Gpio_SimValid(gpio_num)) return 0;
+    return gpio_sim_pins[gpio_num].level;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    gpio_sim_isr_installed = 1;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (!Gpio_SimValid(gpio_num) || !gpio_sim_isr_installed) return ESP_ERR_INVALID_STATE;
+
+    taskENTER_CRITICAL(&gpio_sim_lock);
+    gpio_sim_pins[gpio_num].isr     = isr_handler;
+    gpio_sim_pins[gpio_num].isr_arg = args;
+    taskEXIT_CRITICAL(&gpio_sim_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    return gpio_isr_handler_add(gpio_num, NULL, NULL);
+}
+
+void Gpio_SimSetInput(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!Gpio_SimValid(gpio_num)) return;
+
+    taskENTER_CRITICAL(&gpio_sim_lock);
+    gpio_sim_pin_t *pin = &gpio_sim_pins[gpio_num];
+    uint8_t old         = pin->level;
+    pin->level          = !!level;
+    if (old != pin->level) {
+        pin->edges++;
+    }
+    gpio_isr_t isr = pin->isr;
+    void *isr_arg  = pin->isr_arg;
+    taskEXIT_CRITICAL(&gpio_sim_lock);
+
+    uint8_t fire = 0;
+    switch (pin->intr_type) {
+        case GPIO_INTR_POSEDGE:
+            fire = !old && level;
+            break;
+        case GPIO_INTR_NEGEDGE:
+            fire = old && !level;
+            break;
+        case GPIO_INTR_ANYEDGE:
+            fire = old != !!level;
+            break;
+        case GPIO_INTR_HIGH_LEVEL:
+            fire = !!level;
+            break;
+        case GPIO_INTR_LOW_LEVEL:
+            fire = !level;
+            break;
+        default:
+            break;
+    }
+    // 在调用者的上下文中执行“中断”，处理函数里的 FromISR 接口在 POSIX 移植层上同样可用
+    if (fire && isr) {
+        isr(isr_arg);
+    }
+}
+
+void Gpio_SimSetOutputHook(gpio_sim_output_hook_t hook)
+{
+    gpio_sim_output_hook = hook;
+}
+
+uint32_t Gpio_SimEdgeCount(gpio_num_t gpio_num)
+{
+    if (!Gpio_SimValid(gpio_num)) return 0;
+    return gpio_sim_pins[gpio_num].edges;
+}
@@ -0,0 +1,89 @@
+#pragma once
+// 主机仿真（Linux 目标）用的 GPIO 驱动替身：只实现本工程用到的接口。
+// 输出电平记录在内存中，输入电平由场景脚本通过 Gpio_SimSetInput() 设置，
+// 满足中断条件时在调用者的上下文里执行 gpio_isr_handler_add() 注册的处理函数。
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_attr.h"
+
+#define GPIO_SIM_PIN_COUNT 22
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_0  = 0,
+    GPIO_NUM_1,
+    GPIO_NUM_2,
+    GPIO_NUM_3,
+    GPIO_NUM_4,
+    GPIO_NUM_5,
+    GPIO_NUM_6,
+    GPIO_NUM_7,
+    GPIO_NUM_8,
+    GPIO_NUM_9,
+    GPIO_NUM_10,
+    GPIO_NUM_11,
+    GPIO_NUM_12,
+    GPIO_NUM_13,
+    GPIO_NUM_14,
+    GPIO_NUM_15,
+    GPIO_NUM_16,
+    GPIO_NUM_17,
+    GPIO_NUM_18,
+    GPIO_NUM_19,
+    GPIO_NUM_20,
+    GPIO_NUM_21,
+    GPIO_NUM_MAX,
+} gpio_num_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE,
+    GPIO_INTR_LOW_LEVEL,
+    GPIO_INTR_HIGH_LEVEL,
+} gpio_int_type_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE         = 0,
+    GPIO_MODE_INPUT           = 1,
+    GPIO_MODE_OUTPUT          = 2,
+    GPIO_MODE_OUTPUT_OD       = 6,
+    GPIO_MODE_INPUT_OUTPUT    = 3,
+    GPIO_MODE_INPUT_OUTPUT_OD = 7,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE = 0,
+    GPIO_PULLUP_ENABLE,
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE = 0,
+    GPIO_PULLDOWN_ENABLE,
+} gpio_pulldown_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void *arg);
+
+esp_err_t gpio_config(const gpio_config_t *cfg);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+int gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num);
+
+// 设置输入引脚的电平，满足中断触发条件时调用中断处理函数
+void Gpio_SimSetInput(gpio_num_t gpio_num, uint32_t level);
+// 引脚电平变化的次数（输出引脚由 gpio_set_level 计数），用于检查电机等输出的时序
+uint32_t Gpio_SimEdgeCount(gpio_num_t gpio_num);
+// 输出引脚电平变化时回调（在调用 gpio_set_level 的任务中），NULL 取消
+typedef void (*gpio_sim_output_hook_t)(gpio_num_t gpio_num, uint32_t level);
+void Gpio_SimSetOutputHook(gpio_sim_output_hook_t hook);
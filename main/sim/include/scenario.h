@@ -0,0 +1,36 @@
+#pragma once
+
+/**
+ * @brief 启动场景脚本任务（仅主机仿真）
+ *
+ * 环境变量 SMARTLOCK_SCENARIO 指定脚本文件，未指定时运行内置脚本。脚本每行一条命令：
+ *
+ *   key <按键...>   依次按下按键，0~9 数字，# 和 M 为功能键
+ *   touch <page>    手指放上传感器，page 为指纹库中的位置，-1 表示未录入的手指
+ *   release         手指离开传感器
+ *   ble <text>      手机写入一次特征值
+ *   wait <ms>       等待
+ *   stats           打印各模块的统计
+ *   trace           把追踪缓冲以 "T:<hex>" 行导出到控制台（需要 CONFIG_TRACE_ENABLE）
+ *   credbench       访客密码表装入 10 / 1000 / 10000 个密码，测命中和未命中的校验耗时
+ *   schedtest       时间表在几个时区两年内的判定与 localtime_r 对照，并测一次检查的耗时
+ *   pintest         按键匹配器与直接查密码表的参考实现逐位对照，并测每次按键的耗时
+ *   motortest       检查电机各阶段时长与阶段表一致、流程中请求的合并、回调只调用一次和回调队列满
+ *   fingertest      指纹指令包逐字节比较，成功、错误确认码、应答过短、校验和错误、分包应答的处理
+ *   blehex <hex>    手机写入一次二进制特征值（十六进制，可以有空格），用于二进制命令协议
+ *   protobench      二进制协议的重发识别、PING 速度，以及二进制批量和字符串命令下发 1000 个密码的对比
+ *   bleconn <on|off> 模拟手机连接 / 断开（连接要等门锁的下一次广播）
+ *   bleconntest     检查快速 / 空闲连接参数的切换和请求被协议栈拒收后的重试，比较两种参数下的往返时间
+ *   bleadvtest      手机在断开后、慢速广播中和按键后连接，检查走的广播阶段并比较连上所需的时间
+ *   gatttest        手机丢掉 GATT 缓存后连接、再带缓存重连，检查缓存缩短了连上到第一条命令的时间
+ *   bondtest        比较不配对和绑定后从按键到开锁命令的时间，检查绑定后的快速回连更快
+ *   loadtest [n]    n 部手机（默认会话池大小）同时闭环发 PING，检查全部完成，输出吞吐量、延迟分布和公平性
+ *   bulkbench       批量传输在几种 MTU / PHY / 窗口下的上下行速度，检查数据正确、坏块回退和断开续传
+ *   wifi <op>       操作假 AP 和 WiFi 使用者：drop | on | off | channel <n> | acquire <bg|active> | release <bg|active> | power
+ *   wifitest        模拟信号丢失、AP 换信道和断电，检查重连走缓存 / 完整扫描，并打印射频耗电
+ *   exit            打印统计后退出进程
+ *
+ * 空行和 # 开头的行被忽略，脚本执行完后进程退出。测试命令的检查打印 ok / FAILED，
+ * 有检查失败时进程的退出码为 1，可以直接在 CI 中运行。
+ */
+void Scenario_Start(void);
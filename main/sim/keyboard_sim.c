@@ -0,0 +1,47 @@
+#include "keyboard.h"
+#include "utils.h"
+
+// 主机仿真的假键盘：按键字由场景脚本通过 Keyboard_SimPress() 注入，
+// 读取时按真实 I2C 帧长度（起始 + 地址 + 2 字节数据 + 停止，约 29 个 SCL 周期）
+// 消耗总线时间，这样 Keyboard_LastReadUs() 在主机上也能反映读取延迟。
+#define KEYBOARD_SIM_FRAME_BITS 29
+#define KEYBOARD_SIM_XFER_US    (KEYBOARD_SIM_FRAME_BITS * 1000000 / CONFIG_KEYBOARD_I2C_FREQ_HZ)
+
+static volatile uint16_t keyboard_sim_word = 0;
+
+// 键值 0~11 对应的按键字，与 Keyboard_ReadKey() 的解码相反
+static const uint16_t keyboard_sim_words[] = {
+    0x8000, 0x4000, 0x2000, 0x1000, 0x0100, 0x0400,
+    0x0200, 0x0800, 0x0040, 0x0020, 0x0010, 0x0080,
+};
+
+void Keyboard_SimPress(uint16_t key_word)
+{
+    keyboard_sim_word = key_word;
+}
+
+void Keyboard_SimPressKey(uint8_t key)
+{
+    if (key < sizeof(keyboard_sim_words) / sizeof(keyboard_sim_words[0])) {
+        Keyboard_SimPress(keyboard_sim_words[key]);
+    }
+}
+
+static void Keyboard_SimInit(void)
+{
+    keyboard_sim_word = 0;
+}
+
+static uint8_t Keyboard_SimRead(uint16_t *result)
+{
+    DelayUs(KEYBOARD_SIM_XFER_US);
+    *result           = keyboard_sim_word;
+    keyboard_sim_word = 0;
+    return 0;
+}
+
+const keyboard_backend_t keyboard_backend_sim = {
+    .name      = "host simulation",
+    .init      = Keyboard_SimInit,
+    .read_word = Keyboard_SimRead,
+};
@@ -0,0 +1,56 @@
+#include "LED.h"
+#include "esp_timer.h"
+#include <stdio.h>
+
+// 主机仿真的 WS2812 灯带：保存最近一次发送的帧，并按 800kHz 的线速模拟每帧的发送时间。
+// 与 RMT 后端一样有两个发送缓冲，两帧都还在“发送中”时返回忙。
+#define LED_SIM_BIT_NS   1250
+#define LED_SIM_RESET_US 50
+#define LED_SIM_BUFFERS  2
+
+static uint8_t led_sim_frame[LED_FRAME_BYTES];
+static int64_t led_sim_done_at[LED_SIM_BUFFERS];
+static uint8_t led_sim_next    = 0;
+static uint32_t led_sim_frames = 0;
+
+static void LED_SimInit(void)
+{
+    led_sim_frames = 0;
+    memset(led_sim_done_at, 0, sizeof(led_sim_done_at));
+}
+
+static uint8_t LED_SimTransmit(const uint8_t *frame, size_t len)
+{
+    int64_t now = esp_timer_get_time();
+    // 发送按提交顺序完成，下一个缓冲的上一帧还没发完说明两个缓冲都在使用中
+    if (led_sim_done_at[led_sim_next] > now) {
+        return 1;
+    }
+
+    // 排在前一帧之后发送
+    int64_t start = led_sim_done_at[(led_sim_next + LED_SIM_BUFFERS - 1) % LED_SIM_BUFFERS];
+    if (start < now) start = now;
+    led_sim_done_at[led_sim_next] = start + (int64_t)len * 8 * LED_SIM_BIT_NS / 1000 + LED_SIM_RESET_US;
+    led_sim_next                  = (led_sim_next + 1) % LED_SIM_BUFFERS;
+
+    memcpy(led_sim_frame, frame, len);
+    led_sim_frames++;
+    return 0;
+}
+
+void LED_SimDump(void)
+{
+    printf("led frames %u:", (unsigned)led_sim_frames);
+    for (int i = 0; i < LED_NUMBERS; i++) {
+        // 帧内顺序为 G B R，按 RGB 打印
+        const uint8_t *pixel = &led_sim_frame[i * 3];
+        printf(" %02x%02x%02x", pixel[2], pixel[0], pixel[1]);
+    }
+    printf("\r\n");
+}
+
+const led_backend_t led_backend_sim = {
+    .name     = "host simulation",
+    .init     = LED_SimInit,
+    .transmit = LED_SimTransmit,
+};
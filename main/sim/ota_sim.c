@@ -0,0 +1,9 @@
+#include "ota.h"
+#include "esp_log.h"
+
+static const char *TAG = "ota_sim";
+
+void ota_init(void)
+{
+    ESP_LOGW(TAG, "OTA is not available in host simulation");
+}
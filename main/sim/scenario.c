@@ -0,0 +1,1637 @@
+#include "scenario.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "keyboard.h"
+#include "Fingerprint.h"
+#include "Audio.h"
+#include "LED.h"
+#include "Motor.h"
+#include "bluetooth.h"
+#include "ble_proto.h"
+#include "ble_adv.h"
+#include "ble_session.h"
+#include "ble_bulk.h"
+#include "flash.h"
+#include "schedule.h"
+#include "pin_matcher.h"
+#include "boot.h"
+#include "wifi.h"
+#include "utils.h"
+#include "trace.h"
+#include "esp_rom_crc.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// 场景任务：优先级低于业务任务，保证脚本注入的事件由真实任务及时处理
+#define SCENARIO_TASK_NAME       "scenario_task"
+#define SCENARIO_TASK_STACK_SIZE 4096
+#define SCENARIO_TASK_PRIORITY   3
+
+// 连续按键之间的间隔
+#define SCENARIO_KEY_INTERVAL_MS 100
+#define SCENARIO_LINE_MAX        128
+
+static const char *TAG = "scenario";
+
+static const char *scenario_builtin[] = {
+    "wait 500",
+    // 正确密码开锁，密码前面夹带其他数字也可以
+    "key 123456",
+    "wait 200",
+    "key 77123456",
+    "wait 200",
+    // 已录入和未录入的手指
+    "touch 1",
+    "wait 600",
+    "release",
+    "touch -1",
+    "wait 600",
+    "release",
+    // 蓝牙开锁、修改密码后用新密码开锁
+    "ble openlock",
+    "ble cpw:654321",
+    "key 654321",
+    "wait 200",
+    // 下发访客密码后用访客密码开锁
+    "ble c+:246813,135790",
+    "ble c!",
+    "key 246813",
+    "wait 200",
+    "credbench",
+    "schedtest",
+    "pintest",
+    "motortest",
+    "fingertest",
+    // 二进制协议：PING 和开锁
+    "blehex 01 01 00 0000",
+    "blehex 01 02 01 0000",
+    "blehex 01 00 00 FBFF",
+    "protobench",
+    "bleconntest",
+    "bleadvtest",
+    "gatttest",
+    "bondtest",
+    "loadtest",
+    "bulkbench",
+    "wifitest",
+    "wait 7000",
+    "exit",
+};
+
+static int64_t scenario_start_us = 0;
+// 失败的检查数，不为 0 时进程以 1 退出
+static uint32_t scenario_failures = 0;
+
+// 记下一次检查的结果，返回打印用的 "ok" / "FAILED"
+static const char *Scenario_Check(uint8_t ok)
+{
+    if (!ok) scenario_failures++;
+    return ok ? "ok" : "FAILED";
+}
+
+static void Scenario_BleAdvReport(void)
+{
+    ble_adv_report_t report;
+    BleAdv_GetReport(&report);
+    printf("ble adv: %s, directed %" PRIu64 " ms, burst %" PRIu64 " ms, slow %" PRIu64 " ms, connected %" PRIu64 " ms, duty %" PRIu32 ".%02" PRIu32 "%%, %" PRIu32 " directed, %" PRIu32 " bursts, %" PRIu32 " connects, connect last %" PRIu32 " ms avg %" PRIu32 " ms max %" PRIu32 " ms\r\n",
+           BleAdv_StateName(report.state), report.time_ms[BLE_ADV_DIRECTED], report.time_ms[BLE_ADV_BURST], report.time_ms[BLE_ADV_SLOW], report.time_ms[BLE_ADV_CONNECTED],
+           report.duty_ppm / 10000, report.duty_ppm / 100 % 100, report.directed, report.bursts, report.connects,
+           report.last_connect_ms, report.avg_connect_ms, report.max_connect_ms);
+    for (int i = BLE_ADV_DIRECTED; i <= BLE_ADV_SLOW; i++) {
+        if (!report.path_connects[i]) continue;
+        printf("ble adv: via %-8s %" PRIu32 " connects, connect avg %" PRIu32 " ms, approach to first command avg %" PRIu32 " ms\r\n",
+               BleAdv_StateName(i), report.path_connects[i], report.path_connect_ms[i], report.path_approach_ms[i]);
+    }
+}
+
+static void Scenario_BleConnReport(void)
+{
+    ble_conn_report_t report;
+    for (uint8_t i = 0; i < BLE_CONN_MAX; i++) {
+        if (!BleConn_GetReport(i, &report)) continue;
+        printf("ble conn %u: %s, interval %u.%02u ms, latency %u, first command after %" PRIu32 " ms, %" PRIu32 " commands, rtt last %" PRIu32 " us avg %" PRIu32 " us max %" PRIu32 " us, updates %" PRIu32 " (%" PRIu32 " rejected, %" PRIu32 " failed), duty %" PRIu32 ".%02" PRIu32 "%%\r\n",
+               report.conn_id, BleConn_ModeName(report.mode), report.interval * 125 / 100, report.interval * 125 % 100, report.latency,
+               report.first_command_ms, report.commands, report.last_rtt_us, report.avg_rtt_us, report.max_rtt_us, report.updates, report.rejected, report.failed,
+               report.duty_ppm / 10000, report.duty_ppm / 100 % 100);
+    }
+}
+
+static void Scenario_Stats(void)
+{
+    audio_stats_t audio;
+    led_stats_t led;
+    finger_identify_t finger;
+    flash_stats_t flash;
+    pin_matcher_stats_t pins;
+    wifi_stats_t wifi;
+    ble_proto_stats_t proto;
+
+    Audio_GetStats(&audio);
+    BleProto_GetStats(&proto);
+    Wifi_GetStats(&wifi);
+    PinMatcher_GetStats(&pins);
+    LED_GetStats(&led);
+    Finger_GetLastIdentify(&finger);
+    Flash_GetStats(&flash);
+
+    printf("---- stats @ +%" PRId64 " ms ----\r\n", (esp_timer_get_time() - scenario_start_us) / 1000);
+    printf("keyboard read: last %" PRIu32 " us, max %" PRIu32 " us\r\n", Keyboard_LastReadUs(), Keyboard_MaxReadUs());
+    printf("audio: played %" PRIu32 ", coalesced %" PRIu32 ", dropped %" PRIu32 "\r\n", audio.played, audio.coalesced, audio.dropped);
+    printf("led: commits %" PRIu32 ", skipped %" PRIu32 ", retries %" PRIu32 "\r\n", led.commits, led.skipped, led.retries);
+    printf("finger: page %d, score %u, %s, capture %" PRIu32 " us, extract %" PRIu32 " us, search %" PRIu32 " us, total %" PRIu32 " us\r\n",
+           finger.page_id, finger.score, finger.auto_identify ? "auto" : "step",
+           finger.capture_us, finger.extract_us, finger.search_us, finger.total_us);
+    printf("password: verifies %" PRIu32 ", last %" PRIu32 " us, max %" PRIu32 " us, updates %" PRIu32 ", nvs commits %" PRIu32 ", generation %" PRIu32 "\r\n",
+           flash.verifies, flash.last_verify_us, flash.max_verify_us, flash.updates, flash.nvs_commits, flash.generation);
+    printf("credentials: %" PRIu32 ", max probe %" PRIu32 ", nvs commits %" PRIu32 "\r\n",
+           flash.credentials, flash.cred_max_probe, flash.cred_commits);
+    printf("pin matcher: %" PRIu32 " pins, %" PRIu32 " states, %" PRIu32 " rebuilds, last build %" PRIu32 " us, max step %" PRIu32 " us\r\n",
+           pins.patterns, pins.states, pins.rebuilds, pins.last_build_us, pins.max_step_us);
+    printf("wifi: %s, attempts %" PRIu32 ", connects %" PRIu32 " (%" PRIu32 " cached, %" PRIu32 " lease reused), cache misses %" PRIu32 ", disconnects %" PRIu32 ", last connect %" PRIu32 " ms, last reconnect %" PRIu32 " ms\r\n",
+           Wifi_IsConnected() ? "up" : "down", wifi.attempts, wifi.connects, wifi.fast_connects, wifi.lease_reuses, wifi.cache_misses,
+           wifi.disconnects, wifi.last_connect_ms, wifi.last_reconnect_ms);
+    printf("ble proto: frames %" PRIu32 ", retransmits %" PRIu32 ", errors %" PRIu32 ", last %" PRIu32 " us, max %" PRIu32 " us\r\n",
+           proto.frames, proto.retransmits, proto.errors, proto.last_us, proto.max_us);
+    Scenario_BleAdvReport();
+    Scenario_BleConnReport();
+    printf("boot: unlock ready %" PRId64 " ms, first unlock %" PRId64 " ms\r\n", Boot_UnlockReadyUs() / 1000, Boot_FirstUnlockUs() / 1000);
+    printf("motor: phase %d\r\n", Motor_GetPhase());
+    LED_SimDump();
+    Audio_SimDump();
+}
+
+// 访客密码表校验耗时：分别装入 10、1000、10000 个密码，测命中和未命中的平均/最长耗时
+#define SCENARIO_BENCH_VERIFIES 2000
+
+static void Scenario_CredentialBench(void)
+{
+    static const uint32_t sizes[] = {10, 1000, 10000};
+    char pin[FLASH_CRED_MAX_DIGITS + 1];
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint32_t n      = sizes[s];
+        uint32_t errors = 0;
+        if (n > FLASH_CRED_MAX) {
+            printf("credbench: %" PRIu32 " exceeds CONFIG_CREDENTIAL_MAX\r\n", n);
+            continue;
+        }
+        // 7919 与 10^8 互质，生成的 8 位密码互不相同
+        Flash_CredentialClear();
+        for (uint32_t i = 0; i < n; i++) {
+            snprintf(pin, sizeof(pin), "%08" PRIu32, (i * 7919u + 12345678u) % 100000000u);
+            Flash_CredentialAdd(pin, 8, SCHEDULE_ALWAYS);
+        }
+
+        for (int hit = 1; hit >= 0; hit--) {
+            int64_t total = 0;
+            int64_t max   = 0;
+            for (uint32_t i = 0; i < SCENARIO_BENCH_VERIFIES; i++) {
+                // 未命中用 7 位密码，编码不可能出现在表中
+                if (hit) {
+                    snprintf(pin, sizeof(pin), "%08" PRIu32, ((i % n) * 7919u + 12345678u) % 100000000u);
+                } else {
+                    snprintf(pin, sizeof(pin), "%07" PRIu32, i);
+                }
+                int64_t start = esp_timer_get_time();
+                uint8_t ok    = Flash_VerifyPassword(pin, strlen(pin));
+                int64_t us    = esp_timer_get_time() - start;
+                total += us;
+                if (us > max) max = us;
+                if (ok != hit && errors++ < 10) {
+                    printf("credbench: unexpected result for %s\r\n", pin);
+                }
+            }
+            printf("credbench: %5" PRIu32 " credentials, %s: avg %" PRId64 " ns, max %" PRId64 " us\r\n",
+                   n, hit ? "hit " : "miss", total * 1000 / SCENARIO_BENCH_VERIFIES, max);
+        }
+        printf("credbench: %5" PRIu32 " credentials: %s, %" PRIu32 " wrong results\r\n", n, Scenario_Check(errors == 0), errors);
+    }
+    // 恢复已保存的表
+    Flash_CredentialAbort();
+}
+
+/*
+ * 时间表测试：对几个时区（含夏令时和半小时时区）在两年内每 15 分钟及其前后 1 秒，
+ * 比较编译后的位图 + 小时缓存与直接用 localtime_r 按规则计算的结果，
+ * 然后测量一次检查的耗时。测试会覆盖 1~4 号时间表，结束后从 NVS 恢复。
+ */
+#define SCENARIO_SCHED_FROM  1767225600 // 2026-01-01 00:00 UTC
+#define SCENARIO_SCHED_TO    1830297600 // 2028-01-01 00:00 UTC
+#define SCENARIO_SCHED_STEP  900
+#define SCENARIO_SCHED_BENCH 100000
+
+typedef struct {
+    const char *spec;
+    uint8_t days; // bit0 为周一
+    uint8_t from;
+    uint8_t to;
+    int32_t from_day; // 0 表示不限
+    int32_t until_day;
+} scenario_sched_case_t;
+
+static uint8_t Scenario_SchedReference(const scenario_sched_case_t *c, time_t t)
+{
+    struct tm tm;
+    localtime_r(&t, &tm);
+    int32_t day  = Schedule_DaysFromCivil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday);
+    uint8_t wday = (tm.tm_wday + 6) % 7;
+    uint8_t prev = (wday + 6) % 7;
+    uint8_t hour = tm.tm_hour;
+
+    if (c->from_day && (day < c->from_day || day > c->until_day)) return 0;
+    if (c->from < c->to) {
+        return (c->days >> wday & 1) && hour >= c->from && hour < c->to;
+    }
+    // 跨过午夜：前一天开始的时段延续到今天
+    return ((c->days >> wday & 1) && hour >= c->from) || ((c->days >> prev & 1) && hour < c->to);
+}
+
+static void Scenario_ScheduleTest(void)
+{
+    static const char *zones[] = {
+        "CST-8",
+        "CET-1CEST,M3.5.0,M10.5.0/3",
+        "EST5EDT,M3.2.0,M11.1.0",
+        "ACST-9:30ACDT,M10.1.0,M4.1.0/3",
+    };
+    scenario_sched_case_t cases[] = {
+        {"12345 09-18@20260301-20261130", 0x1F, 9, 18, Schedule_DaysFromCivil(2026, 3, 1), Schedule_DaysFromCivil(2026, 11, 30)},
+        {"67 22-06", 0x60, 22, 6, 0, 0},
+        {"3 00-24", 0x04, 0, 24, 0, 0},
+        {"@20261025-20261026", 0x7F, 0, 24, Schedule_DaysFromCivil(2026, 10, 25), Schedule_DaysFromCivil(2026, 10, 26)},
+    };
+    const uint8_t ncases = sizeof(cases) / sizeof(cases[0]);
+    uint32_t checks      = 0;
+    uint32_t mismatches  = 0;
+
+    for (uint8_t i = 0; i < ncases; i++) {
+        schedule_t schedule;
+        if (Schedule_Compile(cases[i].spec, strlen(cases[i].spec), &schedule) != 0) {
+            printf("schedtest: cannot compile \"%s\": %s\r\n", cases[i].spec, Scenario_Check(0));
+            Flash_CredentialAbort();
+            return;
+        }
+        Schedule_Set(i + 1, &schedule);
+    }
+
+    for (size_t z = 0; z < sizeof(zones) / sizeof(zones[0]); z++) {
+        Schedule_SetTimezone(zones[z]);
+        for (time_t t = SCENARIO_SCHED_FROM; t < SCENARIO_SCHED_TO; t += SCENARIO_SCHED_STEP) {
+            for (time_t u = t - 1; u <= t + 1; u++) {
+                for (uint8_t i = 0; i < ncases; i++) {
+                    checks++;
+                    if (Schedule_AllowsAt(i + 1, u) != Scenario_SchedReference(&cases[i], u)) {
+                        if (mismatches++ < 10) {
+                            printf("schedtest: %s \"%s\" mismatch at %" PRId64 "\r\n", zones[z], cases[i].spec, (int64_t)u);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    // 时钟未校准时受限的时间表一律拒绝
+    if (Schedule_AllowsAt(3, 0) || !Schedule_AllowsAt(SCHEDULE_ALWAYS, 0)) {
+        mismatches++;
+    }
+    printf("schedtest: %" PRIu32 " checks, %" PRIu32 " mismatches: %s\r\n", checks, mismatches, Scenario_Check(mismatches == 0));
+
+    // 耗时：缓存命中的检查和每次都换算本地时间的对照
+    int64_t start = esp_timer_get_time();
+    uint32_t hits = 0;
+    for (uint32_t i = 0; i < SCENARIO_SCHED_BENCH; i++) {
+        hits += Schedule_Allows(2);
+    }
+    int64_t cached = esp_timer_get_time() - start;
+    start          = esp_timer_get_time();
+    for (uint32_t i = 0; i < SCENARIO_SCHED_BENCH; i++) {
+        hits += Scenario_SchedReference(&cases[1], time(NULL));
+    }
+    int64_t reference = esp_timer_get_time() - start;
+    printf("schedtest: check avg %" PRId64 " ns (localtime_r per check: %" PRId64 " ns), %" PRIu32 " allowed\r\n",
+           cached * 1000 / SCENARIO_SCHED_BENCH, reference * 1000 / SCENARIO_SCHED_BENCH, hits);
+
+    Schedule_SetTimezone(CONFIG_LOCK_TIMEZONE);
+    Flash_CredentialAbort();
+}
+
+/*
+ * 按键匹配器测试：装入 10、1000、10000 个 6 位访客密码，再用 8 位密码装满整个密码表（状态最多的情况，
+ * 自动机必须建成），输入一段伪随机数字序列，每一位都和参考实现比较（对最近 4~8 位的每个后缀直接查密码表），
+ * 并统计每次按键的耗时。测试和按键任务共用同一个匹配器，运行期间不要输入按键；结束后从 NVS 恢复密码表。
+ */
+#define SCENARIO_PIN_DIGITS 20000
+
+static uint8_t Scenario_PinReference(const char *history, uint8_t length)
+{
+    for (uint8_t n = FLASH_CRED_MIN_DIGITS; n <= FLASH_CRED_MAX_DIGITS && n <= length; n++) {
+        if (Flash_VerifyPassword(history + FLASH_CRED_MAX_DIGITS - n, n)) return 1;
+    }
+    return 0;
+}
+
+static void Scenario_PinTest(void)
+{
+    // 密码数和位数，0 表示装满密码表
+    static const struct {
+        uint32_t count;
+        uint8_t digits;
+    } sizes[] = {{10, 6}, {1000, 6}, {10000, 6}, {0, 8}};
+    char pin[FLASH_CRED_MAX_DIGITS + 1];
+
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint32_t n   = sizes[s].count ? sizes[s].count : FLASH_CRED_MAX;
+        uint32_t mod = sizes[s].digits == 8 ? 100000000u : 1000000u;
+        if (n > FLASH_CRED_MAX) {
+            printf("pintest: %" PRIu32 " exceeds CONFIG_CREDENTIAL_MAX\r\n", n);
+            continue;
+        }
+        Flash_CredentialClear();
+        for (uint32_t i = 0; i < n; i++) {
+            // 8 位密码乘一个大数，让前缀尽量分散
+            uint32_t value = sizes[s].digits == 8 ? (i * 48271u + 24681357u) % mod : (i * 7919u + 123457u) % mod;
+            snprintf(pin, sizeof(pin), "%0*" PRIu32, sizes[s].digits, value);
+            Flash_CredentialAdd(pin, sizes[s].digits, SCHEDULE_ALWAYS);
+        }
+
+        // 夹在其他数字中间的密码（第一个密码）
+        char masked[FLASH_CRED_MAX_DIGITS + 5];
+        snprintf(masked, sizeof(masked), "93%0*" PRIu32 "07", sizes[s].digits, sizes[s].digits == 8 ? 24681357u : 123457u);
+        PinMatcher_Reset();
+        uint32_t errors = 0;
+        for (const char *c = masked; *c; c++) {
+            pin_match_result_t result = PinMatcher_Feed(*c - '0');
+            if ((result == PIN_MATCH_OK) != (c == masked + 1 + sizes[s].digits)) errors++;
+            if (result == PIN_MATCH_OK) break;
+        }
+
+        // 伪随机序列：参考实现保存最近 8 位（仅用于测试）
+        char history[FLASH_CRED_MAX_DIGITS] = {0};
+        uint8_t length = 0;
+        uint32_t seed  = 12345;
+        uint32_t found = 0;
+        int64_t total  = 0;
+        int64_t max    = 0;
+        PinMatcher_Reset();
+        for (uint32_t i = 0; i < SCENARIO_PIN_DIGITS; i++) {
+            seed          = seed * 1103515245u + 12345u;
+            uint8_t digit = (seed >> 16) % 10;
+
+            memmove(history, history + 1, sizeof(history) - 1);
+            history[sizeof(history) - 1] = '0' + digit;
+            length++;
+            uint8_t expect = Scenario_PinReference(history, length);
+
+            int64_t start             = esp_timer_get_time();
+            pin_match_result_t result = PinMatcher_Feed(digit);
+            int64_t us                = esp_timer_get_time() - start;
+            total += us;
+            if (us > max) max = us;
+
+            if ((result == PIN_MATCH_OK) != expect) {
+                if (errors++ < 10) {
+                    printf("pintest: mismatch at digit %" PRIu32 "\r\n", i);
+                }
+            }
+            if (expect || length >= CONFIG_PIN_MAX_SEQUENCE) {
+                length = 0;
+            }
+            found += expect;
+        }
+
+        pin_matcher_stats_t stats;
+        PinMatcher_GetStats(&stats);
+        // 自动机必须建成，不能退化
+        if (stats.states == 0 || stats.patterns < n) errors++;
+        printf("pintest: %5" PRIu32 " pins, %6" PRIu32 " states, build %" PRIu32 " us, %" PRIu32 " matches, %" PRIu32 " errors, "
+               "key avg %" PRId64 " ns, max %" PRId64 " us: %s\r\n",
+               stats.patterns, stats.states, stats.last_build_us, found, errors, total * 1000 / SCENARIO_PIN_DIGITS, max, Scenario_Check(errors == 0));
+    }
+    Flash_CredentialAbort();
+    PinMatcher_Reset();
+}
+
+/*
+ * 电机时序测试：在 GPIO 输出变化时记下电机阶段和时间，检查正转、停止、反转的时长与阶段表一致；
+ * 流程进行中的请求合并（返回 1），每个回调只调用一次，回调挂满 MOTOR_MAX_WAITERS 个后返回 2。
+ */
+#define SCENARIO_MOTOR_TOLERANCE_MS 20
+#define SCENARIO_MOTOR_MERGE_MS     500
+
+static volatile motor_phase_t scenario_motor_last;
+static int64_t scenario_motor_at[MOTOR_PHASE_REVERSE + 2]; // 各阶段开始的时间，最后一项为回到空闲
+static volatile uint32_t scenario_motor_calls[MOTOR_MAX_WAITERS + 1];
+
+static void Scenario_MotorHook(gpio_num_t gpio_num, uint32_t level)
+{
+    motor_phase_t phase = Motor_GetPhase();
+    if (phase == scenario_motor_last) return;
+    scenario_motor_last = phase;
+    scenario_motor_at[phase == MOTOR_PHASE_IDLE ? MOTOR_PHASE_REVERSE + 1 : phase] = esp_timer_get_time();
+}
+
+static void Scenario_MotorDone(void *arg)
+{
+    scenario_motor_calls[(uintptr_t)arg]++;
+}
+
+static uint8_t Scenario_MotorWaitIdle(void)
+{
+    uint32_t total_ms = 0;
+    for (int i = MOTOR_PHASE_FORWARD; i <= MOTOR_PHASE_REVERSE; i++) {
+        total_ms += Motor_PhaseDurationMs(i);
+    }
+    for (uint32_t waited = 0; Motor_GetPhase() != MOTOR_PHASE_IDLE; waited += 10) {
+        if (waited > total_ms + 1000) return 0;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return 1;
+}
+
+static void Scenario_MotorTest(void)
+{
+    uint8_t ret[MOTOR_MAX_WAITERS + 1];
+    uint8_t ok;
+
+    // 前面的开锁流程先走完
+    if (!Scenario_MotorWaitIdle()) {
+        printf("motortest: motor never idle: %s\r\n", Scenario_Check(0));
+        return;
+    }
+    memset(scenario_motor_at, 0, sizeof(scenario_motor_at));
+    memset((void *)scenario_motor_calls, 0, sizeof(scenario_motor_calls));
+    scenario_motor_last = MOTOR_PHASE_IDLE;
+    Gpio_SimSetOutputHook(Scenario_MotorHook);
+
+    ret[0] = Motor_OpenLockAsync(Scenario_MotorDone, (void *)0);
+    vTaskDelay(pdMS_TO_TICKS(SCENARIO_MOTOR_MERGE_MS));
+    for (uintptr_t i = 1; i <= MOTOR_MAX_WAITERS; i++) {
+        ret[i] = Motor_OpenLockAsync(Scenario_MotorDone, (void *)i);
+    }
+    ok = Scenario_MotorWaitIdle();
+    // 回调在阶段定时器中调用，多等一会儿确认没有重复调用
+    vTaskDelay(pdMS_TO_TICKS(SCENARIO_MOTOR_MERGE_MS));
+    Gpio_SimSetOutputHook(NULL);
+    printf("motortest: cycle finished: %s\r\n", Scenario_Check(ok));
+
+    for (int i = MOTOR_PHASE_FORWARD; i <= MOTOR_PHASE_REVERSE; i++) {
+        int64_t ms    = scenario_motor_at[i] && scenario_motor_at[i + 1] ? (scenario_motor_at[i + 1] - scenario_motor_at[i]) / 1000 : -1;
+        int64_t error = ms - (int64_t)Motor_PhaseDurationMs(i);
+        ok            = ms >= 0 && error >= -SCENARIO_MOTOR_TOLERANCE_MS && error <= SCENARIO_MOTOR_TOLERANCE_MS;
+        printf("motortest: phase %d lasted %" PRId64 " ms (table %" PRIu32 " ms): %s\r\n", i, ms, Motor_PhaseDurationMs(i), Scenario_Check(ok));
+    }
+
+    // 第一个请求开始流程，之后的合并，挂满之后的一个不会回调
+    ok = ret[0] == 0;
+    for (int i = 1; i <= MOTOR_MAX_WAITERS; i++) {
+        ok &= ret[i] == (i < MOTOR_MAX_WAITERS ? 1 : 2);
+    }
+    printf("motortest: request results %u", ret[0]);
+    for (int i = 1; i <= MOTOR_MAX_WAITERS; i++) {
+        printf(" %u", ret[i]);
+    }
+    printf(": %s\r\n", Scenario_Check(ok));
+
+    ok = 1;
+    for (int i = 0; i <= MOTOR_MAX_WAITERS; i++) {
+        ok &= scenario_motor_calls[i] == (i < MOTOR_MAX_WAITERS ? 1 : 0);
+    }
+    printf("motortest: each callback once, overflow never: %s\r\n", Scenario_Check(ok));
+}
+
+/*
+ * 指纹指令测试：指令表中每条指令发出的指令包与手册中的指令包逐字节比较（包括编译期算出的校验和），
+ * 再用脚本应答检查 Finger_Exec 对成功、错误确认码、应答过短、校验和错误、分两次到达的应答的处理。
+ * 指纹任务需要空闲，不要和 touch 同时使用。
+ */
+typedef struct {
+    uint8_t code;
+    uint8_t params[3];
+    uint8_t frame[17]; // 指令包
+    uint8_t frame_len;
+    uint8_t reply_len; // 成功应答中确认码之后的数据字节数
+    uint8_t error;     // 测试用的错误确认码
+} scenario_finger_case_t;
+
+#define SCENARIO_FINGER_HEAD 0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x01
+
+static const scenario_finger_case_t scenario_finger_cases[] = {
+    {0x01, {0}, {SCENARIO_FINGER_HEAD, 0x00, 0x03, 0x01, 0x00, 0x05}, 12, 0, 0x02},
+    {0x02, {0x01}, {SCENARIO_FINGER_HEAD, 0x00, 0x04, 0x02, 0x01, 0x00, 0x08}, 13, 0, 0x06},
+    {0x04, {0}, {SCENARIO_FINGER_HEAD, 0x00, 0x08, 0x04, 0x01, 0x00, 0x00, 0xFF, 0xFF, 0x02, 0x0C}, 17, 4, 0x09},
+    {0x05, {0}, {SCENARIO_FINGER_HEAD, 0x00, 0x03, 0x05, 0x00, 0x09}, 12, 0, 0x0a},
+    {0x06, {0x01, 0x00, 0x03}, {SCENARIO_FINGER_HEAD, 0x00, 0x06, 0x06, 0x01, 0x00, 0x03, 0x00, 0x11}, 15, 0, 0x0b},
+    {0x0E, {0x07, 0x00}, {SCENARIO_FINGER_HEAD, 0x00, 0x05, 0x0E, 0x07, 0x00, 0x00, 0x1B}, 14, 0, 0x1a},
+    {0x1D, {0}, {SCENARIO_FINGER_HEAD, 0x00, 0x03, 0x1D, 0x00, 0x21}, 12, 2, 0x01},
+    {0x33, {0}, {SCENARIO_FINGER_HEAD, 0x00, 0x03, 0x33, 0x00, 0x37}, 12, 0, 0x01},
+    {0x34, {0x00}, {SCENARIO_FINGER_HEAD, 0x00, 0x04, 0x34, 0x00, 0x00, 0x39}, 13, 32, 0x01},
+};
+
+// 组一个应答包：确认码 + data_len 字节数据（1, 2, 3...），返回包长度
+static size_t Scenario_FingerReply(uint8_t *reply, uint8_t confirm, uint8_t data_len)
+{
+    static const uint8_t head[] = {0xEF, 0x01, 0xFF, 0xFF, 0xFF, 0xFF, 0x07};
+    uint16_t pkt_len            = 1 + data_len + 2;
+    size_t n                    = sizeof(head);
+
+    memcpy(reply, head, sizeof(head));
+    reply[n++] = pkt_len >> 8;
+    reply[n++] = pkt_len & 0xFF;
+    reply[n++] = confirm;
+    for (uint8_t i = 0; i < data_len; i++) {
+        reply[n++] = i + 1;
+    }
+    uint16_t checksum = 0;
+    for (size_t i = 6; i < n; i++) {
+        checksum += reply[i];
+    }
+    reply[n++] = checksum >> 8;
+    reply[n++] = checksum & 0xFF;
+    return n;
+}
+
+// 用脚本应答执行一条指令，data 先清零
+static int8_t Scenario_FingerRun(const scenario_finger_case_t *c, const uint8_t *reply, size_t len, size_t split, uint8_t *data)
+{
+    memset(data, 0, FINGER_PACKET_MAX);
+    Finger_SimScript(reply, len, split);
+    return Finger_SimExec(c->code, c->params, data);
+}
+
+// 成功应答的数据是否原样拷贝出来，且没有多拷贝
+static uint8_t Scenario_FingerDataOk(const scenario_finger_case_t *c, const uint8_t *data)
+{
+    for (uint8_t i = 0; i < FINGER_PACKET_MAX; i++) {
+        if (data[i] != (i < c->reply_len ? i + 1 : 0)) return 0;
+    }
+    return 1;
+}
+
+static void Scenario_FingerTest(void)
+{
+    uint8_t reply[FINGER_PACKET_MAX];
+    uint8_t data[FINGER_PACKET_MAX];
+    uint8_t cmd[FINGER_PACKET_MAX];
+
+    for (size_t i = 0; i < sizeof(scenario_finger_cases) / sizeof(scenario_finger_cases[0]); i++) {
+        const scenario_finger_case_t *c = &scenario_finger_cases[i];
+        size_t len, cmd_len;
+        int8_t ret;
+        uint8_t ok;
+
+        // 成功，同时检查发出的指令包
+        len     = Scenario_FingerReply(reply, 0x00, c->reply_len);
+        ret     = Scenario_FingerRun(c, reply, len, 0, data);
+        cmd_len = Finger_SimLastCommand(cmd);
+        ok      = cmd_len == c->frame_len && !memcmp(cmd, c->frame, cmd_len);
+        printf("fingertest: 0x%02x frame: %s\r\n", c->code, Scenario_Check(ok));
+        printf("fingertest: 0x%02x success -> %d: %s\r\n", c->code, ret, Scenario_Check(ret == 0 && Scenario_FingerDataOk(c, data)));
+
+        // 错误确认码原样返回，不拷贝数据
+        len = Scenario_FingerReply(reply, c->error, 0);
+        ret = Scenario_FingerRun(c, reply, len, 0, data);
+        ok  = ret == c->error && data[0] == 0;
+        printf("fingertest: 0x%02x error 0x%02x -> %d: %s\r\n", c->code, c->error, ret, Scenario_Check(ok));
+
+        // 应答过短：有数据的指令少一个数据字节，没有数据的指令只收到半个包
+        if (c->reply_len) {
+            len = Scenario_FingerReply(reply, 0x00, c->reply_len - 1);
+        } else {
+            len = Scenario_FingerReply(reply, 0x00, 0) / 2;
+        }
+        ret = Scenario_FingerRun(c, reply, len, 0, data);
+        printf("fingertest: 0x%02x short reply -> %d: %s\r\n", c->code, ret, Scenario_Check(ret == -1 && data[0] == 0));
+
+        // 校验和错误的包被丢弃，等到超时
+        len = Scenario_FingerReply(reply, 0x00, c->reply_len);
+        reply[len - 1] ^= 0xFF;
+        ret = Scenario_FingerRun(c, reply, len, 0, data);
+        printf("fingertest: 0x%02x bad checksum -> %d: %s\r\n", c->code, ret, Scenario_Check(ret == -1 && data[0] == 0));
+
+        // 应答分两次到达，从包长度字段中间分开
+        len = Scenario_FingerReply(reply, 0x00, c->reply_len);
+        ret = Scenario_FingerRun(c, reply, len, FINGER_HEADER_LEN - 1, data);
+        printf("fingertest: 0x%02x split reply -> %d: %s\r\n", c->code, ret, Scenario_Check(ret == 0 && Scenario_FingerDataOk(c, data)));
+    }
+}
+
+/*
+ * WiFi 重连测试：作为后台使用者打开 WiFi，依次模拟信号丢失（缓存的 AP 仍然可用）、
+ * AP 换信道（缓存失效，退回完整扫描）和 AP 断电一段时间（退避重试），
+ * 打印每次从断开到重新拿到 IP 的时间。信号丢失后应当直连缓存的 AP 并沿用租约，
+ * 换信道后应当有一次缓存未命中。结束后 AP 回到原来的信道，
+ * 再模拟一次 OTA（活跃使用者）后释放 WiFi，打印各射频状态的时间和估算耗电。
+ */
+#define SCENARIO_WIFI_TIMEOUT_MS 60000
+#define SCENARIO_WIFI_OUTAGE_MS  8000
+#define SCENARIO_WIFI_CHANNEL    6
+#define SCENARIO_WIFI_ACTIVE_MS  2000
+#define SCENARIO_WIFI_IDLE_MS    5000
+
+static void Scenario_WifiPower(void)
+{
+    wifi_power_report_t report;
+    Wifi_GetPowerReport(&report);
+    printf("wifi power: %s, %" PRIu32 " transitions, average %" PRIu32 " uA\r\n",
+           Wifi_PowerStateName(report.state), report.transitions, report.average_ua);
+    for (int i = 0; i < WIFI_POWER_STATES; i++) {
+        printf("  %-10s %8" PRIu64 " ms %6" PRIu32 " uAh\r\n", Wifi_PowerStateName(i), report.time_ms[i], report.charge_uah[i]);
+    }
+}
+
+static void Scenario_WifiTest(void)
+{
+    static const char *steps[] = {"signal lost", "channel moved", "ap outage"};
+    wifi_stats_t before;
+    wifi_stats_t after;
+
+    Wifi_Acquire(WIFI_DEMAND_BACKGROUND);
+    if (!Wifi_WaitConnected(pdMS_TO_TICKS(SCENARIO_WIFI_TIMEOUT_MS))) {
+        printf("wifitest: not connected: %s\r\n", Scenario_Check(0));
+        Wifi_Release(WIFI_DEMAND_BACKGROUND);
+        return;
+    }
+    Wifi_GetStats(&after);
+    printf("wifitest: first connect %" PRIu32 " ms (%s)\r\n", after.last_connect_ms, after.fast_connects ? "cached AP" : "full scan");
+
+    for (size_t i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+        Wifi_GetStats(&before);
+        if (i == 0) {
+            Wifi_SimDrop();
+        } else if (i == 1) {
+            Wifi_SimSetChannel(SCENARIO_WIFI_CHANNEL + 5);
+        } else {
+            Wifi_SimSetAp(0);
+        }
+        Wifi_WaitDisconnected(pdMS_TO_TICKS(SCENARIO_WIFI_TIMEOUT_MS));
+        if (i == 2) {
+            vTaskDelay(pdMS_TO_TICKS(SCENARIO_WIFI_OUTAGE_MS));
+            Wifi_SimSetAp(1);
+        }
+        uint8_t ok = Wifi_WaitConnected(pdMS_TO_TICKS(SCENARIO_WIFI_TIMEOUT_MS));
+        Wifi_GetStats(&after);
+        uint32_t misses = after.cache_misses - before.cache_misses;
+        if (i == 0) {
+            ok &= misses == 0 && after.lease_reuses > before.lease_reuses;
+        } else if (i == 1) {
+            ok &= misses > 0;
+        }
+        printf("wifitest: %-13s reconnect %5" PRIu32 " ms, %" PRIu32 " attempts, %" PRIu32 " cache misses, %" PRIu32 " lease reused, last backoff %" PRIu32 " ms: %s\r\n",
+               steps[i], after.last_reconnect_ms, after.attempts - before.attempts, misses, after.lease_reuses - before.lease_reuses,
+               after.last_backoff_ms, Scenario_Check(ok));
+    }
+
+    Wifi_SimSetChannel(SCENARIO_WIFI_CHANNEL);
+    Wifi_WaitDisconnected(pdMS_TO_TICKS(SCENARIO_WIFI_TIMEOUT_MS));
+    Wifi_WaitConnected(pdMS_TO_TICKS(SCENARIO_WIFI_TIMEOUT_MS));
+
+    // 活跃使用一段时间，然后释放全部使用者，射频关闭
+    Wifi_Acquire(WIFI_DEMAND_ACTIVE);
+    vTaskDelay(pdMS_TO_TICKS(SCENARIO_WIFI_ACTIVE_MS));
+    Wifi_Release(WIFI_DEMAND_ACTIVE);
+    Wifi_Release(WIFI_DEMAND_BACKGROUND);
+    Wifi_WaitDisconnected(pdMS_TO_TICKS(SCENARIO_WIFI_TIMEOUT_MS));
+    vTaskDelay(pdMS_TO_TICKS(SCENARIO_WIFI_IDLE_MS));
+    Scenario_WifiPower();
+}
+
+/*
+ * 蓝牙命令协议测试：
+ *  - 重发同一个序号的请求只回复不执行
+ *  - 空请求（PING）的处理速度
+ *  - 下发 1000 个 8 位访客密码：二进制批量（每次写入 100 个）和字符串命令（每次 50 个）
+ *    分别需要的写入次数、字节数和时间，两种方式都应当装入 1000 个；
+ *    用新序号重发最后一批应当成功且数量不变。结束后从 NVS 恢复密码表。
+ */
+#define SCENARIO_PROTO_PINGS      2000
+#define SCENARIO_PROTO_CREDS      1000
+#define SCENARIO_PROTO_BATCH      100
+#define SCENARIO_PROTO_TEXT_BATCH 50
+
+static uint8_t Scenario_ProtoFrame(uint8_t *frame, uint8_t seq, uint8_t op, uint16_t len)
+{
+    frame[0] = BLE_PROTO_VERSION;
+    frame[1] = seq;
+    frame[2] = op;
+    frame[3] = len;
+    frame[4] = len >> 8;
+    return BLE_PROTO_REQ_HEADER;
+}
+
+static void Scenario_ProtoBench(void)
+{
+    static uint8_t frame[BLE_PROTO_MAX_FRAME];
+    static char text[BLE_PROTO_MAX_FRAME];
+    uint8_t rsp[BLE_PROTO_RSP_HEADER + BLE_PROTO_RSP_MAX];
+    ble_proto_stats_t before, after;
+    char pin[FLASH_CRED_MAX_DIGITS + 1];
+    uint8_t seq = 0;
+
+    // 重发：重新连接，新会话的重发识别记录是空的
+    Bluetooth_SimConnect(0);
+    BleProto_GetStats(&before);
+    Scenario_ProtoFrame(frame, 0x42, BLE_OP_PING, 0);
+    Bluetooth_SimWriteRaw(frame, BLE_PROTO_REQ_HEADER);
+    Bluetooth_SimWriteRaw(frame, BLE_PROTO_REQ_HEADER);
+    BleProto_GetStats(&after);
+    printf("protobench: retransmit %s\r\n", Scenario_Check(after.frames - before.frames == 1 && after.retransmits - before.retransmits == 1));
+
+    // 长度字段接近 0xFFFF：加上包头不能回绕，只回一个长度错误，不处理任何帧
+    static const uint16_t huge[] = {0xFFFB, 0xFFFF};
+    for (size_t i = 0; i < sizeof(huge) / sizeof(huge[0]); i++) {
+        const uint8_t bad[BLE_PROTO_REQ_HEADER] = {BLE_PROTO_VERSION, 0x00, 0x00, huge[i] & 0xFF, huge[i] >> 8};
+        BleProto_GetStats(&before);
+        Bluetooth_SimWriteRaw(bad, sizeof(bad));
+        BleProto_GetStats(&after);
+        uint8_t ok = Bluetooth_SimLastNotify(rsp, sizeof(rsp)) == BLE_PROTO_RSP_HEADER && rsp[3] == BLE_STATUS_BAD_LENGTH;
+        ok &= after.frames == before.frames && after.errors - before.errors == 1;
+        printf("protobench: length 0x%04x %s\r\n", huge[i], Scenario_Check(ok));
+    }
+
+    Bluetooth_SimSetEcho(0);
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < SCENARIO_PROTO_PINGS; i++) {
+        Scenario_ProtoFrame(frame, seq++, BLE_OP_PING, 0);
+        Bluetooth_SimWriteRaw(frame, BLE_PROTO_REQ_HEADER);
+    }
+    int64_t us = esp_timer_get_time() - start;
+    printf("protobench: ping %" PRId64 " ns/frame\r\n", us * 1000 / SCENARIO_PROTO_PINGS);
+
+    // 二进制批量
+    uint32_t writes = 0;
+    uint32_t bytes  = 0;
+    uint8_t ok      = 1;
+    Flash_CredentialClear();
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < SCENARIO_PROTO_CREDS; i += SCENARIO_PROTO_BATCH) {
+        uint16_t len = Scenario_ProtoFrame(frame, seq++, BLE_OP_CRED_ADD, SCENARIO_PROTO_BATCH * 5);
+        for (uint32_t j = i; j < i + SCENARIO_PROTO_BATCH; j++) {
+            snprintf(pin, sizeof(pin), "%08" PRIu32, (j * 7919u + 12345678u) % 100000000u);
+            uint32_t code = Flash_CredentialEncode(pin, 8);
+            frame[len++]  = code;
+            frame[len++]  = code >> 8;
+            frame[len++]  = code >> 16;
+            frame[len++]  = code >> 24;
+            frame[len++]  = SCHEDULE_ALWAYS;
+        }
+        Bluetooth_SimWriteRaw(frame, len);
+        ok &= Bluetooth_SimLastNotify(rsp, sizeof(rsp)) >= BLE_PROTO_RSP_HEADER && rsp[3] == BLE_STATUS_OK;
+        writes++;
+        bytes += len;
+    }
+    us = esp_timer_get_time() - start;
+    // 用新的序号重发最后一批：已存在的密码算成功，数量不变
+    frame[1] = seq++;
+    Bluetooth_SimWriteRaw(frame, BLE_PROTO_REQ_HEADER + SCENARIO_PROTO_BATCH * 5);
+    ok &= Bluetooth_SimLastNotify(rsp, sizeof(rsp)) >= BLE_PROTO_RSP_HEADER && rsp[3] == BLE_STATUS_OK;
+    ok &= Flash_CredentialCount() == SCENARIO_PROTO_CREDS;
+    printf("protobench: binary %u credentials, %" PRIu32 " writes, %" PRIu32 " bytes (%" PRIu32 ".%02" PRIu32 " per credential), %" PRId64 " us: %s\r\n",
+           Flash_CredentialCount(), writes, bytes, bytes / SCENARIO_PROTO_CREDS, bytes * 100 / SCENARIO_PROTO_CREDS % 100, us, Scenario_Check(ok));
+    Bluetooth_SimSetEcho(1);
+
+    // 字符串命令
+    writes = 0;
+    bytes  = 0;
+    Flash_CredentialClear();
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < SCENARIO_PROTO_CREDS; i += SCENARIO_PROTO_TEXT_BATCH) {
+        int len = snprintf(text, sizeof(text), "c+:");
+        for (uint32_t j = i; j < i + SCENARIO_PROTO_TEXT_BATCH; j++) {
+            len += snprintf(text + len, sizeof(text) - len, "%s%08" PRIu32, j == i ? "" : ",", (j * 7919u + 12345678u) % 100000000u);
+        }
+        Bluetooth_SimWrite(text);
+        writes++;
+        bytes += len;
+    }
+    us = esp_timer_get_time() - start;
+    printf("protobench: text   %u credentials, %" PRIu32 " writes, %" PRIu32 " bytes (%" PRIu32 ".%02" PRIu32 " per credential), %" PRId64 " us: %s\r\n",
+           Flash_CredentialCount(), writes, bytes, bytes / SCENARIO_PROTO_CREDS, bytes * 100 / SCENARIO_PROTO_CREDS % 100, us,
+           Scenario_Check(Flash_CredentialCount() == SCENARIO_PROTO_CREDS));
+
+    Flash_CredentialAbort();
+}
+
+/*
+ * 连接参数策略测试：连接后等快速参数生效，发 PING；空闲超时后确认切到空闲参数，
+ * 再发 PING（第一条命令要付出空闲参数的等待），然后比较两种参数下的往返时间和占空比。
+ * 切回快速参数的那次请求模拟协议栈不接受，检查稍后重试后仍然切回快速参数。
+ */
+#define SCENARIO_BLE_SETTLE_MS 500
+#define SCENARIO_BLE_RETRY_MS  1500 // 重试间隔 500 ms 加空闲参数下的更新，要短于空闲超时
+
+static uint8_t Scenario_BleConnPing(const char *label, ble_conn_report_t *report)
+{
+    static uint8_t seq = 0x80;
+    uint8_t frame[BLE_PROTO_REQ_HEADER];
+
+    Scenario_ProtoFrame(frame, seq++, BLE_OP_PING, 0);
+    Bluetooth_SimWriteRaw(frame, sizeof(frame));
+    if (!BleConn_GetReport(0, report)) return 0;
+    printf("bleconntest: %-12s rtt %6" PRIu32 " us (interval %u, latency %u)\r\n", label, report->last_rtt_us, report->interval, report->latency);
+    return 1;
+}
+
+static void Scenario_BleConnTest(void)
+{
+    ble_conn_report_t report;
+    uint8_t ok;
+
+    Bluetooth_SimConnect(0);
+    Bluetooth_SimConnect(1);
+    vTaskDelay(pdMS_TO_TICKS(SCENARIO_BLE_SETTLE_MS));
+    ok = Scenario_BleConnPing("fast", &report) && report.mode == BLE_CONN_FAST && report.latency == 0;
+    printf("bleconntest: fast params %s\r\n", Scenario_Check(ok));
+
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_BLE_IDLE_TIMEOUT_MS + SCENARIO_BLE_SETTLE_MS));
+    Scenario_BleConnReport();
+    ok = BleConn_GetReport(0, &report) && report.mode == BLE_CONN_IDLE && report.latency > 0;
+    printf("bleconntest: idle params %s\r\n", Scenario_Check(ok));
+
+    // 这条命令触发的快速参数请求被协议栈拒收，要由空闲定时器重试
+    Bluetooth_SimFailConnParams(1);
+    Scenario_BleConnPing("idle, first", &report);
+    vTaskDelay(pdMS_TO_TICKS(SCENARIO_BLE_RETRY_MS));
+    ok = Scenario_BleConnPing("fast again", &report) && report.mode == BLE_CONN_FAST && report.latency == 0 && report.failed == 1;
+    printf("bleconntest: retry after refused request %s\r\n", Scenario_Check(ok));
+    Scenario_BleConnReport();
+}
+
+// 十六进制字符串（可以有空格）转成字节，返回长度
+static uint16_t Scenario_ParseHex(const char *hex, uint8_t *out, uint16_t size)
+{
+    uint16_t len = 0;
+    while (*hex && len < size) {
+        if (*hex == ' ') {
+            hex++;
+            continue;
+        }
+        unsigned int byte;
+        if (sscanf(hex, "%2x", &byte) != 1) break;
+        out[len++] = byte;
+        hex += hex[1] && hex[1] != ' ' ? 2 : 1;
+    }
+    return len;
+}
+
+static void Scenario_PressKey(char c)
+{
+    uint8_t key;
+    if (c >= '0' && c <= '9') {
+        key = c - '0';
+    } else if (c == '#') {
+        key = 10;
+    } else if (c == 'M') {
+        key = 11;
+    } else {
+        ESP_LOGW(TAG, "unknown key '%c'", c);
+        return;
+    }
+    Keyboard_SimPressKey(key);
+    // 键盘芯片在有按键时拉高中断引脚
+    Gpio_SimSetInput(KEYBOARD_INT_PIN, 1);
+    Gpio_SimSetInput(KEYBOARD_INT_PIN, 0);
+}
+
+/*
+ * 广播调度测试：手机分别在断开后的突发广播、慢速广播和按键触发的突发广播中连接，
+ * 比较连上所需的时间，最后输出广播占空比。每次都要连上，并且只有第二次是从慢速广播连上的
+ * （另外两次是突发广播，已绑定时也可能是定向广播）。
+ */
+static void Scenario_BleAdvTest(void)
+{
+    ble_adv_report_t before;
+    ble_adv_report_t report;
+    static const char *cases[] = {"after disconnect", "slow", "after key press"};
+
+    for (int i = 0; i < 3; i++) {
+        Bluetooth_SimConnect(0);
+        if (i > 0) {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_BLE_ADV_BURST_MS + SCENARIO_BLE_SETTLE_MS));
+        }
+        if (i == 2) {
+            // M 键不影响密码输入和指纹录入
+            Scenario_PressKey('M');
+            vTaskDelay(pdMS_TO_TICKS(SCENARIO_KEY_INTERVAL_MS));
+        }
+        BleAdv_GetReport(&before);
+        Bluetooth_SimConnect(1);
+        BleAdv_GetReport(&report);
+        uint8_t slow = report.path_connects[BLE_ADV_SLOW] != before.path_connects[BLE_ADV_SLOW];
+        uint8_t ok   = report.connects == before.connects + 1 && slow == (i == 1);
+        printf("bleadvtest: %-16s connected in %" PRIu32 " ms (%s advertising): %s\r\n", cases[i], report.last_connect_ms,
+               slow ? "slow" : "fast", Scenario_Check(ok));
+    }
+    Scenario_BleAdvReport();
+}
+
+/*
+ * GATT 缓存测试：手机丢掉缓存后连接（完整服务发现），断开再连（只读数据库哈希），
+ * 比较两次从连上到第一条命令的时间，有缓存时应当更短。
+ */
+static void Scenario_GattTest(void)
+{
+    static const char *cases[] = {"uncached", "cached"};
+    uint8_t frame[BLE_PROTO_REQ_HEADER];
+    ble_conn_report_t report;
+    uint32_t first_ms[2] = {0};
+
+    Bluetooth_SimForgetCache();
+    for (int i = 0; i < 2; i++) {
+        Bluetooth_SimConnect(0);
+        Scenario_ProtoFrame(frame, 0x40 + i, BLE_OP_PING, 0);
+        Bluetooth_SimWriteRaw(frame, sizeof(frame));
+        if (BleConn_GetReport(0, &report)) {
+            first_ms[i] = report.first_command_ms;
+        }
+        printf("gatttest: %-8s first command %" PRIu32 " ms after connect\r\n", cases[i], first_ms[i]);
+    }
+    printf("gatttest: cache saves %" PRId32 " ms: %s\r\n", (int32_t)(first_ms[0] - first_ms[1]),
+           Scenario_Check(first_ms[1] > 0 && first_ms[1] < first_ms[0]));
+}
+
+/*
+ * 绑定快速回连测试：比较以前的行为（手机不配对：普通广播、每次完整服务发现）和
+ * 绑定之后（按键后定向广播、加密、只读数据库哈希）从按键到开锁命令的时间。
+ * 两种情况都从慢速广播开始（人走近时门锁在后台广播），手机在按键后马上开始连接。
+ * 绑定之后应当更快。
+ */
+static void Scenario_BondTest(void)
+{
+    static const char *cases[] = {"anonymous", "bonded"};
+    uint8_t frame[BLE_PROTO_REQ_HEADER];
+    ble_adv_report_t report;
+    uint32_t approach_ms[2] = {0};
+
+    for (int i = 0; i < 2; i++) {
+        Bluetooth_SimSetBonding(i);
+        if (i == 1) {
+            // 第一次连接完成配对和服务发现
+            Bluetooth_SimConnect(0);
+            Bluetooth_SimConnect(1);
+        }
+        Bluetooth_SimConnect(0);
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_BLE_ADV_BURST_MS + SCENARIO_BLE_SETTLE_MS));
+        BleAdv_Activity(BLE_ADV_TRIGGER_KEYPAD);
+        Scenario_ProtoFrame(frame, 0x50 + i, BLE_OP_UNLOCK, 0);
+        Bluetooth_SimWriteRaw(frame, sizeof(frame));
+        BleAdv_GetReport(&report);
+        approach_ms[i] = report.last_approach_ms;
+        printf("bondtest: %-9s key to unlock command %" PRIu32 " ms (connected after %" PRIu32 " ms)\r\n", cases[i], approach_ms[i], report.last_connect_ms);
+    }
+    printf("bondtest: fast reconnect saves %" PRId32 " ms: %s\r\n", (int32_t)(approach_ms[0] - approach_ms[1]),
+           Scenario_Check(approach_ms[1] > 0 && approach_ms[1] < approach_ms[0]));
+    Scenario_BleAdvReport();
+}
+
+/*
+ * 多连接负载测试：n 部手机（默认 BLE_SESSION_MAX 部）同时连着门锁，每部手机一个任务，
+ * 发一条 PING、收到通知后马上发下一条（闭环）。输出总吞吐量、延迟分布（p50 / p99 / 最大），
+ * 以及各手机平均延迟的最小值和最大值（差得越少越公平）。
+ * 一条命令（包括会话队列满时的重试）超过 SCENARIO_LOAD_REPLY_MS 没有响应时这部手机停下，
+ * 检查失败；所有手机都必须完成全部命令。
+ */
+#define SCENARIO_LOAD_COMMANDS 200
+#define SCENARIO_LOAD_REPLY_MS 1000
+
+static SemaphoreHandle_t scenario_load_done[BLE_SESSION_MAX];
+static SemaphoreHandle_t scenario_load_finished = NULL;
+static uint32_t scenario_load_latency[BLE_SESSION_MAX][SCENARIO_LOAD_COMMANDS];
+static uint32_t scenario_load_sorted[BLE_SESSION_MAX * SCENARIO_LOAD_COMMANDS];
+static uint32_t scenario_load_retries[BLE_SESSION_MAX];
+static uint32_t scenario_load_completed[BLE_SESSION_MAX];
+
+static void Scenario_LoadNotify(uint16_t conn_id, const uint8_t *data, size_t len)
+{
+    if (conn_id < BLE_SESSION_MAX && scenario_load_done[conn_id]) {
+        xSemaphoreGive(scenario_load_done[conn_id]);
+    }
+}
+
+static void scenario_load_task(void *arg)
+{
+    uint8_t client = (uintptr_t)arg;
+    uint8_t frame[BLE_PROTO_REQ_HEADER];
+
+    for (uint32_t i = 0; i < SCENARIO_LOAD_COMMANDS; i++) {
+        Scenario_ProtoFrame(frame, i, BLE_OP_PING, 0);
+        int64_t start    = esp_timer_get_time();
+        int64_t deadline = start + (int64_t)SCENARIO_LOAD_REPLY_MS * 1000;
+        uint8_t sent;
+        while (!(sent = Bluetooth_SimClientWrite(client, frame, sizeof(frame))) && esp_timer_get_time() < deadline) {
+            scenario_load_retries[client]++;
+            vTaskDelay(1);
+        }
+        if (!sent || xSemaphoreTake(scenario_load_done[client], pdMS_TO_TICKS(SCENARIO_LOAD_REPLY_MS)) != pdTRUE) {
+            ESP_LOGW(TAG, "loadtest: client %u command %" PRIu32 " timed out", client, i);
+            break;
+        }
+        scenario_load_latency[client][i] = esp_timer_get_time() - start;
+        scenario_load_completed[client]++;
+    }
+    xSemaphoreGive(scenario_load_finished);
+    vTaskDelete(NULL);
+}
+
+static int Scenario_CompareU32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void Scenario_LoadTest(const char *arg)
+{
+    ble_session_report_t report;
+    uint8_t clients = *arg ? atoi(arg) : BLE_SESSION_MAX;
+
+    if (clients == 0 || clients > BLE_SESSION_MAX) clients = BLE_SESSION_MAX;
+    if (scenario_load_finished == NULL) {
+        scenario_load_finished = xSemaphoreCreateCounting(BLE_SESSION_MAX, 0);
+        for (int i = 0; i < BLE_SESSION_MAX; i++) {
+            scenario_load_done[i] = xSemaphoreCreateBinary();
+        }
+    }
+    // 上一次超时的手机可能还有迟到的通知
+    while (xSemaphoreTake(scenario_load_finished, 0) == pdTRUE) {
+    }
+    for (uint8_t i = 0; i < clients; i++) {
+        Bluetooth_SimClientConnect(i, 1);
+        xSemaphoreTake(scenario_load_done[i], 0);
+        scenario_load_retries[i]   = 0;
+        scenario_load_completed[i] = 0;
+    }
+    Bluetooth_SimSetEcho(0);
+    Bluetooth_SimSetNotifyHook(Scenario_LoadNotify);
+
+    int64_t start = esp_timer_get_time();
+    for (uint8_t i = 0; i < clients; i++) {
+        xTaskCreate(scenario_load_task, "scenario_load", SCENARIO_TASK_STACK_SIZE, (void *)(uintptr_t)i, SCENARIO_TASK_PRIORITY, NULL);
+    }
+    // 每部手机最多 SCENARIO_LOAD_COMMANDS 次超时，再多等一倍还没结束说明任务卡住了
+    uint8_t finished = 0;
+    while (finished < clients &&
+           xSemaphoreTake(scenario_load_finished, pdMS_TO_TICKS(2 * SCENARIO_LOAD_COMMANDS * SCENARIO_LOAD_REPLY_MS)) == pdTRUE) {
+        finished++;
+    }
+    int64_t us = esp_timer_get_time() - start;
+
+    Bluetooth_SimSetNotifyHook(NULL);
+    Bluetooth_SimSetEcho(1);
+
+    // 只统计完成了的命令
+    uint32_t total      = 0;
+    uint32_t min_avg_us = UINT32_MAX;
+    uint32_t max_avg_us = 0;
+    uint32_t retries    = 0;
+    for (uint8_t i = 0; i < clients; i++) {
+        uint32_t done = scenario_load_completed[i];
+        uint64_t sum  = 0;
+        for (uint32_t j = 0; j < done; j++) {
+            sum += scenario_load_latency[i][j];
+        }
+        uint32_t avg = done ? sum / done : 0;
+        if (avg < min_avg_us) min_avg_us = avg;
+        if (avg > max_avg_us) max_avg_us = avg;
+        retries += scenario_load_retries[i];
+        memcpy(&scenario_load_sorted[total], scenario_load_latency[i], done * sizeof(uint32_t));
+        total += done;
+    }
+    uint8_t ok = finished == clients && total == clients * SCENARIO_LOAD_COMMANDS;
+    printf("loadtest: %u clients (%u finished), %" PRIu32 " commands in %" PRId64 " ms, %" PRId64 " cmd/s, %" PRIu32 " retries: %s\r\n",
+           clients, finished, total, us / 1000, us ? (int64_t)total * 1000000 / us : 0, retries, Scenario_Check(ok));
+    if (total) {
+        qsort(scenario_load_sorted, total, sizeof(uint32_t), Scenario_CompareU32);
+        printf("loadtest: latency p50 %" PRIu32 " us, p99 %" PRIu32 " us, max %" PRIu32 " us\r\n",
+               scenario_load_sorted[total / 2], scenario_load_sorted[total * 99 / 100], scenario_load_sorted[total - 1]);
+        printf("loadtest: per-client average %" PRIu32 "~%" PRIu32 " us\r\n", min_avg_us, max_avg_us);
+    }
+    for (uint8_t i = 0; i < BLE_SESSION_MAX; i++) {
+        if (!BleSession_GetReport(i, &report)) continue;
+        printf("loadtest: conn %u %" PRIu32 " commands, %" PRIu32 " dropped, queue %u, latency avg %" PRIu32 " us max %" PRIu32 " us\r\n",
+               report.conn_id, report.commands, report.dropped, report.max_queued, report.avg_latency_us, report.max_latency_us);
+    }
+
+    for (uint8_t i = 1; i < clients; i++) {
+        Bluetooth_SimClientConnect(i, 0);
+    }
+}
+
+/*
+ * 批量传输测试：模拟的手机通过批量传输服务下载测试数据（pattern 流）、上传测试数据（sink 流），
+ * 比较 MTU 23 的 1M 链路、MTU 247 + 数据长度扩展、再切换到 2M PHY，以及窗口为 1（每个块都等确认）时的速度。
+ * 门锁的固件真实运行，速度按模拟的空口计时（虚拟时间，不受主机速度影响）：
+ *  - 每个块按 Bluetooth_SimAirtimeUs() 占用空口，当前连接事件放不下时推到下一个事件
+ *  - 接收方在收到块的下一个连接事件回复额度，发送方在再下一个事件才能用新的额度
+ *  - 控制特征值的写入和通知很少，不计空口时间
+ * 最后检查 CRC 错误后的回退和断开重连后的续传，两个方向都要收到完整、正确的数据。
+ */
+#define SCENARIO_BULK_INTERVAL_US  15000
+#define SCENARIO_BULK_GRANTS       64
+#define SCENARIO_BULK_UPLOAD       (64 * 1024)
+// 上传时记住最近发出的块所在的连接事件，在途的块不超过窗口，按块号取模
+#define SCENARIO_BULK_EVENTS       (4 * BLE_BULK_WINDOW)
+#define SCENARIO_BULK_REPLY_WAIT   1000
+#define SCENARIO_BULK_NONE         UINT32_MAX
+
+typedef struct {
+    uint32_t end; // 发送方可以发到这个偏移
+    int64_t at;   // 从这个时间开始可以用
+} scenario_bulk_grant_t;
+
+// 虚拟时间：空口当前时间和当前连接事件的开始时间
+static int64_t scenario_bulk_now_us   = 0;
+static int64_t scenario_bulk_event_us = 0;
+static scenario_bulk_grant_t scenario_bulk_grants[SCENARIO_BULK_GRANTS];
+static uint8_t scenario_bulk_grant_count = 0;
+// 模拟的手机
+static QueueHandle_t scenario_bulk_replies  = NULL;
+static SemaphoreHandle_t scenario_bulk_done = NULL;
+static uint16_t scenario_bulk_block         = 0;
+static uint8_t scenario_bulk_window         = 0;
+static uint32_t scenario_bulk_size          = 0;
+static uint32_t scenario_bulk_received      = 0; // 下载：连续收到的长度
+static uint32_t scenario_bulk_pending       = 0; // 下载：上次回复额度之后收到的块
+static uint32_t scenario_bulk_corrupt       = SCENARIO_BULK_NONE;
+static uint32_t scenario_bulk_rewinds       = 0;
+static uint32_t scenario_bulk_mismatches    = 0;
+static uint32_t scenario_bulk_stop_at       = SCENARIO_BULK_NONE; // 下载：收到这么多之后断开
+static uint8_t scenario_bulk_paused         = 0;
+static int64_t scenario_bulk_events[SCENARIO_BULK_EVENTS]; // 上传：最近的块所在的连接事件（us）
+
+static void Scenario_BulkReset(uint16_t block, uint8_t window)
+{
+    scenario_bulk_now_us      = 0;
+    scenario_bulk_event_us    = 0;
+    scenario_bulk_grant_count = 0;
+    scenario_bulk_block       = block;
+    scenario_bulk_window      = window;
+    scenario_bulk_size        = 0;
+    scenario_bulk_received    = 0;
+    scenario_bulk_pending     = 0;
+    scenario_bulk_rewinds     = 0;
+    scenario_bulk_mismatches  = 0;
+    scenario_bulk_stop_at     = SCENARIO_BULK_NONE;
+    scenario_bulk_paused      = 0;
+    memset(scenario_bulk_events, 0, sizeof(scenario_bulk_events));
+    xQueueReset(scenario_bulk_replies);
+    xSemaphoreTake(scenario_bulk_done, 0);
+}
+
+// 新的额度：at 之后可以发到 end，额度只增不减
+static void Scenario_BulkGrant(uint32_t end, int64_t at)
+{
+    if (scenario_bulk_grant_count && scenario_bulk_grants[scenario_bulk_grant_count - 1].end >= end) return;
+    if (scenario_bulk_grant_count == SCENARIO_BULK_GRANTS) {
+        // 记不下时并进最后一条，只会算慢
+        scenario_bulk_grants[SCENARIO_BULK_GRANTS - 1] = (scenario_bulk_grant_t){end, at};
+        return;
+    }
+    scenario_bulk_grants[scenario_bulk_grant_count++] = (scenario_bulk_grant_t){end, at};
+}
+
+// 回退：之前的额度作废
+static void Scenario_BulkRegrant(uint32_t end, int64_t at)
+{
+    scenario_bulk_grant_count = 0;
+    Scenario_BulkGrant(end, at);
+}
+
+// 从 offset 开始的块最早什么时候能发
+static int64_t Scenario_BulkEarliest(uint32_t offset)
+{
+    while (scenario_bulk_grant_count > 1 && scenario_bulk_grants[0].end <= offset) {
+        memmove(scenario_bulk_grants, scenario_bulk_grants + 1, --scenario_bulk_grant_count * sizeof(scenario_bulk_grant_t));
+    }
+    return scenario_bulk_grant_count ? scenario_bulk_grants[0].at : 0;
+}
+
+// 一个 att_len 字节的包在 earliest_us 之后占用空口，返回它所在连接事件的开始时间
+static int64_t Scenario_BulkAir(uint16_t att_len, int64_t earliest_us)
+{
+    uint32_t us = Bluetooth_SimAirtimeUs(att_len);
+
+    if (earliest_us > scenario_bulk_now_us) {
+        scenario_bulk_event_us = earliest_us;
+        scenario_bulk_now_us   = earliest_us;
+    }
+    if (scenario_bulk_now_us + us > scenario_bulk_event_us + SCENARIO_BULK_INTERVAL_US) {
+        scenario_bulk_event_us += SCENARIO_BULK_INTERVAL_US;
+        scenario_bulk_now_us = scenario_bulk_event_us;
+    }
+    scenario_bulk_now_us += us;
+    return scenario_bulk_event_us;
+}
+
+static void Scenario_BulkControl(uint8_t op, uint8_t arg, uint32_t offset, uint32_t size)
+{
+    uint8_t frame[BLE_BULK_CTRL_LEN] = {op, arg};
+    frame[2] = offset;
+    frame[3] = offset >> 8;
+    frame[4] = offset >> 16;
+    frame[5] = offset >> 24;
+    frame[6] = size;
+    frame[7] = size >> 8;
+    frame[8] = size >> 16;
+    frame[9] = size >> 24;
+    Bluetooth_SimBulkWrite(BLE_BULK_CHAN_CTRL, frame, sizeof(frame));
+}
+
+static uint32_t Scenario_BulkGet32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// 等门锁的控制通知，op 为 0 时任何通知都可以
+static uint8_t Scenario_BulkReply(uint8_t op, uint8_t *reply, uint32_t wait_ms)
+{
+    while (xQueueReceive(scenario_bulk_replies, reply, pdMS_TO_TICKS(wait_ms)) == pdTRUE) {
+        if (op == 0 || reply[0] == (op | 0x80)) return 1;
+    }
+    return 0;
+}
+
+// 门锁的通知（在批量传输任务中）：控制通知交给手机，数据块就是下载
+static void Scenario_BulkHook(uint8_t chan, const uint8_t *data, size_t len)
+{
+    if (chan == BLE_BULK_CHAN_CTRL) {
+        if (data[0] == (BLE_BULK_OP_READ | 0x80) && data[1] == BLE_BULK_OK) {
+            scenario_bulk_size = Scenario_BulkGet32(&data[6]);
+        }
+        xQueueSend(scenario_bulk_replies, data, 0);
+        return;
+    }
+    if (scenario_bulk_paused || len <= BLE_BULK_HEADER + BLE_BULK_CRC) return;
+
+    uint32_t offset = Scenario_BulkGet32(data);
+    uint16_t n      = len - BLE_BULK_HEADER - BLE_BULK_CRC;
+    // 回退之前已经发出的块也占空口，收到后丢弃
+    int64_t event = Scenario_BulkAir(len, offset == scenario_bulk_received ? Scenario_BulkEarliest(offset) : 0);
+    if (offset != scenario_bulk_received) return;
+
+    uint8_t bad = esp_rom_crc32_le(0, data, len - BLE_BULK_CRC) != Scenario_BulkGet32(data + len - BLE_BULK_CRC);
+    if (bad || offset == scenario_bulk_corrupt) {
+        // 坏块：从收到的偏移重新读
+        scenario_bulk_corrupt = SCENARIO_BULK_NONE;
+        scenario_bulk_rewinds++;
+        scenario_bulk_pending = 0;
+        Scenario_BulkRegrant(offset + scenario_bulk_window * scenario_bulk_block, event + 2 * SCENARIO_BULK_INTERVAL_US);
+        Scenario_BulkControl(BLE_BULK_OP_READ, BLE_BULK_STREAM_PATTERN, offset, scenario_bulk_window);
+        return;
+    }
+    for (uint16_t i = 0; i < n; i++) {
+        if (data[BLE_BULK_HEADER + i] != BleBulk_Pattern(offset + i)) scenario_bulk_mismatches++;
+    }
+    scenario_bulk_received += n;
+    if (scenario_bulk_received >= scenario_bulk_stop_at) {
+        // 模拟断开：之后的块都收不到
+        scenario_bulk_stop_at = SCENARIO_BULK_NONE;
+        scenario_bulk_paused  = 1;
+        xSemaphoreGive(scenario_bulk_done);
+        return;
+    }
+    if (scenario_bulk_received >= scenario_bulk_size) {
+        Scenario_BulkControl(BLE_BULK_OP_CREDIT, 0, scenario_bulk_received, 0);
+        xSemaphoreGive(scenario_bulk_done);
+        return;
+    }
+    if (++scenario_bulk_pending >= (scenario_bulk_window + 1) / 2) {
+        scenario_bulk_pending = 0;
+        Scenario_BulkGrant(scenario_bulk_received + scenario_bulk_window * scenario_bulk_block, event + 2 * SCENARIO_BULK_INTERVAL_US);
+        Scenario_BulkControl(BLE_BULK_OP_CREDIT, scenario_bulk_window, scenario_bulk_received, 0);
+    }
+}
+
+// 断开再连上，连接期间手机不处理通知
+static void Scenario_BulkReconnect(void)
+{
+    scenario_bulk_paused = 1;
+    Bluetooth_SimConnect(0);
+    Bluetooth_SimConnect(1);
+    xQueueReset(scenario_bulk_replies);
+    scenario_bulk_paused = 0;
+}
+
+// 下载测试数据，返回虚拟时间（us），失败时返回 0；resume 为 1 时传到一半断开再续传
+static int64_t Scenario_BulkDownload(uint8_t window, uint32_t corrupt, uint8_t resume)
+{
+    uint8_t reply[BLE_BULK_NOTIFY_LEN];
+
+    Scenario_BulkReset(BleBulk_BlockSize(0), window);
+    scenario_bulk_corrupt = corrupt;
+    Scenario_BulkGrant(window * scenario_bulk_block, 0);
+    if (resume) {
+        // 大小在打开的回复中，测试数据是 64 KB
+        scenario_bulk_stop_at = 32 * 1024;
+    }
+    Scenario_BulkControl(BLE_BULK_OP_READ, BLE_BULK_STREAM_PATTERN, 0, window);
+    if (!Scenario_BulkReply(BLE_BULK_OP_READ, reply, SCENARIO_BULK_REPLY_WAIT) || reply[1] != BLE_BULK_OK) {
+        printf("bulkbench: download open failed\r\n");
+        return 0;
+    }
+    if (resume) {
+        if (xSemaphoreTake(scenario_bulk_done, pdMS_TO_TICKS(SCENARIO_BULK_REPLY_WAIT * 20)) != pdTRUE) {
+            printf("bulkbench: download stalled at %" PRIu32 "/%" PRIu32 "\r\n", scenario_bulk_received, scenario_bulk_size);
+            return 0;
+        }
+        Scenario_BulkReconnect();
+        scenario_bulk_pending = 0;
+        Scenario_BulkRegrant(scenario_bulk_received + window * scenario_bulk_block, scenario_bulk_event_us + SCENARIO_BULK_INTERVAL_US);
+        Scenario_BulkControl(BLE_BULK_OP_READ, BLE_BULK_STREAM_PATTERN, scenario_bulk_received, window);
+    }
+    if (xSemaphoreTake(scenario_bulk_done, pdMS_TO_TICKS(SCENARIO_BULK_REPLY_WAIT * 20)) != pdTRUE) {
+        printf("bulkbench: download stalled at %" PRIu32 "/%" PRIu32 "\r\n", scenario_bulk_received, scenario_bulk_size);
+        return 0;
+    }
+    Scenario_BulkReply(BLE_BULK_OP_CREDIT, reply, SCENARIO_BULK_REPLY_WAIT);
+    return scenario_bulk_now_us;
+}
+
+// 上传时从 offset 开始的块所在的连接事件
+static int64_t *Scenario_BulkEvent(uint32_t offset)
+{
+    return &scenario_bulk_events[offset / scenario_bulk_block % SCENARIO_BULK_EVENTS];
+}
+
+// 上传 size 字节测试数据，返回虚拟时间（us），失败时返回 0；resume 为 1 时传到一半断开再续传
+static int64_t Scenario_BulkUpload(uint32_t size, uint8_t window, uint32_t corrupt, uint8_t resume)
+{
+    static uint8_t block[BLE_BULK_MTU - 3];
+    uint8_t reply[BLE_BULK_NOTIFY_LEN];
+    uint32_t window_end = 0;
+    uint32_t next       = 0;
+
+    Scenario_BulkReset(BleBulk_BlockSize(0), window);
+    Scenario_BulkControl(BLE_BULK_OP_WRITE, BLE_BULK_STREAM_SINK, 0, size);
+    while (1) {
+        if (!Scenario_BulkReply(0, reply, SCENARIO_BULK_REPLY_WAIT)) {
+            printf("bulkbench: upload stalled at %" PRIu32 "/%" PRIu32 "\r\n", next, size);
+            return 0;
+        }
+        uint8_t op      = reply[0] & 0x7f;
+        uint8_t status  = reply[1];
+        uint32_t offset = Scenario_BulkGet32(&reply[2]);
+        uint8_t credits = reply[10] < window ? reply[10] : window;
+        if (op == BLE_BULK_OP_WRITE || status == BLE_BULK_BAD_CRC || status == BLE_BULK_BAD_OFFSET) {
+            if (op == BLE_BULK_OP_WRITE && status != BLE_BULK_OK) {
+                printf("bulkbench: upload open failed, status %u\r\n", status);
+                return 0;
+            }
+            // 打开或续传的回复、坏块：从门锁给的偏移开始发
+            int64_t at = op == BLE_BULK_OP_WRITE ? scenario_bulk_now_us : *Scenario_BulkEvent(offset) + 2 * SCENARIO_BULK_INTERVAL_US;
+            if (op != BLE_BULK_OP_WRITE) scenario_bulk_rewinds++;
+            next       = offset;
+            window_end = offset + credits * scenario_bulk_block;
+            Scenario_BulkRegrant(window_end, at);
+        } else if (status == BLE_BULK_DONE) {
+            break;
+        } else if (status == BLE_BULK_OK && op == BLE_BULK_OP_ACK) {
+            // 确认的是 offset 之前的最后一个块；还没收到任何块（offset 为 0）时额度马上可用
+            int64_t at   = offset ? *Scenario_BulkEvent(offset - 1) + 2 * SCENARIO_BULK_INTERVAL_US : scenario_bulk_now_us;
+            uint32_t end = offset + credits * scenario_bulk_block;
+            if (end > window_end) window_end = end;
+            Scenario_BulkGrant(end, at);
+        } else {
+            printf("bulkbench: upload failed, status %u\r\n", status);
+            return 0;
+        }
+
+        while (next < window_end && next < size) {
+            if (resume && next >= size / 2) {
+                resume = 0;
+                Scenario_BulkReconnect();
+                // 偏移不为 0：续传，门锁回复实际的偏移
+                Scenario_BulkControl(BLE_BULK_OP_WRITE, BLE_BULK_STREAM_SINK, next, size);
+                break;
+            }
+            uint16_t n = size - next < scenario_bulk_block ? size - next : scenario_bulk_block;
+            block[0]   = next;
+            block[1]   = next >> 8;
+            block[2]   = next >> 16;
+            block[3]   = next >> 24;
+            for (uint16_t i = 0; i < n; i++) {
+                block[BLE_BULK_HEADER + i] = BleBulk_Pattern(next + i);
+            }
+            uint32_t crc = esp_rom_crc32_le(0, block, BLE_BULK_HEADER + n);
+            if (next == corrupt) {
+                corrupt = SCENARIO_BULK_NONE;
+                crc ^= 1;
+            }
+            uint16_t len  = BLE_BULK_HEADER + n + BLE_BULK_CRC;
+            block[len - 4] = crc;
+            block[len - 3] = crc >> 8;
+            block[len - 2] = crc >> 16;
+            block[len - 1] = crc >> 24;
+
+            *Scenario_BulkEvent(next) = Scenario_BulkAir(len, Scenario_BulkEarliest(next));
+            Bluetooth_SimBulkWrite(BLE_BULK_CHAN_DATA, block, len);
+            next += n;
+        }
+    }
+    return scenario_bulk_now_us;
+}
+
+static uint32_t Scenario_BulkKBps(uint32_t size, int64_t us)
+{
+    return us > 0 ? (uint64_t)size * 1000000 / 1024 / us : 0;
+}
+
+static void Scenario_BulkBench(void)
+{
+    static const struct {
+        const char *name;
+        uint16_t mtu;
+        uint8_t dle;
+        uint8_t phy_2m;
+        uint8_t window;
+    } cases[] = {
+        {"mtu 23, 1M", 23, 0, 0, BLE_BULK_WINDOW},
+        {"mtu 247 + dle, 1M", BLE_BULK_MTU, 1, 0, BLE_BULK_WINDOW},
+        {"mtu 247 + dle, 2M", BLE_BULK_MTU, 1, 1, BLE_BULK_WINDOW},
+        {"2M, stop-and-wait", BLE_BULK_MTU, 1, 1, 1},
+    };
+    ble_bulk_report_t report;
+
+    if (scenario_bulk_replies == NULL) {
+        scenario_bulk_replies = xQueueCreate(64, BLE_BULK_NOTIFY_LEN);
+        scenario_bulk_done    = xSemaphoreCreateBinary();
+    }
+    Bluetooth_SimConnect(1);
+    Bluetooth_SimSetBulkHook(Scenario_BulkHook);
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        Bluetooth_SimSetLink(cases[i].mtu, cases[i].dle, cases[i].phy_2m);
+        int64_t start       = esp_timer_get_time();
+        int64_t down_us     = Scenario_BulkDownload(cases[i].window, SCENARIO_BULK_NONE, 0);
+        uint32_t size       = scenario_bulk_size;
+        uint32_t mismatches = scenario_bulk_mismatches;
+        BleBulk_GetReport(&report);
+        uint32_t sink_mismatches = report.mismatches;
+        int64_t up_us            = Scenario_BulkUpload(SCENARIO_BULK_UPLOAD, cases[i].window, SCENARIO_BULK_NONE, 0);
+        int64_t wall_us          = esp_timer_get_time() - start;
+        BleBulk_GetReport(&report);
+        // 两个方向都要传完（虚拟时间不为 0），数据没有错
+        uint8_t ok = down_us > 0 && up_us > 0 && size > 0 && mismatches == 0 && report.mismatches == sink_mismatches;
+        printf("bulkbench: %-18s %3u-byte blocks, download %4" PRIu32 " KB/s, upload %4" PRIu32 " KB/s, firmware %" PRIu32 " KB/s, %" PRIu32 " mismatches: %s\r\n",
+               cases[i].name, scenario_bulk_block, Scenario_BulkKBps(size, down_us), Scenario_BulkKBps(SCENARIO_BULK_UPLOAD, up_us),
+               Scenario_BulkKBps(size + SCENARIO_BULK_UPLOAD, wall_us), mismatches + report.mismatches - sink_mismatches, Scenario_Check(ok));
+    }
+
+    // 坏块回退、断开续传，用最后一种链路
+    Bluetooth_SimSetLink(BLE_BULK_MTU, 1, 1);
+    uint32_t corrupt = 10 * BleBulk_BlockSize(0);
+    uint8_t ok       = Scenario_BulkDownload(BLE_BULK_WINDOW, corrupt, 0) && scenario_bulk_rewinds == 1 && scenario_bulk_mismatches == 0;
+    printf("bulkbench: download crc error: %s, %" PRIu32 " rewinds\r\n", Scenario_Check(ok), scenario_bulk_rewinds);
+    ok = Scenario_BulkDownload(BLE_BULK_WINDOW, SCENARIO_BULK_NONE, 1) && scenario_bulk_mismatches == 0;
+    printf("bulkbench: download resume: %s\r\n", Scenario_Check(ok));
+
+    BleBulk_GetReport(&report);
+    uint32_t mismatches = report.mismatches;
+    ok                  = Scenario_BulkUpload(SCENARIO_BULK_UPLOAD, BLE_BULK_WINDOW, corrupt, 0) && scenario_bulk_rewinds == 1;
+    BleBulk_GetReport(&report);
+    printf("bulkbench: upload crc error: %s, %" PRIu32 " rewinds\r\n", Scenario_Check(ok && report.mismatches == mismatches), scenario_bulk_rewinds);
+    ok = Scenario_BulkUpload(SCENARIO_BULK_UPLOAD, BLE_BULK_WINDOW, SCENARIO_BULK_NONE, 1);
+    BleBulk_GetReport(&report);
+    printf("bulkbench: upload resume: %s\r\n", Scenario_Check(ok && report.mismatches == mismatches));
+
+    Bluetooth_SimSetBulkHook(NULL);
+    printf("bulkbench: %" PRIu32 " transfers, %" PRIu64 " bytes, %" PRIu32 " blocks, %" PRIu32 " resent, %" PRIu32 " crc errors, %" PRIu32 " offset errors, %" PRIu32 " resumes, %" PRIu32 " mismatches\r\n",
+           report.transfers, report.bytes, report.blocks, report.resent, report.crc_errors, report.offset_errors, report.resumes, report.mismatches);
+}
+
+// 执行一条命令，返回 1 表示脚本结束
+static uint8_t Scenario_Exec(char *line)
+{
+    line[strcspn(line, "\r\n")] = 0;
+    while (*line == ' ') line++;
+    if (*line == 0 || *line == '#') return 0;
+
+    char *arg = strchr(line, ' ');
+    if (arg) {
+        *arg++ = 0;
+        while (*arg == ' ') arg++;
+    } else {
+        arg = "";
+    }
+    printf("[sim +%" PRId64 " ms] %s %s\r\n", (esp_timer_get_time() - scenario_start_us) / 1000, line, arg);
+
+    if (!strcmp(line, "key")) {
+        for (const char *c = arg; *c; c++) {
+            if (c != arg) DelayMs(SCENARIO_KEY_INTERVAL_MS);
+            Scenario_PressKey(*c);
+        }
+    } else if (!strcmp(line, "touch")) {
+        Finger_SimTouch(1, atoi(arg));
+        Gpio_SimSetInput(FINGER_TOUCH_INT_PIN, 1);
+    } else if (!strcmp(line, "release")) {
+        Finger_SimTouch(0, -1);
+        Gpio_SimSetInput(FINGER_TOUCH_INT_PIN, 0);
+    } else if (!strcmp(line, "ble")) {
+        Bluetooth_SimWrite(arg);
+    } else if (!strcmp(line, "blehex")) {
+        uint8_t value[SCENARIO_LINE_MAX / 2];
+        Bluetooth_SimWriteRaw(value, Scenario_ParseHex(arg, value, sizeof(value)));
+    } else if (!strcmp(line, "wait")) {
+        vTaskDelay(pdMS_TO_TICKS(atoi(arg)));
+#if CONFIG_TRACE_ENABLE
+    } else if (!strcmp(line, "trace")) {
+        Trace_RequestDump(Trace_UartSink);
+#endif
+    } else if (!strcmp(line, "credbench")) {
+        Scenario_CredentialBench();
+    } else if (!strcmp(line, "schedtest")) {
+        Scenario_ScheduleTest();
+    } else if (!strcmp(line, "pintest")) {
+        Scenario_PinTest();
+    } else if (!strcmp(line, "bleconn")) {
+        // bleconn on | off
+        Bluetooth_SimConnect(!strcmp(arg, "on"));
+    } else if (!strcmp(line, "bleconntest")) {
+        Scenario_BleConnTest();
+    } else if (!strcmp(line, "bleadvtest")) {
+        Scenario_BleAdvTest();
+    } else if (!strcmp(line, "gatttest")) {
+        Scenario_GattTest();
+    } else if (!strcmp(line, "bondtest")) {
+        Scenario_BondTest();
+    } else if (!strcmp(line, "loadtest")) {
+        // loadtest [手机数]
+        Scenario_LoadTest(arg);
+    } else if (!strcmp(line, "motortest")) {
+        Scenario_MotorTest();
+    } else if (!strcmp(line, "fingertest")) {
+        Scenario_FingerTest();
+    } else if (!strcmp(line, "bulkbench")) {
+        Scenario_BulkBench();
+    } else if (!strcmp(line, "protobench")) {
+        Scenario_ProtoBench();
+    } else if (!strcmp(line, "wifi")) {
+        // wifi drop | on | off | channel <n> | acquire <bg|active> | release <bg|active> | power
+        if (!strcmp(arg, "drop")) {
+            Wifi_SimDrop();
+        } else if (!strncmp(arg, "acquire ", 8)) {
+            Wifi_Acquire(strcmp(arg + 8, "active") ? WIFI_DEMAND_BACKGROUND : WIFI_DEMAND_ACTIVE);
+        } else if (!strncmp(arg, "release ", 8)) {
+            Wifi_Release(strcmp(arg + 8, "active") ? WIFI_DEMAND_BACKGROUND : WIFI_DEMAND_ACTIVE);
+        } else if (!strcmp(arg, "power")) {
+            Scenario_WifiPower();
+        } else if (!strcmp(arg, "on") || !strcmp(arg, "off")) {
+            Wifi_SimSetAp(!strcmp(arg, "on"));
+        } else if (!strncmp(arg, "channel ", 8)) {
+            Wifi_SimSetChannel(atoi(arg + 8));
+        } else {
+            ESP_LOGW(TAG, "unknown wifi command '%s'", arg);
+        }
+    } else if (!strcmp(line, "wifitest")) {
+        Scenario_WifiTest();
+    } else if (!strcmp(line, "stats")) {
+        Scenario_Stats();
+    } else if (!strcmp(line, "exit")) {
+        Scenario_Stats();
+        return 1;
+    } else {
+        ESP_LOGW(TAG, "unknown command '%s'", line);
+    }
+    return 0;
+}
+
+static void scenario_task(void *arg)
+{
+    char line[SCENARIO_LINE_MAX];
+    const char *path = getenv("SMARTLOCK_SCENARIO");
+    uint8_t done     = 0;
+
+    // 脚本也会驱动指纹和蓝牙，等后台初始化全部完成
+    Boot_WaitAll(portMAX_DELAY);
+    scenario_start_us = esp_timer_get_time();
+    if (path) {
+        FILE *file = fopen(path, "r");
+        if (file == NULL) {
+            ESP_LOGE(TAG, "cannot open %s", path);
+            exit(1);
+        }
+        while (!done && fgets(line, sizeof(line), file)) {
+            done = Scenario_Exec(line);
+        }
+        fclose(file);
+    } else {
+        for (size_t i = 0; !done && i < sizeof(scenario_builtin) / sizeof(scenario_builtin[0]); i++) {
+            snprintf(line, sizeof(line), "%s", scenario_builtin[i]);
+            done = Scenario_Exec(line);
+        }
+    }
+    if (scenario_failures) {
+        printf("scenario: %" PRIu32 " checks FAILED\r\n", scenario_failures);
+        exit(1);
+    }
+    exit(0);
+}
+
+void Scenario_Start(void)
+{
+    xTaskCreate(scenario_task, SCENARIO_TASK_NAME, SCENARIO_TASK_STACK_SIZE, NULL, SCENARIO_TASK_PRIORITY, NULL);
+}
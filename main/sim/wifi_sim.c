@@ -0,0 +1,154 @@
+#include "wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include <string.h>
+
+/*
+ * 主机仿真的 WiFi 后端：一个假 AP，按真实设备的典型耗时模拟
+ * 全信道主动扫描、单信道扫描、认证关联和 DHCP，事件从仿真任务上报。
+ */
+static const char *TAG = "wifi_sim";
+
+#define WIFI_SIM_TASK_NAME       "wifi_sim_task"
+#define WIFI_SIM_TASK_STACK_SIZE 2048
+#define WIFI_SIM_TASK_PRIORITY   3
+#define WIFI_SIM_EVT_CONNECT     (1 << 0)
+#define WIFI_SIM_EVT_DROP        (1 << 1)
+
+#define WIFI_SIM_CHANNELS 13
+#define WIFI_SIM_SCAN_MS  120 // 每个信道的主动扫描时间
+#define WIFI_SIM_ASSOC_MS 60  // 认证、关联和四次握手
+#define WIFI_SIM_DHCP_MS  700 // DISCOVER/OFFER/REQUEST/ACK
+#define WIFI_SIM_LEASE_S  7200
+
+// 与 wifi_err_reason_t 相同的断开原因
+#define WIFI_SIM_REASON_BEACON 200
+#define WIFI_SIM_REASON_NO_AP  201
+
+static TaskHandle_t wifi_sim_task_handle = NULL;
+static portMUX_TYPE wifi_sim_lock        = portMUX_INITIALIZER_UNLOCKED;
+
+// 假 AP
+static uint8_t wifi_sim_ap_up          = 1;
+static uint8_t wifi_sim_ap_channel     = 6;
+static const uint8_t wifi_sim_bssid[6] = {0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56};
+// DHCP 分配的地址 192.168.1.57/24，网关 192.168.1.1（网络字节序）
+#define WIFI_SIM_IP      0x3901a8c0
+#define WIFI_SIM_NETMASK 0x00ffffff
+#define WIFI_SIM_GW      0x0101a8c0
+
+static wifi_ap_cache_t wifi_sim_request;
+static uint8_t wifi_sim_use_cache = 0;
+static uint8_t wifi_sim_linked    = 0;
+// 射频打开；关闭时正在进行的连接在下一步放弃，不再上报事件
+static volatile uint8_t wifi_sim_started = 0;
+
+static void Wifi_SimConnect(void)
+{
+    taskENTER_CRITICAL(&wifi_sim_lock);
+    wifi_ap_cache_t request = wifi_sim_request;
+    uint8_t use_cache       = wifi_sim_use_cache;
+    taskEXIT_CRITICAL(&wifi_sim_lock);
+
+    // 有缓存时只扫描一个信道
+    vTaskDelay(pdMS_TO_TICKS(use_cache ? WIFI_SIM_SCAN_MS : WIFI_SIM_CHANNELS * WIFI_SIM_SCAN_MS));
+    if (!wifi_sim_started) return;
+    uint8_t found = wifi_sim_ap_up;
+    if (use_cache) {
+        found &= request.channel == wifi_sim_ap_channel && !memcmp(request.bssid, wifi_sim_bssid, sizeof(wifi_sim_bssid));
+    }
+    if (!found) {
+        Wifi_BackendLinkDown(WIFI_SIM_REASON_NO_AP);
+        return;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(WIFI_SIM_ASSOC_MS));
+    if (!wifi_sim_started) return;
+    wifi_sim_linked = 1;
+    Wifi_BackendLinkUp(wifi_sim_bssid, wifi_sim_ap_channel);
+    if (use_cache && request.ip) {
+        Wifi_BackendGotIp(request.ip, request.netmask, request.gw, 0);
+    } else {
+        vTaskDelay(pdMS_TO_TICKS(WIFI_SIM_DHCP_MS));
+        if (!wifi_sim_started) return;
+        Wifi_BackendGotIp(WIFI_SIM_IP, WIFI_SIM_NETMASK, WIFI_SIM_GW, WIFI_SIM_LEASE_S);
+    }
+}
+
+static void wifi_sim_task(void *arg)
+{
+    uint32_t events;
+
+    while (1) {
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+        if ((events & WIFI_SIM_EVT_DROP) && wifi_sim_linked && wifi_sim_started) {
+            wifi_sim_linked = 0;
+            Wifi_BackendLinkDown(WIFI_SIM_REASON_BEACON);
+        }
+        if (events & WIFI_SIM_EVT_CONNECT) {
+            Wifi_SimConnect();
+        }
+    }
+}
+
+static void Wifi_SimInit(void)
+{
+    xTaskCreate(wifi_sim_task, WIFI_SIM_TASK_NAME, WIFI_SIM_TASK_STACK_SIZE, NULL, WIFI_SIM_TASK_PRIORITY, &wifi_sim_task_handle);
+    ESP_LOGI(TAG, "simulated AP \"%s\" on channel %d", CONFIG_ESP_WIFI_SSID, wifi_sim_ap_channel);
+}
+
+static void Wifi_SimStart(void)
+{
+    wifi_sim_started = 1;
+}
+
+static void Wifi_SimStop(void)
+{
+    wifi_sim_started = 0;
+    wifi_sim_linked  = 0;
+}
+
+static void Wifi_SimSetPowerSave(uint8_t sleep)
+{
+    ESP_LOGI(TAG, "power save: %s", sleep ? "max modem" : "min modem");
+}
+
+static void Wifi_SimStartConnect(const wifi_ap_cache_t *cache)
+{
+    taskENTER_CRITICAL(&wifi_sim_lock);
+    wifi_sim_use_cache = cache != NULL;
+    if (cache) {
+        wifi_sim_request = *cache;
+    }
+    taskEXIT_CRITICAL(&wifi_sim_lock);
+    xTaskNotify(wifi_sim_task_handle, WIFI_SIM_EVT_CONNECT, eSetBits);
+}
+
+const wifi_backend_t wifi_backend_sim = {
+    .name           = "sim",
+    .init           = Wifi_SimInit,
+    .start          = Wifi_SimStart,
+    .stop           = Wifi_SimStop,
+    .connect        = Wifi_SimStartConnect,
+    .set_power_save = Wifi_SimSetPowerSave,
+};
+
+void Wifi_SimSetAp(uint8_t up)
+{
+    wifi_sim_ap_up = up;
+    if (!up) {
+        Wifi_SimDrop();
+    }
+}
+
+void Wifi_SimSetChannel(uint8_t channel)
+{
+    wifi_sim_ap_channel = channel;
+    Wifi_SimDrop();
+}
+
+void Wifi_SimDrop(void)
+{
+    xTaskNotify(wifi_sim_task_handle, WIFI_SIM_EVT_DROP, eSetBits);
+}
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+蓝牙二进制命令协议的主机端编解码（帧格式见 main/dri/ble_proto.h）。
+
+可以作为库使用（手机端测试脚本、产线工具），也可以在命令行生成请求或解析响应：
+  python3 tools/ble_proto.py encode ping
+  python3 tools/ble_proto.py encode --seq 7 cred_add 12345678/0 2345/3
+  python3 tools/ble_proto.py encode cred_remove 12345678
+  python3 tools/ble_proto.py encode time_set 1767225600
+  python3 tools/ble_proto.py decode "01 07 90 00 0600 0200 0000 0200"
+
+生成的十六进制可以直接用在仿真脚本的 blehex 命令中。
+"""
+import argparse
+import struct
+import sys
+
+VERSION = 0x01
+REQUEST = struct.Struct("<BBBH")
+RESPONSE = struct.Struct("<BBBBH")
+RSP_FLAG = 0x80
+MAX_FRAME = 512
+
+# 与 main/dri/ble_proto.h 中的 ble_op_t 保持一致
+OPS = {
+    "ping": 0x00,
+    "unlock": 0x01,
+    "set_password": 0x02,
+    "ota": 0x03,
+    "cred_add": 0x10,
+    "cred_remove": 0x11,
+    "cred_clear": 0x12,
+    "cred_commit": 0x13,
+    "cred_abort": 0x14,
+    "schedule_set": 0x20,
+    "schedule_fp": 0x21,
+    "schedule_ble": 0x22,
+    "time_set": 0x23,
+    "timezone": 0x24,
+    "trace_dump": 0x30,
+}
+OP_NAMES = {v: k for k, v in OPS.items()}
+
+# 与 ble_status_t 保持一致
+STATUS = ["OK", "UNKNOWN_OP", "BAD_LENGTH", "BAD_VALUE", "DENIED", "BAD_VERSION", "PARTIAL"]
+
+
+def pin_code(pin):
+    """与 Flash_CredentialEncode() 相同：高 5 位是位数，低 27 位是数值"""
+    if not (pin.isdigit() and 4 <= len(pin) <= 8):
+        raise ValueError("pin must be 4~8 digits: %r" % pin)
+    return len(pin) << 27 | int(pin)
+
+
+def encode_request(seq, op, payload=b""):
+    if isinstance(op, str):
+        op = OPS[op]
+    frame = REQUEST.pack(VERSION, seq & 0xFF, op, len(payload)) + payload
+    if len(frame) > MAX_FRAME:
+        raise ValueError("frame too long: %d bytes" % len(frame))
+    return frame
+
+
+def cred_add(seq, pins):
+    """pins: [(密码, 时间表编号), ...]"""
+    return encode_request(seq, "cred_add", b"".join(struct.pack("<IB", pin_code(p), s) for p, s in pins))
+
+
+def cred_remove(seq, pins):
+    return encode_request(seq, "cred_remove", b"".join(struct.pack("<I", pin_code(p)) for p in pins))
+
+
+def batches(pins, size):
+    """把密码分成每次写入不超过一帧的批次"""
+    for i in range(0, len(pins), size):
+        yield pins[i:i + size]
+
+
+def decode_responses(data):
+    """解析一个或多个响应帧，返回 [(序号, 操作名, 状态名, 数据), ...]"""
+    result = []
+    pos = 0
+    while pos + RESPONSE.size <= len(data):
+        version, seq, op, status, length = RESPONSE.unpack_from(data, pos)
+        if version != VERSION or not op & RSP_FLAG:
+            raise ValueError("not a response frame at offset %d" % pos)
+        payload = data[pos + RESPONSE.size:pos + RESPONSE.size + length]
+        op &= ~RSP_FLAG
+        result.append((seq, OP_NAMES.get(op, "0x%02x" % op),
+                       STATUS[status] if status < len(STATUS) else "STATUS_%d" % status, payload))
+        pos += RESPONSE.size + length
+    return result
+
+
+def describe(op, payload):
+    """按操作码解释响应数据"""
+    if op == "ping" and len(payload) == 3:
+        return "version %d, max frame %d" % struct.unpack("<BH", payload)
+    if op in ("cred_add", "cred_remove") and len(payload) == 6:
+        return "ok %d, failed %d, total %d" % struct.unpack("<HHH", payload)
+    if op.startswith("cred_") and len(payload) == 2:
+        return "total %d" % struct.unpack("<H", payload)
+    return payload.hex()
+
+
+def payload_for(op, args):
+    if op in ("cred_add", "cred_remove"):
+        pins = []
+        for a in args:
+            pin, _, schedule = a.partition("/")
+            pins.append((pin, int(schedule or 0)))
+        if op == "cred_add":
+            return b"".join(struct.pack("<IB", pin_code(p), s) for p, s in pins)
+        return b"".join(struct.pack("<I", pin_code(p)) for p, _ in pins)
+    if op == "set_password":
+        return args[0].encode()
+    if op == "schedule_set":
+        return struct.pack("<B", int(args[0])) + " ".join(args[1:]).encode()
+    if op == "schedule_fp":
+        return struct.pack("<HB", int(args[0]), int(args[1]))
+    if op in ("schedule_ble", "trace_dump"):
+        return struct.pack("<B", int(args[0]))
+    if op == "time_set":
+        return struct.pack("<I", int(args[0]))
+    if op == "timezone":
+        return args[0].encode()
+    return b""
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    enc = sub.add_parser("encode", help="生成请求帧")
+    enc.add_argument("--seq", type=int, default=0)
+    enc.add_argument("op", choices=sorted(OPS))
+    enc.add_argument("args", nargs="*")
+    dec = sub.add_parser("decode", help="解析响应帧（十六进制，可以有空格）")
+    dec.add_argument("hex")
+    args = parser.parse_args()
+
+    if args.command == "encode":
+        print(encode_request(args.seq, args.op, payload_for(args.op, args.args)).hex())
+    else:
+        try:
+            responses = decode_responses(bytes.fromhex(args.hex.replace(" ", "")))
+        except ValueError as e:
+            sys.exit(str(e))
+        for seq, op, status, payload in responses:
+            print("seq %3d %-13s %-11s %s" % (seq, op, status, describe(op, payload)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+"""
+对比两种蓝牙主机协议栈（Bluedroid / NimBLE）的固件大小、内存占用和连接时间。
+
+每种协议栈给出编译出的固件和一段串口日志（上电启动，再用手机连接、发命令几次）：
+  idf.py -B build build
+  idf.py -B build-nimble -D SDKCONFIG=build-nimble/sdkconfig -D SDKCONFIG_DEFAULTS="sdkconfig;sdkconfig.nimble" build
+  python3 tools/ble_stack_report.py bluedroid=build/smart-lock.bin:bluedroid.log nimble=build-nimble/smart-lock.bin:nimble.log
+
+日志中用到的行：
+  host <名字> ready <ms> ms after init, heap <前> -> <后> (<字节> bytes)   蓝牙后端初始化完成
+  free heap <字节>, minimum <字节>                                          启动报告
+  connected in <ms> ms (<广播状态>)                                         BleAdv
+  first command <ms> ms after connect                                       BleConn
+"""
+import argparse
+import os
+import re
+import sys
+
+PARTITIONS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "partitions-smartlock.csv")
+
+HOST_RE = re.compile(r"host (\w+) ready (\d+) ms after init, heap (\d+) -> (\d+) \((\d+) bytes\)")
+HEAP_RE = re.compile(r"free heap (\d+), minimum (\d+)")
+CONNECT_RE = re.compile(r"connected in (\d+) ms \((\w+)\)")
+FIRST_RE = re.compile(r"first command (\d+) ms after connect")
+
+
+def parse_size(text):
+    text = text.strip()
+    if text.upper().endswith("K"):
+        return int(text[:-1], 0) * 1024
+    if text.upper().endswith("M"):
+        return int(text[:-1], 0) * 1024 * 1024
+    return int(text, 0)
+
+
+def app_slot_size(path):
+    """分区表中 ota_0 的大小，没有时返回 None"""
+    try:
+        with open(path) as f:
+            for line in f:
+                fields = [x.strip() for x in line.split("#")[0].split(",")]
+                if len(fields) >= 5 and fields[0] == "ota_0":
+                    return parse_size(fields[4])
+    except OSError:
+        pass
+    return None
+
+
+def average(values):
+    return sum(values) / len(values) if values else None
+
+
+def parse_log(path):
+    result = {"connect_ms": [], "first_ms": []}
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = HOST_RE.search(line)
+            if m:
+                result["host"] = m.group(1)
+                result["ready_ms"] = int(m.group(2))
+                result["host_heap"] = int(m.group(5))
+            m = HEAP_RE.search(line)
+            if m:
+                result["free_heap"] = int(m.group(1))
+                result["min_heap"] = int(m.group(2))
+            m = CONNECT_RE.search(line)
+            if m:
+                result["connect_ms"].append(int(m.group(1)))
+            m = FIRST_RE.search(line)
+            if m:
+                result["first_ms"].append(int(m.group(1)))
+    return result
+
+
+def measure(spec, slot):
+    name, _, paths = spec.partition("=")
+    image, _, log = paths.partition(":")
+    if not image or not log:
+        raise SystemExit("expected NAME=IMAGE:LOG, got %r" % spec)
+    row = parse_log(log)
+    row["name"] = name
+    row["image"] = os.path.getsize(image)
+    if slot:
+        row["slot_pct"] = row["image"] * 100.0 / slot
+    row["connects"] = len(row["connect_ms"])
+    row["connect_avg"] = average(row["connect_ms"])
+    row["connect_max"] = max(row["connect_ms"]) if row["connect_ms"] else None
+    row["first_avg"] = average(row["first_ms"])
+    return row
+
+
+ROWS = [
+    ("image", "image size (bytes)", "%d"),
+    ("slot_pct", "app slot used (%)", "%.1f"),
+    ("host_heap", "heap taken by host (bytes)", "%d"),
+    ("free_heap", "free heap after boot", "%d"),
+    ("min_heap", "minimum free heap", "%d"),
+    ("ready_ms", "host init to advertising (ms)", "%d"),
+    ("connects", "connects in log", "%d"),
+    ("connect_avg", "trigger to connect avg (ms)", "%.0f"),
+    ("connect_max", "trigger to connect max (ms)", "%d"),
+    ("first_avg", "connect to first command avg (ms)", "%.0f"),
+]
+
+
+def format_value(fmt, value):
+    return "-" if value is None else fmt % value
+
+
+def main():
+    parser = argparse.ArgumentParser(description="side-by-side BLE host stack report")
+    parser.add_argument("builds", nargs="+", metavar="NAME=IMAGE:LOG", help="e.g. bluedroid=build/smart-lock.bin:bluedroid.log")
+    parser.add_argument("--partitions", default=PARTITIONS, help="partition table, for the app slot size")
+    args = parser.parse_args()
+
+    slot = app_slot_size(args.partitions)
+    rows = [measure(spec, slot) for spec in args.builds]
+
+    width = max(len(label) for _, label, _ in ROWS)
+    header = "%-*s" % (width, "") + "".join("%14s" % r["name"] for r in rows)
+    if len(rows) == 2:
+        header += "%14s" % "diff"
+    print(header)
+    for key, label, fmt in ROWS:
+        values = [r.get(key) for r in rows]
+        line = "%-*s" % (width, label) + "".join("%14s" % format_value(fmt, v) for v in values)
+        if len(rows) == 2:
+            a, b = values
+            line += "%14s" % ("-" if a is None or b is None else format_value("%+.1f" if "%.1f" in fmt else "%+d", b - a))
+        print(line)
+    for r in rows:
+        if r.get("host") and r["host"] != r["name"]:
+            print("warning: %s log was produced by host %s" % (r["name"], r["host"]), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
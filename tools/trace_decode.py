@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""
+解析固件导出的开锁路径追踪数据，输出每个阶段的延迟分布。
+
+输入可以是：
+  - 控制台日志（包含 "T:<hex>" 行，来自 BLE 命令 traceu 或仿真脚本的 trace 命令）
+  - 通过蓝牙通知收集到的原始二进制数据
+
+用法：
+  python3 tools/trace_decode.py monitor.log
+  python3 tools/trace_decode.py --events trace.bin
+"""
+import argparse
+import re
+import struct
+import sys
+from collections import OrderedDict
+
+MAGIC = b"TRC1"
+HEADER = struct.Struct("<4sHHIII")
+EVENT = struct.Struct("<IHH")
+
+# 与 main/dri/trace.h 中的 trace_event_id_t 保持一致
+EVENT_NAMES = [
+    "NONE",
+    "KEY_ISR",
+    "KEY_WAKE",
+    "KEY_READ",
+    "AUDIO_PLAY",
+    "PIN_MATCH_START",
+    "PIN_MATCH_DONE",
+    "KEY_DECISION",
+    "FINGER_ISR",
+    "FINGER_WAKE",
+    "FINGER_TX",
+    "FINGER_RX",
+    "FINGER_DECISION",
+    "BLE_WRITE",
+    "BLE_DECISION",
+    "MOTOR_START",
+]
+
+# 每条开锁路径：起点事件、属于该路径的事件、判定事件
+PATHS = OrderedDict(
+    keypad=("KEY_ISR", {"KEY_ISR", "KEY_WAKE", "KEY_READ", "AUDIO_PLAY", "PIN_MATCH_START", "PIN_MATCH_DONE", "KEY_DECISION"}, "KEY_DECISION"),
+    fingerprint=("FINGER_ISR", {"FINGER_ISR", "FINGER_WAKE", "FINGER_TX", "FINGER_RX", "FINGER_DECISION"}, "FINGER_DECISION"),
+    ble=("BLE_WRITE", {"BLE_WRITE", "BLE_DECISION"}, "BLE_DECISION"),
+)
+
+
+def load(path):
+    with open(path, "rb") as f:
+        raw = f.read()
+    if MAGIC not in raw:
+        # 控制台日志：拼接所有 T: 行
+        text = raw.decode("utf-8", errors="replace")
+        raw = bytes.fromhex("".join(re.findall(r"T:([0-9a-fA-F]+)", text)))
+    pos = raw.rfind(MAGIC)
+    if pos < 0:
+        sys.exit("no trace dump found")
+    magic, version, event_size, cycles_per_us, count, overwritten = HEADER.unpack_from(raw, pos)
+    if version != 1 or event_size != EVENT.size:
+        sys.exit("unsupported trace version %d / event size %d" % (version, event_size))
+    body = raw[pos + HEADER.size:]
+    if len(body) < count * EVENT.size:
+        print("warning: dump truncated, %d of %d events" % (len(body) // EVENT.size, count), file=sys.stderr)
+        count = len(body) // EVENT.size
+
+    events = []
+    base = 0
+    last = None
+    for i in range(count):
+        cycles, eid, arg = EVENT.unpack_from(body, i * EVENT.size)
+        # 32 位周期计数回绕
+        if last is not None and cycles < last:
+            base += 1 << 32
+        last = cycles
+        name = EVENT_NAMES[eid] if eid < len(EVENT_NAMES) else "EVENT_%d" % eid
+        events.append(((base + cycles) / cycles_per_us, name, arg))
+    return events, overwritten
+
+
+def stages(events):
+    """按路径切分事件，返回 {路径: {阶段: [微秒...]}}"""
+    result = OrderedDict((p, OrderedDict()) for p in PATHS)
+    active = {}   # 路径 -> (起点时间, 上一个事件名, 上一个事件时间)
+    pending = None  # 判定通过、等待电机启动的路径
+
+    def add(path, label, us):
+        result[path].setdefault(label, []).append(us)
+
+    for t, name, arg in events:
+        if name == "MOTOR_START":
+            if pending in active:
+                start, prev, prev_t = active.pop(pending)
+                add(pending, "%s -> MOTOR_START" % prev, t - prev_t)
+                add(pending, "total (start -> MOTOR_START)", t - start)
+            pending = None
+            continue
+        for path, (first, members, decision) in PATHS.items():
+            if name not in members:
+                continue
+            if name == first:
+                active[path] = (t, name, t)
+                break
+            if path not in active:
+                break
+            start, prev, prev_t = active[path]
+            add(path, "%s -> %s" % (prev, name), t - prev_t)
+            active[path] = (start, name, t)
+            if name == decision:
+                if arg:
+                    pending = path
+                else:
+                    add(path, "total (start -> reject)", t - start)
+                    del active[path]
+            break
+    return result
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def histogram(values, width=40):
+    # 以 2 的幂为桶
+    buckets = OrderedDict()
+    for v in values:
+        b = 1
+        while b < v:
+            b <<= 1
+        buckets[b] = buckets.get(b, 0) + 1
+    peak = max(buckets.values())
+    for b in sorted(buckets):
+        bar = "#" * max(1, buckets[b] * width // peak)
+        print("      <= %8d us %5d %s" % (b, buckets[b], bar))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("file", help="控制台日志或二进制导出文件")
+    parser.add_argument("--events", action="store_true", help="同时打印所有事件")
+    args = parser.parse_args()
+
+    events, overwritten = load(args.file)
+    print("%d events, %d overwritten" % (len(events), overwritten))
+    if args.events and events:
+        t0 = events[0][0]
+        for t, name, arg in events:
+            print("  %12.1f us  %-16s %d" % (t - t0, name, arg))
+
+    for path, labels in stages(events).items():
+        if not labels:
+            continue
+        print("\n== %s ==" % path)
+        for label, values in labels.items():
+            print("  %-40s n=%-4d min %8.1f  p50 %8.1f  p99 %8.1f  max %8.1f us" % (
+                label, len(values), min(values), percentile(values, 50), percentile(values, 99), max(values)))
+            histogram(values)
+
+
+if __name__ == "__main__":
+    main()